@@ -0,0 +1,232 @@
+#include "anticipation.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "graph_scheduler.h"
+#include "render_graph.h"
+#include "trace.h"
+
+namespace kodo {
+
+AheadBuffer::AheadBuffer(int num_channels, int capacity_frames)
+    : num_channels_(num_channels),
+      capacity_(capacity_frames),
+      ring_(num_channels, std::vector<float>(capacity_frames)) {}
+
+void AheadBuffer::Render(float* const* outputs, int num_channels,
+                         int num_frames) {
+  const int64_t read = std::max(read_.load(std::memory_order_relaxed),
+                                skip_to_.load(std::memory_order_acquire));
+  const int64_t write = write_.load(std::memory_order_acquire);
+  const int available = std::clamp<int64_t>(write - read, 0, num_frames);
+  if (available < num_frames) {
+    underruns_.fetch_add(1, std::memory_order_relaxed);
+  }
+  const int channels = std::min(num_channels, num_channels_);
+  const int pos = read % capacity_;
+  const int head = std::min(available, capacity_ - pos);
+  for (int c = 0; c < channels; ++c) {
+    const float* ring = ring_[c].data();
+    std::copy_n(ring + pos, head, outputs[c]);
+    std::copy_n(ring, available - head, outputs[c] + head);
+    std::fill_n(outputs[c] + available, num_frames - available, 0.0f);
+  }
+  for (int c = channels; c < num_channels; ++c) {
+    std::fill_n(outputs[c], num_frames, 0.0f);
+  }
+  // Releases the frames to the writer.
+  read_.store(read + num_frames, std::memory_order_release);
+}
+
+int64_t AheadBuffer::writable() const {
+  // Frames the reader skipped count as room, as Append() drops them.
+  return capacity_ - (write_.load(std::memory_order_relaxed) -
+                      read_.load(std::memory_order_acquire));
+}
+
+void AheadBuffer::Write(const float* const* src, int num_frames,
+                        int latency) {
+  shift_ += latency - latency_;
+  latency_ = latency;
+  int offset = 0;
+  if (shift_ > 0) {
+    // The first frames of a longer latency precede the playhead.
+    offset = std::min(shift_, num_frames);
+    shift_ -= offset;
+  } else if (shift_ < 0) {
+    // Pads as far as the ring has room beyond this block, the rest before
+    // the next one.
+    const int pad = std::min<int64_t>(-shift_, writable() - num_frames);
+    if (pad > 0) {
+      Append(nullptr, 0, pad);
+      shift_ += pad;
+    }
+  }
+  Append(src, offset, num_frames - offset);
+}
+
+void AheadBuffer::Flush() {
+  // The reader may still be copying frames before write_, so the ring is
+  // not rewound; the room frees up as the reader skips.
+  skip_to_.store(write_.load(std::memory_order_relaxed),
+                 std::memory_order_release);
+  shift_ = latency_;
+}
+
+void AheadBuffer::Append(const float* const* src, int offset,
+                         int num_frames) {
+  int64_t write = write_.load(std::memory_order_relaxed);
+  if (const int64_t read = read_.load(std::memory_order_acquire);
+      write < read) {
+    // Played as silence by an underrun.
+    const int skip = std::min<int64_t>(num_frames, read - write);
+    write += skip;
+    offset += skip;
+    num_frames -= skip;
+  }
+  const int pos = write % capacity_;
+  const int head = std::min(num_frames, capacity_ - pos);
+  for (int c = 0; c < num_channels_; ++c) {
+    float* ring = ring_[c].data();
+    if (src == nullptr) {
+      std::fill_n(ring + pos, head, 0.0f);
+      std::fill_n(ring, num_frames - head, 0.0f);
+    } else {
+      std::copy_n(src[c] + offset, head, ring + pos);
+      std::copy_n(src[c] + offset + head, num_frames - head, ring);
+    }
+  }
+  write_.store(write + num_frames, std::memory_order_release);
+}
+
+absl::StatusOr<std::unique_ptr<Anticipator>> Anticipator::Create(
+    std::vector<RenderNodeSpec>& specs, const BufferResolver& buffers,
+    const RenderGraphOptions& graph_options,
+    const AnticipationOptions& options) {
+  const int n = specs.size();
+  std::vector<int> num_inputs(n);
+  for (const RenderNodeSpec& spec : specs) {
+    if (spec.output >= 0 && spec.output < n) ++num_inputs[spec.output];
+  }
+  std::vector<RenderNodeSpec> ahead;
+  std::vector<AheadBuffer*> ahead_buffers;
+  for (int i = 0; i < n; ++i) {
+    RenderNodeSpec& spec = specs[i];
+    if (num_inputs[i] > 0 || spec.receives_midi) continue;
+    AheadBuffer* buffer = buffers(i);
+    if (buffer == nullptr) continue;
+    if (buffer->num_channels() != graph_options.num_channels ||
+        buffer->capacity_frames() < options.block_size) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Buffer of ", spec.name, " cannot take blocks of ",
+          graph_options.num_channels, "x", options.block_size));
+    }
+    RenderNodeSpec live;
+    live.name = spec.name;
+    live.source = buffer;
+    live.output = spec.output;
+    // Measured as it plays, not as it is rendered.
+    live.meter = spec.meter;
+    ahead.push_back(std::exchange(spec, std::move(live)));
+    ahead.back().output = -1;
+    ahead.back().meter = nullptr;
+    ahead_buffers.push_back(buffer);
+  }
+  if (ahead.empty()) return nullptr;
+
+  RenderGraphOptions ahead_options = graph_options;
+  ahead_options.max_block_size = options.block_size;
+  ahead_options.midi_track = -1;
+  ahead_options.mix_outputs = false;
+  absl::StatusOr<std::unique_ptr<RenderGraph>> graph =
+      RenderGraph::Create(std::move(ahead), ahead_options);
+  if (!graph.ok()) return graph.status();
+  LOG(INFO) << "Anticipating " << ahead_buffers.size() << " tracks in blocks"
+            << " of " << options.block_size << " frames";
+  return std::unique_ptr<Anticipator>(
+      new Anticipator(*std::move(graph), std::move(ahead_buffers), options));
+}
+
+Anticipator::Anticipator(std::unique_ptr<RenderGraph> graph,
+                         std::vector<AheadBuffer*> buffers,
+                         const AnticipationOptions& options)
+    : options_(options),
+      graph_(std::move(graph)),
+      buffers_(std::move(buffers)),
+      scheduler_(GraphScheduler::Create(options.num_workers,
+                                        /*realtime=*/false)),
+      thread_(&Anticipator::Loop, this) {}
+
+Anticipator::~Anticipator() {
+  {
+    absl::MutexLock lock(&mu_);
+    quit_ = true;
+  }
+  thread_.join();
+}
+
+bool Anticipator::AwaitFull(absl::Duration timeout) {
+  absl::MutexLock lock(&mu_);
+  return mu_.AwaitWithTimeout(absl::Condition(&full_), timeout);
+}
+
+void Anticipator::Seek(absl::FunctionRef<void()> seek) {
+  absl::MutexLock lock(&mu_);
+  mu_.Await(absl::Condition(this, &Anticipator::BetweenBlocks));
+  seek();
+  for (AheadBuffer* buffer : buffers_) buffer->Flush();
+  full_ = false;
+}
+
+uint64_t Anticipator::underruns() const {
+  uint64_t underruns = 0;
+  for (const AheadBuffer* buffer : buffers_) underruns += buffer->underruns();
+  return underruns;
+}
+
+void Anticipator::Loop() {
+  TraceThread trace_thread("Anticipation");
+  const int block = options_.block_size;
+  while (true) {
+    {
+      absl::MutexLock lock(&mu_);
+      if (quit_) return;
+      if (!HasRoom()) {
+        // The audio thread drains the buffers without telling anyone.
+        full_ = true;
+        mu_.AwaitWithTimeout(absl::Condition(&quit_), options_.idle);
+        continue;
+      }
+      rendering_ = true;
+    }
+    {
+      TraceScope trace("Render ahead");
+      scheduler_->Run(*graph_, block);
+      for (int k = 0; k < buffers_.size(); ++k) {
+        buffers_[k]->Write(graph_->node_output(k), block,
+                           graph_->node_latency(k));
+      }
+    }
+    absl::MutexLock lock(&mu_);
+    rendering_ = false;
+  }
+}
+
+bool Anticipator::HasRoom() const {
+  for (const AheadBuffer* buffer : buffers_) {
+    if (buffer->writable() < options_.block_size) return false;
+  }
+  return true;
+}
+
+}  // namespace kodo
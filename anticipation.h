@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "audio_engine.h"
+#include "graph_scheduler.h"
+#include "render_graph.h"
+
+namespace kodo {
+
+// Frames of one track rendered ahead of the playhead. An Anticipator writes
+// them in large blocks and the audio thread plays them back as the source of
+// the track node; they share only a fixed ring and two atomics. Buffers
+// outlive the anticipators writing them, so rebuilding a graph keeps what
+// was rendered ahead.
+class AheadBuffer : public AudioRenderer {
+ public:
+  AheadBuffer(int num_channels, int capacity_frames);
+
+  AheadBuffer(const AheadBuffer&) = delete;
+  AheadBuffer& operator=(const AheadBuffer&) = delete;
+
+  // Audio thread. Plays the next `num_frames`. Frames not rendered yet play
+  // as silence and are skipped by the writer, so the track stays in time.
+  void Render(float* const* outputs, int num_channels,
+              int num_frames) override;
+
+  // Writer. Frames the next Write() may take.
+  int64_t writable() const;
+  // Writer. Appends `src[num_channels()][num_frames]`, which lags the
+  // playhead by `latency` frames. Frames are dropped or padded as it
+  // changes, so the buffer plays without latency.
+  void Write(const float* const* src, int num_frames, int latency);
+  // Writer. Drops the unplayed frames, e.g. after a seek of the players. The
+  // reader plays silence until the next Write(), whose first `latency`
+  // frames, still from before the seek, are dropped too.
+  void Flush();
+
+  int num_channels() const { return num_channels_; }
+  int capacity_frames() const { return capacity_; }
+  // Number of Render() calls that found frames missing.
+  uint64_t underruns() const {
+    return underruns_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Copies frames [offset, offset + num_frames) of `src`, or silence for
+  // nullptr, past the frames the reader has already skipped.
+  void Append(const float* const* src, int offset, int num_frames);
+
+  const int num_channels_;
+  const int capacity_;
+  // Frame f of the track lives at (f % capacity_) of each channel.
+  std::vector<std::vector<float>> ring_;
+  // Frames [read_, write_) are rendered and unplayed. read_ passes write_
+  // on underruns.
+  std::atomic<int64_t> write_ = 0;
+  std::atomic<int64_t> read_ = 0;
+  // Set by Flush() to the write_ the reader skips to.
+  std::atomic<int64_t> skip_to_ = 0;
+  std::atomic<uint64_t> underruns_ = 0;
+  // Writer only. The latency compensated so far, and frames still to drop
+  // (positive) or pad (negative) for a change of it.
+  int latency_ = 0;
+  int shift_ = 0;
+};
+
+struct AnticipationOptions {
+  // Frames per block of anticipated nodes. Their plugins and players must
+  // be set up for as many.
+  int block_size = 2048;
+  // Workers besides the rendering thread. All run at normal priority, below
+  // the real-time audio threads.
+  int num_workers = 1;
+  // Sleep of the rendering thread while every buffer is full.
+  absl::Duration idle = absl::Milliseconds(1);
+};
+
+// Renders the tracks without live input ahead of the playhead: in blocks of
+// AnticipationOptions::block_size on low-priority threads, into an
+// AheadBuffer per track that the real-time graph only mixes. Edits of their
+// plugins and automation sound once the buffered frames have played; seeks
+// go through Seek() to sound at once.
+class Anticipator {
+ public:
+  // Finds the buffer of node `index` of BuildRenderNodes(), or nullptr to
+  // keep the node in the real-time graph.
+  using BufferResolver = std::function<AheadBuffer*(int index)>;
+
+  // Moves each node of `specs` that has a buffer, no inputs and no MIDI
+  // input into a graph of its own, replaced by a node playing the buffer.
+  // Starts rendering that graph, or returns nullptr if no node moved.
+  // `graph_options` are those of the real-time graph.
+  static absl::StatusOr<std::unique_ptr<Anticipator>> Create(
+      std::vector<RenderNodeSpec>& specs, const BufferResolver& buffers,
+      const RenderGraphOptions& graph_options,
+      const AnticipationOptions& options);
+
+  // Stops rendering. The buffers keep their frames for the next Anticipator
+  // on the same players.
+  ~Anticipator();
+
+  // Waits until every buffer is full, e.g. before the first graph plays
+  // them. Returns false on timeout.
+  bool AwaitFull(absl::Duration timeout) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // GUI thread. Runs `seek`, which calls Seek() on the players of the
+  // anticipated tracks, between two blocks and flushes the buffers, so the
+  // tracks resume at the new position once its first block is rendered.
+  void Seek(absl::FunctionRef<void()> seek) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Sum of AheadBuffer::underruns().
+  uint64_t underruns() const;
+
+ private:
+  Anticipator(std::unique_ptr<RenderGraph> graph,
+              std::vector<AheadBuffer*> buffers,
+              const AnticipationOptions& options);
+
+  void Loop() ABSL_LOCKS_EXCLUDED(mu_);
+  // Whether every buffer takes another block.
+  bool HasRoom() const;
+  bool BetweenBlocks() const ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+    return !rendering_;
+  }
+
+  const AnticipationOptions options_;
+  std::unique_ptr<RenderGraph> graph_;
+  std::vector<AheadBuffer*> buffers_;  // Parallel to the graph nodes.
+  std::unique_ptr<GraphScheduler> scheduler_;
+  absl::Mutex mu_;
+  bool quit_ ABSL_GUARDED_BY(mu_) = false;
+  bool full_ ABSL_GUARDED_BY(mu_) = false;
+  // Whether Loop() renders and writes a block outside `mu_`.
+  bool rendering_ ABSL_GUARDED_BY(mu_) = false;
+  std::thread thread_;
+};
+
+}  // namespace kodo
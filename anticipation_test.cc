@@ -0,0 +1,74 @@
+#include "anticipation.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace kodo {
+namespace {
+
+// Writes `num_frames` of a mono ramp starting at `first`.
+void WriteRamp(AheadBuffer& buffer, float first, int num_frames,
+               int latency = 0) {
+  std::vector<float> frames(num_frames);
+  for (int i = 0; i < num_frames; ++i) frames[i] = first + i;
+  const float* src[] = {frames.data()};
+  buffer.Write(src, num_frames, latency);
+}
+
+std::vector<float> Play(AheadBuffer& buffer, int num_frames) {
+  std::vector<float> frames(num_frames, -1.0f);
+  float* outputs[] = {frames.data()};
+  buffer.Render(outputs, 1, num_frames);
+  return frames;
+}
+
+TEST(AheadBufferTest, PlaysWrittenFramesInOrder) {
+  AheadBuffer buffer(1, 16);
+  WriteRamp(buffer, 0, 8);
+  EXPECT_EQ(buffer.writable(), 8);
+  EXPECT_EQ(Play(buffer, 4), (std::vector<float>{0, 1, 2, 3}));
+  WriteRamp(buffer, 8, 12);  // Wraps the ring.
+  EXPECT_EQ(Play(buffer, 16),
+            (std::vector<float>{4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                                17, 18, 19}));
+  EXPECT_EQ(buffer.underruns(), 0);
+}
+
+TEST(AheadBufferTest, UnderrunStaysInTime) {
+  AheadBuffer buffer(1, 16);
+  WriteRamp(buffer, 0, 2);
+  EXPECT_EQ(Play(buffer, 4), (std::vector<float>{0, 1, 0, 0}));
+  EXPECT_EQ(buffer.underruns(), 1);
+  // Frames 2 and 3 played as silence, so the writer drops them.
+  WriteRamp(buffer, 2, 4);
+  EXPECT_EQ(Play(buffer, 2), (std::vector<float>{4, 5}));
+}
+
+TEST(AheadBufferTest, FlushDropsUnplayedFrames) {
+  AheadBuffer buffer(1, 16);
+  WriteRamp(buffer, 0, 16);
+  EXPECT_EQ(Play(buffer, 2), (std::vector<float>{0, 1}));
+  buffer.Flush();
+  EXPECT_EQ(buffer.writable(), 2) << "The reader has not skipped yet.";
+  EXPECT_EQ(Play(buffer, 2), (std::vector<float>{0, 0}));
+  EXPECT_EQ(buffer.writable(), 18);
+  // Frames the reader played as silence meanwhile are dropped again.
+  WriteRamp(buffer, 100, 4);
+  EXPECT_EQ(Play(buffer, 2), (std::vector<float>{102, 103}));
+  buffer.Flush();
+  WriteRamp(buffer, 200, 4);
+  EXPECT_EQ(Play(buffer, 4), (std::vector<float>{200, 201, 202, 203}));
+}
+
+TEST(AheadBufferTest, FlushDropsLatencyFromBeforeTheSeek) {
+  AheadBuffer buffer(1, 16);
+  WriteRamp(buffer, 0, 3, /*latency=*/3);
+  buffer.Flush();
+  // The first 3 frames after a flush are still the plugin's old output.
+  WriteRamp(buffer, 100, 8, /*latency=*/3);
+  EXPECT_EQ(Play(buffer, 5), (std::vector<float>{103, 104, 105, 106, 107}));
+}
+
+}  // namespace
+}  // namespace kodo
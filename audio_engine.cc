@@ -0,0 +1,352 @@
+#include "audio_engine.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "dsp.h"
+#include "portaudio.h"
+#include "resampler.h"
+#include "rt_alloc.h"
+#include "trace.h"
+
+namespace kodo {
+
+namespace {
+
+absl::Status PaErrorToStatus(PaError err, const char* what) {
+  if (err == paNoError) return absl::OkStatus();
+  return absl::InternalError(absl::StrCat(what, ": ", Pa_GetErrorText(err)));
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<AudioEngine>> AudioEngine::Init(
+    const AudioEngineOptions& options) {
+  if (options.block_size <= 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("block_size=", options.block_size, " must be positive."));
+  }
+  if (options.num_output_channels <= 0 ||
+      options.num_output_channels > kMaxChannels) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("num_output_channels=", options.num_output_channels,
+                     " must be in [1, ", kMaxChannels, "]."));
+  }
+  if (options.num_input_channels < 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "num_input_channels=", options.num_input_channels, " is negative."));
+  }
+
+  PaDeviceIndex device =
+      options.device < 0 ? Pa_GetDefaultOutputDevice() : options.device;
+  if (device == paNoDevice || device >= Pa_GetDeviceCount()) {
+    return absl::NotFoundError(
+        absl::StrCat("No output device for index=", options.device));
+  }
+  const PaDeviceInfo* info = Pa_GetDeviceInfo(device);
+  if (info->maxOutputChannels < options.num_output_channels) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Device ", info->name, " has only ", info->maxOutputChannels,
+        " output channels."));
+  }
+
+  std::unique_ptr<AudioEngine> ret(new AudioEngine);
+  ret->options_ = options;
+  ret->options_.device = device;
+  double& device_rate = ret->options_.device_sample_rate;
+  if (device_rate == 0) device_rate = options.sample_rate;
+  if (device_rate < 0) device_rate = info->defaultSampleRate;
+  // Calibrates the cycle counter before the audio thread needs it.
+  ret->cycles_per_frame_ = CyclesPerSecond() / device_rate;
+  // Likewise picks the DSP kernels.
+  Dsp();
+
+  if (options.num_input_channels > 0) {
+    const PaDeviceIndex input_device = options.input_device < 0
+                                           ? Pa_GetDefaultInputDevice()
+                                           : options.input_device;
+    if (input_device == paNoDevice || input_device >= Pa_GetDeviceCount()) {
+      return absl::NotFoundError(absl::StrCat(
+          "No input device for index=", options.input_device));
+    }
+    const PaDeviceInfo* input_info = Pa_GetDeviceInfo(input_device);
+    if (input_info->maxInputChannels < options.num_input_channels) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Device ", input_info->name, " has only ",
+          input_info->maxInputChannels, " input channels."));
+    }
+    ret->options_.input_device = input_device;
+  }
+  if (absl::Status status = ret->OpenStream(); !status.ok()) return status;
+  return ret;
+}
+
+absl::Status AudioEngine::OpenStream() {
+  const double device_rate = options_.device_sample_rate;
+  resampler_.reset();
+  if (device_rate != options_.sample_rate) {
+    absl::StatusOr<std::unique_ptr<StreamResampler>> resampler =
+        StreamResampler::Create(options_.sample_rate, device_rate,
+                                options_.num_output_channels,
+                                options_.block_size,
+                                options_.resampler_quality);
+    if (!resampler.ok()) return resampler.status();
+    resampler_ = std::move(*resampler);
+    resampler_input_.resize(options_.num_output_channels *
+                            resampler_->max_input_frames());
+  }
+
+  const PaDeviceInfo* info = Pa_GetDeviceInfo(options_.device);
+  PaStreamParameters output_params{};
+  output_params.device = options_.device;
+  output_params.channelCount = options_.num_output_channels;
+  // Non-interleaved float matches the AudioBusBuffers layout of VST3.
+  output_params.sampleFormat = paFloat32 | paNonInterleaved;
+  output_params.suggestedLatency = info->defaultLowOutputLatency;
+  output_params.hostApiSpecificStreamInfo = nullptr;
+
+  PaStreamParameters input_params{};
+  if (options_.num_input_channels > 0) {
+    input_params.device = options_.input_device;
+    input_params.channelCount = options_.num_input_channels;
+    input_params.sampleFormat = paFloat32 | paNonInterleaved;
+    input_params.suggestedLatency =
+        Pa_GetDeviceInfo(options_.input_device)->defaultLowInputLatency;
+  }
+
+  PaError err = Pa_OpenStream(&stream_,
+                              options_.num_input_channels > 0 ? &input_params
+                                                              : nullptr,
+                              &output_params, device_rate,
+                              options_.block_size, paClipOff,
+                              &AudioEngine::StreamCallback, this);
+  if (absl::Status status = PaErrorToStatus(err, "Pa_OpenStream failed");
+      !status.ok()) {
+    stream_ = nullptr;
+    return status;
+  }
+
+  const PaStreamInfo* stream_info = Pa_GetStreamInfo(stream_);
+  LOG(INFO) << "Opened audio stream on " << info->name
+            << " sample_rate=" << stream_info->sampleRate
+            << " render_sample_rate=" << options_.sample_rate
+            << " block_size=" << options_.block_size
+            << " output_latency=" << stream_info->outputLatency;
+  return absl::OkStatus();
+}
+
+AudioEngine::~AudioEngine() {
+  if (stream_) {
+    Pa_CloseStream(stream_);  // Aborts the callback if still running.
+  }
+  Poll();
+  // The stream is closed, so the audio thread no longer owns these.
+  Command command;
+  while (commands_.Pop(&command)) {
+    if (command.type == Command::Type::kSetRenderer) delete command.renderer;
+    if (command.type == Command::Type::kSetRecorder) delete command.recorder;
+  }
+  delete renderer_;
+  delete recorder_;
+}
+
+absl::Status AudioEngine::Start() {
+  frames_rendered_.store(0, std::memory_order_relaxed);
+  return PaErrorToStatus(Pa_StartStream(stream_), "Pa_StartStream failed");
+}
+
+absl::Status AudioEngine::Stop() {
+  return PaErrorToStatus(Pa_StopStream(stream_), "Pa_StopStream failed");
+}
+
+absl::Status AudioEngine::SetBlockSize(int block_size) {
+  if (block_size <= 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("block_size=", block_size, " must be positive."));
+  }
+  const bool active = Pa_IsStreamActive(stream_) == 1;
+  if (absl::Status status =
+          PaErrorToStatus(Pa_CloseStream(stream_), "Pa_CloseStream failed");
+      !status.ok()) {
+    return status;
+  }
+  // No callback runs until the stream starts again.
+  stream_ = nullptr;
+  stats_.last_start.store(0, std::memory_order_relaxed);
+  const int previous = options_.block_size;
+  options_.block_size = block_size;
+  absl::Status status = OpenStream();
+  if (!status.ok()) {
+    LOG(ERROR) << status;
+    options_.block_size = previous;
+    if (absl::Status reopened = OpenStream(); !reopened.ok()) return reopened;
+  }
+  if (active) {
+    if (absl::Status started = PaErrorToStatus(Pa_StartStream(stream_),
+                                               "Pa_StartStream failed");
+        !started.ok()) {
+      return started;
+    }
+  }
+  return status;
+}
+
+absl::Status AudioEngine::SetRenderer(
+    std::unique_ptr<AudioRenderer> renderer) {
+  Command command{};
+  command.type = Command::Type::kSetRenderer;
+  command.renderer = renderer.get();
+  if (!commands_.Push(command)) {
+    return absl::ResourceExhaustedError("Audio command queue is full.");
+  }
+  renderer.release();  // Now owned by the audio thread.
+  return absl::OkStatus();
+}
+
+absl::Status AudioEngine::SetGain(float gain) {
+  Command command{};
+  command.type = Command::Type::kSetGain;
+  command.gain = gain;
+  if (!commands_.Push(command)) {
+    return absl::ResourceExhaustedError("Audio command queue is full.");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status AudioEngine::SetRecorder(std::unique_ptr<Recorder> recorder) {
+  if (recorder &&
+      recorder->options().num_channels != options_.num_input_channels) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Recorder has ", recorder->options().num_channels,
+        " channels but the stream ", options_.num_input_channels,
+        " inputs."));
+  }
+  Command command{};
+  command.type = Command::Type::kSetRecorder;
+  command.recorder = recorder.get();
+  if (!commands_.Push(command)) {
+    return absl::ResourceExhaustedError("Audio command queue is full.");
+  }
+  gui_recorder_ = recorder.release();  // Now owned by the audio thread.
+  return absl::OkStatus();
+}
+
+void AudioEngine::Poll() {
+  AudioRenderer* renderer;
+  while (retired_.Pop(&renderer)) delete renderer;
+  Recorder* recorder;
+  while (retired_recorders_.Pop(&recorder)) {
+    recorder->Finish();
+    finishing_.emplace_back(recorder);
+  }
+  std::erase_if(finishing_, [](const std::unique_ptr<Recorder>& recorder) {
+    return recorder->finished();
+  });
+}
+
+int AudioEngine::StreamCallback(const void* input, void* output,
+                                unsigned long num_frames,
+                                const PaStreamCallbackTimeInfo* /*time_info*/,
+                                PaStreamCallbackFlags status_flags,
+                                void* user_data) {
+  RealtimeScope realtime;
+  auto* engine = static_cast<AudioEngine*>(user_data);
+  // PortAudio owns the thread, which changes as streams reopen, so the
+  // engine rather than the thread keeps the buffer.
+  TraceTrackScope track(engine->trace_track_);
+  TraceScope trace("Audio callback");
+  const uint64_t start = CycleCount();
+  engine->Process(static_cast<const float* const*>(input),
+                  static_cast<float* const*>(output),
+                  static_cast<int>(num_frames));
+  engine->stats_.RecordCallback(
+      start, CycleCount() - start, num_frames * engine->cycles_per_frame_,
+      status_flags & (paOutputUnderflow | paOutputOverflow |
+                      paInputUnderflow | paInputOverflow));
+  return paContinue;
+}
+
+// Runs on the audio thread. No locks, allocations or logging below.
+void AudioEngine::Process(const float* const* inputs, float* const* outputs,
+                          int num_frames) {
+  Command command;
+  // Stop consuming swaps while the GUI has not freed old objects, so a
+  // retired one is never dropped.
+  while (retired_.Size() < retired_.Capacity() &&
+         retired_recorders_.Size() < retired_recorders_.Capacity() &&
+         commands_.Pop(&command)) {
+    switch (command.type) {
+      case Command::Type::kSetRenderer:
+        if (renderer_) retired_.Push(renderer_);
+        renderer_ = command.renderer;
+        break;
+      case Command::Type::kSetGain:
+        target_gain_ = command.gain;
+        break;
+      case Command::Type::kSetRecorder:
+        if (recorder_) retired_recorders_.Push(recorder_);
+        recorder_ = command.recorder;
+        break;
+    }
+  }
+  if (recorder_ && inputs) recorder_->Write(inputs, num_frames);
+
+  const int num_channels = options_.num_output_channels;
+  if (resampler_ == nullptr) {
+    Render(outputs, num_frames);
+  } else {
+    float* rendered[kMaxChannels];
+    for (int c = 0; c < num_channels; ++c) {
+      rendered[c] =
+          resampler_input_.data() + c * resampler_->max_input_frames();
+    }
+    float* block[kMaxChannels];
+    for (int offset = 0; offset < num_frames; offset += options_.block_size) {
+      const int n = std::min(options_.block_size, num_frames - offset);
+      const int needed = resampler_->InputFramesNeeded(n);
+      Render(rendered, needed);
+      for (int c = 0; c < num_channels; ++c) block[c] = outputs[c] + offset;
+      resampler_->Process(rendered, needed, block, n);
+    }
+  }
+
+  // Gain changes ramp over one callback to avoid zipper noise.
+  const DspKernels& dsp = Dsp();
+  if (gain_ != target_gain_) {
+    for (int c = 0; c < num_channels; ++c) {
+      dsp.scale_ramp(outputs[c], gain_, target_gain_, num_frames);
+    }
+    gain_ = target_gain_;
+  } else if (gain_ != 1.0f) {
+    for (int c = 0; c < num_channels; ++c) {
+      dsp.scale(outputs[c], gain_, num_frames);
+    }
+  }
+}
+
+void AudioEngine::Render(float* const* outputs, int num_frames) {
+  const int num_channels = options_.num_output_channels;
+  if (renderer_ == nullptr) {
+    for (int c = 0; c < num_channels; ++c) {
+      std::fill_n(outputs[c], num_frames, 0.0f);
+    }
+  } else {
+    // PortAudio honors the fixed block size, but split defensively so the
+    // renderer never sees more than it preallocated for. Resampling may ask
+    // for a few frames more.
+    float* block[kMaxChannels];
+    for (int offset = 0; offset < num_frames; offset += options_.block_size) {
+      const int n = std::min(options_.block_size, num_frames - offset);
+      for (int c = 0; c < num_channels; ++c) block[c] = outputs[c] + offset;
+      renderer_->Render(block, num_channels, n);
+    }
+  }
+  frames_rendered_.fetch_add(num_frames, std::memory_order_relaxed);
+}
+
+}  // namespace kodo
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "perf_counters.h"
+#include "portaudio.h"
+#include "recorder.h"
+#include "resampler.h"
+#include "spsc_queue.h"
+#include "trace.h"
+
+namespace kodo {
+
+// Produces audio blocks on the real-time audio thread. Render() must not lock,
+// allocate or log; everything it touches has to be preallocated.
+class AudioRenderer {
+ public:
+  virtual ~AudioRenderer() {}
+
+  // Fills non-interleaved `outputs[num_channels][num_frames]`.
+  virtual void Render(float* const* outputs, int num_channels,
+                      int num_frames) = 0;
+};
+
+struct AudioEngineOptions {
+  // PortAudio device index. Negative means the default output device.
+  int device = -1;
+  // Rate of every renderer.
+  double sample_rate = 48000;
+  // Rate the device runs at: 0 means sample_rate and negative the default
+  // rate of the device. Output is resampled when it differs.
+  double device_sample_rate = 0;
+  ResamplerQuality resampler_quality = ResamplerQuality::kStandard;
+  // Frames per callback, at the device rate.
+  int block_size = 128;
+  int num_output_channels = 2;
+  // Input device for recording, negative for the default one. Inputs run at
+  // the device rate and open only with num_input_channels > 0.
+  int input_device = -1;
+  int num_input_channels = 0;
+};
+
+// Owns a PortAudio output stream. All methods except the stream callback are
+// called from the GUI (control) thread and talk to the callback only through
+// fixed-capacity lock-free queues.
+class AudioEngine {
+ public:
+  static constexpr int kMaxChannels = 32;
+
+  static absl::StatusOr<std::unique_ptr<AudioEngine>> Init(
+      const AudioEngineOptions& options);
+
+  // Stops and closes the stream, then deletes every renderer.
+  ~AudioEngine();
+
+  absl::Status Start();
+  absl::Status Stop();
+
+  // Reopens the stream with `block_size` frames per callback, keeping the
+  // renderer and recorder, and restarts it if it was running. Playback and
+  // recording pause meanwhile. Keeps the previous size if the device
+  // rejects the new one.
+  absl::Status SetBlockSize(int block_size);
+
+  // Hands `renderer` to the audio thread. The previous renderer is deleted by
+  // a later Poll(). Fails if the command queue is full.
+  absl::Status SetRenderer(std::unique_ptr<AudioRenderer> renderer);
+
+  // Master gain applied after the renderer.
+  absl::Status SetGain(float gain);
+
+  // Hands `recorder` the input of every later callback, or stops recording
+  // with nullptr. It must have num_input_channels channels. The previous
+  // recorder is finished in the background and deleted by a later Poll().
+  absl::Status SetRecorder(std::unique_ptr<Recorder> recorder);
+
+  // The recorder of the last SetRecorder(), for its stats. Valid until the
+  // next SetRecorder().
+  const Recorder* recorder() const { return gui_recorder_; }
+
+  // Releases resources the audio thread has retired. Call once per GUI frame.
+  // Never waits for a take to reach the disk.
+  void Poll();
+
+  // device_sample_rate is the actual rate of the device.
+  const AudioEngineOptions& options() const { return options_; }
+
+  // Number of frames renderers have produced since Start().
+  int64_t frames_rendered() const {
+    return frames_rendered_.load(std::memory_order_relaxed);
+  }
+
+  // DSP load and xruns, updated by every callback.
+  EngineStats& stats() { return stats_; }
+
+ private:
+  AudioEngine() {}  // Use Init().
+
+  // Opens stream_ and the resampler for options_, whose devices are
+  // resolved.
+  absl::Status OpenStream();
+
+  struct Command {
+    enum class Type { kSetRenderer, kSetGain, kSetRecorder };
+    Type type;
+    AudioRenderer* renderer;
+    float gain;
+    Recorder* recorder;
+  };
+
+  static int StreamCallback(const void* input, void* output,
+                            unsigned long num_frames,
+                            const PaStreamCallbackTimeInfo* time_info,
+                            PaStreamCallbackFlags status_flags,
+                            void* user_data);
+  void Process(const float* const* inputs, float* const* outputs,
+               int num_frames);
+  void Render(float* const* outputs, int num_frames);
+
+  AudioEngineOptions options_;
+  PaStream* stream_ = nullptr;
+  // Of the callbacks of every stream_, outliving them.
+  TraceTrack trace_track_{"Audio callback"};
+
+  // GUI -> audio.
+  SpscQueue<Command, 256> commands_;
+  // Audio -> GUI. Renderers replaced on the audio thread to be freed later.
+  SpscQueue<AudioRenderer*, 256> retired_;
+  SpscQueue<Recorder*, 16> retired_recorders_;
+
+  // GUI thread.
+  Recorder* gui_recorder_ = nullptr;
+  // Retired recorders whose writers still drain. Destroying them joins.
+  std::vector<std::unique_ptr<Recorder>> finishing_;
+
+  // Owned by the audio thread while the stream runs.
+  AudioRenderer* renderer_ = nullptr;
+  Recorder* recorder_ = nullptr;
+  float gain_ = 1.0f;  // Applied at the start of the next callback.
+  float target_gain_ = 1.0f;
+
+  // Converts from sample_rate to the device rate, if they differ.
+  std::unique_ptr<StreamResampler> resampler_;
+  std::vector<float> resampler_input_;  // Channels x max_input_frames().
+
+  std::atomic<int64_t> frames_rendered_{0};
+  EngineStats stats_;
+  double cycles_per_frame_ = 0;  // Buffer deadline per frame.
+};
+
+}  // namespace kodo
@@ -0,0 +1,344 @@
+#include "audio_file.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+
+namespace kodo {
+
+namespace {
+
+constexpr uint16_t kWaveFormatPcm = 1;
+constexpr uint16_t kWaveFormatFloat = 3;
+constexpr uint16_t kWaveFormatExtensible = 0xfffe;
+
+uint32_t Le(const unsigned char* p, int num_bytes) {
+  uint32_t value = 0;
+  for (int i = num_bytes - 1; i >= 0; --i) value = (value << 8) | p[i];
+  return value;
+}
+
+uint64_t Le64(const unsigned char* p) {
+  return Le(p, 4) | uint64_t{Le(p + 4, 4)} << 32;
+}
+
+class WavReader : public AudioFileReader {
+ public:
+  static absl::StatusOr<std::unique_ptr<WavReader>> Init(
+      const std::string& path) {
+    std::unique_ptr<WavReader> ret(new WavReader);
+    ret->file_.open(path, std::ios::binary);
+    if (!ret->file_) {
+      return absl::NotFoundError(absl::StrCat("Cannot open ", path));
+    }
+
+    unsigned char header[12];
+    if (!ret->file_.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        (std::memcmp(header, "RIFF", 4) != 0 &&
+         std::memcmp(header, "RF64", 4) != 0 &&
+         std::memcmp(header, "BW64", 4) != 0) ||
+        std::memcmp(header + 8, "WAVE", 4) != 0) {
+      return absl::InvalidArgumentError(absl::StrCat(path, " is not WAVE."));
+    }
+    // RF64 and BW64 files keep 64-bit sizes in a ds64 chunk, and the 32-bit
+    // fields beyond 4 GiB read 0xffffffff.
+    const bool rf64 = std::memcmp(header, "RIFF", 4) != 0;
+    uint64_t ds64_data_size = 0;
+
+    bool has_format = false;
+    while (true) {
+      unsigned char chunk[8];
+      if (!ret->file_.read(reinterpret_cast<char*>(chunk), sizeof(chunk))) {
+        return absl::InvalidArgumentError(
+            absl::StrCat(path, " has no data chunk."));
+      }
+      const uint32_t size = Le(chunk + 4, 4);
+      // Chunks are padded to an even size.
+      const std::streamoff next =
+          ret->file_.tellg() + std::streamoff(size + (size & 1));
+
+      if (rf64 && std::memcmp(chunk, "ds64", 4) == 0) {
+        unsigned char ds64[16];
+        if (size < 16 ||
+            !ret->file_.read(reinterpret_cast<char*>(ds64), sizeof(ds64))) {
+          return absl::InvalidArgumentError(
+              absl::StrCat(path, " has a broken ds64 chunk."));
+        }
+        // The RIFF size, then the data size.
+        ds64_data_size = Le64(ds64 + 8);
+      } else if (std::memcmp(chunk, "fmt ", 4) == 0) {
+        unsigned char fmt[40] = {};
+        if (size < 16 || !ret->file_.read(reinterpret_cast<char*>(fmt),
+                                          std::min<uint32_t>(size, 40))) {
+          return absl::InvalidArgumentError(
+              absl::StrCat(path, " has a broken fmt chunk."));
+        }
+        ret->format_ = Le(fmt, 2);
+        ret->num_channels_ = Le(fmt + 2, 2);
+        ret->sample_rate_ = Le(fmt + 4, 4);
+        ret->block_align_ = Le(fmt + 12, 2);
+        ret->bits_ = Le(fmt + 14, 2);
+        if (ret->format_ == kWaveFormatExtensible && size >= 40) {
+          // The first two bytes of the SubFormat GUID.
+          ret->format_ = Le(fmt + 24, 2);
+        }
+        has_format = true;
+      } else if (std::memcmp(chunk, "data", 4) == 0) {
+        if (!has_format) {
+          return absl::InvalidArgumentError(
+              absl::StrCat(path, " has data before fmt."));
+        }
+        ret->data_offset_ = ret->file_.tellg();
+        const uint64_t data_size =
+            rf64 && size == 0xffffffffu ? ds64_data_size : size;
+        ret->num_frames_ =
+            ret->block_align_ == 0 ? 0 : data_size / ret->block_align_;
+        break;
+      }
+      ret->file_.seekg(next);
+    }
+
+    const bool pcm = ret->format_ == kWaveFormatPcm &&
+                     (ret->bits_ == 16 || ret->bits_ == 24 || ret->bits_ == 32);
+    const bool ieee = ret->format_ == kWaveFormatFloat && ret->bits_ == 32;
+    if (!pcm && !ieee) {
+      return absl::UnimplementedError(absl::StrCat(
+          path, " has unsupported format=", ret->format_, " bits=",
+          ret->bits_));
+    }
+    if (ret->num_channels_ <= 0 ||
+        ret->block_align_ != ret->num_channels_ * ret->bits_ / 8) {
+      return absl::InvalidArgumentError(
+          absl::StrCat(path, " has invalid channels=", ret->num_channels_));
+    }
+    return ret;
+  }
+
+  double sample_rate() const override { return sample_rate_; }
+  int num_channels() const override { return num_channels_; }
+  int64_t num_frames() const override { return num_frames_; }
+
+  absl::Status Read(int64_t frame, int num_frames,
+                    float* const* outputs) override {
+    if (frame < 0 || num_frames < 0 || frame + num_frames > num_frames_) {
+      return absl::OutOfRangeError(
+          absl::StrCat("Frames [", frame, ", ", frame + num_frames,
+                       ") exceed ", num_frames_));
+    }
+    bytes_.resize(static_cast<size_t>(num_frames) * block_align_);
+    file_.clear();
+    file_.seekg(data_offset_ + std::streamoff(frame) * block_align_);
+    if (!file_.read(reinterpret_cast<char*>(bytes_.data()), bytes_.size())) {
+      return absl::DataLossError("Truncated WAVE data.");
+    }
+
+    const int bytes_per_sample = bits_ / 8;
+    const unsigned char* p = bytes_.data();
+    for (int i = 0; i < num_frames; ++i) {
+      for (int c = 0; c < num_channels_; ++c, p += bytes_per_sample) {
+        outputs[c][i] = Decode(p);
+      }
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  WavReader() {}  // Use Init().
+
+  float Decode(const unsigned char* p) const {
+    if (format_ == kWaveFormatFloat) {
+      const uint32_t bits = Le(p, 4);
+      float value;
+      std::memcpy(&value, &bits, sizeof(value));
+      return value;
+    }
+    switch (bits_) {
+      case 16:
+        return static_cast<int16_t>(Le(p, 2)) * (1.0f / 32768);
+      case 24:
+        // Sign-extend through the top byte of 32 bits.
+        return static_cast<int32_t>(Le(p, 3) << 8) * (1.0f / 2147483648.0f);
+      default:
+        return static_cast<int32_t>(Le(p, 4)) * (1.0f / 2147483648.0f);
+    }
+  }
+
+  std::ifstream file_;
+  uint16_t format_ = 0;
+  int num_channels_ = 0;
+  double sample_rate_ = 0;
+  int block_align_ = 0;
+  int bits_ = 0;
+  std::streamoff data_offset_ = 0;
+  int64_t num_frames_ = 0;
+  std::vector<unsigned char> bytes_;  // Reused across Read().
+};
+
+void PutLe(uint64_t value, int num_bytes, unsigned char* p) {
+  for (int i = 0; i < num_bytes; ++i) p[i] = (value >> (8 * i)) & 0xff;
+}
+
+class WavWriter : public AudioFileWriter {
+ public:
+  static absl::StatusOr<std::unique_ptr<WavWriter>> Init(
+      const std::string& path, double sample_rate, int num_channels,
+      int bits) {
+    if (bits != 16 && bits != 24 && bits != 32) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unsupported bits per sample: ", bits));
+    }
+    std::unique_ptr<WavWriter> ret(new WavWriter);
+    ret->file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!ret->file_) {
+      return absl::NotFoundError(absl::StrCat("Cannot create ", path));
+    }
+    ret->path_ = path;
+    ret->num_channels_ = num_channels;
+    ret->bits_ = bits;
+    ret->sample_rate_ = sample_rate;
+    // Sizes are patched by Close().
+    ret->WriteHeader(0);
+    if (!ret->file_) {
+      return absl::InternalError(absl::StrCat("Cannot write ", path));
+    }
+    return ret;
+  }
+
+  ~WavWriter() override {
+    if (file_.is_open()) Close().IgnoreError();
+  }
+
+  absl::Status Write(const float* const* inputs, int num_frames) override {
+    if (!file_.is_open()) {
+      return absl::FailedPreconditionError(absl::StrCat(path_, " is closed."));
+    }
+    const int sample_bytes = bits_ / 8;
+    bytes_.resize(static_cast<size_t>(num_frames) * num_channels_ *
+                  sample_bytes);
+    unsigned char* p = bytes_.data();
+    for (int i = 0; i < num_frames; ++i) {
+      for (int c = 0; c < num_channels_; ++c, p += sample_bytes) {
+        Encode(inputs[c][i], p);
+      }
+    }
+    file_.write(reinterpret_cast<const char*>(bytes_.data()), bytes_.size());
+    if (!file_) {
+      return absl::InternalError(absl::StrCat("Cannot write ", path_));
+    }
+    num_frames_ += num_frames;
+    return absl::OkStatus();
+  }
+
+  absl::Status Close() override {
+    if (!file_.is_open()) return absl::OkStatus();
+    file_.seekp(0);
+    WriteHeader(num_frames_ * num_channels_ * (bits_ / 8));
+    file_.close();
+    if (!file_) {
+      return absl::InternalError(absl::StrCat("Cannot write ", path_));
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  // RIFF, JUNK or ds64, fmt and the data chunk header.
+  static constexpr int kHeaderSize = 12 + 36 + 24 + 8;
+
+  WavWriter() {}  // Use Init().
+
+  void Encode(float x, unsigned char* p) const {
+    switch (bits_) {
+      case 16:
+        PutLe(static_cast<int16_t>(std::lround(
+                  std::clamp(x, -1.0f, 1.0f) * 32767)),
+              2, p);
+        break;
+      case 24:
+        PutLe(static_cast<int32_t>(std::lround(
+                  std::clamp(x, -1.0f, 1.0f) * 8388607)),
+              3, p);
+        break;
+      default: {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        PutLe(bits, 4, p);
+      }
+    }
+  }
+
+  // A RIFF header with a JUNK chunk reserving room for ds64, which turns
+  // the file into RF64 (EBU Tech 3306) once the sizes pass 32 bits, e.g.
+  // after 5.8 minutes of 32 channels of float at 96 kHz.
+  void WriteHeader(uint64_t data_bytes) {
+    const int block_align = num_channels_ * bits_ / 8;
+    const uint64_t riff_size = kHeaderSize - 8 + data_bytes;
+    const bool rf64 = riff_size > 0xffffffffu;
+    unsigned char header[kHeaderSize];
+    std::memcpy(header, rf64 ? "RF64" : "RIFF", 4);
+    PutLe(rf64 ? 0xffffffffu : riff_size, 4, header + 4);
+    std::memcpy(header + 8, "WAVE", 4);
+    std::memcpy(header + 12, rf64 ? "ds64" : "JUNK", 4);
+    PutLe(28, 4, header + 16);
+    std::memset(header + 20, 0, 28);
+    if (rf64) {
+      PutLe(riff_size, 8, header + 20);
+      PutLe(data_bytes, 8, header + 28);
+      PutLe(block_align == 0 ? 0 : data_bytes / block_align, 8, header + 36);
+      // No table of other chunk sizes follows.
+    }
+    unsigned char* fmt = header + 48;
+    std::memcpy(fmt, "fmt ", 4);
+    PutLe(16, 4, fmt + 4);
+    PutLe(bits_ == 32 ? kWaveFormatFloat : kWaveFormatPcm, 2, fmt + 8);
+    PutLe(num_channels_, 2, fmt + 10);
+    PutLe(static_cast<uint32_t>(sample_rate_), 4, fmt + 12);
+    PutLe(static_cast<uint32_t>(sample_rate_) * block_align, 4, fmt + 16);
+    PutLe(block_align, 2, fmt + 20);
+    PutLe(bits_, 2, fmt + 22);
+    std::memcpy(fmt + 24, "data", 4);
+    PutLe(rf64 ? 0xffffffffu : data_bytes, 4, fmt + 28);
+    file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+  }
+
+  std::ofstream file_;
+  std::string path_;
+  int num_channels_ = 0;
+  int bits_ = 32;
+  double sample_rate_ = 0;
+  int64_t num_frames_ = 0;
+  std::vector<unsigned char> bytes_;  // Reused across Write().
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<AudioFileWriter>> CreateWavFile(
+    const std::string& path, double sample_rate, int num_channels, int bits) {
+  return WavWriter::Init(path, sample_rate, num_channels, bits);
+}
+
+absl::StatusOr<std::unique_ptr<AudioFileReader>> OpenWavFile(
+    const std::string& path) {
+  return WavReader::Init(path);
+}
+
+absl::StatusOr<std::unique_ptr<AudioFileReader>> OpenAudioFile(
+    const std::string& path) {
+  std::string ext = std::filesystem::path(path).extension().string();
+  for (char& ch : ext) ch = std::tolower(ch);
+  if (ext == ".wav" || ext == ".wave") return OpenWavFile(path);
+  return absl::UnimplementedError(absl::StrCat(
+      "Unsupported audio file type: ", path, ". Only WAV can be read."));
+}
+
+}  // namespace kodo
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace kodo {
+
+// Random-access decoder of an audio file into non-interleaved floats. Not
+// real-time safe: it reads the disk and is meant for a prefetch thread.
+class AudioFileReader {
+ public:
+  virtual ~AudioFileReader() {}
+
+  virtual double sample_rate() const = 0;
+  virtual int num_channels() const = 0;
+  virtual int64_t num_frames() const = 0;
+
+  // Decodes frames [frame, frame + num_frames) into
+  // `outputs[num_channels()][num_frames]`. The range must be in the file.
+  virtual absl::Status Read(int64_t frame, int num_frames,
+                            float* const* outputs) = 0;
+};
+
+// Encodes non-interleaved floats into an audio file, appending in order.
+class AudioFileWriter {
+ public:
+  virtual ~AudioFileWriter() {}
+
+  // Appends `inputs[num_channels][num_frames]`.
+  virtual absl::Status Write(const float* const* inputs, int num_frames) = 0;
+  // Finalizes the headers. Writing fails afterwards.
+  virtual absl::Status Close() = 0;
+};
+
+// Opens a RIFF, RF64 or BW64 WAVE file with 16/24/32-bit integer or 32-bit
+// float PCM.
+absl::StatusOr<std::unique_ptr<AudioFileReader>> OpenWavFile(
+    const std::string& path);
+
+// Creates a RIFF WAVE file of `bits` per sample: 16 or 24 for integer PCM,
+// clipping out-of-range samples, or 32 for float. Close() turns files past
+// 4 GiB into RF64.
+absl::StatusOr<std::unique_ptr<AudioFileWriter>> CreateWavFile(
+    const std::string& path, double sample_rate, int num_channels,
+    int bits = 32);
+
+// Opens an audio file by its extension: .wav or .wave, the only format
+// read so far.
+absl::StatusOr<std::unique_ptr<AudioFileReader>> OpenAudioFile(
+    const std::string& path);
+
+}  // namespace kodo
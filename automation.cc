@@ -0,0 +1,269 @@
+#include "automation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "kodo.pb.h"
+#include "param_changes.h"
+
+namespace kodo {
+namespace {
+
+using Segment = AutomationTable::Segment;
+
+absl::StatusOr<std::vector<Segment>> CompileLane(const AutomationLane& lane) {
+  const int n = lane.time_size();
+  if (lane.value_size() != n) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Automation of param ", lane.param_id(), " has ", n, " times and ",
+        lane.value_size(), " values."));
+  }
+  std::vector<Segment> segments;
+  segments.push_back({std::numeric_limits<int64_t>::min(),
+                      Segment::kConstant,
+                      {lane.value(0), 0, 0, 0}});
+  for (int i = 0; i < n; ++i) {
+    if (lane.value(i) < 0 || lane.value(i) > 1) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Automation value ", lane.value(i), " of param ",
+                       lane.param_id(), " is not normalized."));
+    }
+    const int64_t t0 = lane.time(i);
+    const double v0 = lane.value(i);
+    if (i == n - 1) {
+      segments.push_back({t0, Segment::kConstant, {v0, 0, 0, 0}});
+      break;
+    }
+    const int64_t t1 = lane.time(i + 1);
+    if (t1 < t0) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Automation of param ", lane.param_id(), " is not sorted."));
+    }
+    if (t1 == t0) continue;  // Jumps at t1.
+    const double length = t1 - t0;
+    const double delta = lane.value(i + 1) - v0;
+    const AutomationLane::Curve curve =
+        i < lane.curve_size() ? lane.curve(i) : AutomationLane::LINEAR;
+    if (curve == AutomationLane::STEP || delta == 0) {
+      segments.push_back({t0, Segment::kConstant, {v0, 0, 0, 0}});
+    } else if (curve == AutomationLane::SMOOTH) {
+      // Smoothstep: v0 + delta * (3u^2 - 2u^3) with u = x / length.
+      segments.push_back({t0,
+                          Segment::kSmooth,
+                          {v0, 0, 3 * delta / (length * length),
+                           -2 * delta / (length * length * length)}});
+    } else {
+      segments.push_back({t0, Segment::kLinear, {v0, delta / length, 0, 0}});
+    }
+  }
+  return segments;
+}
+
+}  // namespace
+
+absl::StatusOr<std::shared_ptr<const AutomationTable>>
+AutomationTable::Compile(const Track& track) {
+  std::shared_ptr<AutomationTable> ret(new AutomationTable);
+  for (const AutomationLane& lane : track.automation()) {
+    if (lane.time_size() == 0) continue;
+    int plugin_index = -1;
+    for (int i = 0; i < track.plugins_size(); ++i) {
+      if (track.plugins(i).id() == lane.plugin_id()) plugin_index = i;
+    }
+    if (plugin_index == -1) {
+      return absl::NotFoundError(
+          absl::StrCat(track.name(), " automates plugin id=",
+                       lane.plugin_id(), " which it does not hold."));
+    }
+    absl::StatusOr<std::vector<Segment>> segments = CompileLane(lane);
+    if (!segments.ok()) return segments.status();
+    ret->lanes_.push_back(
+        {plugin_index, lane.param_id(), std::move(*segments)});
+  }
+  if (ret->lanes_.size() > kMaxLanes) {
+    return absl::ResourceExhaustedError(absl::StrCat(
+        track.name(), " has ", ret->lanes_.size(), " automation lanes."));
+  }
+
+  auto key = [](const Lane& lane) {
+    return std::make_tuple(lane.plugin_index, lane.param_id);
+  };
+  std::sort(ret->lanes_.begin(), ret->lanes_.end(),
+            [&](const Lane& a, const Lane& b) { return key(a) < key(b); });
+  for (int i = 1; i < ret->lanes_.size(); ++i) {
+    if (key(ret->lanes_[i - 1]) == key(ret->lanes_[i])) {
+      return absl::InvalidArgumentError(
+          absl::StrCat(track.name(), " automates param ",
+                       ret->lanes_[i].param_id, " twice."));
+    }
+  }
+  return ret;
+}
+
+AutomationPlayer::AutomationPlayer(
+    std::shared_ptr<const AutomationTable> table, int resolution)
+    : resolution_(std::max(resolution, 1)),
+      table_(std::move(table)),
+      states_(AutomationTable::kMaxLanes),
+      old_states_(AutomationTable::kMaxLanes),
+      points_(kMaxPoints),
+      spans_(AutomationTable::kMaxLanes) {
+  const std::vector<AutomationTable::Lane>& lanes = table_.current()->lanes();
+  for (int i = 0; i < lanes.size(); ++i) {
+    states_[i].plugin_index = lanes[i].plugin_index;
+    states_[i].param_id = lanes[i].param_id;
+  }
+  num_lanes_ = lanes.size();
+}
+
+// Runs on the audio thread. No locks or allocations below.
+void AutomationPlayer::Render(int num_frames) {
+  int64_t position = position_.load(std::memory_order_relaxed);
+  if (table_.HasUpdate()) Swap(*table_.Acquire());
+  if (int64_t seek = seek_.exchange(-1, std::memory_order_relaxed);
+      seek >= 0) {
+    position = seek;
+  }
+
+  const std::vector<AutomationTable::Lane>& lanes = table_.current()->lanes();
+  num_points_ = 0;
+  num_spans_ = 0;
+  for (int i = 0; i < lanes.size(); ++i) {
+    const AutomationTable::Lane& lane = lanes[i];
+    if (num_spans_ == 0 ||
+        spans_[num_spans_ - 1].plugin_index != lane.plugin_index) {
+      spans_[num_spans_++] = {lane.plugin_index, num_points_, num_points_};
+    }
+    RenderLane(lane, states_[i], position, num_frames);
+    spans_[num_spans_ - 1].end = num_points_;
+  }
+  // Each lane is in order already; interleave the lanes of a plugin.
+  for (int i = 0; i < num_spans_; ++i) {
+    std::sort(points_.begin() + spans_[i].begin,
+              points_.begin() + spans_[i].end,
+              [](const ParamChange& a, const ParamChange& b) {
+                return std::tie(a.sample_offset, a.id) <
+                       std::tie(b.sample_offset, b.id);
+              });
+  }
+  position_.store(position + num_frames, std::memory_order_relaxed);
+}
+
+void AutomationPlayer::Changes(int plugin_index, const ParamChange** changes,
+                               int* num_changes) const {
+  for (int i = 0; i < num_spans_; ++i) {
+    if (spans_[i].plugin_index == plugin_index) {
+      *changes = points_.data() + spans_[i].begin;
+      *num_changes = spans_[i].end - spans_[i].begin;
+      return;
+    }
+  }
+  *changes = nullptr;
+  *num_changes = 0;
+}
+
+void AutomationPlayer::Swap(const AutomationTable& table) {
+  std::swap(states_, old_states_);
+  const int num_old = num_lanes_;
+  const std::vector<AutomationTable::Lane>& lanes = table.lanes();
+  // Both are sorted by plugin_index, then param_id.
+  int old = 0;
+  for (int i = 0; i < lanes.size(); ++i) {
+    LaneState& state = states_[i];
+    state = {};
+    state.plugin_index = lanes[i].plugin_index;
+    state.param_id = lanes[i].param_id;
+    auto key = [](const LaneState& s) {
+      return std::make_tuple(s.plugin_index, s.param_id);
+    };
+    while (old < num_old && key(old_states_[old]) < key(state)) ++old;
+    if (old < num_old && key(old_states_[old]) == key(state)) {
+      state.last = old_states_[old].last;
+      state.ramp_in = state.last >= 0;
+    }
+  }
+  num_lanes_ = lanes.size();
+}
+
+void AutomationPlayer::RenderLane(const AutomationTable::Lane& lane,
+                                  LaneState& state, int64_t position,
+                                  int num_frames) {
+  const std::vector<Segment>& segments = lane.segments;
+  const int num_segments = segments.size();
+  auto next_start = [&](int s) {
+    return s + 1 < num_segments ? segments[s + 1].start
+                                : std::numeric_limits<int64_t>::max();
+  };
+  // Playback moves on by a block, so the hint is almost always right.
+  int s = std::min(state.segment, num_segments - 1);
+  if (segments[s].start > position || next_start(s) <= position) {
+    s = std::upper_bound(segments.begin(), segments.end(), position,
+                         [](int64_t frame, const Segment& segment) {
+                           return frame < segment.start;
+                         }) -
+        segments.begin() - 1;
+  }
+
+  last_offset_ = -1;
+  int offset = 0;
+  if (state.ramp_in) {
+    // Let the plugin ramp from the value of the old table.
+    state.ramp_in = false;
+    offset = std::min(resolution_, num_frames) - 1;
+    while (next_start(s) <= position + offset) ++s;
+    AddPoint(lane, state, offset, segments[s].Value(position + offset));
+    ++offset;
+  }
+  while (offset < num_frames) {
+    while (next_start(s) <= position + offset) ++s;
+    const Segment& segment = segments[s];
+    const int end = std::min<int64_t>(next_start(s) - position, num_frames);
+    switch (segment.shape) {
+      case Segment::kConstant:
+        if (segment.c[0] != state.last) {
+          // A step: hold the old value up to the frame before.
+          if (offset > 0 && last_offset_ < offset - 1 && state.last >= 0) {
+            AddPoint(lane, state, offset - 1, state.last);
+          }
+          AddPoint(lane, state, offset, segment.c[0]);
+        }
+        break;
+      case Segment::kLinear:
+        AddPoint(lane, state, offset, segment.Value(position + offset));
+        AddPoint(lane, state, end - 1, segment.Value(position + end - 1));
+        break;
+      case Segment::kSmooth:
+        for (int o = offset; o < end - 1; o += resolution_) {
+          AddPoint(lane, state, o, segment.Value(position + o));
+        }
+        AddPoint(lane, state, end - 1, segment.Value(position + end - 1));
+        break;
+    }
+    offset = end;
+  }
+  state.segment = s;
+}
+
+void AutomationPlayer::AddPoint(const AutomationTable::Lane& lane,
+                                LaneState& state, int offset, double value) {
+  if (offset == last_offset_) {
+    points_[num_points_ - 1].value = value;
+  } else if (num_points_ < kMaxPoints) {
+    points_[num_points_++] = {lane.param_id, value, offset};
+    last_offset_ = offset;
+  } else {
+    return;  // Sent next block instead.
+  }
+  state.last = value;
+}
+
+}  // namespace kodo
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "kodo.pb.h"
+#include "param_changes.h"
+#include "published.h"
+
+namespace kodo {
+
+// AutomationLanes of one track compiled into segment tables. Every segment
+// is a cubic in the frames since its start with precomputed coefficients,
+// so playback never looks at the breakpoints again.
+class AutomationTable {
+ public:
+  static constexpr int kMaxLanes = 256;
+
+  struct Segment {
+    enum Shape { kConstant, kLinear, kSmooth };
+    int64_t start;  // The segment covers [start, next segment start).
+    Shape shape;
+    // value = c[0] + c[1] x + c[2] x^2 + c[3] x^3 with x = frame - start.
+    double c[4];
+
+    double Value(int64_t frame) const {
+      if (shape == kConstant) return c[0];  // Also before the first point.
+      const double x = frame - start;
+      return c[0] + x * (c[1] + x * (c[2] + x * c[3]));
+    }
+  };
+
+  struct Lane {
+    int plugin_index;  // Into Track.plugins.
+    Steinberg::Vst::ParamID param_id;
+    // Sorted by start. The first starts at INT64_MIN and the last holds
+    // forever.
+    std::vector<Segment> segments;
+  };
+
+  // Fails for lanes of plugins not on `track`, duplicate parameters or
+  // unsorted breakpoints.
+  static absl::StatusOr<std::shared_ptr<const AutomationTable>> Compile(
+      const Track& track);
+
+  // Sorted by plugin_index, then param_id.
+  const std::vector<Lane>& lanes() const { return lanes_; }
+
+ private:
+  AutomationTable() {}  // Use Compile().
+
+  std::vector<Lane> lanes_;
+};
+
+// Plays an AutomationTable along its own playhead, like ClipPlayer does
+// audio. Each block becomes IParameterChanges points that plugins ramp
+// between linearly: one point per linear segment end, one every
+// `resolution` frames along smooth segments and two around a step. Lanes
+// holding a value they already sent cost a segment lookup and nothing else.
+class AutomationPlayer {
+ public:
+  // Upper bound of the points of one block across all lanes.
+  static constexpr int kMaxPoints = 4096;
+
+  explicit AutomationPlayer(std::shared_ptr<const AutomationTable> table,
+                            int resolution = 32);
+
+  AutomationPlayer(const AutomationPlayer&) = delete;
+  AutomationPlayer& operator=(const AutomationPlayer&) = delete;
+
+  // GUI thread. Publishes an edited table for the next Render(). Lanes of
+  // the same parameter ramp from the value last sent to the new curve
+  // within `resolution` frames instead of jumping.
+  void SetTable(std::shared_ptr<const AutomationTable> table) {
+    table_.Publish(std::move(table));
+  }
+  // GUI thread. The last published table.
+  const std::shared_ptr<const AutomationTable>& table() const {
+    return table_.latest();
+  }
+
+  // Audio thread. Computes the points of the next `num_frames` for every
+  // lane and advances the playhead.
+  void Render(int num_frames);
+  // Audio thread. Points of plugin `plugin_index` from the last Render(),
+  // sorted by sample_offset.
+  void Changes(int plugin_index, const ParamChange** changes,
+               int* num_changes) const;
+
+  // Moves the playhead. Safe to call from any thread.
+  void Seek(int64_t frame) { seek_.store(frame, std::memory_order_relaxed); }
+  int64_t position() const {
+    return position_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct LaneState {
+    int plugin_index = 0;
+    Steinberg::Vst::ParamID param_id = 0;
+    int segment = 0;       // Hint for the segment at the playhead.
+    double last = -1;      // Value sent last, or -1 before the first.
+    bool ramp_in = false;  // Ramp from `last` after a table swap.
+  };
+  struct Span {
+    int plugin_index;
+    int begin;
+    int end;
+  };
+
+  // Carries the state of lanes of the same parameter over to `table`.
+  void Swap(const AutomationTable& table);
+  // Appends the points of `lane` for [position, position + num_frames).
+  void RenderLane(const AutomationTable::Lane& lane, LaneState& state,
+                  int64_t position, int num_frames);
+  void AddPoint(const AutomationTable::Lane& lane, LaneState& state,
+                int offset, double value);
+
+  const int resolution_;
+  Published<AutomationTable> table_;
+  std::atomic<int64_t> position_ = 0;
+  std::atomic<int64_t> seek_ = -1;
+
+  // Audio thread. Preallocated for kMaxLanes.
+  std::vector<LaneState> states_;  // Parallel to the lanes of the table.
+  std::vector<LaneState> old_states_;
+  int num_lanes_ = 0;
+  std::vector<ParamChange> points_;  // kMaxPoints.
+  int num_points_ = 0;
+  int last_offset_ = -1;  // Of the last point of the current lane.
+  std::vector<Span> spans_;
+  int num_spans_ = 0;
+};
+
+}  // namespace kodo
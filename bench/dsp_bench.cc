@@ -0,0 +1,128 @@
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "dsp.h"
+
+namespace kodo {
+namespace {
+
+// Arguments: block size, then 1 for ScalarDsp() or 0 for Dsp().
+const DspKernels& Kernels(const benchmark::State& state) {
+  return state.range(1) ? ScalarDsp() : Dsp();
+}
+
+void DspArgs(benchmark::internal::Benchmark* b) {
+  for (int64_t n : {64, 256, 1024, 4096}) {
+    b->Args({n, 0});
+    b->Args({n, 1});
+  }
+}
+
+void BM_Add(benchmark::State& state) {
+  const DspKernels& dsp = Kernels(state);
+  const int n = state.range(0);
+  std::vector<float> src(n, 0.5f), dst(n, 0.0f);
+  for (auto _ : state) {
+    dsp.add(src.data(), dst.data(), n);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetLabel(dsp.name);
+  state.SetBytesProcessed(state.iterations() * n * 3 * sizeof(float));
+}
+BENCHMARK(BM_Add)->Apply(DspArgs);
+
+void BM_AddRamp(benchmark::State& state) {
+  const DspKernels& dsp = Kernels(state);
+  const int n = state.range(0);
+  std::vector<float> src(n, 0.5f), dst(n, 0.0f);
+  for (auto _ : state) {
+    dsp.add_ramp(src.data(), 0.25f, 0.75f, dst.data(), n);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetLabel(dsp.name);
+  state.SetBytesProcessed(state.iterations() * n * 3 * sizeof(float));
+}
+BENCHMARK(BM_AddRamp)->Apply(DspArgs);
+
+void BM_Scale(benchmark::State& state) {
+  const DspKernels& dsp = Kernels(state);
+  const int n = state.range(0);
+  std::vector<float> x(n, 0.5f);
+  for (auto _ : state) {
+    dsp.scale(x.data(), 1.0f, n);
+    benchmark::DoNotOptimize(x.data());
+  }
+  state.SetLabel(dsp.name);
+  state.SetBytesProcessed(state.iterations() * n * 2 * sizeof(float));
+}
+BENCHMARK(BM_Scale)->Apply(DspArgs);
+
+void BM_Dot(benchmark::State& state) {
+  const DspKernels& dsp = Kernels(state);
+  const int n = state.range(0);
+  std::vector<float> a(n, 0.5f), b(n, 0.25f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dsp.dot(a.data(), b.data(), n));
+  }
+  state.SetLabel(dsp.name);
+  state.SetBytesProcessed(state.iterations() * n * 2 * sizeof(float));
+}
+BENCHMARK(BM_Dot)->Apply(DspArgs);
+
+void BM_MaxAbs(benchmark::State& state) {
+  const DspKernels& dsp = Kernels(state);
+  const int n = state.range(0);
+  std::vector<float> x(n, -0.5f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dsp.max_abs(x.data(), n));
+  }
+  state.SetLabel(dsp.name);
+  state.SetBytesProcessed(state.iterations() * n * sizeof(float));
+}
+BENCHMARK(BM_MaxAbs)->Apply(DspArgs);
+
+void BM_FloatToInt16(benchmark::State& state) {
+  const DspKernels& dsp = Kernels(state);
+  const int n = state.range(0);
+  std::vector<float> src(n, 0.5f);
+  std::vector<int16_t> dst(n);
+  for (auto _ : state) {
+    dsp.float_to_int16(src.data(), dst.data(), n);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetLabel(dsp.name);
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_FloatToInt16)->Apply(DspArgs);
+
+void BM_FloatToInt24(benchmark::State& state) {
+  const DspKernels& dsp = Kernels(state);
+  const int n = state.range(0);
+  std::vector<float> src(n, 0.5f);
+  std::vector<uint8_t> dst(3 * n);
+  for (auto _ : state) {
+    dsp.float_to_int24(src.data(), dst.data(), n);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetLabel(dsp.name);
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_FloatToInt24)->Apply(DspArgs);
+
+void BM_Interleave(benchmark::State& state) {
+  const DspKernels& dsp = Kernels(state);
+  const int n = state.range(0);
+  std::vector<float> left(n, 0.5f), right(n, -0.5f), dst(2 * n);
+  const float* src[] = {left.data(), right.data()};
+  for (auto _ : state) {
+    dsp.interleave(src, 2, n, dst.data());
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetLabel(dsp.name);
+  state.SetItemsProcessed(state.iterations() * 2 * n);
+}
+BENCHMARK(BM_Interleave)->Apply(DspArgs);
+
+}  // namespace
+}  // namespace kodo
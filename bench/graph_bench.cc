@@ -0,0 +1,58 @@
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/statusor.h"
+#include "bench/null_plugin.h"
+#include "benchmark/benchmark.h"
+#include "graph_scheduler.h"
+#include "render_graph.h"
+
+namespace kodo {
+namespace {
+
+constexpr int kBlockSize = 128;
+constexpr int kChannels = 2;
+
+// Tracks of one NullPlugin each, summed into a master node, rendered one
+// audio callback per iteration. Arguments: nodes including the master,
+// scheduler workers, and multiply-adds per frame in every plugin.
+void BM_RenderGraph(benchmark::State& state) {
+  const int num_nodes = state.range(0);
+  const int num_workers = state.range(1);
+  std::vector<std::unique_ptr<NullPlugin>> plugins;
+  std::vector<RenderNodeSpec> specs(num_nodes);
+  for (int i = 0; i < num_nodes; ++i) {
+    plugins.push_back(std::make_unique<NullPlugin>(state.range(2)));
+    CHECK_OK(plugins.back()->SetActive(true));
+    specs[i].name = "Track";
+    specs[i].chain = {plugins.back().get()};
+    specs[i].output = i == num_nodes - 1 ? -1 : num_nodes - 1;
+  }
+  RenderGraphOptions options;
+  options.num_channels = kChannels;
+  options.max_block_size = kBlockSize;
+  absl::StatusOr<std::unique_ptr<RenderGraph>> graph =
+      RenderGraph::Create(std::move(specs), options);
+  CHECK_OK(graph);
+  std::unique_ptr<GraphScheduler> scheduler =
+      GraphScheduler::Create(num_workers);
+  GraphRenderer renderer(std::move(*graph), scheduler.get());
+
+  std::vector<float> output(kChannels * kBlockSize);
+  float* channels[] = {output.data(), output.data() + kBlockSize};
+  for (auto _ : state) {
+    renderer.Render(channels, kChannels, kBlockSize);
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * num_nodes);
+}
+BENCHMARK(BM_RenderGraph)
+    ->ArgNames({"nodes", "workers", "work"})
+    ->ArgsProduct({{1, 16, 64, 256, 1024}, {0, 1, 3}, {0}})
+    ->ArgsProduct({{16, 256}, {0, 1, 3}, {64}})
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace kodo
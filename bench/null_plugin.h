@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+
+#include "absl/status/status.h"
+#include "plugin_vst3.h"
+
+namespace kodo {
+
+// Plugin that copies its input to its output, so benchmarks measure what
+// the engine spends around Process() without a VST3 installed. It can also
+// burn a fixed number of multiply-adds per frame to stand in for real work.
+class NullPlugin : public Plugin {
+ public:
+  explicit NullPlugin(int work_per_frame = 0, int latency = 0)
+      : work_per_frame_(work_per_frame), latency_(latency) {}
+
+  std::string name() const override { return "Null"; }
+  absl::Status Render(void* window_handle) override {
+    return absl::UnimplementedError("NullPlugin has no editor.");
+  }
+  absl::Status SetupProcessing(const ProcessSetup& setup) override {
+    return absl::OkStatus();
+  }
+  absl::Status SetActive(bool active) override {
+    active_ = active;
+    return absl::OkStatus();
+  }
+  int num_inputs() const override { return 2; }
+  int num_outputs() const override { return 2; }
+  int latency() const override { return latency_; }
+
+  bool Process(const AudioBlock& block) override {
+    if (!active_) return false;
+    const int channels = std::min(block.num_inputs, block.num_outputs);
+    for (int c = 0; c < channels; ++c) {
+      const float* in = block.inputs[c];
+      float* out = block.outputs[c];
+      for (int i = 0; i < block.num_frames; ++i) {
+        float x = in[i];
+        for (int k = 0; k < work_per_frame_; ++k) x = x * 0.999f + 1e-6f;
+        out[i] = x;
+      }
+    }
+    return true;
+  }
+
+ private:
+  const int work_per_frame_;
+  const int latency_;
+  bool active_ = false;
+};
+
+}  // namespace kodo
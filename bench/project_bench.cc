@@ -0,0 +1,92 @@
+#include <cstdint>
+#include <string>
+
+#include "absl/log/check.h"
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "google/protobuf/arena.h"
+#include "kodo.pb.h"
+
+namespace kodo {
+namespace {
+
+// A project of `num_tracks` tracks, each with a few plugins holding state
+// blobs, audio clips, a note clip and automation, like a large session.
+Project LargeProject(int num_tracks) {
+  Project project;
+  project.set_name("Benchmark");
+  int64_t plugin_id = 0;
+  for (int t = 0; t < num_tracks; ++t) {
+    Track* track = project.add_tracks();
+    track->set_name(absl::StrCat("Track ", t));
+    for (int p = 0; p < 4; ++p) {
+      PluginInstance* plugin = track->add_plugins();
+      plugin->set_id(++plugin_id);
+      plugin->set_path("/usr/lib/vst3/Null.vst3");
+      plugin->set_component_state(std::string(4096, 'c'));
+      plugin->set_controller_state(std::string(1024, 'e'));
+    }
+    for (int c = 0; c < 32; ++c) {
+      AudioClip* clip = track->add_audio_clips();
+      clip->set_path(absl::StrCat("/media/take_", t, "_", c, ".wav"));
+      clip->set_start(c * 96000);
+      clip->set_length(96000);
+    }
+    NoteClip* notes = track->add_note_clips();
+    notes->set_length(int64_t{1000} * 12000);
+    for (int n = 0; n < 1000; ++n) {
+      notes->add_note_start(n * 12000);
+      notes->add_note_length(6000);
+      notes->add_pitch(36 + n % 48);
+      notes->add_velocity(0.8f);
+    }
+    AutomationLane* lane = track->add_automation();
+    lane->set_plugin_id(plugin_id);
+    for (int a = 0; a < 256; ++a) {
+      lane->add_time(a * 4800);
+      lane->add_value((a % 16) / 15.0);
+      lane->add_curve(AutomationLane::LINEAR);
+    }
+  }
+  return project;
+}
+
+void BM_ProjectSerialize(benchmark::State& state) {
+  const Project project = LargeProject(state.range(0));
+  std::string bytes;
+  for (auto _ : state) {
+    CHECK(project.SerializeToString(&bytes));
+    benchmark::DoNotOptimize(bytes.data());
+  }
+  state.SetBytesProcessed(state.iterations() * bytes.size());
+}
+BENCHMARK(BM_ProjectSerialize)->Arg(16)->Arg(128)->Arg(512);
+
+void BM_ProjectParse(benchmark::State& state) {
+  std::string bytes;
+  CHECK(LargeProject(state.range(0)).SerializeToString(&bytes));
+  for (auto _ : state) {
+    Project project;
+    CHECK(project.ParseFromString(bytes));
+    benchmark::DoNotOptimize(project);
+  }
+  state.SetBytesProcessed(state.iterations() * bytes.size());
+}
+BENCHMARK(BM_ProjectParse)->Arg(16)->Arg(128)->Arg(512);
+
+// How main.cc loads projects.
+void BM_ProjectParseArena(benchmark::State& state) {
+  std::string bytes;
+  CHECK(LargeProject(state.range(0)).SerializeToString(&bytes));
+  for (auto _ : state) {
+    google::protobuf::Arena arena;
+    Project* project = google::protobuf::Arena::Create<Project>(&arena);
+    CHECK(project->ParseFromString(bytes));
+    benchmark::DoNotOptimize(project);
+  }
+  state.SetBytesProcessed(state.iterations() * bytes.size());
+}
+BENCHMARK(BM_ProjectParseArena)->Arg(16)->Arg(128)->Arg(512);
+
+}  // namespace
+}  // namespace kodo
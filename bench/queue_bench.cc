@@ -0,0 +1,80 @@
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "benchmark/benchmark.h"
+#include "param_changes.h"
+#include "spsc_queue.h"
+#include "work_stealing_queue.h"
+
+namespace kodo {
+namespace {
+
+void BM_SpscPushPop(benchmark::State& state) {
+  ParamChangeQueue queue;
+  ParamChange change{1, 0.5, 0};
+  for (auto _ : state) {
+    queue.Push(change);
+    queue.Pop(&change);
+    benchmark::DoNotOptimize(change);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpscPushPop);
+
+// Round trip through two queues and an echo thread, i.e. twice the latency
+// of a hand-off between cores.
+void BM_SpscRoundTrip(benchmark::State& state) {
+  SpscQueue<int64_t, 1024> ping;
+  SpscQueue<int64_t, 1024> pong;
+  std::atomic<bool> quit = false;
+  std::thread echo([&] {
+    int64_t value;
+    while (!quit.load(std::memory_order_relaxed)) {
+      if (ping.Pop(&value)) {
+        while (!pong.Push(value)) {
+        }
+      }
+    }
+  });
+  int64_t value = 0;
+  for (auto _ : state) {
+    while (!ping.Push(value)) {
+    }
+    while (!pong.Pop(&value)) {
+    }
+    ++value;
+  }
+  quit.store(true);
+  echo.join();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpscRoundTrip)->UseRealTime();
+
+// Owner-side push and pop, the path of every node a worker makes ready.
+void BM_WorkStealingPushPop(benchmark::State& state) {
+  WorkStealingQueue queue(4096);
+  int32_t task = 0;
+  for (auto _ : state) {
+    queue.Push(task);
+    queue.Pop(&task);
+    benchmark::DoNotOptimize(task);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WorkStealingPushPop);
+
+void BM_WorkStealingSteal(benchmark::State& state) {
+  WorkStealingQueue queue(4096);
+  int32_t task = 0;
+  for (auto _ : state) {
+    queue.Push(task);
+    queue.Steal(&task);
+    benchmark::DoNotOptimize(task);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WorkStealingSteal);
+
+}  // namespace
+}  // namespace kodo
@@ -0,0 +1,53 @@
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "kodo/platform/linux/runloop.h"
+
+namespace kodo {
+namespace {
+
+// Far enough ahead never to fire during a benchmark.
+constexpr TimerInterval kIdleInterval = 3'600'000;
+
+// One due timer among `n` idle ones, the way editors schedule one-shot
+// work: register, dispatch, unregister from its own callback.
+void BM_TimerDispatch(benchmark::State& state) {
+  TimerProcessor timers;
+  for (int i = 0; i < state.range(0); ++i) {
+    timers.registerTimer(kIdleInterval, [](TimerID) {});
+  }
+  int64_t fired = 0;
+  for (auto _ : state) {
+    timers.registerTimer(0, [&](TimerID id) {
+      ++fired;
+      timers.unregisterTimer(id);
+    });
+    timers.handleTimers();
+  }
+  state.SetItemsProcessed(fired);
+}
+BENCHMARK(BM_TimerDispatch)->RangeMultiplier(8)->Range(1, 32768);
+
+// `n` timers due at once on the same wake-up.
+void BM_TimerBurst(benchmark::State& state) {
+  TimerProcessor timers;
+  std::vector<TimerID> ids(state.range(0));
+  int64_t fired = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (TimerID& id : ids) {
+      id = timers.registerTimer(0, [&](TimerID) { ++fired; });
+    }
+    state.ResumeTiming();
+    timers.handleTimers();
+    state.PauseTiming();
+    for (TimerID id : ids) timers.unregisterTimer(id);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(fired);
+}
+BENCHMARK(BM_TimerBurst)->RangeMultiplier(8)->Range(8, 32768);
+
+}  // namespace
+}  // namespace kodo
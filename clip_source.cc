@@ -0,0 +1,311 @@
+#include "clip_source.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "dsp.h"
+#include "perf_counters.h"
+#include "resampler.h"
+#include "trace.h"
+
+namespace kodo {
+
+ClipStream::ClipStream(std::unique_ptr<AudioFileReader> reader,
+                       int64_t capacity_frames)
+    : reader_(std::move(reader)),
+      capacity_(capacity_frames),
+      ring_(reader_->num_channels(), std::vector<float>(capacity_frames)),
+      scratch_(reader_->num_channels()) {}
+
+bool ClipStream::Read(int64_t frame, int num_frames, float* const* outputs,
+                      int num_channels) {
+  const int64_t available = std::clamp<int64_t>(
+      reader_->num_frames() - frame, 0, num_frames);
+  const uint32_t generation = generation_.load(std::memory_order_acquire);
+  const int64_t begin = begin_.load(std::memory_order_acquire);
+  const int64_t end = end_.load(std::memory_order_acquire);
+  auto underrun = [&]() {
+    for (int c = 0; c < num_channels; ++c) {
+      std::fill_n(outputs[c], num_frames, 0.0f);
+    }
+    underruns_.fetch_add(1, std::memory_order_relaxed);
+    read_pos_.store(frame + num_frames, std::memory_order_release);
+    return false;
+  };
+  if ((generation & 1) ||
+      (available > 0 && (frame < begin || frame + available > end))) {
+    return underrun();
+  }
+
+  const int file_channels = ring_.size();
+  const int64_t index = frame % capacity_;
+  const int64_t first = std::min(available, capacity_ - index);
+  for (int c = 0; c < num_channels; ++c) {
+    // Mono files play on every channel.
+    const float* src = file_channels == 1 ? ring_[0].data()
+                       : c < file_channels ? ring_[c].data()
+                                           : nullptr;
+    if (src == nullptr) {
+      std::fill_n(outputs[c], num_frames, 0.0f);
+      continue;
+    }
+    std::copy_n(src + index, first, outputs[c]);
+    std::copy_n(src, available - first, outputs[c] + first);
+    std::fill_n(outputs[c] + available, num_frames - available, 0.0f);
+  }
+
+  // A seek restarted the ring while copying; the frames may be torn.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (generation_.load(std::memory_order_relaxed) != generation) {
+    return underrun();
+  }
+  read_pos_.store(frame + num_frames, std::memory_order_release);
+  return true;
+}
+
+absl::StatusOr<int64_t> ClipStream::Fill(int64_t max_frames) {
+  const int64_t read_pos = read_pos_.load(std::memory_order_acquire);
+  int64_t begin = begin_.load(std::memory_order_relaxed);
+  int64_t end = end_.load(std::memory_order_relaxed);
+
+  const bool seek = read_pos < begin || read_pos > end;
+  if (seek) {
+    // Drop everything and decode from the new position.
+    generation_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    begin = end = read_pos;
+    begin_.store(begin, std::memory_order_relaxed);
+    end_.store(end, std::memory_order_relaxed);
+  } else if (read_pos > begin) {
+    // Frames before read_pos are consumed; their slots are free again.
+    begin = read_pos;
+    begin_.store(begin, std::memory_order_release);
+  }
+
+  const int64_t target =
+      std::min(begin + capacity_, reader_->num_frames());
+  int64_t n = std::clamp<int64_t>(target - end, 0, max_frames);
+  absl::Status status;
+  int64_t decoded = 0;
+  while (n > 0 && status.ok()) {
+    const int64_t index = end % capacity_;
+    const int chunk = std::min(n, capacity_ - index);
+    for (int c = 0; c < ring_.size(); ++c) {
+      scratch_[c] = ring_[c].data() + index;
+    }
+    status = reader_->Read(end, chunk, scratch_.data());
+    if (status.ok()) {
+      end += chunk;
+      decoded += chunk;
+      n -= chunk;
+    }
+  }
+  end_.store(end, std::memory_order_release);
+  if (seek) generation_.fetch_add(1, std::memory_order_release);
+  if (!status.ok()) return status;
+  return decoded;
+}
+
+std::unique_ptr<ClipPrefetcher> ClipPrefetcher::Create(
+    const ClipPrefetcherOptions& options) {
+  std::unique_ptr<ClipPrefetcher> ret(new ClipPrefetcher(options));
+  if (options.background) {
+    ret->thread_ = std::thread(&ClipPrefetcher::Loop, ret.get());
+  }
+  return ret;
+}
+
+ClipPrefetcher::~ClipPrefetcher() {
+  {
+    absl::MutexLock lock(&mu_);
+    quit_ = true;
+  }
+  if (thread_.joinable()) thread_.join();
+}
+
+absl::StatusOr<ClipStream*> ClipPrefetcher::Open(const std::string& path) {
+  absl::StatusOr<std::unique_ptr<AudioFileReader>> reader = OpenAudioFile(path);
+  if (!reader.ok()) return reader.status();
+  if (options_.sample_rate > 0 &&
+      (*reader)->sample_rate() != options_.sample_rate) {
+    reader = ResampleAudioFile(std::move(*reader), options_.sample_rate,
+                               options_.resampler_quality);
+    if (!reader.ok()) return reader.status();
+  }
+
+  const int64_t capacity = std::max<int64_t>(
+      options_.lookahead_seconds * (*reader)->sample_rate(),
+      options_.chunk_frames);
+  const int64_t bytes = capacity * (*reader)->num_channels() * sizeof(float);
+  absl::MutexLock lock(&mu_);
+  if (memory_bytes_ + bytes > options_.max_memory_bytes) {
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "Streaming ", path, " needs ", bytes, " bytes over the budget ",
+        options_.max_memory_bytes));
+  }
+  memory_bytes_ += bytes;
+  streams_.push_back(
+      std::make_unique<ClipStream>(std::move(*reader), capacity));
+  return streams_.back().get();
+}
+
+void ClipPrefetcher::Close(ClipStream* stream) {
+  absl::MutexLock lock(&mu_);
+  // Loop() may be filling it outside the lock. It moves on to the next
+  // stream rather than going idle while any stream decodes.
+  const auto filled = [this, stream]() ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    return filling_ != stream;
+  };
+  mu_.Await(absl::Condition(&filled));
+  auto it = std::find_if(
+      streams_.begin(), streams_.end(),
+      [&](const std::unique_ptr<ClipStream>& s) { return s.get() == stream; });
+  if (it == streams_.end()) return;
+  memory_bytes_ -= (*it)->capacity_frames() *
+                   (*it)->reader().num_channels() * sizeof(float);
+  streams_.erase(it);
+}
+
+int64_t ClipPrefetcher::memory_bytes() const {
+  absl::MutexLock lock(&mu_);
+  return memory_bytes_;
+}
+
+void ClipPrefetcher::Loop() {
+  TraceThread trace_thread("Clip prefetch");
+  absl::MutexLock lock(&mu_);
+  while (!quit_) {
+    // Round-robin in chunks, so one long clip does not starve the others.
+    int64_t decoded = 0;
+    for (size_t i = 0; i < streams_.size() && !quit_; ++i) {
+      // Reads the disk without the lock, so Open() and Close() of other
+      // streams on the GUI thread never wait for it.
+      ClipStream* stream = filling_ = streams_[i].get();
+      mu_.Unlock();
+      const uint64_t start = CycleCount();
+      absl::StatusOr<int64_t> n = stream->Fill(options_.chunk_frames);
+      // Full rings return at once; only reads make it to traces.
+      if (n.ok() && *n > 0 && TracingEnabled()) {
+        AddTraceEvent("Prefetch", start, CycleCount());
+      }
+      mu_.Lock();
+      filling_ = nullptr;
+      if (n.ok()) {
+        decoded += *n;
+      } else {
+        LOG_EVERY_N_SEC(ERROR, 1) << n.status();
+      }
+    }
+    // Idle: every ring is full. Sleep a little unless asked to quit.
+    if (decoded == 0) {
+      mu_.AwaitWithTimeout(absl::Condition(&quit_), absl::Milliseconds(2));
+    }
+  }
+}
+
+ClipPlayer::ClipPlayer(std::vector<Clip> clips, int max_block_size,
+                       bool synchronous)
+    : clips_(std::move(clips)),
+      scratch_(kMaxChannels * max_block_size),
+      max_block_size_(max_block_size),
+      synchronous_(synchronous) {
+  for (const Clip& clip : clips_) clip.stream->Cue(clip.offset);
+}
+
+void ClipPlayer::Render(float* const* outputs, int num_channels,
+                        int num_frames) {
+  for (int c = 0; c < num_channels; ++c) {
+    std::fill_n(outputs[c], num_frames, 0.0f);
+  }
+
+  int64_t position = position_.load(std::memory_order_relaxed);
+  if (int64_t seek = seek_.exchange(-1, std::memory_order_relaxed);
+      seek >= 0) {
+    position = seek;
+    // Let the prefetcher jump to where each remaining clip resumes.
+    for (const Clip& clip : clips_) {
+      if (position < clip.start + clip.length) {
+        clip.stream->Cue(clip.offset +
+                         std::max<int64_t>(position - clip.start, 0));
+      }
+    }
+  }
+
+  float* block[kMaxChannels];
+  for (int c = 0; c < num_channels; ++c) {
+    block[c] = scratch_.data() + c * max_block_size_;
+  }
+  for (const Clip& clip : clips_) {
+    const int64_t from = std::max(position, clip.start);
+    const int64_t to =
+        std::min(position + num_frames, clip.start + clip.length);
+    if (from >= to) continue;
+    const int n = to - from;
+    if (synchronous_) {
+      if (absl::StatusOr<int64_t> filled =
+              clip.stream->Fill(clip.stream->capacity_frames());
+          !filled.ok()) {
+        LOG_EVERY_N_SEC(ERROR, 1) << filled.status();
+      }
+    }
+    clip.stream->Read(clip.offset + (from - clip.start), n, block,
+                      num_channels);
+    for (int c = 0; c < num_channels; ++c) {
+      Dsp().add(block[c], outputs[c] + (from - position), n);
+    }
+  }
+  position_.store(position + num_frames, std::memory_order_relaxed);
+}
+
+int64_t ClipPlayer::end() const {
+  int64_t end = 0;
+  for (const Clip& clip : clips_) {
+    end = std::max(end, clip.start + clip.length);
+  }
+  return end;
+}
+
+absl::StatusOr<std::unique_ptr<ClipPlayer>> CreateTrackPlayer(
+    const Track& track, ClipPrefetcher& prefetcher, int max_block_size) {
+  if (track.has_freeze()) {
+    // The rendering of everything on the track, from the timeline start.
+    Track frozen;
+    frozen.add_audio_clips()->set_path(track.freeze().path());
+    return CreateTrackPlayer(frozen, prefetcher, max_block_size);
+  }
+  if (track.audio_clips().empty()) return nullptr;
+  std::vector<Clip> clips;
+  auto close = [&]() {
+    for (const Clip& clip : clips) prefetcher.Close(clip.stream);
+  };
+  for (const AudioClip& audio_clip : track.audio_clips()) {
+    absl::StatusOr<ClipStream*> stream = prefetcher.Open(audio_clip.path());
+    if (!stream.ok()) {
+      close();
+      return stream.status();
+    }
+    Clip clip;
+    clip.stream = *stream;
+    clip.start = audio_clip.start();
+    clip.offset = audio_clip.offset();
+    clip.length = audio_clip.has_length()
+                      ? audio_clip.length()
+                      : (*stream)->reader().num_frames() - clip.offset;
+    clips.push_back(clip);
+  }
+  return std::make_unique<ClipPlayer>(std::move(clips), max_block_size,
+                                      !prefetcher.background());
+}
+
+}  // namespace kodo
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "audio_engine.h"
+#include "audio_file.h"
+#include "kodo.pb.h"
+#include "resampler.h"
+
+namespace kodo {
+
+// Decoded frames of one audio file, streamed ahead of the playback position.
+// A single prefetch thread calls Fill() and a single audio thread calls
+// Read(); they share only a fixed ring and a few atomics.
+class ClipStream {
+ public:
+  ClipStream(std::unique_ptr<AudioFileReader> reader, int64_t capacity_frames);
+
+  ClipStream(const ClipStream&) = delete;
+  ClipStream& operator=(const ClipStream&) = delete;
+
+  // Audio thread. Copies file frames [frame, frame + num_frames) into
+  // `outputs[num_channels]`, padding past the end of the file with silence.
+  // Returns false and writes silence if they are not decoded yet; the next
+  // Fill() then restarts decoding from where the reader is heading.
+  bool Read(int64_t frame, int num_frames, float* const* outputs,
+            int num_channels);
+
+  // Tells Fill() where the next Read() will start, e.g. the first frame of a
+  // clip or after a seek. Real-time safe.
+  void Cue(int64_t frame) {
+    read_pos_.store(frame, std::memory_order_release);
+  }
+
+  // Prefetch thread. Decodes up to `max_frames` ahead of the last Read().
+  // Returns the number of frames decoded.
+  absl::StatusOr<int64_t> Fill(int64_t max_frames);
+
+  const AudioFileReader& reader() const { return *reader_; }
+  int64_t capacity_frames() const { return capacity_; }
+  // Number of Read() calls that found no decoded frames.
+  uint64_t underruns() const {
+    return underruns_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::unique_ptr<AudioFileReader> reader_;
+  const int64_t capacity_;
+  // Frame f of the file lives at (f % capacity_) of each channel.
+  std::vector<std::vector<float>> ring_;
+  std::vector<float*> scratch_;
+
+  // The ring holds file frames [begin_, end_), written by Fill() only.
+  std::atomic<int64_t> begin_ = 0;
+  std::atomic<int64_t> end_ = 0;
+  // Frame the audio thread will read next, written by Read() and Cue().
+  std::atomic<int64_t> read_pos_ = 0;
+  // Odd while Fill() restarts the ring after a seek, like a seqlock.
+  std::atomic<uint32_t> generation_ = 0;
+  std::atomic<uint64_t> underruns_ = 0;
+};
+
+struct ClipPrefetcherOptions {
+  // Seconds decoded ahead of the playback position, per clip.
+  double lookahead_seconds = 4;
+  // Bound of all ring buffers together. Open() fails past it.
+  int64_t max_memory_bytes = int64_t{1} << 30;
+  // Frames decoded per clip before moving to the next one.
+  int chunk_frames = 16384;
+  // Runs the prefetch thread. Without it, streams are only filled by
+  // synchronous ClipPlayers, e.g. for offline rendering.
+  bool background = true;
+  // Files at other rates are converted to this one while decoding. 0 keeps
+  // the rate of each file.
+  double sample_rate = 0;
+  ResamplerQuality resampler_quality = ResamplerQuality::kStandard;
+};
+
+// Owns every ClipStream and a background thread keeping them filled.
+class ClipPrefetcher {
+ public:
+  static std::unique_ptr<ClipPrefetcher> Create(
+      const ClipPrefetcherOptions& options);
+
+  // Joins the thread.
+  ~ClipPrefetcher();
+
+  bool background() const { return options_.background; }
+
+  // Opens an audio file for streaming. The stream lives until Close().
+  absl::StatusOr<ClipStream*> Open(const std::string& path)
+      ABSL_LOCKS_EXCLUDED(mu_);
+  // Call after no renderer reads `stream` anymore.
+  void Close(ClipStream* stream) ABSL_LOCKS_EXCLUDED(mu_);
+
+  int64_t memory_bytes() const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  explicit ClipPrefetcher(const ClipPrefetcherOptions& options)
+      : options_(options) {}
+
+  void Loop();
+
+  const ClipPrefetcherOptions options_;
+  mutable absl::Mutex mu_;
+  std::vector<std::unique_ptr<ClipStream>> streams_ ABSL_GUARDED_BY(mu_);
+  // The stream Loop() fills outside `mu_`, which Close() waits for.
+  ClipStream* filling_ ABSL_GUARDED_BY(mu_) = nullptr;
+  int64_t memory_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+  bool quit_ ABSL_GUARDED_BY(mu_) = false;
+  std::thread thread_;
+};
+
+// A clip placed on the timeline.
+struct Clip {
+  ClipStream* stream = nullptr;  // Borrowed from ClipPrefetcher.
+  int64_t start = 0;             // Timeline frame where the clip begins.
+  int64_t offset = 0;            // First file frame played.
+  int64_t length = 0;            // Frames played.
+};
+
+// Track source playing clips along its own playhead. Every clip needs its
+// own stream, as a stream follows a single read position.
+class ClipPlayer : public AudioRenderer {
+ public:
+  // A `synchronous` player decodes its streams itself before reading them,
+  // which blocks on the disk but never underruns. Only for offline rendering
+  // without a prefetch thread.
+  ClipPlayer(std::vector<Clip> clips, int max_block_size,
+             bool synchronous = false);
+
+  // `num_frames` must not exceed max_block_size.
+  void Render(float* const* outputs, int num_channels,
+              int num_frames) override;
+
+  // Moves the playhead. Safe to call from any thread.
+  void Seek(int64_t frame) { seek_.store(frame, std::memory_order_relaxed); }
+  int64_t position() const {
+    return position_.load(std::memory_order_relaxed);
+  }
+  // Timeline frame where the last clip ends.
+  int64_t end() const;
+
+ private:
+  static constexpr int kMaxChannels = AudioEngine::kMaxChannels;
+
+  std::vector<Clip> clips_;
+  std::vector<float> scratch_;  // kMaxChannels * max_block_size.
+  int max_block_size_;
+  bool synchronous_;
+  std::atomic<int64_t> position_ = 0;
+  std::atomic<int64_t> seek_ = -1;
+};
+
+// Opens a stream for every audio clip of `track` and plays them, or returns
+// nullptr if it has none. Clips without a length play to the end of the file.
+// A frozen track plays its Freeze file instead.
+absl::StatusOr<std::unique_ptr<ClipPlayer>> CreateTrackPlayer(
+    const Track& track, ClipPrefetcher& prefetcher, int max_block_size);
+
+}  // namespace kodo
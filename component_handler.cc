@@ -0,0 +1,58 @@
+#include "component_handler.h"
+
+#include "base/source/fdebug.h"
+#include "pluginterfaces/base/funknown.h"
+
+namespace kodo {
+
+using Steinberg::tresult;
+
+tresult PLUGIN_API ComponentHandler::beginEdit(Steinberg::Vst::ParamID id) {
+  SMTG_DBPRT1("beginEdit called (%d)\n", id);
+  return Steinberg::kResultOk;
+}
+
+tresult PLUGIN_API ComponentHandler::performEdit(
+    Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue valueNormalized) {
+  SMTG_DBPRT2("performEdit called (%d, %f)\n", id, valueNormalized);
+  // Edits from the editor have no timing, so apply them at the block start.
+  if (queue_ && !queue_->Push({id, valueNormalized, /*sample_offset=*/0})) {
+    return Steinberg::kResultFalse;
+  }
+  if (state_changed_) state_changed_();
+  return Steinberg::kResultOk;
+}
+
+tresult PLUGIN_API ComponentHandler::endEdit(Steinberg::Vst::ParamID id) {
+  SMTG_DBPRT1("endEdit called (%d)\n", id);
+  return Steinberg::kResultOk;
+}
+
+tresult PLUGIN_API ComponentHandler::restartComponent(Steinberg::int32 flags) {
+  SMTG_DBPRT1("restartComponent called (%d)\n", flags);
+  bool handled = false;
+  // Parameter values or the whole component changed, e.g. by a preset.
+  if (state_changed_) {
+    state_changed_();
+    handled = true;
+  }
+  if ((flags & Steinberg::Vst::kLatencyChanged) && latency_changed_) {
+    latency_changed_();
+    handled = true;
+  }
+  return handled ? Steinberg::kResultOk : Steinberg::kNotImplemented;
+}
+
+tresult PLUGIN_API ComponentHandler::queryInterface(const Steinberg::TUID _iid,
+                                                    void** obj) {
+  if (Steinberg::FUnknownPrivate::iidEqual(
+          _iid, Steinberg::Vst::IComponentHandler::iid) ||
+      Steinberg::FUnknownPrivate::iidEqual(_iid, Steinberg::FUnknown::iid)) {
+    *obj = this;
+    addRef();
+    return Steinberg::kResultTrue;
+  }
+  return Steinberg::kNoInterface;
+}
+
+}  // namespace kodo
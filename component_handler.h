@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <utility>
+
+#include "param_changes.h"
+#include "pluginterfaces/vst/ivsteditcontroller.h"
+
+namespace kodo {
+
+// Receives edits from a plug-in controller on the GUI thread and forwards
+// them to the audio thread through a wait-free queue.
+class ComponentHandler : public Steinberg::Vst::IComponentHandler {
+ public:
+  // `queue`, if set, must outlive this handler. Its consumer is the audio
+  // thread. Without one, edits are accepted and dropped, as by a host that
+  // processes no audio.
+  // `latency_changed` runs on the GUI thread when the plug-in reports a new
+  // latency, and `state_changed` after every edit and restart, e.g. when the
+  // editor loaded a preset.
+  explicit ComponentHandler(ParamChangeQueue* queue,
+                            std::function<void()> latency_changed = nullptr,
+                            std::function<void()> state_changed = nullptr)
+      : queue_(queue),
+        latency_changed_(std::move(latency_changed)),
+        state_changed_(std::move(state_changed)) {}
+
+  Steinberg::tresult PLUGIN_API
+  beginEdit(Steinberg::Vst::ParamID id) override;
+  Steinberg::tresult PLUGIN_API
+  performEdit(Steinberg::Vst::ParamID id,
+              Steinberg::Vst::ParamValue valueNormalized) override;
+  Steinberg::tresult PLUGIN_API endEdit(Steinberg::Vst::ParamID id) override;
+  Steinberg::tresult PLUGIN_API
+  restartComponent(Steinberg::int32 flags) override;
+
+ private:
+  Steinberg::tresult PLUGIN_API queryInterface(const Steinberg::TUID _iid,
+                                               void** obj) override;
+  // we do not care here of the ref-counting. A plug-in call of release should
+  // not destroy this class!
+  uint32_t PLUGIN_API addRef() override { return 1000; }
+  uint32_t PLUGIN_API release() override { return 1000; }
+
+  ParamChangeQueue* queue_;
+  std::function<void()> latency_changed_;
+  std::function<void()> state_changed_;
+};
+
+}  // namespace kodo
@@ -0,0 +1,108 @@
+#include "dsp.h"
+
+#include <cmath>
+#include <cstdint>
+
+#include "dsp_internal.h"
+
+namespace kodo {
+namespace {
+
+void Add(const float* src, float* dst, int n) {
+  for (int i = 0; i < n; ++i) dst[i] += src[i];
+}
+
+void AddScaled(const float* src, float gain, float* dst, int n) {
+  for (int i = 0; i < n; ++i) dst[i] += gain * src[i];
+}
+
+void AddRamp(const float* src, float from, float to, float* dst, int n) {
+  const float step = RampStep(from, to, n);
+  for (int i = 0; i < n; ++i) dst[i] += (from + step * float(i)) * src[i];
+}
+
+void Scale(float* x, float gain, int n) {
+  for (int i = 0; i < n; ++i) x[i] *= gain;
+}
+
+void ScaleRamp(float* x, float from, float to, int n) {
+  const float step = RampStep(from, to, n);
+  for (int i = 0; i < n; ++i) x[i] *= from + step * float(i);
+}
+
+float Dot(const float* a, const float* b, int n) {
+  float sum = 0;
+  for (int i = 0; i < n; ++i) sum += a[i] * b[i];
+  return sum;
+}
+
+float MaxAbs(const float* x, int n) {
+  float m = 0;
+  for (int i = 0; i < n; ++i) m = MaxAbsStep(m, x[i]);
+  return m;
+}
+
+void FloatToInt16(const float* src, int16_t* dst, int n) {
+  for (int i = 0; i < n; ++i) {
+    dst[i] = std::lrint(ClampUnit(src[i]) * kInt16Scale);
+  }
+}
+
+void Int16ToFloat(const int16_t* src, float* dst, int n) {
+  for (int i = 0; i < n; ++i) dst[i] = src[i] * (1.0f / 32768);
+}
+
+void FloatToInt24(const float* src, uint8_t* dst, int n) {
+  for (int i = 0; i < n; ++i) {
+    StoreInt24(std::lrint(ClampUnit(src[i]) * kInt24Scale), dst + 3 * i);
+  }
+}
+
+void Int24ToFloat(const uint8_t* src, float* dst, int n) {
+  for (int i = 0; i < n; ++i) {
+    dst[i] = LoadInt24(src + 3 * i) * (1.0f / 8388608);
+  }
+}
+
+void Interleave(const float* const* src, int num_channels, int n,
+                float* dst) {
+  for (int i = 0; i < n; ++i) {
+    for (int c = 0; c < num_channels; ++c) *dst++ = src[c][i];
+  }
+}
+
+void Deinterleave(const float* src, int num_channels, int n,
+                  float* const* dst) {
+  for (int i = 0; i < n; ++i) {
+    for (int c = 0; c < num_channels; ++c) dst[c][i] = *src++;
+  }
+}
+
+const DspKernels kScalar = {
+    "scalar",     Add,          AddScaled,    AddRamp,
+    Scale,        ScaleRamp,    Dot,          MaxAbs,
+    FloatToInt16, Int16ToFloat, FloatToInt24, Int24ToFloat,
+    Interleave,   Deinterleave,
+};
+
+const DspKernels* Detect() {
+#if defined(KODO_DSP_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return &Avx512Kernels();
+  if (__builtin_cpu_supports("avx2")) return &Avx2Kernels();
+#elif defined(KODO_DSP_NEON)
+  return &NeonKernels();
+#endif
+  return &kScalar;
+}
+
+}  // namespace
+
+const DspKernels& ScalarDsp() { return kScalar; }
+
+const DspKernels& Dsp() {
+  static const DspKernels* kernels = Detect();
+  return *kernels;
+}
+
+}  // namespace kodo
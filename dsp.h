@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+namespace kodo {
+
+// Inner loops of mixing, filtering and sample format conversion. Except for
+// dot(), every variant returns results bit-identical to ScalarDsp(): they
+// evaluate the same expressions lane by lane, without fused multiply-add. All
+// kernels are real-time safe and accept any alignment and any `n`, including
+// 0.
+struct DspKernels {
+  const char* name;
+
+  // dst[i] += src[i].
+  void (*add)(const float* src, float* dst, int n);
+  // dst[i] += gain * src[i].
+  void (*add_scaled)(const float* src, float gain, float* dst, int n);
+  // dst[i] += g(i) * src[i], where g(i) = from + (to - from) / n * i ramps
+  // linearly from `from` towards `to` over the block.
+  void (*add_ramp)(const float* src, float from, float to, float* dst, int n);
+  // x[i] *= gain.
+  void (*scale)(float* x, float gain, int n);
+  // x[i] *= g(i), with g(i) as in add_ramp.
+  void (*scale_ramp)(float* x, float from, float to, int n);
+  // Sum of a[i] * b[i], e.g. one FIR output. Variants sum in their own
+  // order, so the last bits may differ.
+  float (*dot)(const float* a, const float* b, int n);
+  // Largest |x[i]|, or 0 for n == 0, e.g. a peak meter. NaNs are skipped.
+  float (*max_abs)(const float* x, int n);
+
+  // Clamp to [-1, 1], then scale by 2^15 - 1 and round to nearest even.
+  void (*float_to_int16)(const float* src, int16_t* dst, int n);
+  // Scales by 2^-15.
+  void (*int16_to_float)(const int16_t* src, float* dst, int n);
+  // Packed little-endian 24-bit samples, as paInt24. Scale 2^23 - 1.
+  void (*float_to_int24)(const float* src, uint8_t* dst, int n);
+  // Scales by 2^-23.
+  void (*int24_to_float)(const uint8_t* src, float* dst, int n);
+
+  // dst[i * num_channels + c] = src[c][i].
+  void (*interleave)(const float* const* src, int num_channels, int n,
+                     float* dst);
+  // dst[c][i] = src[i * num_channels + c].
+  void (*deinterleave)(const float* src, int num_channels, int n,
+                       float* const* dst);
+};
+
+// Fastest kernels for this CPU, detected on the first call. Call it once
+// before starting the audio thread.
+const DspKernels& Dsp();
+
+// Portable reference implementation.
+const DspKernels& ScalarDsp();
+
+}  // namespace kodo
@@ -0,0 +1,389 @@
+// AVX2 and AVX-512 DspKernels, compiled with target attributes and picked by
+// Dsp() at run time.
+
+#include "dsp.h"
+#include "dsp_internal.h"
+
+#if defined(KODO_DSP_X86)
+
+#include <immintrin.h>
+
+#include <cmath>
+#include <cstdint>
+
+#define KODO_AVX2 __attribute__((target("avx2")))
+#define KODO_AVX512 __attribute__((target("avx512f")))
+
+namespace kodo {
+namespace {
+
+// Scalar tails, the same expressions as ScalarDsp().
+
+void AddTail(const float* src, float* dst, int i, int n) {
+  for (; i < n; ++i) dst[i] += src[i];
+}
+
+void AddScaledTail(const float* src, float gain, float* dst, int i, int n) {
+  for (; i < n; ++i) dst[i] += gain * src[i];
+}
+
+void AddRampTail(const float* src, float from, float step, float* dst, int i,
+                 int n) {
+  for (; i < n; ++i) dst[i] += (from + step * float(i)) * src[i];
+}
+
+void ScaleTail(float* x, float gain, int i, int n) {
+  for (; i < n; ++i) x[i] *= gain;
+}
+
+void ScaleRampTail(float* x, float from, float step, int i, int n) {
+  for (; i < n; ++i) x[i] *= from + step * float(i);
+}
+
+// AVX2, 8 lanes.
+
+KODO_AVX2 void Add2(const float* src, float* dst, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i),
+                                            _mm256_loadu_ps(src + i)));
+  }
+  AddTail(src, dst, i, n);
+}
+
+KODO_AVX2 void AddScaled2(const float* src, float gain, float* dst, int n) {
+  const __m256 g = _mm256_set1_ps(gain);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 x = _mm256_mul_ps(g, _mm256_loadu_ps(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), x));
+  }
+  AddScaledTail(src, gain, dst, i, n);
+}
+
+// The gain of each lane is recomputed from its index rather than
+// accumulated, which keeps it bit-exact and costs one extra mul and add per
+// vector over constant gain.
+KODO_AVX2 void AddRamp2(const float* src, float from, float to, float* dst,
+                        int n) {
+  const float step = RampStep(from, to, n);
+  const __m256 vfrom = _mm256_set1_ps(from);
+  const __m256 vstep = _mm256_set1_ps(step);
+  const __m256 eight = _mm256_set1_ps(8);
+  __m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 g = _mm256_add_ps(vfrom, _mm256_mul_ps(vstep, index));
+    const __m256 x = _mm256_mul_ps(g, _mm256_loadu_ps(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), x));
+    index = _mm256_add_ps(index, eight);
+  }
+  AddRampTail(src, from, step, dst, i, n);
+}
+
+KODO_AVX2 void Scale2(float* x, float gain, int n) {
+  const __m256 g = _mm256_set1_ps(gain);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), g));
+  }
+  ScaleTail(x, gain, i, n);
+}
+
+KODO_AVX2 void ScaleRamp2(float* x, float from, float to, int n) {
+  const float step = RampStep(from, to, n);
+  const __m256 vfrom = _mm256_set1_ps(from);
+  const __m256 vstep = _mm256_set1_ps(step);
+  const __m256 eight = _mm256_set1_ps(8);
+  __m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 g = _mm256_add_ps(vfrom, _mm256_mul_ps(vstep, index));
+    _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), g));
+    index = _mm256_add_ps(index, eight);
+  }
+  ScaleRampTail(x, from, step, i, n);
+}
+
+// Two accumulators hide the latency of vaddps.
+KODO_AVX2 float Dot2(const float* a, const float* b, int n) {
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                             _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+  }
+  if (i + 8 <= n) {
+    sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                             _mm256_loadu_ps(b + i)));
+    i += 8;
+  }
+  const __m256 sum = _mm256_add_ps(sum0, sum1);
+  __m128 x = _mm_add_ps(_mm256_castps256_ps128(sum),
+                        _mm256_extractf128_ps(sum, 1));
+  x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+  x = _mm_add_ss(x, _mm_movehdup_ps(x));
+  float ret = _mm_cvtss_f32(x);
+  for (; i < n; ++i) ret += a[i] * b[i];
+  return ret;
+}
+
+// cvtps2dq rounds to nearest even like lrint() in the default mode.
+KODO_AVX2 __m256i ToInt2(const float* src, __m256 scale) {
+  __m256 x = _mm256_max_ps(_mm256_loadu_ps(src), _mm256_set1_ps(-1));
+  x = _mm256_min_ps(x, _mm256_set1_ps(1));
+  return _mm256_cvtps_epi32(_mm256_mul_ps(x, scale));
+}
+
+KODO_AVX2 float MaxAbs2(const float* x, int n) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 m = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    m = _mm256_max_ps(_mm256_andnot_ps(sign, _mm256_loadu_ps(x + i)), m);
+  }
+  alignas(32) float lanes[8];
+  _mm256_store_ps(lanes, m);
+  float ret = 0;
+  for (float lane : lanes) ret = MaxAbsStep(ret, lane);
+  for (; i < n; ++i) ret = MaxAbsStep(ret, x[i]);
+  return ret;
+}
+
+KODO_AVX2 void FloatToInt16_2(const float* src, int16_t* dst, int n) {
+  const __m256 scale = _mm256_set1_ps(kInt16Scale);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256i a = ToInt2(src + i, scale);
+    const __m256i b = ToInt2(src + i + 8, scale);
+    // packs works within 128-bit lanes; restore the order of quarters.
+    const __m256i packed =
+        _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+  }
+  for (; i < n; ++i) dst[i] = std::lrint(ClampUnit(src[i]) * kInt16Scale);
+}
+
+KODO_AVX2 void Int16ToFloat2(const int16_t* src, float* dst, int n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / 32768);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i x = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+  }
+  for (; i < n; ++i) dst[i] = src[i] * (1.0f / 32768);
+}
+
+// Packs 4 samples into 12 bytes per 16-byte store. The 4 bytes of zeros past
+// them are overwritten by the next store, so each step needs 6 samples left
+// to stay inside the buffer.
+KODO_AVX2 void FloatToInt24_2(const float* src, uint8_t* dst, int n) {
+  const __m128 scale = _mm_set1_ps(kInt24Scale);
+  const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                                     -1, -1, -1, -1);
+  int i = 0;
+  for (; i + 6 <= n; i += 4) {
+    __m128 x = _mm_max_ps(_mm_loadu_ps(src + i), _mm_set1_ps(-1));
+    x = _mm_min_ps(x, _mm_set1_ps(1));
+    const __m128i v = _mm_cvtps_epi32(_mm_mul_ps(x, scale));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * i),
+                     _mm_shuffle_epi8(v, pack));
+  }
+  for (; i < n; ++i) {
+    StoreInt24(std::lrint(ClampUnit(src[i]) * kInt24Scale), dst + 3 * i);
+  }
+}
+
+KODO_AVX2 void Int24ToFloat2(const uint8_t* src, float* dst, int n) {
+  const __m128 scale = _mm_set1_ps(1.0f / 8388608);
+  // Each sample into the top 3 bytes of an int32, then sign-extend.
+  const __m128i unpack = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8,
+                                       -1, 9, 10, 11);
+  int i = 0;
+  for (; i + 6 <= n; i += 4) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i));
+    const __m128i v = _mm_srai_epi32(_mm_shuffle_epi8(bytes, unpack), 8);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+  }
+  for (; i < n; ++i) dst[i] = LoadInt24(src + 3 * i) * (1.0f / 8388608);
+}
+
+KODO_AVX2 void Interleave2(const float* const* src, int num_channels, int n,
+                           float* dst) {
+  int i = 0;
+  if (num_channels == 2) {
+    for (; i + 8 <= n; i += 8) {
+      const __m256 l = _mm256_loadu_ps(src[0] + i);
+      const __m256 r = _mm256_loadu_ps(src[1] + i);
+      const __m256 lo = _mm256_unpacklo_ps(l, r);
+      const __m256 hi = _mm256_unpackhi_ps(l, r);
+      _mm256_storeu_ps(dst + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+      _mm256_storeu_ps(dst + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+  }
+  for (; i < n; ++i) {
+    for (int c = 0; c < num_channels; ++c) {
+      dst[i * num_channels + c] = src[c][i];
+    }
+  }
+}
+
+KODO_AVX2 void Deinterleave2(const float* src, int num_channels, int n,
+                             float* const* dst) {
+  int i = 0;
+  if (num_channels == 2) {
+    for (; i + 8 <= n; i += 8) {
+      const __m256 a = _mm256_loadu_ps(src + 2 * i);
+      const __m256 b = _mm256_loadu_ps(src + 2 * i + 8);
+      // Even and odd floats, in 64-bit pairs ordered 0, 2, 1, 3.
+      const __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      const __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      _mm256_storeu_ps(dst[0] + i, _mm256_castpd_ps(_mm256_permute4x64_pd(
+                                       _mm256_castps_pd(l), 0xd8)));
+      _mm256_storeu_ps(dst[1] + i, _mm256_castpd_ps(_mm256_permute4x64_pd(
+                                       _mm256_castps_pd(r), 0xd8)));
+    }
+  }
+  for (; i < n; ++i) {
+    for (int c = 0; c < num_channels; ++c) {
+      dst[c][i] = src[i * num_channels + c];
+    }
+  }
+}
+
+// AVX-512, 16 lanes. Conversions are memory bound and stay on AVX2.
+
+KODO_AVX512 void Add512(const float* src, float* dst, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(dst + i),
+                                            _mm512_loadu_ps(src + i)));
+  }
+  AddTail(src, dst, i, n);
+}
+
+KODO_AVX512 void AddScaled512(const float* src, float gain, float* dst,
+                              int n) {
+  const __m512 g = _mm512_set1_ps(gain);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 x = _mm512_mul_ps(g, _mm512_loadu_ps(src + i));
+    _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(dst + i), x));
+  }
+  AddScaledTail(src, gain, dst, i, n);
+}
+
+KODO_AVX512 float Dot512(const float* a, const float* b, int n) {
+  __m512 sum = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(a + i),
+                                           _mm512_loadu_ps(b + i)));
+  }
+  // Sums lanes in memory: GCC 12 raises -Wuninitialized inside
+  // _mm512_reduce_add_ps.
+  alignas(64) float lanes[16];
+  _mm512_store_ps(lanes, sum);
+  float ret = 0;
+  for (float lane : lanes) ret += lane;
+  for (; i < n; ++i) ret += a[i] * b[i];
+  return ret;
+}
+
+KODO_AVX512 float MaxAbs512(const float* x, int n) {
+  __m512 m = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    // GCC 12 warns of the undefined passthrough of _mm512_max_ps at -O2;
+    // the zero-masked form with every lane set has none.
+    m = _mm512_maskz_max_ps(0xffff, _mm512_abs_ps(_mm512_loadu_ps(x + i)), m);
+  }
+  alignas(64) float lanes[16];
+  _mm512_store_ps(lanes, m);
+  float ret = 0;
+  for (float lane : lanes) ret = MaxAbsStep(ret, lane);
+  for (; i < n; ++i) ret = MaxAbsStep(ret, x[i]);
+  return ret;
+}
+
+KODO_AVX512 __m512 Iota512() {
+  return _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+KODO_AVX512 void AddRamp512(const float* src, float from, float to,
+                            float* dst, int n) {
+  const float step = RampStep(from, to, n);
+  const __m512 vfrom = _mm512_set1_ps(from);
+  const __m512 vstep = _mm512_set1_ps(step);
+  const __m512 sixteen = _mm512_set1_ps(16);
+  __m512 index = Iota512();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 g = _mm512_add_ps(vfrom, _mm512_mul_ps(vstep, index));
+    const __m512 x = _mm512_mul_ps(g, _mm512_loadu_ps(src + i));
+    _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(dst + i), x));
+    index = _mm512_add_ps(index, sixteen);
+  }
+  AddRampTail(src, from, step, dst, i, n);
+}
+
+KODO_AVX512 void Scale512(float* x, float gain, int n) {
+  const __m512 g = _mm512_set1_ps(gain);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(x + i, _mm512_mul_ps(_mm512_loadu_ps(x + i), g));
+  }
+  ScaleTail(x, gain, i, n);
+}
+
+KODO_AVX512 void ScaleRamp512(float* x, float from, float to, int n) {
+  const float step = RampStep(from, to, n);
+  const __m512 vfrom = _mm512_set1_ps(from);
+  const __m512 vstep = _mm512_set1_ps(step);
+  const __m512 sixteen = _mm512_set1_ps(16);
+  __m512 index = Iota512();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 g = _mm512_add_ps(vfrom, _mm512_mul_ps(vstep, index));
+    _mm512_storeu_ps(x + i, _mm512_mul_ps(_mm512_loadu_ps(x + i), g));
+    index = _mm512_add_ps(index, sixteen);
+  }
+  ScaleRampTail(x, from, step, i, n);
+}
+
+}  // namespace
+
+const DspKernels& Avx2Kernels() {
+  static const DspKernels kernels = {
+      "avx2",         Add2,          AddScaled2,     AddRamp2,
+      Scale2,         ScaleRamp2,    Dot2,           MaxAbs2,
+      FloatToInt16_2, Int16ToFloat2, FloatToInt24_2, Int24ToFloat2,
+      Interleave2,    Deinterleave2,
+  };
+  return kernels;
+}
+
+const DspKernels& Avx512Kernels() {
+  static const DspKernels kernels = []() {
+    DspKernels k = Avx2Kernels();
+    k.name = "avx512";
+    k.add = Add512;
+    k.add_scaled = AddScaled512;
+    k.add_ramp = AddRamp512;
+    k.scale = Scale512;
+    k.scale_ramp = ScaleRamp512;
+    k.dot = Dot512;
+    k.max_abs = MaxAbs512;
+    return k;
+  }();
+  return kernels;
+}
+
+}  // namespace kodo
+
+#endif  // defined(KODO_DSP_X86)
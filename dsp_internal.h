@@ -0,0 +1,58 @@
+#pragma once
+
+// Shared by the DspKernels variants only.
+
+#include <cmath>
+#include <cstdint>
+
+#include "dsp.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// Variants use target attributes, so the rest of the build keeps its -march.
+#define KODO_DSP_X86 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define KODO_DSP_NEON 1
+#endif
+
+namespace kodo {
+
+inline constexpr float kInt16Scale = 32767;
+inline constexpr float kInt24Scale = 8388607;
+
+inline float RampStep(float from, float to, int n) {
+  return n > 0 ? (to - from) / n : 0.0f;
+}
+
+// Written like maxps/minps, so NaN becomes -1 in every variant.
+inline float ClampUnit(float x) {
+  x = x > -1.0f ? x : -1.0f;
+  return x < 1.0f ? x : 1.0f;
+}
+
+// Written like maxps(|x|, m), so NaN keeps m in every variant.
+inline float MaxAbsStep(float m, float x) {
+  const float a = std::fabs(x);
+  return a > m ? a : m;
+}
+
+inline void StoreInt24(int32_t value, uint8_t* p) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+}
+
+inline int32_t LoadInt24(const uint8_t* p) {
+  // Sign-extend through the top byte of 32 bits.
+  return static_cast<int32_t>((uint32_t{p[0]} << 8) | (uint32_t{p[1]} << 16) |
+                              (uint32_t{p[2]} << 24)) >>
+         8;
+}
+
+#if defined(KODO_DSP_X86)
+const DspKernels& Avx2Kernels();
+const DspKernels& Avx512Kernels();
+#elif defined(KODO_DSP_NEON)
+const DspKernels& NeonKernels();
+#endif
+
+}  // namespace kodo
@@ -0,0 +1,191 @@
+// NEON DspKernels. Advanced SIMD is part of the AArch64 baseline, so the
+// variant needs no detection.
+
+#include "dsp.h"
+#include "dsp_internal.h"
+
+#if defined(KODO_DSP_NEON)
+
+#include <arm_neon.h>
+
+#include <cmath>
+#include <cstdint>
+
+namespace kodo {
+namespace {
+
+void Add(const float* src, float* dst, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+  }
+  for (; i < n; ++i) dst[i] += src[i];
+}
+
+// vmlaq_f32 may fuse, so multiply and add are kept as separate intrinsics.
+void AddScaled(const float* src, float gain, float* dst, int n) {
+  const float32x4_t g = vdupq_n_f32(gain);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t x = vmulq_f32(g, vld1q_f32(src + i));
+    vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), x));
+  }
+  for (; i < n; ++i) dst[i] += gain * src[i];
+}
+
+void AddRamp(const float* src, float from, float to, float* dst, int n) {
+  const float step = RampStep(from, to, n);
+  const float32x4_t vfrom = vdupq_n_f32(from);
+  const float32x4_t vstep = vdupq_n_f32(step);
+  const float32x4_t four = vdupq_n_f32(4);
+  const float kIota[4] = {0, 1, 2, 3};
+  float32x4_t index = vld1q_f32(kIota);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t g = vaddq_f32(vfrom, vmulq_f32(vstep, index));
+    const float32x4_t x = vmulq_f32(g, vld1q_f32(src + i));
+    vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), x));
+    index = vaddq_f32(index, four);
+  }
+  for (; i < n; ++i) dst[i] += (from + step * float(i)) * src[i];
+}
+
+void Scale(float* x, float gain, int n) {
+  const float32x4_t g = vdupq_n_f32(gain);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) vst1q_f32(x + i, vmulq_f32(vld1q_f32(x + i), g));
+  for (; i < n; ++i) x[i] *= gain;
+}
+
+void ScaleRamp(float* x, float from, float to, int n) {
+  const float step = RampStep(from, to, n);
+  const float32x4_t vfrom = vdupq_n_f32(from);
+  const float32x4_t vstep = vdupq_n_f32(step);
+  const float32x4_t four = vdupq_n_f32(4);
+  const float kIota[4] = {0, 1, 2, 3};
+  float32x4_t index = vld1q_f32(kIota);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t g = vaddq_f32(vfrom, vmulq_f32(vstep, index));
+    vst1q_f32(x + i, vmulq_f32(vld1q_f32(x + i), g));
+    index = vaddq_f32(index, four);
+  }
+  for (; i < n; ++i) x[i] *= from + step * float(i);
+}
+
+float Dot(const float* a, const float* b, int n) {
+  float32x4_t sum = vdupq_n_f32(0);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    sum = vaddq_f32(sum, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+  }
+  float ret = vaddvq_f32(sum);
+  for (; i < n; ++i) ret += a[i] * b[i];
+  return ret;
+}
+
+float MaxAbs(const float* x, int n) {
+  float32x4_t m = vdupq_n_f32(0);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    // Selects rather than vmaxq, which would propagate NaN.
+    const float32x4_t a = vabsq_f32(vld1q_f32(x + i));
+    m = vbslq_f32(vcgtq_f32(a, m), a, m);
+  }
+  // Lanes hold no NaN.
+  float ret = vmaxvq_f32(m);
+  for (; i < n; ++i) ret = MaxAbsStep(ret, x[i]);
+  return ret;
+}
+
+// Selects rather than vmaxq/vminq, which would propagate NaN.
+float32x4_t Clamp(float32x4_t x) {
+  const float32x4_t lo = vdupq_n_f32(-1);
+  const float32x4_t hi = vdupq_n_f32(1);
+  x = vbslq_f32(vcgtq_f32(x, lo), x, lo);
+  return vbslq_f32(vcltq_f32(x, hi), x, hi);
+}
+
+void FloatToInt16(const float* src, int16_t* dst, int n) {
+  const float32x4_t scale = vdupq_n_f32(kInt16Scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const int32x4_t a =
+        vcvtnq_s32_f32(vmulq_f32(Clamp(vld1q_f32(src + i)), scale));
+    const int32x4_t b =
+        vcvtnq_s32_f32(vmulq_f32(Clamp(vld1q_f32(src + i + 4)), scale));
+    vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+  }
+  for (; i < n; ++i) dst[i] = std::lrint(ClampUnit(src[i]) * kInt16Scale);
+}
+
+void Int16ToFloat(const int16_t* src, float* dst, int n) {
+  const float32x4_t scale = vdupq_n_f32(1.0f / 32768);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const int32x4_t x = vmovl_s16(vld1_s16(src + i));
+    vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(x), scale));
+  }
+  for (; i < n; ++i) dst[i] = src[i] * (1.0f / 32768);
+}
+
+void FloatToInt24(const float* src, uint8_t* dst, int n) {
+  for (int i = 0; i < n; ++i) {
+    StoreInt24(std::lrint(ClampUnit(src[i]) * kInt24Scale), dst + 3 * i);
+  }
+}
+
+void Int24ToFloat(const uint8_t* src, float* dst, int n) {
+  for (int i = 0; i < n; ++i) {
+    dst[i] = LoadInt24(src + 3 * i) * (1.0f / 8388608);
+  }
+}
+
+void Interleave(const float* const* src, int num_channels, int n,
+                float* dst) {
+  int i = 0;
+  if (num_channels == 2) {
+    for (; i + 4 <= n; i += 4) {
+      float32x4x2_t lr = {{vld1q_f32(src[0] + i), vld1q_f32(src[1] + i)}};
+      vst2q_f32(dst + 2 * i, lr);
+    }
+  }
+  for (; i < n; ++i) {
+    for (int c = 0; c < num_channels; ++c) {
+      dst[i * num_channels + c] = src[c][i];
+    }
+  }
+}
+
+void Deinterleave(const float* src, int num_channels, int n,
+                  float* const* dst) {
+  int i = 0;
+  if (num_channels == 2) {
+    for (; i + 4 <= n; i += 4) {
+      const float32x4x2_t lr = vld2q_f32(src + 2 * i);
+      vst1q_f32(dst[0] + i, lr.val[0]);
+      vst1q_f32(dst[1] + i, lr.val[1]);
+    }
+  }
+  for (; i < n; ++i) {
+    for (int c = 0; c < num_channels; ++c) {
+      dst[c][i] = src[i * num_channels + c];
+    }
+  }
+}
+
+}  // namespace
+
+const DspKernels& NeonKernels() {
+  static const DspKernels kernels = {
+      "neon",       Add,          AddScaled,    AddRamp,
+      Scale,        ScaleRamp,    Dot,          MaxAbs,
+      FloatToInt16, Int16ToFloat, FloatToInt24, Int24ToFloat,
+      Interleave,   Deinterleave,
+  };
+  return kernels;
+}
+
+}  // namespace kodo
+
+#endif  // defined(KODO_DSP_NEON)
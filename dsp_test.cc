@@ -0,0 +1,327 @@
+#include "dsp.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dsp_internal.h"
+#include "gtest/gtest.h"
+
+namespace kodo {
+namespace {
+
+// Lengths around every vector width and its tails, and starts off any
+// alignment the variants might assume.
+constexpr int kLengths[] = {0,  1,  2,  3,  4,  5,  7,  8,  9,   15,  16,
+                            17, 31, 32, 33, 47, 63, 64, 65, 127, 1000};
+constexpr int kOffsets[] = {0, 1, 3};
+constexpr int kMaxLength = 1000 + 3;
+
+// Audio-range samples, with overs, zeros of both signs, denormals, Inf and
+// NaN scattered through when `special`.
+std::vector<float> Samples(int n, uint32_t seed, bool special = true) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> uniform(-1.5f, 1.5f);
+  std::vector<float> x(n);
+  for (float& v : x) v = uniform(rng);
+  if (!special) return x;
+  const float kSpecial[] = {0.0f,
+                            -0.0f,
+                            1.0f,
+                            -1.0f,
+                            std::numeric_limits<float>::denorm_min(),
+                            std::numeric_limits<float>::infinity(),
+                            -std::numeric_limits<float>::infinity(),
+                            std::numeric_limits<float>::quiet_NaN()};
+  for (int i = 0; i < n; i += 1 + rng() % 13) {
+    x[i] = kSpecial[rng() % std::size(kSpecial)];
+  }
+  return x;
+}
+
+bool SameFloat(float a, float b) {
+  if (std::isnan(a) && std::isnan(b)) return true;
+  return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+void ExpectSameFloats(const float* expected, const float* actual, int n) {
+  for (int i = 0; i < n; ++i) {
+    ASSERT_TRUE(SameFloat(expected[i], actual[i]))
+        << "at " << i << " of " << n << ": " << expected[i] << " vs "
+        << actual[i];
+  }
+}
+
+// Every variant this CPU runs, not only the one Dsp() picks.
+std::vector<const DspKernels*> Variants() {
+  std::vector<const DspKernels*> variants;
+#if defined(KODO_DSP_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) variants.push_back(&Avx2Kernels());
+  if (__builtin_cpu_supports("avx512f")) variants.push_back(&Avx512Kernels());
+#elif defined(KODO_DSP_NEON)
+  variants.push_back(&NeonKernels());
+#endif
+  return variants;
+}
+
+class DspTest : public ::testing::TestWithParam<const DspKernels*> {
+ protected:
+  const DspKernels& scalar_ = ScalarDsp();
+  const DspKernels& simd_ = *GetParam();
+};
+
+INSTANTIATE_TEST_SUITE_P(
+    Variants, DspTest, ::testing::ValuesIn(Variants()),
+    [](const ::testing::TestParamInfo<const DspKernels*>& info) {
+      return std::string(info.param->name);
+    });
+// Scalar-only CPUs have no variant to compare.
+GTEST_ALLOW_UNINSTANTIATED_PARAMETERIZED_TEST(DspTest);
+
+TEST(DspDispatchTest, PicksAVariantThisCpuRuns) {
+  const std::vector<const DspKernels*> variants = Variants();
+  if (variants.empty()) {
+    EXPECT_EQ(&Dsp(), &ScalarDsp());
+  } else {
+    EXPECT_EQ(&Dsp(), variants.back()) << Dsp().name;
+  }
+}
+
+TEST_P(DspTest, Add) {
+  const std::vector<float> src = Samples(kMaxLength, 1);
+  const std::vector<float> dst = Samples(kMaxLength, 2);
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      std::vector<float> expected = dst, actual = dst;
+      scalar_.add(src.data() + offset, expected.data() + offset, n);
+      simd_.add(src.data() + offset, actual.data() + offset, n);
+      ExpectSameFloats(expected.data(), actual.data(), kMaxLength);
+    }
+  }
+}
+
+TEST_P(DspTest, AddScaled) {
+  const std::vector<float> src = Samples(kMaxLength, 3);
+  const std::vector<float> dst = Samples(kMaxLength, 4);
+  for (float gain : {0.0f, 0.70710678f, -2.5f}) {
+    for (int offset : kOffsets) {
+      for (int n : kLengths) {
+        std::vector<float> expected = dst, actual = dst;
+        scalar_.add_scaled(src.data() + offset, gain,
+                           expected.data() + offset, n);
+        simd_.add_scaled(src.data() + offset, gain, actual.data() + offset,
+                         n);
+        ExpectSameFloats(expected.data(), actual.data(), kMaxLength);
+      }
+    }
+  }
+}
+
+TEST_P(DspTest, AddRamp) {
+  const std::vector<float> src = Samples(kMaxLength, 5);
+  const std::vector<float> dst = Samples(kMaxLength, 6);
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      std::vector<float> expected = dst, actual = dst;
+      scalar_.add_ramp(src.data() + offset, 0.1f, 0.9f,
+                       expected.data() + offset, n);
+      simd_.add_ramp(src.data() + offset, 0.1f, 0.9f, actual.data() + offset,
+                     n);
+      ExpectSameFloats(expected.data(), actual.data(), kMaxLength);
+    }
+  }
+}
+
+TEST_P(DspTest, Scale) {
+  const std::vector<float> x = Samples(kMaxLength, 7);
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      std::vector<float> expected = x, actual = x;
+      scalar_.scale(expected.data() + offset, 0.3f, n);
+      simd_.scale(actual.data() + offset, 0.3f, n);
+      ExpectSameFloats(expected.data(), actual.data(), kMaxLength);
+    }
+  }
+}
+
+TEST_P(DspTest, ScaleRamp) {
+  const std::vector<float> x = Samples(kMaxLength, 8);
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      std::vector<float> expected = x, actual = x;
+      scalar_.scale_ramp(expected.data() + offset, 1.0f, 0.0f, n);
+      simd_.scale_ramp(actual.data() + offset, 1.0f, 0.0f, n);
+      ExpectSameFloats(expected.data(), actual.data(), kMaxLength);
+    }
+  }
+}
+
+// Variants sum in their own order, so only the rounding error is bounded.
+TEST_P(DspTest, DotWithinRounding) {
+  const std::vector<float> a = Samples(kMaxLength, 9, /*special=*/false);
+  const std::vector<float> b = Samples(kMaxLength, 10, /*special=*/false);
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      const float* x = a.data() + offset;
+      const float* y = b.data() + offset;
+      double magnitude = 0;
+      for (int i = 0; i < n; ++i) magnitude += std::fabs(double{x[i]} * y[i]);
+      const float tolerance =
+          n * std::numeric_limits<float>::epsilon() * magnitude;
+      EXPECT_NEAR(scalar_.dot(x, y, n), simd_.dot(x, y, n), tolerance)
+          << "n=" << n << " offset=" << offset;
+    }
+  }
+}
+
+TEST_P(DspTest, DotPropagatesNanAndInf) {
+  std::vector<float> a = Samples(kMaxLength, 11, /*special=*/false);
+  const std::vector<float> b = Samples(kMaxLength, 12, /*special=*/false);
+  for (int n : kLengths) {
+    if (n == 0) continue;
+    a[n / 2] = std::numeric_limits<float>::quiet_NaN();
+    EXPECT_TRUE(std::isnan(simd_.dot(a.data(), b.data(), n))) << n;
+    a[n / 2] = std::copysign(std::numeric_limits<float>::infinity(), b[n / 2]);
+    EXPECT_EQ(simd_.dot(a.data(), b.data(), n),
+              std::numeric_limits<float>::infinity())
+        << n;
+    a[n / 2] = 0.5f;
+  }
+}
+
+TEST_P(DspTest, MaxAbs) {
+  const std::vector<float> x = Samples(kMaxLength, 13);
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      const float* p = x.data() + offset;
+      EXPECT_TRUE(SameFloat(scalar_.max_abs(p, n), simd_.max_abs(p, n)))
+          << "n=" << n << " offset=" << offset;
+    }
+  }
+  // The largest magnitude in a vector lane, not only in the tail.
+  std::vector<float> peak(64, 0.25f);
+  peak[5] = -0.75f;
+  EXPECT_EQ(simd_.max_abs(peak.data(), 64), 0.75f);
+  peak.assign(64, std::numeric_limits<float>::quiet_NaN());
+  EXPECT_EQ(simd_.max_abs(peak.data(), 64), 0.0f);
+}
+
+TEST_P(DspTest, FloatToInt16) {
+  const std::vector<float> src = Samples(kMaxLength, 14);
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      std::vector<int16_t> expected(kMaxLength, 7), actual(kMaxLength, 7);
+      scalar_.float_to_int16(src.data() + offset, expected.data() + offset,
+                             n);
+      simd_.float_to_int16(src.data() + offset, actual.data() + offset, n);
+      EXPECT_EQ(expected, actual) << "n=" << n << " offset=" << offset;
+    }
+  }
+}
+
+TEST_P(DspTest, Int16ToFloat) {
+  std::mt19937 rng(15);
+  std::vector<int16_t> src(kMaxLength);
+  for (int16_t& v : src) v = static_cast<int16_t>(rng());
+  src[0] = -32768;
+  src[1] = 32767;
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      std::vector<float> expected(kMaxLength, 7), actual(kMaxLength, 7);
+      scalar_.int16_to_float(src.data() + offset, expected.data() + offset,
+                             n);
+      simd_.int16_to_float(src.data() + offset, actual.data() + offset, n);
+      ExpectSameFloats(expected.data(), actual.data(), kMaxLength);
+    }
+  }
+}
+
+TEST_P(DspTest, FloatToInt24) {
+  const std::vector<float> src = Samples(kMaxLength, 16);
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      std::vector<uint8_t> expected(3 * kMaxLength, 7),
+          actual(3 * kMaxLength, 7);
+      scalar_.float_to_int24(src.data() + offset,
+                             expected.data() + 3 * offset, n);
+      simd_.float_to_int24(src.data() + offset, actual.data() + 3 * offset,
+                           n);
+      EXPECT_EQ(expected, actual) << "n=" << n << " offset=" << offset;
+    }
+  }
+}
+
+TEST_P(DspTest, Int24ToFloat) {
+  std::mt19937 rng(17);
+  std::vector<uint8_t> src(3 * kMaxLength);
+  for (uint8_t& v : src) v = static_cast<uint8_t>(rng());
+  for (int offset : kOffsets) {
+    for (int n : kLengths) {
+      std::vector<float> expected(kMaxLength, 7), actual(kMaxLength, 7);
+      scalar_.int24_to_float(src.data() + 3 * offset,
+                             expected.data() + offset, n);
+      simd_.int24_to_float(src.data() + 3 * offset, actual.data() + offset,
+                           n);
+      ExpectSameFloats(expected.data(), actual.data(), kMaxLength);
+    }
+  }
+}
+
+TEST_P(DspTest, Interleave) {
+  constexpr int kMaxChannels = 8;
+  std::vector<std::vector<float>> planes;
+  for (int c = 0; c < kMaxChannels; ++c) {
+    planes.push_back(Samples(kMaxLength, 18 + c));
+  }
+  for (int num_channels = 1; num_channels <= kMaxChannels; ++num_channels) {
+    for (int offset : kOffsets) {
+      const float* src[kMaxChannels];
+      for (int c = 0; c < num_channels; ++c) {
+        src[c] = planes[c].data() + offset;
+      }
+      for (int n : kLengths) {
+        std::vector<float> expected(num_channels * kMaxLength, 7),
+            actual(num_channels * kMaxLength, 7);
+        scalar_.interleave(src, num_channels, n, expected.data() + offset);
+        simd_.interleave(src, num_channels, n, actual.data() + offset);
+        ExpectSameFloats(expected.data(), actual.data(), expected.size());
+      }
+    }
+  }
+}
+
+TEST_P(DspTest, Deinterleave) {
+  constexpr int kMaxChannels = 8;
+  for (int num_channels = 1; num_channels <= kMaxChannels; ++num_channels) {
+    const std::vector<float> src =
+        Samples(num_channels * kMaxLength, 30 + num_channels);
+    for (int offset : kOffsets) {
+      for (int n : kLengths) {
+        std::vector<std::vector<float>> expected(
+            num_channels, std::vector<float>(kMaxLength, 7));
+        std::vector<std::vector<float>> actual = expected;
+        float* expected_planes[kMaxChannels];
+        float* actual_planes[kMaxChannels];
+        for (int c = 0; c < num_channels; ++c) {
+          expected_planes[c] = expected[c].data() + offset;
+          actual_planes[c] = actual[c].data() + offset;
+        }
+        scalar_.deinterleave(src.data() + offset, num_channels, n,
+                             expected_planes);
+        simd_.deinterleave(src.data() + offset, num_channels, n,
+                           actual_planes);
+        for (int c = 0; c < num_channels; ++c) {
+          ExpectSameFloats(expected[c].data(), actual[c].data(), kMaxLength);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace kodo
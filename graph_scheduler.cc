@@ -0,0 +1,131 @@
+#include "graph_scheduler.h"
+
+#include <memory>
+#include <thread>
+
+#include "absl/log/log.h"
+#include "render_graph.h"
+#include "rt_alloc.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace kodo {
+
+namespace {
+
+void CpuRelax() {
+#if defined(__x86_64__) || defined(_M_X64)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Best effort: needs rtprio (Linux) or is silently ignored.
+void SetRealtimePriority(std::thread& thread) {
+#ifdef _WIN32
+  SetThreadPriority(thread.native_handle(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+  sched_param param{};
+  param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+  if (int err = pthread_setschedparam(thread.native_handle(), SCHED_FIFO,
+                                      &param);
+      err != 0) {
+    LOG_FIRST_N(WARNING, 1) << "Cannot set SCHED_FIFO for audio workers: "
+                            << err;
+  }
+#endif
+}
+
+}  // namespace
+
+std::unique_ptr<GraphScheduler> GraphScheduler::Create(int num_workers,
+                                                       bool realtime) {
+  std::unique_ptr<GraphScheduler> ret(new GraphScheduler);
+  ret->trace_name_ = realtime ? "Audio worker" : "Anticipation worker";
+  for (int i = 0; i <= num_workers; ++i) {
+    ret->queues_.push_back(
+        std::make_unique<WorkStealingQueue>(RenderGraph::kMaxNodes));
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    ret->threads_.emplace_back(&GraphScheduler::WorkerLoop, ret.get(), i + 1);
+    if (realtime) SetRealtimePriority(ret->threads_.back());
+  }
+  LOG(INFO) << "GraphScheduler started " << num_workers << " workers.";
+  return ret;
+}
+
+GraphScheduler::~GraphScheduler() {
+  quit_.store(true, std::memory_order_release);
+  epoch_.fetch_add(1, std::memory_order_release);
+  epoch_.notify_all();
+  for (std::thread& thread : threads_) thread.join();
+}
+
+void GraphScheduler::Run(RenderGraph& graph, int num_frames) {
+  graph.BeginBlock(num_frames);
+  remaining_.store(graph.num_nodes(), std::memory_order_relaxed);
+  graph_.store(&graph, std::memory_order_release);
+  for (int root : graph.roots()) queues_[0]->Push(root);
+
+  if (!threads_.empty()) {
+    epoch_.fetch_add(1, std::memory_order_release);
+    epoch_.notify_all();
+  }
+  Work(0);
+}
+
+void GraphScheduler::WorkerLoop(int index) {
+  TraceThread trace_thread(trace_name_);
+  uint32_t seen = epoch_.load(std::memory_order_acquire);
+  while (true) {
+    epoch_.wait(seen, std::memory_order_acquire);
+    seen = epoch_.load(std::memory_order_acquire);
+    if (quit_.load(std::memory_order_acquire)) return;
+    Work(index);
+  }
+}
+
+void GraphScheduler::Work(int index) {
+  RealtimeScope realtime;
+  WorkStealingQueue& own = *queues_[index];
+  int32_t task;
+  int idle = 0;
+  while (remaining_.load(std::memory_order_acquire) > 0) {
+    if (own.Pop(&task) || Steal(index, &task)) {
+      // Holding a task means the block (and its graph) is still alive.
+      RenderGraph* graph = graph_.load(std::memory_order_acquire);
+      const int ready = graph->ProcessNode(task);
+      if (ready != -1) own.Push(ready);
+      remaining_.fetch_sub(1, std::memory_order_acq_rel);
+      idle = 0;
+    } else if (++idle < 1024) {
+      CpuRelax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+bool GraphScheduler::Steal(int index, int32_t* task) {
+  const int n = queues_.size();
+  for (int k = 1; k < n; ++k) {
+    if (queues_[(index + k) % n]->Steal(task)) {
+      AddTraceInstant("Steal");
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace kodo
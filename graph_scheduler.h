@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "work_stealing_queue.h"
+
+namespace kodo {
+
+class RenderGraph;
+
+// Runs the nodes of a RenderGraph each block on a fixed pool of real-time
+// worker threads plus the calling audio thread. Ready nodes go to the deque
+// of the thread that made them ready and idle threads steal from the others.
+// Dependencies are tracked by per-node atomic counters in the graph.
+class GraphScheduler {
+ public:
+  // Starts `num_workers` threads. Zero runs everything on the audio thread.
+  // Workers run at SCHED_FIFO priority unless not `realtime`, e.g. when
+  // rendering ahead of the playhead.
+  static std::unique_ptr<GraphScheduler> Create(int num_workers,
+                                                bool realtime = true);
+
+  // Joins the workers. No Run() may be in progress.
+  ~GraphScheduler();
+
+  // Processes every node of `graph` for a block of `num_frames` and returns
+  // when all are done. One rendering thread only, e.g. the audio thread;
+  // never locks or allocates.
+  void Run(RenderGraph& graph, int num_frames);
+
+  int num_workers() const { return threads_.size(); }
+
+ private:
+  GraphScheduler() {}  // Use Create().
+
+  void WorkerLoop(int index);
+  // Executes and steals tasks until the current block is done.
+  void Work(int index);
+  bool Steal(int index, int32_t* task);
+
+  // queues_[0] belongs to the audio thread, queues_[i + 1] to threads_[i].
+  std::vector<std::unique_ptr<WorkStealingQueue>> queues_;
+  std::vector<std::thread> threads_;
+  // Track name of the workers in traces.
+  const char* trace_name_ = nullptr;
+
+  std::atomic<RenderGraph*> graph_{nullptr};
+  // Nodes not finished in the current block.
+  std::atomic<int> remaining_{0};
+  // Bumped once per block to wake the workers.
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<bool> quit_{false};
+};
+
+}  // namespace kodo
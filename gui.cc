@@ -9,10 +9,10 @@
 #include <stdio.h>
 
 #include <algorithm>
-#include <array>
 #include <cmath>
 #include <cstring>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "ImCurveEdit.h"
@@ -22,6 +22,10 @@
 #include "backends/imgui_impl_opengl3.h"
 #include "imgui.h"
 #include "imgui_internal.h"
+#include "kodo.pb.h"
+#include "note_store.h"
+#include "peak_cache.h"
+#include "trace.h"
 
 #define GL_SILENCE_DEPRECATION
 #if defined(IMGUI_IMPL_OPENGL_ES2)
@@ -129,7 +133,7 @@ void* Gui::GetHandle() {
 #endif
 }
 
-std::unique_ptr<Gui> Gui::Init() {
+std::unique_ptr<Gui> Gui::Init(const GuiOptions& options) {
   glfwSetErrorCallback(glfw_error_callback);
   if (!glfwInit()) {
     return nullptr;
@@ -213,6 +217,7 @@ std::unique_ptr<Gui> Gui::Init() {
 
   std::unique_ptr<Gui> ret(new Gui);
   ret->window_ = window;
+  ret->options_ = options;
 
 #ifdef __linux__
   Display* xDisplay = glfwGetX11Display();
@@ -259,14 +264,46 @@ void Gui::Begin() {
   // data to your main application, or clear/overwrite your copy of the
   // keyboard data. Generally you may always pass all inputs to dear imgui,
   // and hide them from your application based on those two flags.
-  glfwPollEvents();
+  if (options_.on_demand_redraw) {
+    WaitForRedraw();
+  } else {
+    glfwPollEvents();
+  }
 
   // Start the Dear ImGui frame
   ImGui_ImplOpenGL3_NewFrame();
   ImGui_ImplGlfw_NewFrame();
 }
 
+void Gui::RequestRedraw() {
+  redraw_requested_.store(true, std::memory_order_relaxed);
+  glfwPostEmptyEvent();
+}
+
+void Gui::WaitForRedraw() {
+  if (settle_frames_ > 0) {
+    --settle_frames_;
+    glfwPollEvents();
+    return;
+  }
+  const double interval = 1 / options_.max_animation_fps;
+  while (!glfwWindowShouldClose(window_)) {
+    const double start = glfwGetTime();
+    glfwWaitEventsTimeout(interval);
+    // An early return means input or RequestRedraw().
+    if (redraw_requested_.exchange(false, std::memory_order_relaxed) ||
+        glfwGetTime() - start < interval) {
+      settle_frames_ = 2;
+      return;
+    }
+    for (const std::function<bool()>& dirty : repaint_sources_) {
+      if (dirty()) return;
+    }
+  }
+}
+
 void Gui::End() {
+  TraceScope trace("Gui::End");
   // RenderCore();
 
   int display_w, display_h;
@@ -277,6 +314,7 @@ void Gui::End() {
   glClear(GL_COLOR_BUFFER_BIT);
   ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
+  TraceScope swap("Swap buffers");
   glfwSwapBuffers(window_);
 }
 
@@ -303,13 +341,6 @@ void RenderMyFirstTool() {
     LOG(INFO) << "Color: " << my_color;
   }
 
-  // Generate samples and plot them.
-  std::array<float, 100> samples;
-  for (int i = 0; i < samples.size(); ++i) {
-    samples[i] = std::sin(i * 0.2 + ImGui::GetTime() * 1.5);
-  }
-  ImGui::PlotLines("Samples", samples.data(), samples.size());
-
   // Display contents in a scrolling region
   ImGui::TextColored(ImVec4(1, 1, 0, 1), "Important Stuff");
   ImGui::BeginChild("Scrolling");
@@ -365,6 +396,7 @@ struct RampEdit : public ImCurveEdit::Delegate {
   virtual int EditPoint(size_t curveIndex, int pointIndex, ImVec2 value) {
     mPts[curveIndex][pointIndex] = ImVec2(value.x, value.y);
     SortValues(curveIndex);
+    Publish(curveIndex);
     for (size_t i = 0; i < GetPointCount(curveIndex); i++) {
       if (mPts[curveIndex][i].x == value.x) return (int)i;
     }
@@ -374,6 +406,7 @@ struct RampEdit : public ImCurveEdit::Delegate {
     if (mPointCount[curveIndex] >= 8) return;
     mPts[curveIndex][mPointCount[curveIndex]++] = value;
     SortValues(curveIndex);
+    Publish(curveIndex);
   }
   virtual ImVec2& GetMax() { return mMax; }
   virtual ImVec2& GetMin() { return mMin; }
@@ -383,8 +416,25 @@ struct RampEdit : public ImCurveEdit::Delegate {
   bool mbVisible[3];
   ImVec2 mMin;
   ImVec2 mMax;
+  Gui::AutomationCallback onEdit;
 
  private:
+  // Hands the edited curve to the automation engine, which compiles it
+  // rather than reading these points on the audio thread.
+  void Publish(size_t curveIndex) {
+    if (!onEdit) return;
+    AutomationLane lane;
+    for (size_t i = 0; i < GetPointCount(curveIndex); i++) {
+      const ImVec2& point = mPts[curveIndex][i];
+      lane.add_time(std::lround(point.x));
+      lane.add_value(std::clamp(point.y, 0.0f, 1.0f));
+      lane.add_curve(GetCurveType(curveIndex) == ImCurveEdit::CurveSmooth
+                         ? AutomationLane::SMOOTH
+                         : AutomationLane::LINEAR);
+    }
+    onEdit(curveIndex, lane);
+  }
+
   void SortValues(size_t curveIndex) {
     auto b = std::begin(mPts[curveIndex]);
     auto e = std::begin(mPts[curveIndex]) + GetPointCount(curveIndex);
@@ -392,6 +442,69 @@ struct RampEdit : public ImCurveEdit::Delegate {
   }
 };
 
+// Draws the peaks of a whole audio file stretched over [x0, x1] of `rc`.
+// Costs O(visible pixels) whatever the file length is.
+void DrawWaveform(ImDrawList* draw_list, const PeakFile& peaks, float x0,
+                  float x1, const ImRect& rc, const ImRect& clippingRect) {
+  const int first = std::max(x0, clippingRect.Min.x);
+  const int last = std::min(x1, clippingRect.Max.x);
+  if (first >= last || x1 <= x0) return;
+  const double frames_per_pixel = peaks.num_frames() / double(x1 - x0);
+
+  std::vector<Peak> columns(last - first);
+  std::vector<Peak> channel(columns.size());
+  for (int c = 0; c < peaks.num_channels(); ++c) {
+    peaks.Columns(c, (first - x0) * frames_per_pixel, frames_per_pixel,
+                  channel.size(), c == 0 ? columns.data() : channel.data());
+    if (c == 0) continue;
+    for (int i = 0; i < columns.size(); ++i) {
+      columns[i].min = std::min(columns[i].min, channel[i].min);
+      columns[i].max = std::max(columns[i].max, channel[i].max);
+      columns[i].rms = std::max(columns[i].rms, channel[i].rms);
+    }
+  }
+
+  const float mid = (rc.Min.y + rc.Max.y) / 2;
+  const float scale = (rc.Max.y - rc.Min.y) / 2 / 32767;
+  draw_list->PushClipRect(clippingRect.Min, clippingRect.Max, true);
+  for (int i = 0; i < columns.size(); ++i) {
+    const float x = first + i + 0.5f;
+    draw_list->AddLine(ImVec2(x, mid - columns[i].max * scale),
+                       ImVec2(x, mid - columns[i].min * scale), 0xAA402020);
+    draw_list->AddLine(ImVec2(x, mid - columns[i].rms * scale),
+                       ImVec2(x, mid + columns[i].rms * scale), 0xCC603030);
+  }
+  draw_list->PopClipRect();
+}
+
+// Draws the notes of [0, notes.last_end()) stretched over [x0, x1] of `rc`,
+// one row per pitch. Only notes overlapping the visible frames are visited.
+void DrawNotes(ImDrawList* draw_list, const NoteStore& notes, float x0,
+               float x1, const ImRect& rc, const ImRect& clippingRect) {
+  const float first = std::max(x0, clippingRect.Min.x);
+  const float last = std::min(x1, clippingRect.Max.x);
+  if (first >= last || x1 <= x0 || notes.last_end() <= 0) return;
+  const double frames_per_pixel = notes.last_end() / double(x1 - x0);
+  const int64_t begin = std::floor((first - x0) * frames_per_pixel);
+  const int64_t end = std::ceil((last - x0) * frames_per_pixel);
+
+  const int rows = notes.max_pitch() - notes.min_pitch() + 1;
+  const float row_height = (rc.Max.y - rc.Min.y) / rows;
+  draw_list->PushClipRect(clippingRect.Min, clippingRect.Max, true);
+  notes.ForEachOverlap(begin, end, [&](int64_t i) {
+    const float y = rc.Max.y - (notes.pitch(i) - notes.min_pitch() + 1) *
+                                   row_height;
+    // At least a pixel wide, so dense passages stay visible.
+    const float left = x0 + notes.start(i) / frames_per_pixel;
+    const float right =
+        std::max(left + 1, float(x0 + notes.end(i) / frames_per_pixel));
+    draw_list->AddRectFilled(ImVec2(left, y),
+                             ImVec2(right, y + std::max(row_height, 1.0f)),
+                             0xCC603030);
+  });
+  draw_list->PopClipRect();
+}
+
 struct MySequence : public ImSequencer::SequenceInterface {
   // interface with sequencer
 
@@ -444,6 +557,7 @@ struct MySequence : public ImSequencer::SequenceInterface {
   void CustomDraw(int index, ImDrawList* draw_list, const ImRect& rc,
                   const ImRect& legendRect, const ImRect& clippingRect,
                   const ImRect& legendClippingRect) override {
+    if (DrawClip(index, draw_list, rc, clippingRect)) return;
     static const char* labels[] = {"Translation", "Rotation", "Scale"};
 
     rampEdit.mMax = ImVec2(float(mFrameMax), 1.f);
@@ -468,6 +582,7 @@ struct MySequence : public ImSequencer::SequenceInterface {
 
   void CustomDrawCompact(int index, ImDrawList* draw_list, const ImRect& rc,
                          const ImRect& clippingRect) override {
+    if (DrawClip(index, draw_list, rc, clippingRect)) return;
     rampEdit.mMax = ImVec2(float(mFrameMax), 1.f);
     rampEdit.mMin = ImVec2(float(mFrameMin), 0.f);
     draw_list->PushClipRect(clippingRect.Min, clippingRect.Max, true);
@@ -485,10 +600,38 @@ struct MySequence : public ImSequencer::SequenceInterface {
     draw_list->PopClipRect();
   }
 
+  // Draws the waveform if the item is an audio clip with ready peaks, or
+  // the notes of a note clip.
+  bool DrawClip(int index, ImDrawList* draw_list, const ImRect& rc,
+                const ImRect& clippingRect) {
+    const MySequenceItem& item = myItems[index];
+    if (item.mNotes) {
+      const float range = mFrameMax - mFrameMin;
+      const float x0 =
+          ImLerp(rc.Min.x, rc.Max.x, (item.mFrameStart - mFrameMin) / range);
+      const float x1 =
+          ImLerp(rc.Min.x, rc.Max.x, (item.mFrameEnd - mFrameMin) / range);
+      DrawNotes(draw_list, *item.mNotes, x0, x1, rc, clippingRect);
+      return true;
+    }
+    if (item.mClipPath.empty() || peakCache == nullptr) return false;
+    const PeakFile* peaks = peakCache->Get(item.mClipPath);
+    if (peaks == nullptr) return true;  // Still building.
+    const float range = mFrameMax - mFrameMin;
+    const float x0 =
+        ImLerp(rc.Min.x, rc.Max.x, (item.mFrameStart - mFrameMin) / range);
+    const float x1 =
+        ImLerp(rc.Min.x, rc.Max.x, (item.mFrameEnd - mFrameMin) / range);
+    DrawWaveform(draw_list, *peaks, x0, x1, rc, clippingRect);
+    return true;
+  }
+
   struct MySequenceItem {
     int mType;
     int mFrameStart, mFrameEnd;
     bool mExpanded;
+    std::string mClipPath = "";  // Audio file of a clip item.
+    std::shared_ptr<const NoteStore> mNotes;  // Notes of a note clip item.
   };
 
   MySequence(int frameMin, int frameMax, std::vector<MySequenceItem> items)
@@ -499,12 +642,10 @@ struct MySequence : public ImSequencer::SequenceInterface {
   int mFrameMax = 0;
   std::vector<MySequenceItem> myItems;
   RampEdit rampEdit;
+  PeakCache* peakCache = nullptr;
 };
 
-// From https://github.com/CedricGuillemet/ImGuizmo/blob/master/example/main.cpp
-void RenderSequencer() {
-  // sequence with default values
-  // static std::vector<MySequence::MySequenceItem> initItems;
+MySequence& GetSequence() {
   static MySequence mySequence{-100,
                                1000,
                                {{0, 10, 30, false},
@@ -512,6 +653,15 @@ void RenderSequencer() {
                                 {3, 12, 60, false},
                                 {2, 61, 90, false},
                                 {4, 90, 99, false}}};
+  return mySequence;
+}
+
+// From https://github.com/CedricGuillemet/ImGuizmo/blob/master/example/main.cpp
+void RenderSequencer(PeakCache* peak_cache) {
+  // sequence with default values
+  // static std::vector<MySequence::MySequenceItem> initItems;
+  MySequence& mySequence = GetSequence();
+  mySequence.peakCache = peak_cache;
 
   ImGui::SetNextWindowSize(ImVec2(940, 480), ImGuiCond_Appearing);
   ImGui::Begin("Sequencer");
@@ -548,8 +698,26 @@ void RenderSequencer() {
 
 }  // namespace
 
+void Gui::AddAudioClip(const std::string& path, int frame_start,
+                       int frame_end) {
+  if (peak_cache_) peak_cache_->Request(path);
+  // Type 1 is "Music".
+  GetSequence().myItems.push_back({1, frame_start, frame_end, false, path});
+}
+
+void Gui::AddNoteClip(std::shared_ptr<const NoteStore> notes,
+                      int frame_start, int frame_end) {
+  // Type 1 is "Music".
+  GetSequence().myItems.push_back(
+      {1, frame_start, frame_end, false, "", std::move(notes)});
+}
+
+void Gui::SetAutomationCallback(AutomationCallback callback) {
+  GetSequence().rampEdit.onEdit = std::move(callback);
+}
+
 void Gui::RenderCore() {
-  RenderSequencer();
+  RenderSequencer(peak_cache_);
   RenderMyFirstTool();
 
   // 1. Show the big demo window (Most of the sample code is in
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "imgui.h"
 #define GL_SILENCE_DEPRECATION
@@ -8,10 +12,22 @@
 
 namespace kodo {
 
+class AutomationLane;
+class NoteStore;
+class PeakCache;
+
+struct GuiOptions {
+  // Draws a frame only on input, RequestRedraw() or a dirty repaint source
+  // instead of every vsync.
+  bool on_demand_redraw = true;
+  // Cap of frames per second driven by repaint sources, e.g. meters.
+  double max_animation_fps = 30;
+};
+
 class Gui {
  public:
   // Initializes GUI resources and libs.
-  static std::unique_ptr<Gui> Init();
+  static std::unique_ptr<Gui> Init(const GuiOptions& options = {});
 
   // Finizelizes GUI resources and libs.
   virtual ~Gui();
@@ -19,6 +35,7 @@ class Gui {
   // Checks if GUI is closed during event loop.
   bool Close();
 
+  // Waits for the next frame to draw in on-demand mode, then starts it.
   void Begin();
 
   void End();
@@ -28,15 +45,51 @@ class Gui {
 
   void* GetHandle();
 
+  // Draws audio clips with peaks from `cache`, which must outlive this.
+  void SetPeakCache(PeakCache* cache) { peak_cache_ = cache; }
+
+  // Adds an audio clip item to the sequencer and requests its peaks.
+  void AddAudioClip(const std::string& path, int frame_start, int frame_end);
+
+  // Adds a note clip item showing all of `notes` as a piano roll.
+  void AddNoteClip(std::shared_ptr<const NoteStore> notes, int frame_start,
+                   int frame_end);
+
+  // Called on the GUI thread with curve `index` of the curve editor after
+  // each edit. Times of `lane` are in sequencer frames.
+  using AutomationCallback =
+      std::function<void(int index, const AutomationLane& lane)>;
+  void SetAutomationCallback(AutomationCallback callback);
+
+  // Wakes Begin() up for a new frame. Thread-safe, but not real-time safe.
+  void RequestRedraw();
+
+  // Adds a check polled at max_animation_fps while waiting, for state that
+  // changes without telling the GUI (e.g. meters). Returns true if a
+  // repaint is needed.
+  void AddRepaintSource(std::function<bool()> dirty) {
+    repaint_sources_.push_back(std::move(dirty));
+  }
+
  private:
   Gui() {}  // Use Init() with error handing.
 
+  // Blocks until input, RequestRedraw() or a dirty repaint source.
+  void WaitForRedraw();
+
   // Our state
   bool show_demo_window_ = true;
   bool show_another_window_ = false;
   ImVec4 clear_color_ = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
   GLFWwindow* window_;
   void* plugin_parent_window_;
+  PeakCache* peak_cache_ = nullptr;
+
+  GuiOptions options_;
+  std::atomic<bool> redraw_requested_ = true;  // Draws the first frame.
+  std::vector<std::function<bool()>> repaint_sources_;
+  // Frames still drawn after input, so ImGui settles hover and click states.
+  int settle_frames_ = 0;
 };
 
 }  // namespace kodo
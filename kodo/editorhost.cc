@@ -4,6 +4,7 @@
 #include <iostream>
 
 #include "base/source/fcommandline.h"
+#include "component_handler.h"
 #include "kodo/platform/iplatform.h"
 #include "pluginterfaces/base/funknown.h"
 #include "pluginterfaces/gui/iplugview.h"
@@ -68,39 +69,8 @@ class WindowController : public IWindowController,
   bool resizeViewRecursionGard{false};
 };
 
-class ComponentHandler : public Steinberg::Vst::IComponentHandler {
- public:
-  tresult PLUGIN_API beginEdit(Steinberg::Vst::ParamID id) override {
-    SMTG_DBPRT1("beginEdit called (%d)\n", id);
-    return kNotImplemented;
-  }
-  tresult PLUGIN_API
-  performEdit(Steinberg::Vst::ParamID id,
-              Steinberg::Vst::ParamValue valueNormalized) override {
-    SMTG_DBPRT2("performEdit called (%d, %f)\n", id, valueNormalized);
-    return kNotImplemented;
-  }
-  tresult PLUGIN_API endEdit(Steinberg::Vst::ParamID id) override {
-    SMTG_DBPRT1("endEdit called (%d)\n", id);
-    return kNotImplemented;
-  }
-  tresult PLUGIN_API restartComponent(int32 flags) override {
-    SMTG_DBPRT1("restartComponent called (%d)\n", flags);
-    return kNotImplemented;
-  }
-
- private:
-  tresult PLUGIN_API queryInterface(const TUID /*_iid*/,
-                                    void** /*obj*/) override {
-    return kNoInterface;
-  }
-  // we do not care here of the ref-counting. A plug-in call of release should
-  // not destroy this class!
-  uint32 PLUGIN_API addRef() override { return 1000; }
-  uint32 PLUGIN_API release() override { return 1000; }
-};
-
-static ComponentHandler gComponentHandler;
+// The standalone editor host processes no audio, so edits have no consumer.
+static ComponentHandler gComponentHandler(/*queue=*/nullptr);
 
 App::~App() noexcept { terminate(); }
 
@@ -1,3 +1,5 @@
+#include <X11/Xlib.h>
+
 #include <chrono>
 #include <iostream>
 #include <memory>
@@ -1,17 +1,39 @@
 #include "kodo/platform/linux/runloop.h"
 
+#include <X11/Xlib.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
 
 namespace kodo {
 
-using LockGuard = std::lock_guard<std::recursive_mutex>;
-
 RunLoop& RunLoop::instance() {
   static RunLoop gInstance;
   return gInstance;
 }
 
+RunLoop::RunLoop() {
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (epollFd < 0 || timerFd < 0) {
+    std::cerr << "Cannot create the epoll run loop\n";
+    return;
+  }
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = timerFd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event);
+}
+
+RunLoop::~RunLoop() {
+  if (timerFd >= 0) close(timerFd);
+  if (epollFd >= 0) close(epollFd);
+}
+
 void RunLoop::setDisplay(Display* display) { this->display = display; }
 
 void RunLoop::registerWindow(XID window, const EventCallback& callback) {
@@ -26,36 +48,60 @@ void RunLoop::unregisterWindow(XID window) {
 
 void RunLoop::registerFileDescriptor(int fd,
                                      const FileDescriptorCallback& callback) {
-  fileDescriptors.emplace(fd, callback);
+  if (!fileDescriptors.emplace(fd, callback).second) return;
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    std::cerr << "Cannot watch file descriptor " << fd << "\n";
+  }
 }
 
 void RunLoop::unregisterFileDescriptor(int fd) {
   auto it = fileDescriptors.find(fd);
   if (it == fileDescriptors.end()) return;
   fileDescriptors.erase(it);
-}
-
-void RunLoop::select(timeval* timeout) {
-  int nfds = 0;
-  fd_set readFDs = {}, writeFDs = {}, exceptFDs = {};
-
-  for (auto& e : fileDescriptors) {
-    int fd = e.first;
-    FD_SET(fd, &readFDs);
-    FD_SET(fd, &writeFDs);
-    FD_SET(fd, &exceptFDs);
-    nfds = std::max(nfds, fd);
+  // Fails harmlessly if the owner closed `fd` already.
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void RunLoop::wait() {
+  constexpr int kMaxEvents = 32;
+  epoll_event events[kMaxEvents];
+  int count = epoll_wait(epollFd, events, kMaxEvents, -1);
+  for (int i = 0; i < count; ++i) {
+    int fd = events[i].data.fd;
+    if (fd == timerFd) {
+      uint64_t expirations;
+      while (read(timerFd, &expirations, sizeof(expirations)) > 0) {
+      }
+      timerProcessor.handleTimers();
+      armTimer();
+      continue;
+    }
+    // An earlier callback may have unregistered it, and this one may
+    // unregister itself.
+    auto it = fileDescriptors.find(fd);
+    if (it == fileDescriptors.end()) continue;
+    FileDescriptorCallback callback = it->second;
+    callback(fd);
   }
+}
 
-  int result = ::select(nfds, &readFDs, &writeFDs, nullptr, timeout);
-
-  if (result > 0) {
-    for (auto& e : fileDescriptors) {
-      if (FD_ISSET(e.first, &readFDs) || FD_ISSET(e.first, &writeFDs) ||
-          FD_ISSET(e.first, &exceptFDs))
-        e.second(e.first);
-    }
+void RunLoop::armTimer() {
+  TimerProcessor::TimePoint nextFireTime;
+  itimerspec spec{};
+  if (timerProcessor.nextFireTime(&nextFireTime)) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  nextFireTime.time_since_epoch())
+                  .count();
+    // Zero would disarm the timer.
+    ns = std::max<int64_t>(ns, 1);
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
   }
+  // steady_clock is CLOCK_MONOTONIC on Linux.
+  timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
 }
 
 bool RunLoop::handleEvents() {
@@ -80,15 +126,15 @@ bool RunLoop::handleEvents() {
 
 TimerID RunLoop::registerTimer(TimerInterval interval,
                                const TimerCallback& callback) {
-  return timerProcessor.registerTimer(interval, callback);
+  auto id = timerProcessor.registerTimer(interval, callback);
+  armTimer();
+  return id;
 }
 
 void RunLoop::unregisterTimer(TimerID id) {
   timerProcessor.unregisterTimer(id);
 }
 
-bool timeValEmpty(timeval& val) { return val.tv_sec == 0 && val.tv_usec == 0; }
-
 void RunLoop::start() {
   running = true;
 
@@ -97,62 +143,69 @@ void RunLoop::start() {
 
   XSync(display, false);
   handleEvents();
-  timeval selectTimeout{};
   while (running && !map.empty()) {
-    select(timeValEmpty(selectTimeout) ? nullptr : &selectTimeout);
-    auto nextFireTime = timerProcessor.handleTimersAndReturnNextFireTimeInMs();
-    if (nextFireTime == TimerProcessor::noTimers) {
-      selectTimeout = {};
-    } else {
-      selectTimeout.tv_sec = nextFireTime / 1000;
-      selectTimeout.tv_usec =
-          (nextFireTime - (selectTimeout.tv_sec * 1000)) * 1000;
-    }
+    wait();
+    // Callbacks may have made Xlib read events into its queue, which leaves
+    // nothing to wake epoll up for.
+    handleEvents();
   }
 }
 
-void RunLoop::stop() { running = false; }
-
-uint64_t TimerProcessor::handleTimersAndReturnNextFireTimeInMs() {
-  using std::chrono::time_point_cast;
-
-  if (timers.empty()) return noTimers;
-
-  auto current = time_point_cast<Millisecond>(Clock::now());
+void RunLoop::run() {
+  running = true;
+  while (running) wait();
+}
 
-  std::vector<TimerID> timersToFire;
-  for (auto& timer : timers) {
-    if (timer.nextFireTime > current) break;
-    timersToFire.push_back(timer.id);
-    updateTimerNextFireTime(timer, current);
-  }
+void RunLoop::stop() { running = false; }
 
-  for (auto id : timersToFire) {
-    for (auto& timer : timers) {
-      if (timer.id == id) {
-        timer.callback(timer.id);
-        break;
-      }
-    }
+void TimerProcessor::handleTimers() {
+  auto current = now();
+  while (dropStaleTop() && heap.front().fireTime <= current) {
+    TimerID id = heap.front().id;
+    std::pop_heap(heap.begin(), heap.end());
+    heap.pop_back();
+
+    Timer& timer = timers.at(id);
+    // At least 1ms ahead, so a zero interval cannot keep this loop busy.
+    timer.nextFireTime =
+        current + Millisecond(std::max<TimerInterval>(timer.interval, 1));
+    push(id, timer.nextFireTime);
+    // The callback may add or remove timers, including itself.
+    TimerCallback callback = timer.callback;
+    callback(id);
   }
-  if (timersToFire.empty()) return noTimers;
+}
 
-  sortTimers();
+bool TimerProcessor::nextFireTime(TimePoint* fireTime) {
+  if (!dropStaleTop()) return false;
+  *fireTime = heap.front().fireTime;
+  return true;
+}
 
-  auto nextFireTime = timers.front().nextFireTime;
-  current = now();
-  if (nextFireTime < current) return 0;
-  return (nextFireTime - current).count();
+void TimerProcessor::push(TimerID id, TimePoint fireTime) {
+  heap.push_back({fireTime, id});
+  std::push_heap(heap.begin(), heap.end());
 }
 
-void TimerProcessor::updateTimerNextFireTime(Timer& timer, TimePoint current) {
-  timer.nextFireTime = current + Millisecond(timer.interval);
+bool TimerProcessor::dropStaleTop() {
+  while (!heap.empty()) {
+    const HeapEntry& top = heap.front();
+    auto it = timers.find(top.id);
+    if (it != timers.end() && it->second.nextFireTime == top.fireTime) {
+      return true;
+    }
+    std::pop_heap(heap.begin(), heap.end());
+    heap.pop_back();
+  }
+  return false;
 }
 
-void TimerProcessor::sortTimers() {
-  std::sort(timers.begin(), timers.end(), [](const Timer& t1, const Timer& t2) {
-    return t1.nextFireTime < t2.nextFireTime;
-  });
+void TimerProcessor::compact() {
+  heap.clear();
+  for (const auto& [id, timer] : timers) {
+    heap.push_back({timer.nextFireTime, id});
+  }
+  std::make_heap(heap.begin(), heap.end());
 }
 
 auto TimerProcessor::now() -> TimePoint {
@@ -163,24 +216,18 @@ TimerID TimerProcessor::registerTimer(TimerInterval interval,
                                       const TimerCallback& callback) {
   auto timerId = ++timerIdCounter;
   Timer timer;
-  timer.id = timerId;
   timer.callback = callback;
   timer.interval = interval;
-  updateTimerNextFireTime(timer, now());
-
-  timers.emplace_back(std::move(timer));
-  sortTimers();
-
+  timer.nextFireTime = now() + Millisecond(interval);
+  push(timerId, timer.nextFireTime);
+  timers.emplace(timerId, std::move(timer));
   return timerId;
 }
 
 void TimerProcessor::unregisterTimer(TimerID id) {
-  for (auto it = timers.begin(), end = timers.end(); it != end; ++it) {
-    if (it->id == id) {
-      timers.erase(it);
-      break;
-    }
-  }
+  if (timers.erase(id) == 0) return;
+  // Bound the stale entries when editors churn through timers.
+  if (heap.size() > 2 * timers.size() + 16) compact();
 }
 
 }  // namespace kodo
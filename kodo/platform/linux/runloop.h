@@ -1,45 +1,64 @@
 #pragma once
 
-#include <X11/Xlib.h>
-
 #include <chrono>
+#include <cstdint>
 #include <functional>
-#include <mutex>
-#include <thread>
 #include <unordered_map>
 #include <vector>
 
+// Not <X11/Xlib.h>, whose macros such as Status break code including this.
+struct _XDisplay;
+typedef struct _XDisplay Display;
+union _XEvent;
+typedef union _XEvent XEvent;
+typedef unsigned long XID;
+
 namespace kodo {
 
 using TimerID = uint64_t;
 using TimerInterval = uint64_t;
 using TimerCallback = std::function<void(TimerID)>;
 
+// Timers ordered by a binary min-heap of fire times, so firing one costs
+// O(log n) regardless of how many editors registered timers.
 class TimerProcessor {
  public:
+  using Clock = std::chrono::steady_clock;
+  using Millisecond = std::chrono::milliseconds;
+  using TimePoint = std::chrono::time_point<Clock, Millisecond>;
+
   TimerID registerTimer(TimerInterval interval, const TimerCallback& callback);
   void unregisterTimer(TimerID id);
 
-  static constexpr uint64_t noTimers = std::numeric_limits<uint64_t>::max();
-  uint64_t handleTimersAndReturnNextFireTimeInMs();
+  // Fires every due timer once.
+  void handleTimers();
+  // Returns false if there is no timer, otherwise sets when the next is due.
+  bool nextFireTime(TimePoint* fireTime);
 
  private:
-  using Clock = std::chrono::steady_clock;
-  using Millisecond = std::chrono::milliseconds;
-  using TimePoint = std::chrono::time_point<Clock, Millisecond>;
-
   struct Timer {
-    TimerID id;
     TimerInterval interval;
     TimerCallback callback;
     TimePoint nextFireTime;
   };
-  using Timers = std::vector<Timer>;
-  Timers timers;
+  // Unregistered or rescheduled timers leave stale entries behind, skipped
+  // when they reach the top.
+  struct HeapEntry {
+    TimePoint fireTime;
+    TimerID id;
+    bool operator<(const HeapEntry& other) const {
+      return fireTime > other.fireTime;  // Earliest on top.
+    }
+  };
+
+  std::unordered_map<TimerID, Timer> timers;
+  std::vector<HeapEntry> heap;
   TimerID timerIdCounter{0};
 
-  void updateTimerNextFireTime(Timer& timer, TimePoint current);
-  void sortTimers();
+  void push(TimerID id, TimePoint fireTime);
+  // Pops stale entries. Returns false if the heap became empty.
+  bool dropStaleTop();
+  void compact();
   TimePoint now();
 };
 
@@ -61,11 +80,20 @@ class RunLoop {
   TimerID registerTimer(TimerInterval interval, const TimerCallback& callback);
   void unregisterTimer(TimerID id);
 
+  // Dispatches the X events of registered windows until they are all gone.
   void start();
+  // Without a display: dispatches file descriptors and timers until stop(),
+  // for a process hosting plug-in views whose windows live elsewhere.
+  void run();
   void stop();
 
  private:
-  void select(timeval* timeout = nullptr);
+  RunLoop();
+  ~RunLoop();
+
+  // Waits on epoll until a descriptor is ready or the timerfd expires.
+  void wait();
+  void armTimer();
   bool handleEvents();
 
   using WindowMap = std::unordered_map<XID, EventCallback>;
@@ -78,6 +106,8 @@ class RunLoop {
 
   Display* display{nullptr};
   bool running{false};
+  int epollFd{-1};
+  int timerFd{-1};
 };
 
 }  // namespace kodo
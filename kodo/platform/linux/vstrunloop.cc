@@ -0,0 +1,87 @@
+#include "kodo/platform/linux/vstrunloop.h"
+
+#include "kodo/platform/linux/runloop.h"
+#include "pluginterfaces/gui/iplugview.h"
+
+using ::Steinberg::tresult;
+namespace Linux = ::Steinberg::Linux;
+
+namespace kodo {
+
+VstRunLoop::~VstRunLoop() {
+  for (const auto& [fd, handler] : eventHandlers) {
+    RunLoop::instance().unregisterFileDescriptor(fd);
+  }
+  for (const auto& [id, handler] : timerHandlers) {
+    RunLoop::instance().unregisterTimer(id);
+  }
+}
+
+//------------------------------------------------------------------------
+tresult PLUGIN_API VstRunLoop::registerEventHandler(
+    Linux::IEventHandler* handler, Linux::FileDescriptor fd) {
+  if (!handler || eventHandlers.find(fd) != eventHandlers.end())
+    return Steinberg::kInvalidArgument;
+
+  RunLoop::instance().registerFileDescriptor(
+      fd, [handler](int fd) { handler->onFDIsSet(fd); });
+  eventHandlers.emplace(fd, handler);
+  return Steinberg::kResultTrue;
+}
+
+//------------------------------------------------------------------------
+tresult PLUGIN_API
+VstRunLoop::unregisterEventHandler(Linux::IEventHandler* handler) {
+  if (!handler) return Steinberg::kInvalidArgument;
+
+  for (auto it = eventHandlers.begin(), end = eventHandlers.end(); it != end;
+       ++it) {
+    if (it->second == handler) {
+      RunLoop::instance().unregisterFileDescriptor(it->first);
+      eventHandlers.erase(it);
+      return Steinberg::kResultTrue;
+    }
+  }
+
+  return Steinberg::kResultFalse;
+}
+
+//------------------------------------------------------------------------
+tresult PLUGIN_API VstRunLoop::registerTimer(
+    Linux::ITimerHandler* handler, Linux::TimerInterval milliseconds) {
+  if (!handler || milliseconds == 0) return Steinberg::kInvalidArgument;
+
+  auto id = RunLoop::instance().registerTimer(
+      milliseconds, [handler](auto) { handler->onTimer(); });
+  timerHandlers.emplace(id, handler);
+  return Steinberg::kResultTrue;
+}
+
+//------------------------------------------------------------------------
+tresult PLUGIN_API VstRunLoop::unregisterTimer(Linux::ITimerHandler* handler) {
+  if (!handler) return Steinberg::kInvalidArgument;
+
+  for (auto it = timerHandlers.begin(), end = timerHandlers.end(); it != end;
+       ++it) {
+    if (it->second == handler) {
+      RunLoop::instance().unregisterTimer(it->first);
+      timerHandlers.erase(it);
+      return Steinberg::kResultTrue;
+    }
+  }
+
+  return Steinberg::kNotImplemented;
+}
+
+//------------------------------------------------------------------------
+tresult PLUGIN_API VstRunLoop::queryInterface(const Steinberg::TUID iid,
+                                              void** obj) {
+  if (Steinberg::FUnknownPrivate::iidEqual(iid, Linux::IRunLoop::iid) ||
+      Steinberg::FUnknownPrivate::iidEqual(iid, Steinberg::FUnknown::iid)) {
+    *obj = this;
+    return Steinberg::kResultTrue;
+  }
+  return Steinberg::kNoInterface;
+}
+
+}  // namespace kodo
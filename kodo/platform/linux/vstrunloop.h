@@ -0,0 +1,48 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "kodo/platform/linux/runloop.h"
+#include "pluginterfaces/gui/iplugview.h"
+
+namespace kodo {
+
+// Linux::IRunLoop of plug-in views over RunLoop::instance(), on which X11
+// editors watch their file descriptors and run their timers. Hand it out from
+// IPlugFrame::queryInterface(); it must outlive the views.
+class VstRunLoop : public Steinberg::Linux::IRunLoop {
+ public:
+  VstRunLoop() = default;
+  // Drops what the views left registered.
+  ~VstRunLoop();
+
+  VstRunLoop(const VstRunLoop&) = delete;
+  VstRunLoop& operator=(const VstRunLoop&) = delete;
+
+  Steinberg::tresult PLUGIN_API registerEventHandler(
+      Steinberg::Linux::IEventHandler* handler,
+      Steinberg::Linux::FileDescriptor fd) override;
+  Steinberg::tresult PLUGIN_API
+  unregisterEventHandler(Steinberg::Linux::IEventHandler* handler) override;
+  Steinberg::tresult PLUGIN_API
+  registerTimer(Steinberg::Linux::ITimerHandler* handler,
+                Steinberg::Linux::TimerInterval milliseconds) override;
+  Steinberg::tresult PLUGIN_API
+  unregisterTimer(Steinberg::Linux::ITimerHandler* handler) override;
+
+  // Owned by its creator, not ref-counted.
+  Steinberg::uint32 PLUGIN_API addRef() override { return 1000; }
+  Steinberg::uint32 PLUGIN_API release() override { return 1000; }
+  Steinberg::tresult PLUGIN_API queryInterface(const Steinberg::TUID iid,
+                                               void** obj) override;
+
+ private:
+  using EventHandler = Steinberg::IPtr<Steinberg::Linux::IEventHandler>;
+  using TimerHandler = Steinberg::IPtr<Steinberg::Linux::ITimerHandler>;
+
+  std::unordered_map<Steinberg::Linux::FileDescriptor, EventHandler>
+      eventHandlers;
+  std::unordered_map<TimerID, TimerHandler> timerHandlers;
+};
+
+}  // namespace kodo
@@ -6,20 +6,19 @@
 #include <cassert>
 #include <cstdint>
 #include <iostream>
-#include <unordered_map>
 
 #include "kodo/platform/linux/runloop.h"
+#include "kodo/platform/linux/vstrunloop.h"
 #include "pluginterfaces/gui/iplugview.h"
 #include "public.sdk/source/vst/utility/stringconvert.h"
 
-using ::Steinberg::IPtr;
 using ::Steinberg::tresult;
 using ::Steinberg::TUID;
 namespace Linux = ::Steinberg::Linux;
 
 namespace kodo {
 
-struct X11Window::Impl : public Steinberg::Linux::IRunLoop {
+struct X11Window::Impl {
   Impl(X11Window* x11Window);
   bool init(const std::string& name, Size size, bool resizeable,
             const WindowControllerPtr& controller, Display* display,
@@ -41,7 +40,6 @@ struct X11Window::Impl : public Steinberg::Linux::IRunLoop {
   bool handlePlugEvent(const XEvent& event);
   XEmbedInfo* getXEmbedInfo();
   void checkSize();
-  void callPlugEventHandlers();
 
   WindowControllerPtr controller{nullptr};
   WindowClosedFunc windowClosedFunc;
@@ -55,31 +53,11 @@ struct X11Window::Impl : public Steinberg::Linux::IRunLoop {
   Atom xEmbedAtom{None};
   bool isMapped{false};
 
-  using EventHandler = IPtr<Linux::IEventHandler>;
-  using TimerHandler = IPtr<Linux::ITimerHandler>;
-
   Size mCurrentSize{};
   X11Window* x11Window{nullptr};
 
-  using EventHandlers = std::unordered_map<Linux::FileDescriptor, EventHandler>;
-  EventHandlers eventHandlers;
-
-  using TimerHandlers = std::unordered_map<TimerID, TimerHandler>;
-  TimerHandlers timerHandlers;
-
-  tresult PLUGIN_API registerEventHandler(Linux::IEventHandler* handler,
-                                          Linux::FileDescriptor fd) override;
-  tresult PLUGIN_API
-  unregisterEventHandler(Linux::IEventHandler* handler) override;
-  tresult PLUGIN_API registerTimer(Linux::ITimerHandler* handler,
-                                   Linux::TimerInterval milliseconds) override;
-  tresult PLUGIN_API unregisterTimer(Linux::ITimerHandler* handler) override;
-
-  uint32_t PLUGIN_API addRef() override { return 1000; }
-  uint32_t PLUGIN_API release() override { return 1000; }
-  tresult PLUGIN_API queryInterface(const TUID, void**) override {
-    return Steinberg::kNoInterface;
-  }
+  // Handed to the plug-in view as its Linux::IRunLoop.
+  VstRunLoop runLoop;
 };
 
 auto X11Window::make(const std::string& name, Size size, bool resizeable,
@@ -121,7 +99,7 @@ NativePlatformWindow X11Window::getNativePlatformWindow() const {
 
 tresult X11Window::queryInterface(const TUID iid, void** obj) {
   if (Steinberg::FUnknownPrivate::iidEqual(iid, Linux::IRunLoop::iid)) {
-    *obj = impl.get();
+    *obj = &impl->runLoop;
     return Steinberg::kResultTrue;
   }
   return Steinberg::kNoInterface;
@@ -269,70 +247,6 @@ bool X11Window::Impl::init(const std::string& name, Size size, bool resizeable,
   return true;
 }
 
-//------------------------------------------------------------------------
-tresult PLUGIN_API X11Window::Impl::registerEventHandler(
-    Linux::IEventHandler* handler, Linux::FileDescriptor fd) {
-  if (!handler || eventHandlers.find(fd) != eventHandlers.end())
-    return Steinberg::kInvalidArgument;
-
-  RunLoop::instance().registerFileDescriptor(
-      fd, [handler](int fd) { handler->onFDIsSet(fd); });
-  eventHandlers.emplace(fd, handler);
-  return Steinberg::kResultTrue;
-}
-
-//------------------------------------------------------------------------
-tresult PLUGIN_API
-X11Window::Impl::unregisterEventHandler(Linux::IEventHandler* handler) {
-  if (!handler) return Steinberg::kInvalidArgument;
-
-  for (auto it = eventHandlers.begin(), end = eventHandlers.end(); it != end;
-       ++it) {
-    if (it->second == handler) {
-      RunLoop::instance().unregisterFileDescriptor(it->first);
-      eventHandlers.erase(it);
-      return Steinberg::kResultTrue;
-    }
-  }
-
-  return Steinberg::kResultFalse;
-}
-
-//------------------------------------------------------------------------
-tresult PLUGIN_API X11Window::Impl::registerTimer(
-    Linux::ITimerHandler* handler, Linux::TimerInterval milliseconds) {
-  if (!handler || milliseconds == 0) return Steinberg::kInvalidArgument;
-
-  auto id = RunLoop::instance().registerTimer(
-      milliseconds, [handler](auto) { handler->onTimer(); });
-  timerHandlers.emplace(id, handler);
-  return Steinberg::kResultTrue;
-}
-
-//------------------------------------------------------------------------
-tresult PLUGIN_API
-X11Window::Impl::unregisterTimer(Linux::ITimerHandler* handler) {
-  if (!handler) return Steinberg::kInvalidArgument;
-
-  for (auto it = timerHandlers.begin(), end = timerHandlers.end(); it != end;
-       ++it) {
-    if (it->second == handler) {
-      RunLoop::instance().unregisterTimer(it->first);
-      timerHandlers.erase(it);
-      return Steinberg::kResultTrue;
-    }
-  }
-
-  return Steinberg::kNotImplemented;
-}
-
-//------------------------------------------------------------------------
-void X11Window::Impl::callPlugEventHandlers() {
-  for (auto& e : eventHandlers) {
-    e.second->onFDIsSet(e.first);
-  }
-}
-
 //------------------------------------------------------------------------
 void X11Window::Impl::show() { XMapWindow(xDisplay, xWindow); }
 
@@ -0,0 +1,245 @@
+#include "latency_tuner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "audio_engine.h"
+#include "device_settings.pb.h"
+#include "portaudio.h"
+
+namespace kodo {
+namespace {
+
+namespace fs = std::filesystem;
+
+absl::StatusOr<DeviceSettings> ReadSettings(const std::string& path) {
+  DeviceSettings settings;
+  if (path.empty()) return settings;
+  std::ifstream input(path, std::ios::binary);
+  if (!input) return settings;  // First run.
+  if (!settings.ParseFromIstream(&input)) {
+    return absl::DataLossError(
+        absl::StrCat("Corrupted device settings ", path));
+  }
+  return settings;
+}
+
+absl::Status WriteSettings(const DeviceSettings& settings,
+                           const std::string& path) {
+  // Write then rename, so a crash never leaves truncated settings.
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream output(tmp, std::ios::binary | std::ios::trunc);
+    if (!settings.SerializeToOstream(&output)) {
+      return absl::InternalError(absl::StrCat("Cannot write ", tmp));
+    }
+  }
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    return absl::InternalError(
+        absl::StrCat("Cannot rename ", tmp, ": ", ec.message()));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<LatencyTuner>> LatencyTuner::Create(
+    AudioEngine* engine, const LatencyTunerOptions& options) {
+  if (options.block_sizes.empty()) {
+    return absl::InvalidArgumentError("No block sizes to tune.");
+  }
+  absl::StatusOr<DeviceSettings> settings =
+      ReadSettings(options.settings_path);
+  if (!settings.ok()) return settings.status();
+  std::unique_ptr<LatencyTuner> ret(new LatencyTuner(engine, options));
+  ret->settings_ = *std::move(settings);
+  const PaDeviceInfo* info = Pa_GetDeviceInfo(engine->options().device);
+  ret->device_ = info->name;
+  ret->host_api_ = Pa_GetHostApiInfo(info->hostApi)->name;
+  ret->TakeWindow();
+  return ret;
+}
+
+int LatencyTuner::saved_block_size() const {
+  const int index = FindDevice();
+  return index < 0 ? 0 : settings_.devices(index).block_size();
+}
+
+absl::Status LatencyTuner::Restore() {
+  const int saved = saved_block_size();
+  if (saved <= 0 || saved == block_size()) return absl::OkStatus();
+  LOG(INFO) << "Using the saved block_size=" << saved << " of " << device_;
+  return Switch(saved);
+}
+
+absl::StatusOr<int> LatencyTuner::Calibrate() {
+  std::vector<int> sizes = options_.block_sizes;
+  std::sort(sizes.begin(), sizes.end(), std::greater<int>());
+  trials_.clear();
+  // Renders as usual, so the load is that of the project.
+  if (absl::Status status = engine_->SetGain(0); !status.ok()) return status;
+  int best = 0;
+  float best_load = 0;
+  for (int size : sizes) {
+    if (absl::Status status = Switch(size); !status.ok()) {
+      LOG(WARNING) << "Skipping block_size=" << size << ": " << status;
+      continue;
+    }
+    // The first callbacks of a stream are often late.
+    absl::SleepFor(options_.window / 4);
+    TakeWindow();
+    absl::SleepFor(options_.window);
+    const LatencyWindow window = TakeWindow();
+    trials_.push_back(window);
+    LOG(INFO) << "block_size=" << size << " load=" << window.max_load
+              << " jitter=" << window.max_jitter << " xruns=" << window.xruns
+              << " deadline_misses=" << window.deadline_misses
+              << (window.stable ? " stable" : " unstable");
+    if (!window.stable) break;
+    best = size;
+    best_load = window.max_load;
+  }
+  const bool found = best > 0;
+  if (!found) best = sizes.front();
+  absl::Status status = Switch(best);
+  if (absl::Status unmuted = engine_->SetGain(1); status.ok()) {
+    status = unmuted;
+  }
+  if (!status.ok()) return status;
+  if (!found) {
+    LOG(WARNING) << "No stable block size on " << device_
+                 << ". Using the largest.";
+    return best;
+  }
+  LOG(INFO) << "Calibrated block_size=" << best << " on " << device_;
+  if (absl::Status saved = Save(best, best_load); !saved.ok()) return saved;
+  return best;
+}
+
+void LatencyTuner::Poll() {
+  const absl::Time now = absl::Now();
+  if (now - window_start_ < options_.window) return;
+  last_window_ = TakeWindow();
+  const int current = block_size();
+  if (!last_window_.stable) {
+    unstable_[current] = now;
+    calm_windows_ = 0;
+    // The smallest larger candidate, or none.
+    suggestion_ = 0;
+    for (int size : options_.block_sizes) {
+      if (size > current && (suggestion_ == 0 || size < suggestion_)) {
+        suggestion_ = size;
+      }
+    }
+    return;
+  }
+  if (last_window_.max_load >= options_.lower_load) {
+    calm_windows_ = 0;
+    if (suggestion_ < current) suggestion_ = 0;
+    return;
+  }
+  if (++calm_windows_ < options_.lower_windows || suggestion_ != 0) return;
+  // The largest smaller candidate not unstable lately, or none.
+  for (int size : options_.block_sizes) {
+    if (size >= current || size <= suggestion_) continue;
+    auto it = unstable_.find(size);
+    if (it != unstable_.end() && now - it->second < options_.retry_after) {
+      continue;
+    }
+    suggestion_ = size;
+  }
+}
+
+absl::Status LatencyTuner::Apply() {
+  if (suggestion_ <= 0) return absl::OkStatus();
+  const int size = suggestion_;
+  if (absl::Status status = Switch(size); !status.ok()) {
+    unstable_[size] = absl::Now();
+    return status;
+  }
+  LOG(INFO) << "Switched to block_size=" << size << " on " << device_;
+  return Save(size, 0);
+}
+
+absl::Status LatencyTuner::Switch(int block_size) {
+  absl::Status status = engine_->SetBlockSize(block_size);
+  suggestion_ = 0;
+  calm_windows_ = 0;
+  TakeWindow();
+  return status;
+}
+
+LatencyWindow LatencyTuner::TakeWindow() {
+  EngineStats& stats = engine_->stats();
+  const absl::Time now = absl::Now();
+  LatencyWindow window;
+  window.block_size = block_size();
+  const uint64_t callbacks = stats.callback.Read().count;
+  const uint64_t xruns = stats.xruns.load(std::memory_order_relaxed);
+  const uint64_t deadline_misses =
+      stats.deadline_misses.load(std::memory_order_relaxed);
+  window.callbacks = callbacks - callbacks_;
+  window.xruns = xruns - xruns_;
+  window.deadline_misses = deadline_misses - deadline_misses_;
+  std::tie(window.max_load, window.max_jitter) = stats.TakeWindow();
+  // A stalled stream calls back too rarely to miss anything.
+  const double expected = absl::ToDoubleSeconds(now - window_start_) *
+                          engine_->options().device_sample_rate /
+                          window.block_size;
+  window.stable = window.xruns == 0 && window.deadline_misses == 0 &&
+                  window.max_load <= options_.max_load &&
+                  window.max_jitter <= options_.max_jitter &&
+                  window.callbacks >= expected / 2;
+  window_start_ = now;
+  callbacks_ = callbacks;
+  xruns_ = xruns;
+  deadline_misses_ = deadline_misses;
+  return window;
+}
+
+absl::Status LatencyTuner::Save(int block_size, float max_load) {
+  const int index = FindDevice();
+  DeviceLatency* entry = index < 0 ? settings_.add_devices()
+                                   : settings_.mutable_devices(index);
+  entry->set_device(device_);
+  entry->set_host_api(host_api_);
+  entry->set_sample_rate(engine_->options().device_sample_rate);
+  entry->set_block_size(block_size);
+  if (max_load > 0) {
+    entry->set_max_load(max_load);
+  } else {
+    entry->clear_max_load();
+  }
+  if (options_.settings_path.empty()) return absl::OkStatus();
+  return WriteSettings(settings_, options_.settings_path);
+}
+
+int LatencyTuner::FindDevice() const {
+  const double sample_rate = engine_->options().device_sample_rate;
+  for (int i = 0; i < settings_.devices_size(); ++i) {
+    const DeviceLatency& entry = settings_.devices(i);
+    if (entry.device() == device_ && entry.host_api() == host_api_ &&
+        entry.sample_rate() == sample_rate) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+}  // namespace kodo
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "audio_engine.h"
+#include "device_settings.pb.h"
+
+namespace kodo {
+
+struct LatencyTunerOptions {
+  // Candidate frames per callback.
+  std::vector<int> block_sizes = {32, 64, 128, 256, 512, 1024, 2048};
+  // How long each candidate plays while calibrating, and the windows in
+  // which Poll() judges the running one.
+  absl::Duration window = absl::Seconds(2);
+  // A window is stable without xruns and missed deadlines, and with its
+  // worst load and jitter, over the buffer duration, below these.
+  float max_load = 0.7;
+  float max_jitter = 0.5;
+  // Poll() suggests a smaller buffer after this many stable windows in a
+  // row with their worst load below lower_load.
+  int lower_windows = 15;
+  float lower_load = 0.3;
+  // An unstable block size is not suggested again for this long.
+  absl::Duration retry_after = absl::Minutes(5);
+  // File of DeviceSettings. Empty saves nothing.
+  std::string settings_path = "device_settings.binpb";
+};
+
+// Stream health over one window.
+struct LatencyWindow {
+  int block_size = 0;
+  uint64_t callbacks = 0;
+  uint64_t xruns = 0;
+  uint64_t deadline_misses = 0;
+  float max_load = 0;
+  float max_jitter = 0;
+  bool stable = false;
+};
+
+// Picks the smallest stable buffer of an AudioEngine for the load of what it
+// plays, from the callback timing in EngineStats, and saves it per device
+// and sample rate. While running, suggests a larger buffer once a window
+// turns unstable and a smaller one once the load stays low. GUI thread only.
+class LatencyTuner {
+ public:
+  // Reads the saved settings. `engine` must outlive the tuner.
+  static absl::StatusOr<std::unique_ptr<LatencyTuner>> Create(
+      AudioEngine* engine, const LatencyTunerOptions& options);
+
+  // Block size saved for the device at its sample rate, or 0.
+  int saved_block_size() const;
+  // Switches the engine to saved_block_size(), if any.
+  absl::Status Restore();
+
+  // Plays every candidate from the largest down, muted, for a window each
+  // until one is unstable. Settles on the smallest stable one, or the
+  // largest if none is, saves it and returns it. Blocks meanwhile.
+  absl::StatusOr<int> Calibrate();
+  // The windows measured by the last Calibrate().
+  const std::vector<LatencyWindow>& trials() const { return trials_; }
+
+  // Judges the current window once it has passed. Call once per GUI frame.
+  void Poll();
+  // Block size Poll() suggests switching to, or 0.
+  int suggestion() const { return suggestion_; }
+  // Switches the engine to suggestion() and saves it.
+  absl::Status Apply();
+
+  int block_size() const { return engine_->options().block_size; }
+  // The last window judged by Poll().
+  const LatencyWindow& last_window() const { return last_window_; }
+
+ private:
+  LatencyTuner(AudioEngine* engine, const LatencyTunerOptions& options)
+      : engine_(engine), options_(options) {}
+
+  // Switches the engine and starts a new window.
+  absl::Status Switch(int block_size);
+  // Ends the current window and starts the next one.
+  LatencyWindow TakeWindow();
+  // Records `block_size` for the device, with the load measured by
+  // calibration if positive, and writes the settings.
+  absl::Status Save(int block_size, float max_load);
+  // Index of the device at its sample rate in settings_, or -1.
+  int FindDevice() const;
+
+  AudioEngine* const engine_;
+  const LatencyTunerOptions options_;
+  DeviceSettings settings_;
+  std::string device_;
+  std::string host_api_;
+  std::vector<LatencyWindow> trials_;
+
+  absl::Time window_start_;
+  uint64_t callbacks_ = 0;
+  uint64_t xruns_ = 0;
+  uint64_t deadline_misses_ = 0;
+  LatencyWindow last_window_;
+  int calm_windows_ = 0;
+  int suggestion_ = 0;
+  // When each block size was last found unstable.
+  std::map<int, absl::Time> unstable_;
+};
+
+}  // namespace kodo
@@ -0,0 +1,62 @@
+#include "load_window.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "imgui.h"
+#include "plugin_loader.h"
+
+namespace kodo {
+
+void RenderLoadWindow(const PluginLoader& loader) {
+  const std::vector<PluginLoader::Instance>& instances = loader.instances();
+  const bool failed = std::any_of(
+      instances.begin(), instances.end(), [](const auto& instance) {
+        return instance.state == PluginLoader::State::kFailed;
+      });
+  if (loader.done() && !failed) return;
+
+  ImGui::SetNextWindowSize(ImVec2(420, 260), ImGuiCond_FirstUseEver);
+  ImGui::Begin("Plugins");
+  ImGui::ProgressBar(static_cast<float>(loader.num_done()) /
+                         std::max<int>(instances.size(), 1),
+                     ImVec2(-1, 0));
+  ImGui::Text("%d of %d loaded", loader.num_done(),
+              static_cast<int>(instances.size()));
+  if (ImGui::BeginTable("Instances", 3)) {
+    ImGui::TableSetupColumn("Track");
+    ImGui::TableSetupColumn("Plugin");
+    ImGui::TableSetupColumn("State");
+    ImGui::TableHeadersRow();
+    for (const PluginLoader::Instance& instance : instances) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(instance.track->name().c_str());
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(instance.plugin
+                                 ? instance.plugin->name().c_str()
+                                 : instance.instance->path().c_str());
+      ImGui::TableNextColumn();
+      switch (instance.state) {
+        case PluginLoader::State::kLoading:
+          ImGui::TextUnformatted("Loading");
+          break;
+        case PluginLoader::State::kReady:
+          ImGui::TextUnformatted("Ready");
+          break;
+        case PluginLoader::State::kFailed:
+          ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "Failed");
+          if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("%s", std::string(instance.status.message())
+                                        .c_str());
+          }
+          break;
+      }
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+}  // namespace kodo
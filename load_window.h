@@ -0,0 +1,11 @@
+#pragma once
+
+#include "plugin_loader.h"
+
+namespace kodo {
+
+// Draws the "Plugins" window with the progress of every plugin of `loader`
+// by track, until all of them are ready. Failed ones stay listed.
+void RenderLoadWindow(const PluginLoader& loader);
+
+}  // namespace kodo
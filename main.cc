@@ -1,8 +1,21 @@
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "absl/cleanup/cleanup.h"
+#include "absl/debugging/symbolize.h"
+#include "absl/flags/commandlineflag.h"
 #include "absl/flags/declare.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
@@ -10,16 +23,140 @@
 #include "absl/log/initialize.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/time/time.h"
+#include "anticipation.h"
+#include "audio_engine.h"
+#include "audio_file.h"
+#include "automation.h"
+#include "clip_source.h"
+#include "graph_scheduler.h"
+#include "google/protobuf/arena.h"
 #include "gui.h"
 #include "kodo.pb.h"
+#include "latency_tuner.h"
+#include "load_window.h"
+#include "meter.h"
+#include "meter_window.h"
+#include "midi_input.h"
+#include "note_store.h"
+#include "offline_render.h"
+#include "peak_cache.h"
+#include "perf_counters.h"
+#include "perf_window.h"
+#include "plugin_cache.pb.h"
+#include "plugin_loader.h"
+#include "plugin_sandbox.h"
+#include "plugin_scanner.h"
+#include "plugin_state_cache.h"
 #include "plugin_vst3.h"
 #include "portaudio.h"
+#include "project_io.h"
+#include "recorder.h"
 #include "public.sdk/source/vst/hosting/hostclasses.h"
 #include "public.sdk/source/vst/hosting/plugprovider.h"
+#include "render_graph.h"
+#include "resampler.h"
+#include "spectrum_analyzer.h"
+#include "trace.h"
+#include "track_freeze.h"
 
 ABSL_FLAG(bool, gui, true, "Will launch GUI.");
 ABSL_FLAG(std::string, test_vst3, "", "Test the given VST3 on launch.");
+ABSL_FLAG(std::string, test_clip, "",
+          "Play the given WAV file on a track from the beginning.");
+ABSL_FLAG(bool, audio, true, "Will open the audio output stream.");
+ABSL_FLAG(int, audio_device, -1,
+          "PortAudio output device index. -1 uses the default device.");
+ABSL_FLAG(double, sample_rate, 48000,
+          "Sample rate in Hz of a new project. A loaded project renders at "
+          "its own rate, at which all its positions are.");
+ABSL_FLAG(double, device_sample_rate, 0,
+          "Rate of the output device in Hz, resampled from the project rate. "
+          "0 uses the project rate and -1 the default rate of the device.");
+ABSL_FLAG(std::string, resampler_quality, "standard",
+          "Sample-rate conversion of clips and the device output: fast, "
+          "standard or best.");
+ABSL_FLAG(int, block_size, 128,
+          "Audio frames per callback. Unless set, the size saved by "
+          "--calibrate_latency for the device.");
+ABSL_FLAG(bool, calibrate_latency, false,
+          "Plays the project muted at decreasing block sizes and keeps the "
+          "smallest stable one for the device in --device_settings.");
+ABSL_FLAG(bool, auto_latency, false,
+          "Switches the block size as the load changes instead of offering "
+          "it in the Performance window.");
+ABSL_FLAG(std::string, device_settings, "device_settings.binpb",
+          "File of the block sizes chosen per audio device.");
+ABSL_FLAG(std::string, record, "",
+          "Records the audio input into this WAV file until exit.");
+ABSL_FLAG(int, input_device, -1,
+          "PortAudio input device index for --record. -1 uses the default "
+          "device.");
+ABSL_FLAG(int, input_channels, 2, "Channels recorded by --record.");
+ABSL_FLAG(int, midi_input, -1,
+          "MIDI input port played by --test_vst3, or else by the first "
+          "track. -1 for none.");
+ABSL_FLAG(int, audio_threads,
+          std::max<int>(std::thread::hardware_concurrency(), 2) - 1,
+          "Worker threads rendering the audio graph besides the callback.");
+ABSL_FLAG(int, anticipation_block_size, 2048,
+          "Frames per block of tracks without live input, which render ahead "
+          "of the playhead on low-priority threads. 0 renders every track in "
+          "the callback.");
+ABSL_FLAG(int, anticipation_blocks, 4,
+          "Blocks buffered ahead of the playhead per anticipated track.");
+ABSL_FLAG(int, anticipation_threads, 1,
+          "Low-priority threads rendering anticipated tracks besides the one "
+          "filling their buffers.");
+ABSL_FLAG(bool, scan_plugins, true,
+          "Will scan VST3 directories in the background on launch.");
+ABSL_FLAG(std::string, plugin_cache, "plugin_cache.binpb",
+          "File caching the VST3 scan results.");
+ABSL_FLAG(std::string, scan_vst3_module, "",
+          "Internal: scans one module into --scan_out and exits.");
+ABSL_FLAG(std::string, scan_out, "", "Internal: see --scan_vst3_module.");
+ABSL_FLAG(bool, sandbox_plugins, false,
+          "Will run plugins in separate plugin_host processes.");
+ABSL_FLAG(std::string, plugin_host, "",
+          "plugin_host binary. Defaults to the one next to this binary.");
+ABSL_FLAG(int, plugin_load_threads, 4,
+          "Threads opening the plugin modules of the project.");
+ABSL_FLAG(std::string, project, "", "Project file to open.");
+ABSL_FLAG(std::vector<std::string>, freeze, {},
+          "Tracks, by name, to render with their plugins into --freeze_cache "
+          "and play from there without instantiating the plugins.");
+ABSL_FLAG(std::vector<std::string>, unfreeze, {},
+          "Frozen tracks, by name, to play through their plugins again.");
+ABSL_FLAG(std::string, freeze_cache, "freeze_cache",
+          "Directory of frozen track renderings.");
+ABSL_FLAG(int, autosave_seconds, 60,
+          "Interval of saving project changes in the background. 0 disables "
+          "autosave.");
+ABSL_FLAG(std::string, render, "",
+          "Renders the project into this WAV file as fast as possible without "
+          "opening an audio device, then exits.");
+ABSL_FLAG(int, render_block_size, 4096, "Frames per block with --render.");
+ABSL_FLAG(double, render_tail_seconds, 2,
+          "Seconds rendered past the last clip with --render, e.g. for "
+          "reverb tails.");
+ABSL_FLAG(int, render_bits, 32,
+          "Bits per sample with --render: 16 or 24 for PCM, 32 for float.");
+ABSL_FLAG(int, headless_seconds, 0,
+          "With --gui=false, keeps rendering audio this long and logs the "
+          "performance counters every second.");
+ABSL_FLAG(bool, gui_on_demand, true,
+          "Will redraw the GUI only on input or state changes instead of "
+          "every vsync.");
+ABSL_FLAG(double, gui_max_fps, 30,
+          "Redraw rate cap for meters and the spectrum with --gui_on_demand.");
+ABSL_FLAG(std::string, trace_out, "",
+          "Records trace events of the audio, worker and GUI threads from "
+          "launch and writes them here at exit, as Chrome trace JSON for a "
+          ".json path and as a Perfetto trace otherwise. The Performance "
+          "window also toggles recording and saves here, or to trace.json.");
 ABSL_DECLARE_FLAG(int, stderrthreshold);  // To override in main().
 
 // From https://github.com/PortAudio/portaudio/blob/master/examples/pa_devs.c
@@ -60,10 +197,54 @@ absl::Status ListAudioDevices() {
                                  deviceInfo->defaultHighInputLatency);
     LOG(INFO) << absl::StrFormat("Default high output latency = %8.4f",
                                  deviceInfo->defaultHighOutputLatency);
+    LOG(INFO) << absl::StrFormat("Default sample rate         = %8.1f",
+                                 deviceInfo->defaultSampleRate);
   }
   return absl::OkStatus();
 }
 
+// Child process side of kodo::ScanPlugins().
+int ScanModule(const std::string& path, const std::string& out) {
+  absl::StatusOr<kodo::PluginModuleInfo> info = kodo::ScanVst3Module(path);
+  if (!info.ok()) {
+    LOG(ERROR) << info.status();
+    return 1;
+  }
+  std::ofstream output(out, std::ios::binary);
+  if (!info->SerializeToOstream(&output)) {
+    LOG(ERROR) << "Cannot write " << out;
+    return 1;
+  }
+  return 0;
+}
+
+// Opens a VST3 module, whose classes load in plugin_host processes with
+// --sandbox_plugins.
+absl::StatusOr<std::unique_ptr<kodo::PluginModule>> OpenModule(
+    const std::string& path, const char* argv0) {
+  if (absl::GetFlag(FLAGS_sandbox_plugins)) {
+    kodo::SandboxOptions sandbox_options;
+    sandbox_options.host_command = absl::GetFlag(FLAGS_plugin_host);
+    if (sandbox_options.host_command.empty()) {
+      sandbox_options.host_command =
+          (std::filesystem::path(argv0).parent_path() / "plugin_host")
+              .string();
+    }
+    sandbox_options.vst3_path = path;
+    return kodo::SandboxedVst3Module(sandbox_options);
+  }
+  return kodo::Vst3Module(path);
+}
+
+// Loads class `class_index` of a VST3 module.
+absl::StatusOr<std::unique_ptr<kodo::Plugin>> LoadPlugin(
+    const std::string& path, int class_index, const char* argv0) {
+  absl::StatusOr<std::unique_ptr<kodo::PluginModule>> module =
+      OpenModule(path, argv0);
+  if (!module.ok()) return module.status();
+  return (*module)->Load(class_index);
+}
+
 int main(int argc, char** argv) {
   // Process command line flags. https://abseil.io/docs/cpp/guides/flags.
   absl::SetFlag(&FLAGS_stderrthreshold, 0);
@@ -71,59 +252,644 @@ int main(int argc, char** argv) {
 
   // Log startup info.
   absl::InitializeLog();
+  // Names the frames of trapped real-time allocations.
+  absl::InitializeSymbolizer(argv[0]);
   LOG(INFO) << "Current path:" << std::filesystem::current_path();
   for (int i = 0; i < argc; ++i) {
     LOG(INFO) << "arg[" << i << "]: " << argv[i];
   }
 
-  kodo::Project project;
-  project.set_name("<untitled>");
-  project.set_author("<unknown>");
-  LOG(INFO) << "Project proto\n" << project.Utf8DebugString();
+  // VST3::Hosting::
+  Steinberg::Vst::HostApplication vst_host_app;
+  Steinberg::Vst::PluginContextFactory::instance().setPluginContext(
+      &vst_host_app);
+
+  if (std::string path = absl::GetFlag(FLAGS_scan_vst3_module);
+      !path.empty()) {
+    return ScanModule(path, absl::GetFlag(FLAGS_scan_out));
+  }
+
+  // Waits for the background scan on exit.
+  std::future<absl::StatusOr<kodo::PluginCache>> plugin_scan;
+  if (absl::GetFlag(FLAGS_scan_plugins)) {
+    kodo::PluginScanOptions scan_options;
+    scan_options.directories = kodo::DefaultVst3Directories();
+    scan_options.cache_path = absl::GetFlag(FLAGS_plugin_cache);
+    scan_options.scanner_command = argv[0];
+    plugin_scan =
+        std::async(std::launch::async, kodo::ScanPlugins, scan_options);
+  }
+
+  // Owns the project and everything parsed with it.
+  google::protobuf::Arena project_arena;
+  kodo::Project* project = nullptr;
+  if (std::string path = absl::GetFlag(FLAGS_project); !path.empty()) {
+    absl::StatusOr<kodo::Project*> loaded =
+        kodo::LoadProject(path, &project_arena);
+    if (loaded.ok()) {
+      project = *loaded;
+    } else {
+      LOG(ERROR) << loaded.status();
+    }
+  }
+  if (project == nullptr) {
+    project = google::protobuf::Arena::Create<kodo::Project>(&project_arena);
+    project->set_name("<untitled>");
+    project->set_author("<unknown>");
+    project->set_sample_rate(absl::GetFlag(FLAGS_sample_rate));
+  }
+  LOG(INFO) << "Project " << project->name() << " with "
+            << project->tracks_size() << " tracks";
 
-  PaError err = Pa_Initialize();
-  absl::Cleanup pa_cleanup = []() { Pa_Terminate(); };
+  // Unfrozen tracks load their plugins with the saved states again.
+  auto find_track = [&](const std::string& name) -> int {
+    for (int i = 0; i < project->tracks_size(); ++i) {
+      if (project->tracks(i).name() == name) return i;
+    }
+    LOG(ERROR) << "No track named " << name;
+    return -1;
+  };
+  for (const std::string& name : absl::GetFlag(FLAGS_unfreeze)) {
+    if (int i = find_track(name); i >= 0) {
+      project->mutable_tracks(i)->clear_freeze();
+    }
+  }
+  if (std::vector<std::string> names = absl::GetFlag(FLAGS_freeze);
+      !names.empty()) {
+    kodo::FreezeOptions freeze_options;
+    freeze_options.cache_dir = absl::GetFlag(FLAGS_freeze_cache);
+    freeze_options.loader.num_threads =
+        absl::GetFlag(FLAGS_plugin_load_threads);
+    freeze_options.loader.open_module =
+        [argv0 = argv[0]](const std::string& path) {
+          return OpenModule(path, argv0);
+        };
+    for (const std::string& name : names) {
+      const int i = find_track(name);
+      if (i < 0) continue;
+      absl::StatusOr<kodo::Freeze> freeze =
+          kodo::FreezeTrack(*project, i, freeze_options);
+      if (freeze.ok()) {
+        *project->mutable_tracks(i)->mutable_freeze() = *std::move(freeze);
+      } else {
+        LOG(ERROR) << freeze.status();
+      }
+    }
+  }
+
+  // Bouncing to a file never opens an audio device.
+  const std::string render_path = absl::GetFlag(FLAGS_render);
+  const bool offline = !render_path.empty();
+  PaError err = offline ? paNoError : Pa_Initialize();
+  absl::Cleanup pa_cleanup = [offline]() {
+    if (!offline) Pa_Terminate();
+  };
   if (err != paNoError) {
     LOG(ERROR) << "Pa_Initialize failed: " << Pa_GetErrorText(err);
     return err;
   }
 
-  if (absl::Status status = ListAudioDevices(); !status.ok()) {
-    LOG(ERROR) << status;
+  if (!offline) {
+    if (absl::Status status = ListAudioDevices(); !status.ok()) {
+      LOG(ERROR) << status;
+    }
+    absl::StatusOr<std::vector<std::string>> midi_ports =
+        kodo::MidiInputPorts();
+    if (midi_ports.ok()) {
+      for (int i = 0; i < midi_ports->size(); ++i) {
+        LOG(INFO) << "MIDI input: " << i << " " << (*midi_ports)[i];
+      }
+    } else {
+      LOG(ERROR) << midi_ports.status();
+    }
   }
 
   // Load test plugin.
-  // VST3::Hosting::
-  Steinberg::Vst::HostApplication vst_host_app;
-  Steinberg::Vst::PluginContextFactory::instance().setPluginContext(
-      &vst_host_app);
-
   std::unique_ptr<kodo::Plugin> test_plugin;
-  auto module = kodo::Vst3Module(absl::GetFlag(FLAGS_test_vst3));
-  if (module.ok()) {
-    auto plugin = module.value()->Load(0);
-    QCHECK_OK(plugin);
-    test_plugin = std::move(*plugin);
-  } else {
-    LOG(ERROR) << module.status();
+  if (std::string path = absl::GetFlag(FLAGS_test_vst3); !path.empty()) {
+    absl::StatusOr<std::unique_ptr<kodo::Plugin>> plugin =
+        LoadPlugin(path, 0, argv[0]);
+    if (plugin.ok()) {
+      test_plugin = std::move(*plugin);
+    } else {
+      LOG(ERROR) << plugin.status();
+    }
   }
 
+  kodo::ResamplerQuality resampler_quality = kodo::ResamplerQuality::kStandard;
+  if (const std::string quality = absl::GetFlag(FLAGS_resampler_quality);
+      quality == "fast") {
+    resampler_quality = kodo::ResamplerQuality::kFast;
+  } else if (quality == "best") {
+    resampler_quality = kodo::ResamplerQuality::kBest;
+  } else if (quality != "standard") {
+    LOG(ERROR) << "Unknown --resampler_quality=" << quality;
+  }
+  // Clips and devices at common rates then never wait for filter design.
+  kodo::PrecomputeResamplerFilters(resampler_quality);
+
+  const std::string trace_out = absl::GetFlag(FLAGS_trace_out);
+  if (!trace_out.empty()) kodo::StartTracing();
+  // Runs last, once every traced thread has stopped.
+  absl::Cleanup write_trace = [&trace_out]() {
+    if (trace_out.empty()) return;
+    if (absl::Status status = kodo::WriteTrace(trace_out); !status.ok()) {
+      LOG(ERROR) << status;
+    }
+  };
+
+  // Must outlive the engine which renders graphs on them.
+  kodo::PerfRegistry perf_registry;
+  std::unique_ptr<kodo::MidiInput> midi_input;
+  std::unique_ptr<kodo::ClipPrefetcher> clip_prefetcher;
+  std::vector<std::unique_ptr<kodo::ClipPlayer>> clip_players;
+  std::vector<std::unique_ptr<kodo::NotePlayer>> note_players;
+  std::unordered_map<const kodo::Track*,
+                     std::unique_ptr<kodo::AutomationPlayer>>
+      automation_players;
+  std::unique_ptr<kodo::PluginLoader> plugin_loader;
+  std::unique_ptr<kodo::GraphScheduler> scheduler;
+  std::unordered_map<const kodo::Track*, std::unique_ptr<kodo::AheadBuffer>>
+      ahead_buffers;
+  std::unique_ptr<kodo::Anticipator> anticipator;
+  std::unique_ptr<kodo::SpectrumAnalyzer> spectrum_analyzer;
+  // Parallel to the nodes of BuildRenderNodes(), if metered.
+  std::vector<std::unique_ptr<kodo::Meter>> meters;
+  std::unique_ptr<kodo::AudioEngine> audio_engine;
+  if (absl::GetFlag(FLAGS_audio) && !offline) {
+    kodo::AudioEngineOptions options;
+    options.device = absl::GetFlag(FLAGS_audio_device);
+    // Clips, notes and automation are in frames at the project rate.
+    options.sample_rate = project->sample_rate();
+    options.device_sample_rate = absl::GetFlag(FLAGS_device_sample_rate);
+    options.resampler_quality = resampler_quality;
+    options.block_size = absl::GetFlag(FLAGS_block_size);
+    const std::string record_path = absl::GetFlag(FLAGS_record);
+    if (!record_path.empty()) {
+      options.input_device = absl::GetFlag(FLAGS_input_device);
+      options.num_input_channels = absl::GetFlag(FLAGS_input_channels);
+    }
+    absl::StatusOr<std::unique_ptr<kodo::AudioEngine>> engine =
+        kodo::AudioEngine::Init(options);
+    if (engine.ok()) {
+      audio_engine = std::move(*engine);
+      QCHECK_OK(audio_engine->Start());
+    } else {
+      LOG(ERROR) << engine.status();
+    }
+    if (audio_engine && !record_path.empty()) {
+      // The engine stops and finalizes the take when it goes away.
+      kodo::RecorderOptions recorder_options;
+      recorder_options.path = record_path;
+      recorder_options.sample_rate = audio_engine->options().device_sample_rate;
+      recorder_options.num_channels = options.num_input_channels;
+      absl::StatusOr<std::unique_ptr<kodo::Recorder>> recorder =
+          kodo::Recorder::Create(recorder_options);
+      absl::Status status = recorder.status();
+      if (status.ok()) status = audio_engine->SetRecorder(std::move(*recorder));
+      if (!status.ok()) LOG(ERROR) << status;
+    }
+  }
+
+  // The same graph renders live or offline.
+  std::unique_ptr<kodo::GraphRenderer> renderer;
+  kodo::ProcessSetup setup;
+  int num_channels = 2;
+  if (audio_engine) {
+    setup.sample_rate = audio_engine->options().sample_rate;
+    setup.max_block_size = audio_engine->options().block_size;
+    num_channels = audio_engine->options().num_output_channels;
+  } else if (offline) {
+    setup.sample_rate = project->sample_rate();
+    setup.max_block_size = absl::GetFlag(FLAGS_render_block_size);
+    setup.offline = true;
+  }
+  // Tracks without live input render ahead of the playhead in larger blocks,
+  // which their plugins and players are set up for too.
+  const int live_block_size = setup.max_block_size;
+  kodo::AnticipationOptions anticipation_options;
+  anticipation_options.block_size =
+      audio_engine ? absl::GetFlag(FLAGS_anticipation_block_size) : 0;
+  anticipation_options.num_workers = absl::GetFlag(FLAGS_anticipation_threads);
+  setup.max_block_size =
+      std::max(setup.max_block_size, anticipation_options.block_size);
+  if (audio_engine) {
+    if (int port = absl::GetFlag(FLAGS_midi_input); port >= 0) {
+      absl::StatusOr<std::unique_ptr<kodo::MidiInput>> midi =
+          kodo::MidiInput::Open(port, setup.sample_rate);
+      if (midi.ok()) {
+        midi_input = std::move(*midi);
+      } else {
+        LOG(ERROR) << midi.status();
+      }
+    }
+  }
+  int midi_track = midi_input ? 0 : -1;
+  // With the GUI, the arrangement shows and plays while plugins load. Tracks
+  // stay muted until their chains are ready. Calibration measures the
+  // complete project instead.
+  const bool async_load = !offline && absl::GetFlag(FLAGS_gui) &&
+                          !absl::GetFlag(FLAGS_calibrate_latency);
+  // Players outlive every graph rebuilt on them.
+  std::unordered_map<const kodo::Track*, kodo::AudioRenderer*> sources;
+  std::unordered_map<const kodo::Track*, kodo::NotePlayer*> note_sources;
+  int64_t test_plugin_id = -1;
+  kodo::RenderGraphOptions graph_options;
+  std::function<std::unique_ptr<kodo::GraphRenderer>()> build_renderer;
+  if (audio_engine || offline) {
+    // Runs in the background while the players below are set up.
+    kodo::PluginLoaderOptions loader_options;
+    loader_options.num_threads = absl::GetFlag(FLAGS_plugin_load_threads);
+    loader_options.setup = setup;
+    loader_options.open_module = [argv0 = argv[0]](const std::string& path) {
+      return OpenModule(path, argv0);
+    };
+    plugin_loader = kodo::PluginLoader::Create(*project, loader_options);
+
+    if (test_plugin) {
+      QCHECK_OK(test_plugin->SetupProcessing(setup));
+      QCHECK_OK(test_plugin->SetActive(true));
+      int64_t max_id = 0;
+      for (const kodo::PluginLoader::Instance& instance :
+           plugin_loader->instances()) {
+        max_id = std::max(max_id, instance.instance->id());
+      }
+      test_plugin_id = max_id + 1;
+      kodo::Track* track = project->add_tracks();
+      track->set_name("Track 1");
+      kodo::PluginInstance* instance = track->add_plugins();
+      instance->set_id(test_plugin_id);
+      instance->set_path(absl::GetFlag(FLAGS_test_vst3));
+      if (midi_input) midi_track = project->tracks_size() - 1;
+    }
+    if (std::string path = absl::GetFlag(FLAGS_test_clip); !path.empty()) {
+      kodo::Track* track = project->add_tracks();
+      track->set_name("Clip 1");
+      track->add_audio_clips()->set_path(path);
+    }
+
+    kodo::ClipPrefetcherOptions prefetch_options;
+    // Offline, clip players decode on the render threads instead.
+    prefetch_options.background = !offline;
+    prefetch_options.sample_rate = setup.sample_rate;
+    prefetch_options.resampler_quality = resampler_quality;
+    clip_prefetcher = kodo::ClipPrefetcher::Create(prefetch_options);
+    for (const kodo::Track& track : project->tracks()) {
+      absl::StatusOr<std::unique_ptr<kodo::ClipPlayer>> player =
+          kodo::CreateTrackPlayer(track, *clip_prefetcher,
+                                  setup.max_block_size);
+      if (!player.ok()) {
+        LOG(ERROR) << track.name() << ": " << player.status();
+      } else if (*player) {
+        sources[&track] = player->get();
+        clip_players.push_back(std::move(*player));
+      }
+    }
+    for (const kodo::Track& track : project->tracks()) {
+      if (track.note_clips().empty()) continue;
+      absl::StatusOr<std::shared_ptr<const kodo::NoteStore>> notes =
+          kodo::NoteStore::Create(track);
+      if (!notes.ok()) {
+        LOG(ERROR) << notes.status();
+        continue;
+      }
+      note_players.push_back(std::make_unique<kodo::NotePlayer>(*notes));
+      note_sources[&track] = note_players.back().get();
+    }
+    auto compile_automation = [&](const kodo::Track& track) {
+      if (track.automation().empty()) return;
+      absl::StatusOr<std::shared_ptr<const kodo::AutomationTable>> table =
+          kodo::AutomationTable::Compile(track);
+      if (!table.ok()) {
+        LOG(ERROR) << table.status();
+        return;
+      }
+      automation_players[&track] =
+          std::make_unique<kodo::AutomationPlayer>(*table);
+    };
+    for (const kodo::Track& track : project->tracks()) {
+      compile_automation(track);
+    }
+    for (const kodo::Track& bus : project->buses()) compile_automation(bus);
+    compile_automation(project->master());
+    if (anticipation_options.block_size > 0) {
+      const int capacity =
+          anticipation_options.block_size *
+          std::max(absl::GetFlag(FLAGS_anticipation_blocks), 1);
+      for (int i = 0; i < project->tracks_size(); ++i) {
+        if (i == midi_track) continue;  // Plays the MIDI input live.
+        ahead_buffers[&project->tracks(i)] =
+            std::make_unique<kodo::AheadBuffer>(num_channels, capacity);
+      }
+    }
+    if (audio_engine && absl::GetFlag(FLAGS_gui)) {
+      // Measure only while the meter window shows them.
+      kodo::SpectrumOptions spectrum_options;
+      spectrum_options.sample_rate = setup.sample_rate;
+      absl::StatusOr<std::unique_ptr<kodo::SpectrumAnalyzer>> analyzer =
+          kodo::SpectrumAnalyzer::Create(spectrum_options);
+      QCHECK_OK(analyzer.status());
+      spectrum_analyzer = *std::move(analyzer);
+      auto add_meter = [&](const kodo::Track& track,
+                           kodo::SpectrumAnalyzer* analyzer) {
+        meters.push_back(std::make_unique<kodo::Meter>(
+            track.name(), num_channels, /*window_frames=*/1024, analyzer));
+      };
+      for (const kodo::Track& track : project->tracks()) {
+        add_meter(track, nullptr);
+      }
+      for (const kodo::Track& bus : project->buses()) add_meter(bus, nullptr);
+      add_meter(project->master(), spectrum_analyzer.get());
+    }
+
+    scheduler =
+        kodo::GraphScheduler::Create(absl::GetFlag(FLAGS_audio_threads));
+    graph_options.num_channels = num_channels;
+    graph_options.max_block_size = live_block_size;
+    graph_options.perf = &perf_registry;
+    graph_options.midi_track = midi_track;
+    graph_options.plugins_loading = async_load;
+    if (!async_load) plugin_loader->Finish();
+    build_renderer = [&]() -> std::unique_ptr<kodo::GraphRenderer> {
+      absl::StatusOr<std::vector<kodo::RenderNodeSpec>> specs =
+          kodo::BuildRenderNodes(
+              *project, graph_options,
+              [&](const kodo::PluginInstance& instance) {
+                return instance.id() == test_plugin_id
+                           ? test_plugin.get()
+                           : plugin_loader->Find(instance.id());
+              },
+              [&](const kodo::Track& track) {
+                auto it = sources.find(&track);
+                return it == sources.end() ? nullptr : it->second;
+              },
+              [&](const kodo::Track& track) {
+                auto it = note_sources.find(&track);
+                return it == note_sources.end() ? nullptr : it->second;
+              },
+              [&](const kodo::Track& track) {
+                auto it = automation_players.find(&track);
+                return it == automation_players.end() ? nullptr
+                                                      : it->second.get();
+              });
+      if (!specs.ok()) {
+        LOG(ERROR) << specs.status();
+        return nullptr;
+      }
+      for (int i = 0; i < meters.size() && i < specs->size(); ++i) {
+        (*specs)[i].meter = meters[i].get();
+      }
+      if (!ahead_buffers.empty()) {
+        // A buffer takes one writer at a time. The playing graph drains what
+        // the previous one rendered meanwhile.
+        anticipator.reset();
+        absl::StatusOr<std::unique_ptr<kodo::Anticipator>> ahead =
+            kodo::Anticipator::Create(
+                *specs,
+                [&](int index) -> kodo::AheadBuffer* {
+                  if (index >= project->tracks_size()) return nullptr;
+                  auto it = ahead_buffers.find(&project->tracks(index));
+                  return it == ahead_buffers.end() ? nullptr
+                                                   : it->second.get();
+                },
+                graph_options, anticipation_options);
+        if (!ahead.ok()) {
+          LOG(ERROR) << ahead.status();
+          return nullptr;
+        }
+        anticipator = *std::move(ahead);
+      }
+      absl::StatusOr<std::unique_ptr<kodo::RenderGraph>> graph =
+          kodo::RenderGraph::Create(*std::move(specs), graph_options);
+      if (!graph.ok()) {
+        LOG(ERROR) << graph.status();
+        return nullptr;
+      }
+      auto ret = std::make_unique<kodo::GraphRenderer>(
+          std::move(*graph), scheduler.get(), midi_input.get());
+      LOG(INFO) << "Plugin latency=" << ret->latency() << " frames";
+      return ret;
+    };
+    renderer = build_renderer();
+    if (anticipator && !anticipator->AwaitFull(absl::Seconds(1))) {
+      LOG(WARNING) << "Anticipated tracks start before their buffers filled.";
+    }
+  }
+
+  if (offline) {
+    if (!renderer) return 1;
+    kodo::OfflineRenderOptions render_options;
+    render_options.sample_rate = setup.sample_rate;
+    render_options.block_size = setup.max_block_size;
+    render_options.num_channels = num_channels;
+    render_options.latency = renderer->latency();
+    int64_t length = kodo::ProjectLength(*project);
+    for (const std::unique_ptr<kodo::ClipPlayer>& player : clip_players) {
+      length = std::max(length, player->end());
+    }
+    render_options.num_frames =
+        length + absl::GetFlag(FLAGS_render_tail_seconds) * setup.sample_rate;
+    absl::StatusOr<std::unique_ptr<kodo::AudioFileWriter>> writer =
+        kodo::CreateWavFile(render_path, setup.sample_rate, num_channels,
+                            absl::GetFlag(FLAGS_render_bits));
+    if (!writer.ok()) {
+      LOG(ERROR) << writer.status();
+      return 1;
+    }
+    if (absl::Status status =
+            kodo::RenderOffline(*renderer, render_options, **writer);
+        !status.ok()) {
+      LOG(ERROR) << status;
+      return 1;
+    }
+    return 0;
+  }
+  if (audio_engine && renderer) {
+    QCHECK_OK(audio_engine->SetRenderer(std::move(renderer)));
+  }
+
+  std::unique_ptr<kodo::LatencyTuner> latency_tuner;
+  if (audio_engine) {
+    kodo::LatencyTunerOptions tuner_options;
+    tuner_options.settings_path = absl::GetFlag(FLAGS_device_settings);
+    absl::StatusOr<std::unique_ptr<kodo::LatencyTuner>> tuner =
+        kodo::LatencyTuner::Create(audio_engine.get(), tuner_options);
+    absl::Status status = tuner.status();
+    if (tuner.ok()) {
+      latency_tuner = std::move(*tuner);
+      if (absl::GetFlag(FLAGS_calibrate_latency)) {
+        status = latency_tuner->Calibrate().status();
+      } else if (!absl::GetFlagReflectionHandle(FLAGS_block_size)
+                      .IsSpecifiedOnCommandLine()) {
+        status = latency_tuner->Restore();
+      }
+    }
+    if (!status.ok()) LOG(ERROR) << status;
+  }
+  auto tune_latency = [&]() {
+    if (!latency_tuner) return;
+    latency_tuner->Poll();
+    if (absl::GetFlag(FLAGS_auto_latency) && latency_tuner->suggestion() > 0) {
+      if (absl::Status status = latency_tuner->Apply(); !status.ok()) {
+        LOG(ERROR) << status;
+      }
+    }
+  };
+
   if (!absl::GetFlag(FLAGS_gui)) {
     LOG(INFO) << "Skip GUI by --gui=false.";
+    if (!audio_engine) return 0;
+    for (int i = 0; i < absl::GetFlag(FLAGS_headless_seconds); ++i) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      audio_engine->Poll();
+      tune_latency();
+      std::string report =
+          kodo::FormatPerfReport(audio_engine->stats(), perf_registry.Read());
+      if (const kodo::Recorder* recorder = audio_engine->recorder()) {
+        absl::StrAppend(&report, "\n  recorder: ",
+                        kodo::FormatRecorderStats(recorder->stats()));
+      }
+      LOG(INFO) << report;
+    }
     return 0;
   }
 
   // Launch GUI.
-  std::unique_ptr<kodo::Gui> gui = kodo::Gui::Init();
+  kodo::GuiOptions gui_options;
+  gui_options.on_demand_redraw = absl::GetFlag(FLAGS_gui_on_demand);
+  gui_options.max_animation_fps = absl::GetFlag(FLAGS_gui_max_fps);
+  std::unique_ptr<kodo::Gui> gui = kodo::Gui::Init(gui_options);
+  // Joins its thread, which requests redraws, before the GUI goes away.
+  std::unique_ptr<kodo::PeakCache> peak_cache = kodo::PeakCache::Create();
+  gui->SetPeakCache(peak_cache.get());
+  peak_cache->SetOnReady([&gui]() { gui->RequestRedraw(); });
+  if (!meters.empty()) {
+    // Only levels that visibly move repaint, not every rendered block.
+    gui->AddRepaintSource([&meters, &spectrum_analyzer]() {
+      return kodo::MeterWindowDirty(meters, spectrum_analyzer.get());
+    });
+  }
+  if (plugin_loader) {
+    // Progress shows and tracks unmute without input.
+    gui->AddRepaintSource(
+        [&plugin_loader]() { return !plugin_loader->done(); });
+  }
+  if (std::string path = absl::GetFlag(FLAGS_test_clip); !path.empty()) {
+    gui->AddAudioClip(path, 0, 100);
+  }
+  for (const std::unique_ptr<kodo::NotePlayer>& player : note_players) {
+    gui->AddNoteClip(player->notes(), 0, 100);
+  }
+
+  kodo::ProjectModel project_model(*project);
+  // Plugins join as they finish loading.
+  kodo::PluginStateCache state_cache;
+  if (test_plugin) state_cache.Add(test_plugin_id, test_plugin.get());
+  // The curve editor edits the lanes of the first automated track.
+  int automated_track = -1;
+  for (int i = 0; i < project->tracks_size(); ++i) {
+    if (automation_players.contains(&project->tracks(i))) {
+      automated_track = i;
+      break;
+    }
+  }
+  if (automated_track >= 0) {
+    kodo::AutomationPlayer* player =
+        automation_players[&project->tracks(automated_track)].get();
+    // The demo sequencer counts hundredths of a second.
+    const double frames_per_unit = setup.sample_rate / 100;
+    gui->SetAutomationCallback([&project_model, automated_track, player,
+                                frames_per_unit](
+                                   int curve,
+                                   const kodo::AutomationLane& edited) {
+      kodo::Track* track = project_model.mutable_track(automated_track);
+      if (curve >= track->automation_size()) return;
+      kodo::AutomationLane* lane = track->mutable_automation(curve);
+      lane->clear_time();
+      for (int64_t time : edited.time()) {
+        lane->add_time(std::llround(time * frames_per_unit));
+      }
+      *lane->mutable_value() = edited.value();
+      *lane->mutable_curve() = edited.curve();
+      absl::StatusOr<std::shared_ptr<const kodo::AutomationTable>> table =
+          kodo::AutomationTable::Compile(*track);
+      if (table.ok()) {
+        player->SetTable(*std::move(table));
+      } else {
+        LOG(ERROR) << table.status();
+      }
+    });
+  }
+  std::unique_ptr<kodo::ProjectAutosaver> autosaver;
+  const std::chrono::seconds autosave_interval(
+      absl::GetFlag(FLAGS_autosave_seconds));
+  if (autosave_interval.count() > 0) {
+    const std::string path = absl::GetFlag(FLAGS_project);
+    autosaver = kodo::ProjectAutosaver::Create(
+        path.empty() ? "autosave.binpb" : path + ".autosave");
+  }
+  int64_t autosaved_generation = -1;
+  auto last_autosave = std::chrono::steady_clock::now();
+
+  kodo::TraceThread trace_thread("GUI");
   while (!gui->Close()) {
+    if (audio_engine) audio_engine->Poll();
+    tune_latency();
+    if (plugin_loader && !plugin_loader->done()) {
+      const int completed = plugin_loader->Poll();
+      for (const kodo::PluginLoader::Instance& instance :
+           plugin_loader->instances()) {
+        const int64_t id = instance.instance->id();
+        if (instance.plugin && !state_cache.contains(id)) {
+          state_cache.Add(id, instance.plugin.get());
+        }
+      }
+      if (completed > 0 && audio_engine) {
+        // Unmutes the tracks whose chains just finished.
+        if (std::unique_ptr<kodo::GraphRenderer> rebuilt = build_renderer()) {
+          QCHECK_OK(audio_engine->SetRenderer(std::move(rebuilt)));
+        }
+      }
+    }
+    state_cache.Poll(absl::Milliseconds(4));
+    if (autosaver && std::chrono::steady_clock::now() - last_autosave >=
+                         autosave_interval) {
+      // Only plugins edited since their last capture serialize here.
+      state_cache.Flush();
+    }
+    for (std::shared_ptr<const kodo::PluginState>& state :
+         state_cache.TakeChanges()) {
+      project_model.SetPluginState(std::move(state));
+    }
+    if (autosaver && project_model.generation() != autosaved_generation &&
+        std::chrono::steady_clock::now() - last_autosave >=
+            autosave_interval) {
+      // Copies only pointers; the autosaver serializes in the background.
+      autosaver->Save(project_model.snapshot());
+      autosaved_generation = project_model.generation();
+      last_autosave = std::chrono::steady_clock::now();
+    }
     gui->Begin();
 
-    ImGui::NewFrame();
-    if (test_plugin) {
-      QCHECK_OK(test_plugin->Render(gui->GetHandle()));
+    {
+      kodo::TraceScope trace_frame("ImGui frame");
+      ImGui::NewFrame();
+      if (test_plugin) {
+        QCHECK_OK(test_plugin->Render(gui->GetHandle()));
+      }
+      gui->RenderCore();
+      if (audio_engine) {
+        kodo::RenderPerfWindow(audio_engine->stats(), perf_registry,
+                               latency_tuner.get(),
+                               trace_out.empty() ? "trace.json" : trace_out,
+                               audio_engine->recorder());
+      }
+      if (!meters.empty()) {
+        kodo::RenderMeterWindow(meters, spectrum_analyzer.get());
+      }
+      if (plugin_loader) kodo::RenderLoadWindow(*plugin_loader);
+      ImGui::Render();
     }
-    gui->RenderCore();
-    ImGui::Render();
     gui->End();
   }
 }
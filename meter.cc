@@ -0,0 +1,132 @@
+#include "meter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dsp.h"
+#include "spectrum_analyzer.h"
+
+namespace kodo {
+namespace {
+
+// The 4x oversampling filter of ITU-R BS.1770-4, Annex 2, one row per
+// phase.
+constexpr float kTruePeakTaps[4][12] = {
+    {0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f,
+     -0.0594482421875f, 0.1373291015625f, 0.9721679687500f, -0.1022949218750f,
+     0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f},
+    {-0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f,
+     -0.1665039062500f, 0.4650878906250f, 0.7797851562500f, -0.2003173828125f,
+     0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f},
+    {-0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f,
+     -0.2003173828125f, 0.7797851562500f, 0.4650878906250f, -0.1665039062500f,
+     0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f},
+    {-0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f,
+     -0.1022949218750f, 0.9721679687500f, 0.1373291015625f, -0.0594482421875f,
+     0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f},
+};
+
+// Levels below -120 dBFS all read as silence.
+float ToDb(float amplitude) {
+  return 20 * std::log10(std::max(amplitude, 1e-6f));
+}
+
+}  // namespace
+
+Meter::Meter(std::string name, int num_channels, int window_frames,
+             SpectrumAnalyzer* analyzer)
+    : name_(std::move(name)),
+      num_channels_(std::clamp(num_channels, 0, MeterLevels::kMaxChannels)),
+      window_frames_(std::max(window_frames, 1)),
+      analyzer_(analyzer),
+      history_(num_channels_, std::vector<float>(kTaps - 1 + kChunk)),
+      oversampled_(kChunk) {}
+
+void Meter::Process(const float* const* channels, int num_channels,
+                    int num_frames) {
+  if (analyzer_) analyzer_->Write(channels, num_channels, num_frames);
+  if (!visible_.load(std::memory_order_relaxed)) {
+    measuring_ = false;
+    return;
+  }
+  if (!measuring_) {
+    // Frames from before hiding would read as a glitch.
+    measuring_ = true;
+    frames_ = 0;
+    peak_.fill(0);
+    sum_squares_.fill(0);
+    true_peak_.fill(0);
+    for (std::vector<float>& history : history_) {
+      std::fill(history.begin(), history.end(), 0.0f);
+    }
+  }
+  const DspKernels& dsp = Dsp();
+  const int channels_used = std::min(num_channels, num_channels_);
+  int done = 0;
+  while (done < num_frames) {
+    // Publishes on window boundaries, whatever the block size.
+    const int n = std::min(num_frames - done, window_frames_ - frames_);
+    for (int c = 0; c < channels_used; ++c) {
+      const float* x = channels[c] + done;
+      peak_[c] = std::max(peak_[c], dsp.max_abs(x, n));
+      sum_squares_[c] += dsp.dot(x, x, n);
+      for (int i = 0; i < n; i += kChunk) {
+        AddTruePeak(c, x + i, std::min(kChunk, n - i));
+      }
+    }
+    done += n;
+    frames_ += n;
+    if (frames_ < window_frames_) break;
+
+    MeterLevels& levels = levels_.back();
+    levels.num_channels = channels_used;
+    for (int c = 0; c < channels_used; ++c) {
+      levels.peak[c] = peak_[c];
+      levels.rms[c] = std::sqrt(sum_squares_[c] / frames_);
+      levels.true_peak[c] = std::max(true_peak_[c], peak_[c]);
+    }
+    levels_.Publish();
+    frames_ = 0;
+    peak_.fill(0);
+    sum_squares_.fill(0);
+    true_peak_.fill(0);
+  }
+}
+
+bool Meter::Changed(float threshold_db) const {
+  const MeterLevels& levels = levels_.front();
+  if (levels.num_channels != drawn_.num_channels) return true;
+  auto moved = [threshold_db](float a, float b) {
+    return std::fabs(ToDb(a) - ToDb(b)) > threshold_db;
+  };
+  for (int c = 0; c < levels.num_channels; ++c) {
+    if (moved(levels.peak[c], drawn_.peak[c]) ||
+        moved(levels.rms[c], drawn_.rms[c]) ||
+        moved(levels.true_peak[c], drawn_.true_peak[c])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Meter::AddTruePeak(int c, const float* x, int num_frames) {
+  const DspKernels& dsp = Dsp();
+  float* history = history_[c].data();
+  std::copy_n(x, num_frames, history + kTaps - 1);
+  float* y = oversampled_.data();
+  for (const auto& taps : kTruePeakTaps) {
+    // y[i] = sum of taps[k] * x[i - k], one tap over the chunk at a time.
+    std::fill_n(y, num_frames, 0.0f);
+    for (int k = 0; k < kTaps; ++k) {
+      dsp.add_scaled(history + kTaps - 1 - k, taps[k], y, num_frames);
+    }
+    true_peak_[c] = std::max(true_peak_[c], dsp.max_abs(y, num_frames));
+  }
+  // Keeps the last kTaps - 1 frames for the next chunk.
+  std::copy_n(history + num_frames, kTaps - 1, history);
+}
+
+}  // namespace kodo
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "spectrum_analyzer.h"
+#include "triple_buffer.h"
+
+namespace kodo {
+
+// Linear amplitudes of one window of a Meter.
+struct MeterLevels {
+  static constexpr int kMaxChannels = 8;
+
+  int num_channels = 0;
+  std::array<float, kMaxChannels> peak = {};
+  std::array<float, kMaxChannels> rms = {};
+  // Peak of the signal 4x oversampled as in ITU-R BS.1770-4, which catches
+  // peaks between samples.
+  std::array<float, kMaxChannels> true_peak = {};
+};
+
+// Peak, RMS and true-peak levels of one node of the render graph, measured
+// on the rendering thread and handed to the GUI through a TripleBuffer.
+// While hidden, Process() returns at once, so meters cost in proportion to
+// those on screen.
+class Meter {
+ public:
+  // Publishes levels every `window_frames`. `analyzer`, if set, gets the
+  // same signal and must outlive the meter.
+  Meter(std::string name, int num_channels, int window_frames = 1024,
+        SpectrumAnalyzer* analyzer = nullptr);
+
+  Meter(const Meter&) = delete;
+  Meter& operator=(const Meter&) = delete;
+
+  const std::string& name() const { return name_; }
+  int num_channels() const { return num_channels_; }
+  SpectrumAnalyzer* analyzer() const { return analyzer_; }
+
+  // Any thread. Showing starts a new window.
+  void SetVisible(bool visible) {
+    visible_.store(visible, std::memory_order_relaxed);
+  }
+  bool visible() const { return visible_.load(std::memory_order_relaxed); }
+
+  // Rendering thread, one at a time. Measures the next
+  // `channels[num_channels][num_frames]`. Real-time safe.
+  void Process(const float* const* channels, int num_channels,
+               int num_frames);
+
+  // GUI thread. Switches levels() to the latest window, if any.
+  bool Update() { return levels_.Update(); }
+  // GUI thread. The levels of the last Update().
+  const MeterLevels& levels() const { return levels_.front(); }
+
+  // GUI thread. Whether any level of levels() is more than `threshold_db`
+  // away from the last MarkDrawn(), so a repaint would show a change.
+  bool Changed(float threshold_db) const;
+  void MarkDrawn() { drawn_ = levels(); }
+
+ private:
+  // Frames oversampled at a time, and taps of each polyphase filter.
+  static constexpr int kChunk = 256;
+  static constexpr int kTaps = 12;
+
+  // Adds the true peak of `num_frames` <= kChunk of channel `c`.
+  void AddTruePeak(int c, const float* x, int num_frames);
+
+  const std::string name_;
+  const int num_channels_;
+  const int window_frames_;
+  SpectrumAnalyzer* const analyzer_;
+  std::atomic<bool> visible_ = false;
+
+  // Rendering thread only. Whether the window below is current, and the
+  // window so far.
+  bool measuring_ = false;
+  int frames_ = 0;
+  std::array<float, MeterLevels::kMaxChannels> peak_;
+  std::array<double, MeterLevels::kMaxChannels> sum_squares_;
+  std::array<float, MeterLevels::kMaxChannels> true_peak_;
+  // Per channel, the last kTaps - 1 frames followed by a chunk.
+  std::vector<std::vector<float>> history_;
+  std::vector<float> oversampled_;
+
+  TripleBuffer<MeterLevels> levels_;
+  MeterLevels drawn_;  // GUI thread only.
+};
+
+}  // namespace kodo
@@ -0,0 +1,113 @@
+#include "meter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace kodo {
+namespace {
+
+std::vector<float> Sine(int num_frames, double cycles_per_frame,
+                        double phase = 0, float amplitude = 1) {
+  std::vector<float> x(num_frames);
+  for (int i = 0; i < num_frames; ++i) {
+    x[i] = amplitude *
+           std::sin(2 * std::numbers::pi * cycles_per_frame * i + phase);
+  }
+  return x;
+}
+
+// Feeds `x` in blocks of `block` frames and returns how many windows
+// were published.
+int Feed(Meter& meter, const std::vector<float>& x, int block) {
+  int published = 0;
+  for (int i = 0; i < x.size(); i += block) {
+    const float* channels[] = {x.data() + i};
+    meter.Process(channels, 1, std::min<int>(block, x.size() - i));
+    published += meter.Update();
+  }
+  return published;
+}
+
+TEST(MeterTest, PublishesOnWindowBoundaries) {
+  Meter meter("test", 1, /*window_frames=*/1000);
+  meter.SetVisible(true);
+  const std::vector<float> x(999, 0.5f);
+  // Blocks that do not divide the window.
+  EXPECT_EQ(Feed(meter, x, 37), 0);
+  EXPECT_EQ(Feed(meter, std::vector<float>(1, 0.5f), 1), 1);
+  EXPECT_EQ(meter.levels().num_channels, 1);
+  EXPECT_FLOAT_EQ(meter.levels().peak[0], 0.5f);
+  EXPECT_NEAR(meter.levels().rms[0], 0.5f, 1e-6);
+}
+
+TEST(MeterTest, HiddenMeterPublishesNothing) {
+  Meter meter("test", 1, /*window_frames=*/100);
+  EXPECT_EQ(Feed(meter, std::vector<float>(1000, 1.0f), 64), 0);
+}
+
+TEST(MeterTest, ShowingStartsANewWindow) {
+  Meter meter("test", 1, /*window_frames=*/100);
+  meter.SetVisible(true);
+  EXPECT_EQ(Feed(meter, std::vector<float>(60, 1.0f), 60), 0);
+  meter.SetVisible(false);
+  Feed(meter, std::vector<float>(60, 1.0f), 60);
+  meter.SetVisible(true);
+  // The 60 frames from before hiding are gone.
+  EXPECT_EQ(Feed(meter, std::vector<float>(60, 0.25f), 60), 0);
+  EXPECT_EQ(Feed(meter, std::vector<float>(40, 0.25f), 40), 1);
+  EXPECT_FLOAT_EQ(meter.levels().peak[0], 0.25f);
+}
+
+TEST(MeterTest, SineLevels) {
+  Meter meter("test", 1, /*window_frames=*/4800);
+  meter.SetVisible(true);
+  // 100 whole cycles.
+  ASSERT_EQ(Feed(meter, Sine(4800, 1.0 / 48), 256), 1);
+  EXPECT_NEAR(meter.levels().peak[0], 1.0f, 1e-3);
+  EXPECT_NEAR(meter.levels().rms[0], std::sqrt(0.5f), 1e-4);
+  EXPECT_GE(meter.levels().true_peak[0], meter.levels().peak[0]);
+}
+
+// A sine at a quarter of the rate with its peaks between samples: those
+// read 0.707 while the true peak is 1, the case of ITU-R BS.1770-4.
+TEST(MeterTest, TruePeakFindsPeaksBetweenSamples) {
+  Meter meter("test", 1, /*window_frames=*/4096);
+  meter.SetVisible(true);
+  ASSERT_EQ(Feed(meter, Sine(4096, 0.25, std::numbers::pi / 4), 300), 1);
+  EXPECT_NEAR(meter.levels().peak[0], std::sqrt(0.5f), 1e-5);
+  // Within the 0.1 dB or so the 4x filter is off by at this frequency.
+  EXPECT_NEAR(20 * std::log10(meter.levels().true_peak[0]), 0.0, 0.2);
+}
+
+TEST(MeterTest, TruePeakIsContinuousAcrossBlocks) {
+  const std::vector<float> x = Sine(4096, 0.25, std::numbers::pi / 4);
+  Meter whole("whole", 1, 4096), split("split", 1, 4096);
+  whole.SetVisible(true);
+  split.SetVisible(true);
+  ASSERT_EQ(Feed(whole, x, 4096), 1);
+  ASSERT_EQ(Feed(split, x, 7), 1);
+  EXPECT_NEAR(whole.levels().true_peak[0], split.levels().true_peak[0],
+              1e-5);
+}
+
+TEST(MeterTest, ChangedComparesWithLastDrawn) {
+  Meter meter("test", 1, /*window_frames=*/100);
+  meter.SetVisible(true);
+  // The second window is past the overshoot of the true-peak filter.
+  ASSERT_EQ(Feed(meter, std::vector<float>(200, 0.5f), 100), 2);
+  EXPECT_TRUE(meter.Changed(0.5f));
+  meter.MarkDrawn();
+  EXPECT_FALSE(meter.Changed(0.5f));
+  // 0.1 dB quieter stays below the threshold, 6 dB does not.
+  ASSERT_EQ(Feed(meter, std::vector<float>(100, 0.5f * 0.9886f), 100), 1);
+  EXPECT_FALSE(meter.Changed(0.5f));
+  ASSERT_EQ(Feed(meter, std::vector<float>(100, 0.25f), 100), 1);
+  EXPECT_TRUE(meter.Changed(0.5f));
+}
+
+}  // namespace
+}  // namespace kodo
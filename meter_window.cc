@@ -0,0 +1,95 @@
+#include "meter_window.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "imgui.h"
+#include "meter.h"
+#include "spectrum_analyzer.h"
+
+namespace kodo {
+namespace {
+
+// Bottom of the meter scale.
+constexpr float kMinDb = -60;
+
+float ToDb(float amplitude) {
+  return amplitude > 0 ? 20 * std::log10(amplitude) : -INFINITY;
+}
+
+void RenderSpectrum(SpectrumAnalyzer& analyzer, bool open) {
+  const bool shown = open && ImGui::CollapsingHeader("Spectrum");
+  if (analyzer.visible() != shown) analyzer.SetVisible(shown);
+  if (!shown) return;
+  analyzer.Update();
+  const std::vector<float>& spectrum = analyzer.spectrum();
+  const std::string overlay = absl::StrFormat(
+      "0 - %.1f kHz", analyzer.bin_hz() * spectrum.size() / 1000);
+  ImGui::PlotLines("##spectrum", spectrum.data(), spectrum.size(), 0,
+                   overlay.c_str(), analyzer.options().floor_db, 0,
+                   ImVec2(-1, 120));
+}
+
+void RenderLevels(Meter& meter) {
+  meter.Update();
+  const MeterLevels& levels = meter.levels();
+  ImGui::TextUnformatted(meter.name().c_str());
+  for (int c = 0; c < meter.num_channels(); ++c) {
+    if (c >= levels.num_channels) {
+      ImGui::ProgressBar(0, ImVec2(-1, 0), "");
+      continue;
+    }
+    const float rms = ToDb(levels.rms[c]);
+    const float true_peak = ToDb(levels.true_peak[c]);
+    const std::string overlay =
+        absl::StrFormat("RMS %.1f  peak %.1f  true peak %.1f dBFS", rms,
+                        ToDb(levels.peak[c]), true_peak);
+    ImGui::ProgressBar(std::clamp((rms - kMinDb) / -kMinDb, 0.0f, 1.0f),
+                       ImVec2(-1, 0), overlay.c_str());
+    if (true_peak > 0 && ImGui::IsItemHovered()) {
+      ImGui::SetTooltip("Clipping between samples");
+    }
+  }
+  meter.MarkDrawn();
+}
+
+}  // namespace
+
+void RenderMeterWindow(const std::vector<std::unique_ptr<Meter>>& meters,
+                       SpectrumAnalyzer* analyzer) {
+  ImGui::SetNextWindowSize(ImVec2(360, 420), ImGuiCond_FirstUseEver);
+  // Collapsed, nothing is drawn and nothing needs measuring.
+  const bool open = ImGui::Begin("Meters");
+  if (analyzer) RenderSpectrum(*analyzer, open);
+  const float row = ImGui::GetFrameHeightWithSpacing();
+  for (const std::unique_ptr<Meter>& meter : meters) {
+    const ImVec2 size(1, row * (1 + meter->num_channels()));
+    const bool shown = open && ImGui::IsRectVisible(size);
+    meter->SetVisible(shown);
+    if (!open) continue;
+    if (shown) {
+      RenderLevels(*meter);
+    } else {
+      ImGui::Dummy(size);  // Keeps the scroll range.
+    }
+  }
+  ImGui::End();
+}
+
+bool MeterWindowDirty(const std::vector<std::unique_ptr<Meter>>& meters,
+                      SpectrumAnalyzer* analyzer, float threshold_db) {
+  // Hidden meters and spectra measure nothing, so their values never change.
+  if (analyzer && analyzer->visible() && analyzer->Update()) return true;
+  for (const std::unique_ptr<Meter>& meter : meters) {
+    if (!meter->visible()) continue;
+    meter->Update();
+    if (meter->Changed(threshold_db)) return true;
+  }
+  return false;
+}
+
+}  // namespace kodo
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "meter.h"
+#include "spectrum_analyzer.h"
+
+namespace kodo {
+
+// Draws the "Meters" window: the levels of `meters` and, if set, the
+// spectrum of `analyzer`. Meters and the analyzer measure only while shown,
+// i.e. the window is open and they are not scrolled or collapsed away.
+void RenderMeterWindow(const std::vector<std::unique_ptr<Meter>>& meters,
+                       SpectrumAnalyzer* analyzer = nullptr);
+
+// Whether the "Meters" window would draw differently: a shown meter moved by
+// more than `threshold_db` or the shown spectrum has a new transform. A
+// repaint source for Gui::AddRepaintSource().
+bool MeterWindowDirty(const std::vector<std::unique_ptr<Meter>>& meters,
+                      SpectrumAnalyzer* analyzer = nullptr,
+                      float threshold_db = 0.5f);
+
+}  // namespace kodo
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace kodo {
+
+// A short MIDI channel message placed within an audio block.
+struct MidiEvent {
+  int32_t sample_offset;  // Within the block, in [0, num_frames).
+  uint8_t status;         // Message type in the high nibble, channel in low.
+  uint8_t data1;
+  uint8_t data2;
+};
+
+}  // namespace kodo
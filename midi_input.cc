@@ -0,0 +1,105 @@
+#include "midi_input.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RtMidi.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "perf_counters.h"
+
+namespace kodo {
+
+absl::StatusOr<std::vector<std::string>> MidiInputPorts() {
+  try {
+    RtMidiIn midi;
+    std::vector<std::string> ret;
+    for (unsigned i = 0; i < midi.getPortCount(); ++i) {
+      ret.push_back(midi.getPortName(i));
+    }
+    return ret;
+  } catch (const RtMidiError& error) {
+    return absl::UnavailableError(error.getMessage());
+  }
+}
+
+absl::StatusOr<std::unique_ptr<MidiInput>> MidiInput::Open(
+    int port, double sample_rate) {
+  if (sample_rate <= 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid sample rate ", sample_rate));
+  }
+  try {
+    auto midi = std::make_unique<RtMidiIn>();
+    if (port < 0 || port >= midi->getPortCount()) {
+      return absl::NotFoundError(absl::StrCat(
+          "No MIDI input port ", port, " among ", midi->getPortCount()));
+    }
+    std::unique_ptr<MidiInput> ret(
+        new MidiInput(midi->getPortName(port), sample_rate));
+    // Only channel messages reach the queue; drop SysEx, clock and sensing
+    // in the driver already.
+    midi->ignoreTypes(true, true, true);
+    midi->setCallback(&MidiInput::Callback, ret.get());
+    midi->openPort(port, "kodo");
+    ret->midi_ = std::move(midi);
+    LOG(INFO) << "Opened MIDI input " << ret->name_;
+    return ret;
+  } catch (const RtMidiError& error) {
+    return absl::UnavailableError(error.getMessage());
+  }
+}
+
+MidiInput::MidiInput(std::string name, double sample_rate)
+    : name_(std::move(name)),
+      cycles_per_frame_(CyclesPerSecond() / sample_rate) {}
+
+MidiInput::~MidiInput() {
+  // Joins the driver thread, so Callback() is not running afterwards.
+  if (midi_) midi_->closePort();
+}
+
+// Runs on the driver thread.
+void MidiInput::Callback(double /*delta_seconds*/,
+                         std::vector<unsigned char>* message,
+                         void* user_data) {
+  // RtMidi's own delta is per message and quantized by the driver; our
+  // stamp shares the clock of the audio thread.
+  const uint64_t now = CycleCount();
+  auto* self = static_cast<MidiInput*>(user_data);
+  if (message->empty() || (*message)[0] < 0x80 || (*message)[0] >= 0xf0) {
+    return;
+  }
+  TimedMessage timed{now, {}};
+  std::copy_n(message->begin(), std::min<size_t>(message->size(), 3),
+              timed.bytes);
+  if (!self->queue_.Push(timed)) {
+    self->dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// Runs on the audio thread. No locks or allocations below.
+int MidiInput::Drain(int num_frames, MidiEvent* events, int max_events) {
+  const uint64_t now = CycleCount();
+  int n = 0;
+  while (n < max_events && (has_pending_ || queue_.Pop(&pending_))) {
+    has_pending_ = true;
+    if (pending_.cycles > now) break;  // Arrived during this call.
+    const double age = (now - pending_.cycles) / cycles_per_frame_;
+    const int64_t offset = num_frames - std::llround(age);
+    events[n++] = {
+        static_cast<int32_t>(std::clamp<int64_t>(offset, 0, num_frames - 1)),
+        pending_.bytes[0], pending_.bytes[1], pending_.bytes[2]};
+    has_pending_ = false;
+  }
+  return n;
+}
+
+}  // namespace kodo
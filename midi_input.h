@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "midi_event.h"
+#include "spsc_queue.h"
+
+class RtMidiIn;
+
+namespace kodo {
+
+// Names of the MIDI input ports, indexed as MidiInput::Open() expects.
+absl::StatusOr<std::vector<std::string>> MidiInputPorts();
+
+// One MIDI input port. The driver thread stamps each channel message with
+// CycleCount() on arrival and pushes it to a wait-free queue, and the audio
+// thread places it within its next block by that time. Every event is
+// therefore delayed by exactly one block instead of jittering by up to one.
+class MidiInput {
+ public:
+  // Timing is computed at `sample_rate`, the rate of the blocks Drain()
+  // fills.
+  static absl::StatusOr<std::unique_ptr<MidiInput>> Open(int port,
+                                                         double sample_rate);
+
+  ~MidiInput();
+
+  MidiInput(const MidiInput&) = delete;
+  MidiInput& operator=(const MidiInput&) = delete;
+
+  // Audio thread. Moves messages that arrived before this call into
+  // `events`, sorted by offset in a block of `num_frames` that starts
+  // playing now. A message that arrived one block ago lands on offset 0,
+  // one that just arrived near the end. Returns the number of events; the
+  // rest stays queued for the next block.
+  int Drain(int num_frames, MidiEvent* events, int max_events);
+
+  const std::string& name() const { return name_; }
+  // Messages lost to a full queue.
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  struct TimedMessage {
+    uint64_t cycles;  // CycleCount() on arrival.
+    uint8_t bytes[3];
+  };
+
+  MidiInput(std::string name, double sample_rate);
+
+  static void Callback(double delta_seconds,
+                       std::vector<unsigned char>* message, void* user_data);
+
+  const std::string name_;
+  const double cycles_per_frame_;
+  std::unique_ptr<RtMidiIn> midi_;
+  SpscQueue<TimedMessage, 1024> queue_;
+  std::atomic<uint64_t> dropped_{0};
+  // Audio thread. Popped, but stamped after the block being drained.
+  TimedMessage pending_{};
+  bool has_pending_ = false;
+};
+
+}  // namespace kodo
@@ -0,0 +1,172 @@
+#include "note_store.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "kodo.pb.h"
+#include "midi_event.h"
+
+namespace kodo {
+
+absl::StatusOr<std::shared_ptr<const NoteStore>> NoteStore::Create(
+    const Track& track) {
+  struct Note {
+    int64_t start;
+    int64_t length;
+    int32_t pitch;
+    float velocity;
+  };
+  std::vector<Note> notes;
+  for (const NoteClip& clip : track.note_clips()) {
+    const int n = clip.note_start_size();
+    if (clip.note_length_size() != n || clip.pitch_size() != n ||
+        clip.velocity_size() != n) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          track.name(), " has a note clip with mismatched arrays."));
+    }
+    const int64_t clip_end = clip.start() + clip.length();
+    for (int i = 0; i < n; ++i) {
+      if (clip.pitch(i) < 0 || clip.pitch(i) > 127) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            track.name(), " has a note of pitch ", clip.pitch(i)));
+      }
+      const int64_t start = clip.start() + clip.note_start(i);
+      const int64_t end = std::min(start + clip.note_length(i), clip_end);
+      if (clip.note_start(i) < 0 || end <= start) continue;
+      notes.push_back({start, end - start, clip.pitch(i), clip.velocity(i)});
+    }
+  }
+  // Clips are sorted within, but may overlap each other.
+  std::stable_sort(notes.begin(), notes.end(),
+                   [](const Note& a, const Note& b) {
+                     return a.start < b.start;
+                   });
+
+  std::shared_ptr<NoteStore> ret(new NoteStore);
+  ret->start_.reserve(notes.size());
+  ret->length_.reserve(notes.size());
+  ret->pitch_.reserve(notes.size());
+  ret->velocity_.reserve(notes.size());
+  for (const Note& note : notes) {
+    ret->last_end_ = std::max(ret->last_end_, note.start + note.length);
+    ret->start_.push_back(note.start);
+    ret->length_.push_back(note.length);
+    ret->pitch_.push_back(note.pitch);
+    ret->velocity_.push_back(note.velocity);
+  }
+  if (!notes.empty()) {
+    const auto [min, max] =
+        std::minmax_element(ret->pitch_.begin(), ret->pitch_.end());
+    ret->min_pitch_ = *min;
+    ret->max_pitch_ = *max;
+  }
+  ret->BuildIndex();
+  return ret;
+}
+
+void NoteStore::BuildIndex() {
+  const int64_t n = size();
+  max_end_.resize(n);
+  if (n == 0) return;
+  // Leaves are the even indices. `last` tracks the max end of the subtree
+  // holding the last node, which the missing right children beyond n stand
+  // in for.
+  int64_t last_i = 0;
+  int64_t last = 0;
+  for (int64_t i = 0; i < n; i += 2) {
+    last_i = i;
+    last = max_end_[i] = end(i);
+  }
+  int k = 1;
+  for (; (int64_t{1} << k) <= n; ++k) {
+    const int64_t x = int64_t{1} << (k - 1);
+    for (int64_t i = (x << 1) - 1; i < n; i += x << 2) {
+      const int64_t right = i + x < n ? max_end_[i + x] : last;
+      max_end_[i] = std::max({end(i), max_end_[i - x], right});
+    }
+    last_i = (last_i >> k & 1) ? last_i - x : last_i + x;
+    if (last_i < n) last = std::max(last, max_end_[last_i]);
+  }
+  max_level_ = k - 1;
+}
+
+// Runs on the audio thread. No locks or allocations below.
+int NotePlayer::Render(int num_frames, MidiEvent* events, int max_events) {
+  int num_events = 0;
+  int64_t position = position_.load(std::memory_order_relaxed);
+  const NoteStore* notes = notes_.current();
+  if (notes_.HasUpdate()) {
+    // The old store stays alive until Acquire().
+    num_events += ReleaseAt(*notes, position, events, max_events);
+    notes = notes_.Acquire();
+  }
+  if (int64_t seek = seek_.exchange(-1, std::memory_order_relaxed);
+      seek >= 0) {
+    num_events += ReleaseAt(*notes, position, events + num_events,
+                            max_events - num_events);
+    position = seek;
+  }
+
+  // Note offs for ends in [position, end) come out of the overlap query in
+  // start order.
+  const int64_t end = position + num_frames;
+  int num_offs = 0;
+  notes->ForEachOverlap(position - 1, end, [&](int64_t i) {
+    if (notes->end(i) < end && num_offs < kMaxNoteOffs) {
+      offs_[num_offs++] = {static_cast<int32_t>(notes->end(i) - position),
+                           0x80, static_cast<uint8_t>(notes->pitch(i)), 0};
+    }
+  });
+  // std::stable_sort takes a temporary buffer from the heap; a total order
+  // makes the unstable in-place sort deterministic instead.
+  std::sort(offs_, offs_ + num_offs,
+            [](const MidiEvent& a, const MidiEvent& b) {
+              return std::pair(a.sample_offset, a.data1) <
+                     std::pair(b.sample_offset, b.data1);
+            });
+
+  // Merge with the note ons, offs first so a repeated key retriggers.
+  int off = 0;
+  for (int64_t i = notes->LowerBound(position);
+       i < notes->size() && notes->start(i) < end; ++i) {
+    const int32_t offset = notes->start(i) - position;
+    while (off < num_offs && offs_[off].sample_offset <= offset &&
+           num_events < max_events) {
+      events[num_events++] = offs_[off++];
+    }
+    if (num_events == max_events) break;
+    const int velocity = std::clamp<int>(
+        std::lround(notes->velocity(i) * 127), 1, 127);
+    events[num_events++] = {offset, 0x90,
+                            static_cast<uint8_t>(notes->pitch(i)),
+                            static_cast<uint8_t>(velocity)};
+  }
+  while (off < num_offs && num_events < max_events) {
+    events[num_events++] = offs_[off++];
+  }
+
+  position_.store(end, std::memory_order_relaxed);
+  return num_events;
+}
+
+int NotePlayer::ReleaseAt(const NoteStore& notes, int64_t frame,
+                          MidiEvent* events, int max_events) {
+  // Notes started before `frame` and ending at or after it.
+  int n = 0;
+  notes.ForEachOverlap(frame - 1, frame, [&](int64_t i) {
+    if (n < max_events) {
+      events[n++] = {0, 0x80, static_cast<uint8_t>(notes.pitch(i)), 0};
+    }
+  });
+  return n;
+}
+
+}  // namespace kodo
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "kodo.pb.h"
+#include "midi_event.h"
+#include "published.h"
+
+namespace kodo {
+
+// Immutable notes of one track on the timeline, as parallel arrays sorted by
+// start. An implicit interval tree over the sorted order, i.e. the max end
+// frame of every subtree, answers overlap queries in O(log n + k), so the
+// audio thread and the piano roll only touch the notes they show or play.
+class NoteStore {
+ public:
+  // Merges the note clips of `track`. Notes are cut at the end of their clip
+  // and empty ones dropped.
+  static absl::StatusOr<std::shared_ptr<const NoteStore>> Create(
+      const Track& track);
+
+  int64_t size() const { return start_.size(); }
+  int64_t start(int64_t i) const { return start_[i]; }
+  int64_t length(int64_t i) const { return length_[i]; }
+  int64_t end(int64_t i) const { return start_[i] + length_[i]; }
+  int32_t pitch(int64_t i) const { return pitch_[i]; }
+  float velocity(int64_t i) const { return velocity_[i]; }
+
+  // Bounds of every note, or 0 for an empty store.
+  int64_t last_end() const { return last_end_; }
+  int32_t min_pitch() const { return min_pitch_; }
+  int32_t max_pitch() const { return max_pitch_; }
+
+  // Index of the first note starting at or after `frame`.
+  int64_t LowerBound(int64_t frame) const {
+    return std::lower_bound(start_.begin(), start_.end(), frame) -
+           start_.begin();
+  }
+
+  // Calls `f(index)` in ascending order for every note overlapping
+  // [begin, end). Real-time safe.
+  template <typename F>
+  void ForEachOverlap(int64_t begin, int64_t end, F&& f) const;
+
+ private:
+  // Subtrees at or below this level are scanned linearly.
+  static constexpr int kLeafLevel = 3;
+
+  NoteStore() {}  // Use Create().
+
+  void BuildIndex();
+
+  std::vector<int64_t> start_;
+  std::vector<int64_t> length_;
+  std::vector<int32_t> pitch_;
+  std::vector<float> velocity_;
+  // Node i at level k, where the lowest k bits of i are set and bit k is
+  // clear, covers notes [i - 2^k + 1, i + 2^k - 1].
+  std::vector<int64_t> max_end_;
+  int max_level_ = -1;
+  int64_t last_end_ = 0;
+  int32_t min_pitch_ = 0;
+  int32_t max_pitch_ = 0;
+};
+
+// Plays a NoteStore as MIDI along its own playhead, like ClipPlayer does
+// audio. The GUI swaps in edited stores while the audio thread plays; the
+// audio thread only ever reads an immutable store.
+class NotePlayer {
+ public:
+  explicit NotePlayer(std::shared_ptr<const NoteStore> notes)
+      : notes_(std::move(notes)) {}
+
+  NotePlayer(const NotePlayer&) = delete;
+  NotePlayer& operator=(const NotePlayer&) = delete;
+
+  // GUI thread. Publishes `notes` for the next Render(). A replaced store is
+  // freed by a later SetNotes() once the audio thread has moved on.
+  void SetNotes(std::shared_ptr<const NoteStore> notes) {
+    notes_.Publish(std::move(notes));
+  }
+  // GUI thread. The last published store.
+  const std::shared_ptr<const NoteStore>& notes() const {
+    return notes_.latest();
+  }
+
+  // Audio thread. Writes note on/off events of the next `num_frames` into
+  // `events`, sorted by offset, and advances the playhead. Notes sounding
+  // across a seek or a store swap are released at offset 0. Returns the
+  // number of events, dropping any beyond `max_events`.
+  int Render(int num_frames, MidiEvent* events, int max_events);
+
+  // Moves the playhead. Safe to call from any thread.
+  void Seek(int64_t frame) { seek_.store(frame, std::memory_order_relaxed); }
+  int64_t position() const {
+    return position_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr int kMaxNoteOffs = 512;
+
+  // Adds a note off at offset 0 for every note of `notes` sounding at
+  // `frame`.
+  int ReleaseAt(const NoteStore& notes, int64_t frame, MidiEvent* events,
+                int max_events);
+
+  Published<NoteStore> notes_;
+  std::atomic<int64_t> position_ = 0;
+  std::atomic<int64_t> seek_ = -1;
+  MidiEvent offs_[kMaxNoteOffs];  // Audio thread scratch.
+};
+
+template <typename F>
+void NoteStore::ForEachOverlap(int64_t begin, int64_t end, F&& f) const {
+  struct Frame {
+    int64_t x;
+    int k;
+    bool left_done;
+  };
+  if (max_level_ < 0) return;
+  const int64_t n = size();
+  // Each level pushes at most two frames.
+  Frame stack[2 * 64];
+  int top = 0;
+  stack[top++] = {(int64_t{1} << max_level_) - 1, max_level_, false};
+  while (top > 0) {
+    const Frame z = stack[--top];
+    if (z.k <= kLeafLevel) {
+      const int64_t first = z.x >> z.k << z.k;
+      const int64_t last =
+          std::min(first + (int64_t{1} << (z.k + 1)) - 1, n);
+      for (int64_t i = first; i < last && start_[i] < end; ++i) {
+        if (begin < this->end(i)) f(i);
+      }
+    } else if (!z.left_done) {
+      const int64_t left = z.x - (int64_t{1} << (z.k - 1));
+      stack[top++] = {z.x, z.k, true};
+      if (left >= n || max_end_[left] > begin) {
+        stack[top++] = {left, z.k - 1, false};
+      }
+    } else if (z.x < n && start_[z.x] < end) {
+      if (begin < this->end(z.x)) f(z.x);
+      stack[top++] = {z.x + (int64_t{1} << (z.k - 1)), z.k - 1, false};
+    }
+  }
+}
+
+}  // namespace kodo
@@ -0,0 +1,109 @@
+#include "note_store.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "kodo.pb.h"
+#include "midi_event.h"
+#include "rt_alloc.h"
+
+namespace kodo {
+namespace {
+
+struct TestNote {
+  int64_t start;
+  int64_t length;
+  int32_t pitch;
+};
+
+std::shared_ptr<const NoteStore> MakeStore(
+    const std::vector<TestNote>& notes) {
+  Track track;
+  NoteClip* clip = track.add_note_clips();
+  clip->set_length(int64_t{1} << 40);
+  for (const TestNote& note : notes) {
+    clip->add_note_start(note.start);
+    clip->add_note_length(note.length);
+    clip->add_pitch(note.pitch);
+    clip->add_velocity(1);
+  }
+  absl::StatusOr<std::shared_ptr<const NoteStore>> store =
+      NoteStore::Create(track);
+  EXPECT_TRUE(store.ok()) << store.status();
+  return *store;
+}
+
+// Chords of four notes every 50 frames, so many offs share an offset.
+std::vector<TestNote> Chords(int num_chords) {
+  std::vector<TestNote> notes;
+  for (int i = 0; i < num_chords; ++i) {
+    for (int32_t pitch : {67, 60, 64, 72}) {
+      notes.push_back({50 * i, 40 + pitch % 3 * 5, pitch});
+    }
+  }
+  return notes;
+}
+
+TEST(NoteStoreTest, ForEachOverlapMatchesScan) {
+  std::vector<TestNote> notes;
+  for (int i = 0; i < 300; ++i) {
+    notes.push_back({i * 7 % 1000, 1 + i * 13 % 200, i % 128});
+  }
+  std::shared_ptr<const NoteStore> store = MakeStore(notes);
+  for (int64_t begin = 0; begin < 1300; begin += 37) {
+    const int64_t end = begin + 1 + begin % 90;
+    std::vector<int64_t> found;
+    store->ForEachOverlap(begin, end, [&](int64_t i) { found.push_back(i); });
+    std::vector<int64_t> expected;
+    for (int64_t i = 0; i < store->size(); ++i) {
+      if (store->start(i) < end && begin < store->end(i)) {
+        expected.push_back(i);
+      }
+    }
+    EXPECT_EQ(found, expected) << "[" << begin << ", " << end << ")";
+  }
+}
+
+TEST(NotePlayerTest, RenderSortsOffsBeforeOns) {
+  NotePlayer player(MakeStore(Chords(8)));
+  MidiEvent events[64];
+  for (int block = 0; block < 8; ++block) {
+    const int n = player.Render(64, events, 64);
+    for (int i = 1; i < n; ++i) {
+      const MidiEvent& a = events[i - 1];
+      const MidiEvent& b = events[i];
+      ASSERT_LE(a.sample_offset, b.sample_offset);
+      // Offs at one offset come in a fixed order, whatever the store's.
+      if (a.sample_offset == b.sample_offset && a.status == 0x80 &&
+          b.status == 0x80) {
+        EXPECT_LT(a.data1, b.data1);
+      }
+      EXPECT_FALSE(a.sample_offset == b.sample_offset &&
+                   a.status == 0x90 && b.status == 0x80);
+    }
+  }
+}
+
+TEST(NotePlayerTest, RenderDoesNotAllocate) {
+  NotePlayer player(MakeStore(Chords(200)));
+  std::shared_ptr<const NoteStore> other = MakeStore(Chords(100));
+  MidiEvent events[256];
+  const uint64_t trapped = TrappedAllocations();
+  {
+    RealtimeScope realtime;
+    for (int block = 0; block < 32; ++block) player.Render(128, events, 256);
+  }
+  // A swap and a seek release sounding notes on the audio thread too.
+  player.SetNotes(other);
+  player.Seek(1000);
+  {
+    RealtimeScope realtime;
+    for (int block = 0; block < 32; ++block) player.Render(128, events, 256);
+  }
+  EXPECT_EQ(TrappedAllocations(), trapped);
+}
+
+}  // namespace
+}  // namespace kodo
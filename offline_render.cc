@@ -0,0 +1,73 @@
+#include "offline_render.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "audio_engine.h"
+#include "audio_file.h"
+#include "kodo.pb.h"
+
+namespace kodo {
+
+absl::Status RenderOffline(AudioRenderer& renderer,
+                           const OfflineRenderOptions& options,
+                           AudioFileWriter& writer) {
+  if (options.num_channels <= 0 ||
+      options.num_channels > AudioEngine::kMaxChannels) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported num_channels=", options.num_channels));
+  }
+  std::vector<float> buffer(options.num_channels * options.block_size);
+  std::vector<float*> channels(options.num_channels);
+  for (int c = 0; c < options.num_channels; ++c) {
+    channels[c] = buffer.data() + c * options.block_size;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int64_t skip = std::max(options.latency, 0); skip > 0;) {
+    const int n = std::min<int64_t>(options.block_size, skip);
+    renderer.Render(channels.data(), options.num_channels, n);
+    skip -= n;
+  }
+  for (int64_t frame = 0; frame < options.num_frames;
+       frame += options.block_size) {
+    const int n = std::min<int64_t>(options.block_size,
+                                    options.num_frames - frame);
+    renderer.Render(channels.data(), options.num_channels, n);
+    if (absl::Status status = writer.Write(channels.data(), n);
+        !status.ok()) {
+      return status;
+    }
+  }
+  if (absl::Status status = writer.Close(); !status.ok()) return status;
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  const double seconds = options.num_frames / options.sample_rate;
+  LOG(INFO) << "Rendered " << seconds << " s in " << elapsed.count()
+            << " s (" << seconds / std::max(elapsed.count(), 1e-9)
+            << "x real-time)";
+  return absl::OkStatus();
+}
+
+int64_t ProjectLength(const Project& project) {
+  int64_t end = 0;
+  auto add = [&](const Track& track) {
+    for (const AudioClip& clip : track.audio_clips()) {
+      end = std::max(end, clip.start() + clip.length());
+    }
+    for (const NoteClip& clip : track.note_clips()) {
+      end = std::max(end, clip.start() + clip.length());
+    }
+  };
+  for (const Track& track : project.tracks()) add(track);
+  for (const Track& bus : project.buses()) add(bus);
+  return end;
+}
+
+}  // namespace kodo
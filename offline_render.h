@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include "absl/status/status.h"
+#include "audio_engine.h"
+#include "audio_file.h"
+#include "kodo.pb.h"
+
+namespace kodo {
+
+struct OfflineRenderOptions {
+  double sample_rate = 48000;
+  // Frames per Render() call. Larger than live blocks, as latency does not
+  // matter and fewer calls amortize per-block costs.
+  int block_size = 4096;
+  int num_channels = 2;
+  int64_t num_frames = 0;
+  // Frames by which the renderer output lags the timeline, e.g.
+  // GraphRenderer::latency(). They are rendered but not written, so the file
+  // lines up with the project.
+  int latency = 0;
+};
+
+// Pulls `renderer` as fast as the CPU allows and writes every block to
+// `writer`, then closes it. Not real-time: plugins must be set up with
+// ProcessSetup::offline, and clip players must be synchronous.
+absl::Status RenderOffline(AudioRenderer& renderer,
+                           const OfflineRenderOptions& options,
+                           AudioFileWriter& writer);
+
+// Timeline frame where the last audio or note clip of `project` ends.
+int64_t ProjectLength(const Project& project);
+
+}  // namespace kodo
@@ -0,0 +1,145 @@
+#include "param_changes.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace kodo {
+
+using Steinberg::int32;
+using Steinberg::tresult;
+using Steinberg::Vst::IParamValueQueue;
+using Steinberg::Vst::ParamID;
+using Steinberg::Vst::ParamValue;
+
+namespace {
+
+uint32_t HashParamId(ParamID id) {
+  // Fibonacci hashing spreads sequential ids across the table.
+  return static_cast<uint32_t>(id) * 2654435769u;
+}
+
+}  // namespace
+
+tresult PLUGIN_API ParamValueQueue::getPoint(int32 index, int32& sampleOffset,
+                                             ParamValue& value) {
+  if (index < 0 || index >= count_) return Steinberg::kInvalidArgument;
+  sampleOffset = points_[index].offset;
+  value = points_[index].value;
+  return Steinberg::kResultOk;
+}
+
+tresult PLUGIN_API ParamValueQueue::addPoint(int32 sampleOffset,
+                                             ParamValue value, int32& index) {
+  // Points mostly arrive in order, so search from the back.
+  int32 i = count_;
+  while (i > 0 && points_[i - 1].offset > sampleOffset) --i;
+  if (i > 0 && points_[i - 1].offset == sampleOffset) {
+    points_[i - 1].value = value;
+    index = i - 1;
+    return Steinberg::kResultOk;
+  }
+  if (count_ == capacity_) return Steinberg::kOutOfMemory;
+  std::copy_backward(points_ + i, points_ + count_, points_ + count_ + 1);
+  points_[i] = {sampleOffset, value};
+  ++count_;
+  index = i;
+  return Steinberg::kResultOk;
+}
+
+tresult PLUGIN_API ParamValueQueue::queryInterface(const Steinberg::TUID _iid,
+                                                   void** obj) {
+  if (Steinberg::FUnknownPrivate::iidEqual(_iid, IParamValueQueue::iid) ||
+      Steinberg::FUnknownPrivate::iidEqual(_iid, Steinberg::FUnknown::iid)) {
+    *obj = this;
+    addRef();
+    return Steinberg::kResultTrue;
+  }
+  return Steinberg::kNoInterface;
+}
+
+ParameterChangeList::ParameterChangeList(int max_params,
+                                         int max_points_per_param)
+    : queues_(std::max(max_params, 1)) {
+  const int32 capacity = std::max(max_points_per_param, 1);
+  points_.resize(queues_.size() * capacity);
+  for (int i = 0; i < queues_.size(); ++i) {
+    queues_[i].points_ = points_.data() + i * capacity;
+    queues_[i].capacity_ = capacity;
+  }
+  // Keep the load factor at most 1/2 so probes stay short.
+  uint32_t num_slots = 1;
+  while (num_slots < 2 * queues_.size()) num_slots <<= 1;
+  slots_.assign(num_slots, kEmpty);
+  slot_mask_ = num_slots - 1;
+}
+
+IParamValueQueue* PLUGIN_API
+ParameterChangeList::getParameterData(int32 index) {
+  if (index < 0 || index >= used_) return nullptr;
+  return &queues_[index];
+}
+
+IParamValueQueue* PLUGIN_API
+ParameterChangeList::addParameterData(const ParamID& id, int32& index) {
+  uint32_t slot = HashParamId(id) & slot_mask_;
+  while (slots_[slot] != kEmpty) {
+    if (queues_[slots_[slot]].id_ == id) {
+      index = slots_[slot];
+      return &queues_[index];
+    }
+    slot = (slot + 1) & slot_mask_;
+  }
+  if (used_ == static_cast<int32>(queues_.size())) return nullptr;
+
+  index = used_++;
+  slots_[slot] = index;
+  ParamValueQueue& queue = queues_[index];
+  queue.id_ = id;
+  queue.count_ = 0;
+  queue.slot_ = slot;
+  return &queue;
+}
+
+bool ParameterChangeList::Add(ParamID id, int32 sample_offset,
+                              ParamValue value) {
+  int32 index;
+  IParamValueQueue* queue = addParameterData(id, index);
+  if (queue == nullptr) return false;
+  return queue->addPoint(sample_offset, value, index) == Steinberg::kResultOk;
+}
+
+void ParameterChangeList::Drain(ParamChangeQueue& queue, int num_frames) {
+  const int32 last = std::max(num_frames - 1, 0);
+  ParamChange change;
+  while (has_pending_ || queue.Pop(&change)) {
+    if (has_pending_) {
+      change = pending_;
+      has_pending_ = false;
+    }
+    if (!Add(change.id, std::clamp(change.sample_offset, 0, last),
+             change.value)) {
+      pending_ = change;
+      has_pending_ = true;
+      return;
+    }
+  }
+}
+
+void ParameterChangeList::Clear() {
+  for (int32 i = 0; i < used_; ++i) slots_[queues_[i].slot_] = kEmpty;
+  used_ = 0;
+}
+
+tresult PLUGIN_API
+ParameterChangeList::queryInterface(const Steinberg::TUID _iid, void** obj) {
+  if (Steinberg::FUnknownPrivate::iidEqual(
+          _iid, Steinberg::Vst::IParameterChanges::iid) ||
+      Steinberg::FUnknownPrivate::iidEqual(_iid, Steinberg::FUnknown::iid)) {
+    *obj = this;
+    addRef();
+    return Steinberg::kResultTrue;
+  }
+  return Steinberg::kNoInterface;
+}
+
+}  // namespace kodo
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "pluginterfaces/vst/ivstparameterchanges.h"
+#include "pluginterfaces/vst/vsttypes.h"
+#include "spsc_queue.h"
+
+namespace kodo {
+
+// One parameter edit travelling from the GUI thread to the audio thread.
+struct ParamChange {
+  Steinberg::Vst::ParamID id;
+  Steinberg::Vst::ParamValue value;  // Normalized to [0, 1].
+  int32_t sample_offset;             // Within the next processed block.
+};
+
+using ParamChangeQueue = SpscQueue<ParamChange, 1024>;
+
+// IParamValueQueue over points owned by its ParameterChangeList.
+class ParamValueQueue : public Steinberg::Vst::IParamValueQueue {
+ public:
+  Steinberg::Vst::ParamID PLUGIN_API getParameterId() override { return id_; }
+  Steinberg::int32 PLUGIN_API getPointCount() override { return count_; }
+  Steinberg::tresult PLUGIN_API getPoint(
+      Steinberg::int32 index, Steinberg::int32& sampleOffset,
+      Steinberg::Vst::ParamValue& value) override;
+  // Keeps points sorted by offset and overwrites a point at the same offset.
+  Steinberg::tresult PLUGIN_API addPoint(Steinberg::int32 sampleOffset,
+                                         Steinberg::Vst::ParamValue value,
+                                         Steinberg::int32& index) override;
+
+ private:
+  friend class ParameterChangeList;
+
+  struct Point {
+    Steinberg::int32 offset;
+    Steinberg::Vst::ParamValue value;
+  };
+
+  Steinberg::tresult PLUGIN_API queryInterface(const Steinberg::TUID _iid,
+                                               void** obj) override;
+  // Owned by ParameterChangeList, not ref-counted.
+  uint32_t PLUGIN_API addRef() override { return 1000; }
+  uint32_t PLUGIN_API release() override { return 1000; }
+
+  Steinberg::Vst::ParamID id_ = 0;
+  Steinberg::int32 count_ = 0;
+  uint32_t slot_ = 0;  // Index in ParameterChangeList::slots_.
+  Point* points_ = nullptr;
+  Steinberg::int32 capacity_ = 0;
+};
+
+// IParameterChanges whose queues are all allocated at construction, so
+// filling and clearing it per block touches no heap. The points of every
+// queue share one allocation.
+class ParameterChangeList : public Steinberg::Vst::IParameterChanges {
+ public:
+  ParameterChangeList(int max_params, int max_points_per_param);
+
+  // Queues point into `points_`.
+  ParameterChangeList(const ParameterChangeList&) = delete;
+  ParameterChangeList& operator=(const ParameterChangeList&) = delete;
+
+  // Moves every pending record of `queue` into this list, clamping offsets
+  // into [0, num_frames). Records that do not fit are kept for next block.
+  void Drain(ParamChangeQueue& queue, int num_frames);
+
+  // Adds a single point. Returns false if the list is full.
+  bool Add(Steinberg::Vst::ParamID id, Steinberg::int32 sample_offset,
+           Steinberg::Vst::ParamValue value);
+
+  // Removes all queues. O(number of used queues).
+  void Clear();
+
+  Steinberg::int32 PLUGIN_API getParameterCount() override { return used_; }
+  Steinberg::Vst::IParamValueQueue* PLUGIN_API
+  getParameterData(Steinberg::int32 index) override;
+  Steinberg::Vst::IParamValueQueue* PLUGIN_API addParameterData(
+      const Steinberg::Vst::ParamID& id, Steinberg::int32& index) override;
+
+ private:
+  static constexpr int32_t kEmpty = -1;
+
+  Steinberg::tresult PLUGIN_API queryInterface(const Steinberg::TUID _iid,
+                                               void** obj) override;
+  uint32_t PLUGIN_API addRef() override { return 1000; }
+  uint32_t PLUGIN_API release() override { return 1000; }
+
+  std::vector<ParamValueQueue> queues_;
+  std::vector<ParamValueQueue::Point> points_;
+  Steinberg::int32 used_ = 0;
+  // Open-addressing table from ParamID to an index of queues_.
+  std::vector<int32_t> slots_;
+  uint32_t slot_mask_ = 0;
+  // A record popped from the queue that did not fit in this block.
+  ParamChange pending_{};
+  bool has_pending_ = false;
+};
+
+}  // namespace kodo
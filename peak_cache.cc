@@ -0,0 +1,343 @@
+#include "peak_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace kodo {
+
+struct PeakFile::Header {
+  char magic[4];
+  uint32_t version;
+  int32_t num_channels;
+  int32_t num_levels;
+  int64_t num_frames;
+  // Stamp of the audio file the peaks were built from.
+  int64_t source_size;
+  int64_t source_mtime;
+};
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr char kMagic[4] = {'K', 'P', 'K', '1'};
+constexpr uint32_t kVersion = 1;
+constexpr int kChunkBlocks = 64;
+
+struct SourceStamp {
+  int64_t size = 0;
+  int64_t mtime = 0;
+};
+
+SourceStamp Stamp(const std::string& path) {
+  std::error_code ec;
+  SourceStamp stamp;
+  stamp.size = fs::file_size(path, ec);
+  stamp.mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+  return stamp;
+}
+
+int64_t LevelSize(int64_t num_frames, int level) {
+  int64_t n = (num_frames + PeakFile::kBaseDecimation - 1) /
+              PeakFile::kBaseDecimation;
+  for (int i = 0; i < level; ++i) n = (n + 1) / 2;
+  return n;
+}
+
+int NumLevels(int64_t num_frames) {
+  int levels = 1;
+  while (LevelSize(num_frames, levels - 1) > 1) ++levels;
+  return levels;
+}
+
+int16_t ToInt16(float x) {
+  return std::lround(std::clamp(x, -1.0f, 1.0f) * 32767);
+}
+
+Peak Merge(const Peak& a, const Peak& b) {
+  Peak p;
+  p.min = std::min(a.min, b.min);
+  p.max = std::max(a.max, b.max);
+  p.rms = std::lround(
+      std::sqrt((float(a.rms) * a.rms + float(b.rms) * b.rms) / 2));
+  return p;
+}
+
+}  // namespace
+
+std::string PeakFilePath(const std::string& source_path) {
+  return source_path + ".peaks";
+}
+
+absl::Status BuildPeakFile(AudioFileReader& reader,
+                           const std::string& source_path,
+                           const std::string& path) {
+  const int channels = reader.num_channels();
+  const int64_t frames = reader.num_frames();
+  const int num_levels = NumLevels(frames);
+
+  // Level 0 straight from the samples, one chunk at a time.
+  std::vector<std::vector<Peak>> levels(num_levels);
+  levels[0].resize(LevelSize(frames, 0) * channels);
+  const int chunk = PeakFile::kBaseDecimation * kChunkBlocks;
+  std::vector<std::vector<float>> samples(channels, std::vector<float>(chunk));
+  std::vector<float*> outputs(channels);
+  for (int c = 0; c < channels; ++c) outputs[c] = samples[c].data();
+  for (int64_t offset = 0; offset < frames; offset += chunk) {
+    const int n = std::min<int64_t>(chunk, frames - offset);
+    if (absl::Status status = reader.Read(offset, n, outputs.data());
+        !status.ok()) {
+      return status;
+    }
+    for (int b = 0; b * PeakFile::kBaseDecimation < n; ++b) {
+      const int from = b * PeakFile::kBaseDecimation;
+      const int to = std::min(n, from + PeakFile::kBaseDecimation);
+      const int64_t index = offset / PeakFile::kBaseDecimation + b;
+      for (int c = 0; c < channels; ++c) {
+        const float* x = samples[c].data();
+        float lo = x[from], hi = x[from], sum = 0;
+        for (int i = from; i < to; ++i) {
+          lo = std::min(lo, x[i]);
+          hi = std::max(hi, x[i]);
+          sum += x[i] * x[i];
+        }
+        levels[0][index * channels + c] = {
+            ToInt16(lo), ToInt16(hi), ToInt16(std::sqrt(sum / (to - from)))};
+      }
+    }
+  }
+  // Each coarser level halves the previous one.
+  for (int l = 1; l < num_levels; ++l) {
+    const std::vector<Peak>& prev = levels[l - 1];
+    const int64_t prev_size = prev.size() / channels;
+    levels[l].resize(LevelSize(frames, l) * channels);
+    for (int64_t i = 0; i < LevelSize(frames, l); ++i) {
+      for (int c = 0; c < channels; ++c) {
+        const Peak& a = prev[2 * i * channels + c];
+        levels[l][i * channels + c] =
+            2 * i + 1 < prev_size ? Merge(a, prev[(2 * i + 1) * channels + c])
+                                  : a;
+      }
+    }
+  }
+
+  PeakFile::Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_channels = channels;
+  header.num_levels = num_levels;
+  header.num_frames = frames;
+  const SourceStamp stamp = Stamp(source_path);
+  header.source_size = stamp.size;
+  header.source_mtime = stamp.mtime;
+
+  // Write then rename, so a crash never leaves a truncated peak file.
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream output(tmp, std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const std::vector<Peak>& level : levels) {
+      output.write(reinterpret_cast<const char*>(level.data()),
+                   level.size() * sizeof(Peak));
+    }
+    if (!output) {
+      return absl::InternalError(absl::StrCat("Cannot write ", tmp));
+    }
+  }
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    return absl::InternalError(
+        absl::StrCat("Cannot rename ", tmp, ": ", ec.message()));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::unique_ptr<PeakFile>> PeakFile::Open(
+    const std::string& path, const std::string& source_path) {
+  std::unique_ptr<PeakFile> ret(new PeakFile);
+#ifdef _WIN32
+  std::ifstream input(path, std::ios::binary);
+  if (!input) return absl::NotFoundError(absl::StrCat("Cannot open ", path));
+  ret->fallback_.assign(std::istreambuf_iterator<char>(input),
+                        std::istreambuf_iterator<char>());
+  ret->size_ = ret->fallback_.size();
+  if (ret->size_ >= sizeof(Header)) {
+    ret->header_ = reinterpret_cast<const Header*>(ret->fallback_.data());
+  }
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return absl::NotFoundError(absl::StrCat("Cannot open ", path));
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size >= sizeof(Header)) {
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED) {
+      ret->header_ = static_cast<const Header*>(data);
+      ret->size_ = st.st_size;
+    }
+  }
+  close(fd);
+#endif
+  if (ret->header_ == nullptr) {
+    return absl::DataLossError(absl::StrCat("Cannot map ", path));
+  }
+
+  const Header& header = *ret->header_;
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.num_channels <= 0) {
+    return absl::DataLossError(absl::StrCat(path, " is not a peak file."));
+  }
+  size_t expected = sizeof(Header);
+  for (int l = 0; l < header.num_levels; ++l) {
+    expected += ret->level_size(l) * header.num_channels * sizeof(Peak);
+  }
+  if (ret->size_ != expected) {
+    return absl::DataLossError(absl::StrCat(path, " is truncated."));
+  }
+  const SourceStamp stamp = Stamp(source_path);
+  if (header.source_size != stamp.size || header.source_mtime != stamp.mtime) {
+    return absl::FailedPreconditionError(
+        absl::StrCat(path, " is older than ", source_path));
+  }
+  return ret;
+}
+
+PeakFile::~PeakFile() {
+#ifndef _WIN32
+  if (header_ && fallback_.empty()) {
+    munmap(const_cast<Header*>(header_), size_);
+  }
+#endif
+}
+
+int PeakFile::num_channels() const { return header_->num_channels; }
+int64_t PeakFile::num_frames() const { return header_->num_frames; }
+int PeakFile::num_levels() const { return header_->num_levels; }
+
+int64_t PeakFile::level_size(int index) const {
+  return LevelSize(header_->num_frames, index);
+}
+
+const Peak* PeakFile::level(int index) const {
+  const Peak* p = reinterpret_cast<const Peak*>(header_ + 1);
+  for (int l = 0; l < index; ++l) p += level_size(l) * num_channels();
+  return p;
+}
+
+void PeakFile::Columns(int channel, double first_frame,
+                       double frames_per_pixel, int num_pixels,
+                       Peak* out) const {
+  int l = 0;
+  while (l + 1 < num_levels() &&
+         (int64_t{kBaseDecimation} << (l + 1)) <= frames_per_pixel) {
+    ++l;
+  }
+  const Peak* peaks = level(l);
+  const int64_t size = level_size(l);
+  const double decimation = double(int64_t{kBaseDecimation} << l);
+  const int channels = num_channels();
+
+  for (int px = 0; px < num_pixels; ++px) {
+    const double from = first_frame + px * frames_per_pixel;
+    const int64_t begin = std::max<int64_t>(0, std::floor(from / decimation));
+    const double to = from + frames_per_pixel;
+    const int64_t end = std::min<int64_t>(
+        size, std::max<int64_t>(begin + 1, std::ceil(to / decimation)));
+    if (from < 0 || begin >= end) {
+      out[px] = {0, 0, 0};
+      continue;
+    }
+    Peak p = peaks[begin * channels + channel];
+    for (int64_t i = begin + 1; i < end; ++i) {
+      p = Merge(p, peaks[i * channels + channel]);
+    }
+    out[px] = p;
+  }
+}
+
+std::unique_ptr<PeakCache> PeakCache::Create() {
+  std::unique_ptr<PeakCache> ret(new PeakCache);
+  ret->thread_ = std::thread(&PeakCache::Loop, ret.get());
+  return ret;
+}
+
+PeakCache::~PeakCache() {
+  {
+    absl::MutexLock lock(&mu_);
+    quit_ = true;
+  }
+  thread_.join();
+}
+
+void PeakCache::Request(const std::string& source_path) {
+  absl::MutexLock lock(&mu_);
+  if (files_.try_emplace(source_path).second) queue_.push_back(source_path);
+}
+
+const PeakFile* PeakCache::Get(const std::string& source_path) {
+  absl::MutexLock lock(&mu_);
+  auto [it, inserted] = files_.try_emplace(source_path);
+  if (inserted) queue_.push_back(source_path);
+  return it->second.get();
+}
+
+void PeakCache::Loop() {
+  while (true) {
+    std::string source;
+    {
+      absl::MutexLock lock(&mu_);
+      mu_.Await(absl::Condition(this, &PeakCache::HasWork));
+      if (quit_) return;
+      source = std::move(queue_.front());
+      queue_.erase(queue_.begin());
+    }
+
+    // Decode outside the lock; the GUI keeps drawing without peaks.
+    const std::string path = PeakFilePath(source);
+    absl::StatusOr<std::unique_ptr<PeakFile>> file =
+        PeakFile::Open(path, source);
+    if (!file.ok()) {
+      absl::Status status;
+      if (absl::StatusOr<std::unique_ptr<AudioFileReader>> reader =
+              OpenAudioFile(source);
+          reader.ok()) {
+        status = BuildPeakFile(**reader, source, path);
+      } else {
+        status = reader.status();
+      }
+      file = status.ok() ? PeakFile::Open(path, source) : status;
+    }
+    if (!file.ok()) {
+      LOG(ERROR) << "No peaks for " << source << ": " << file.status();
+      continue;
+    }
+    {
+      absl::MutexLock lock(&mu_);
+      files_[source] = std::move(*file);
+    }
+    if (on_ready_) on_ready_();
+  }
+}
+
+}  // namespace kodo
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "audio_file.h"
+
+namespace kodo {
+
+// Summary of a frame range, normalized to [-1, 1] and stored as int16.
+struct Peak {
+  int16_t min;
+  int16_t max;
+  int16_t rms;
+};
+
+// Memory-mapped peak file: min/max/RMS pyramids at power-of-two decimations
+// of kBaseDecimation frames, interleaved by channel within each level.
+class PeakFile {
+ public:
+  static constexpr int kBaseDecimation = 256;
+  struct Header;  // On-disk layout, followed by the levels.
+
+  // Maps `path` and checks it still matches `source_path`.
+  static absl::StatusOr<std::unique_ptr<PeakFile>> Open(
+      const std::string& path, const std::string& source_path);
+
+  ~PeakFile();
+
+  int num_channels() const;
+  int64_t num_frames() const;
+  int num_levels() const;
+
+  // Fills one Peak per pixel column starting at `first_frame`. Reads at most
+  // two entries per column from the coarsest level that still resolves
+  // `frames_per_pixel`, so drawing costs O(num_pixels).
+  void Columns(int channel, double first_frame, double frames_per_pixel,
+               int num_pixels, Peak* out) const;
+
+ private:
+  PeakFile() {}  // Use Open().
+
+  const Peak* level(int index) const;
+  int64_t level_size(int index) const;
+
+  const Header* header_ = nullptr;
+  size_t size_ = 0;
+  std::vector<char> fallback_;  // Holds the file where mmap is unavailable.
+};
+
+// Peak file path of an audio file, next to it.
+std::string PeakFilePath(const std::string& source_path);
+
+// Decodes `reader` chunk by chunk and writes its peak file to `path`.
+absl::Status BuildPeakFile(AudioFileReader& reader,
+                           const std::string& source_path,
+                           const std::string& path);
+
+// Builds peak files of imported clips in a background thread and keeps them
+// mapped for drawing.
+class PeakCache {
+ public:
+  static std::unique_ptr<PeakCache> Create();
+
+  // Joins the thread.
+  ~PeakCache();
+
+  // Schedules building (or reusing) the peak file of `source_path`.
+  void Request(const std::string& source_path) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the peaks of `source_path`, or nullptr while they are not ready.
+  // Requests them on the first call.
+  const PeakFile* Get(const std::string& source_path)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Called on the background thread whenever a peak file becomes ready.
+  // Set it before requesting anything.
+  void SetOnReady(std::function<void()> on_ready) {
+    on_ready_ = std::move(on_ready);
+  }
+
+ private:
+  PeakCache() {}  // Use Create().
+
+  void Loop();
+  bool HasWork() const ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+    return quit_ || !queue_.empty();
+  }
+
+  absl::Mutex mu_;
+  // nullptr while pending or failed.
+  std::unordered_map<std::string, std::unique_ptr<PeakFile>> files_
+      ABSL_GUARDED_BY(mu_);
+  std::vector<std::string> queue_ ABSL_GUARDED_BY(mu_);
+  bool quit_ ABSL_GUARDED_BY(mu_) = false;
+  std::function<void()> on_ready_;
+  std::thread thread_;
+};
+
+}  // namespace kodo
@@ -0,0 +1,117 @@
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace kodo {
+
+uint64_t CycleCount() {
+#if defined(_M_X64) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t count;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(count));
+  return count;
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+double CyclesPerSecond() {
+  static const double cycles_per_second = []() {
+#if defined(__aarch64__) && !defined(_MSC_VER)
+    uint64_t frequency;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    return double(frequency);
+#elif defined(_M_X64) || defined(__x86_64__) || defined(__i386__)
+    // Assumes an invariant TSC, true for every x86 CPU since ~2008.
+    const auto t0 = std::chrono::steady_clock::now();
+    const uint64_t c0 = CycleCount();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    const uint64_t c1 = CycleCount();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - t0;
+    return (c1 - c0) / elapsed.count();
+#else
+    return double(std::chrono::steady_clock::period::den) /
+           std::chrono::steady_clock::period::num;
+#endif
+  }();
+  return cycles_per_second;
+}
+
+TimingStats::Snapshot TimingStats::Read() const {
+  Snapshot snapshot;
+  snapshot.name = name_;
+  snapshot.count = count_.load(std::memory_order_relaxed);
+  const double us_per_cycle = 1e6 / CyclesPerSecond();
+  if (snapshot.count > 0) {
+    snapshot.average_us = us_per_cycle *
+                          total_.load(std::memory_order_relaxed) /
+                          snapshot.count;
+  }
+  snapshot.max_us = us_per_cycle * max_.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+std::shared_ptr<TimingStats> PerfRegistry::Register(std::string name) {
+  auto stats = std::make_shared<TimingStats>(std::move(name));
+  absl::MutexLock lock(&mu_);
+  stats_.push_back(stats);
+  return stats;
+}
+
+std::vector<TimingStats::Snapshot> PerfRegistry::Read() {
+  absl::MutexLock lock(&mu_);
+  // Drop entries of retired graphs.
+  stats_.erase(std::remove_if(stats_.begin(), stats_.end(),
+                              [](const std::shared_ptr<TimingStats>& s) {
+                                return s.use_count() == 1;
+                              }),
+               stats_.end());
+  std::vector<TimingStats::Snapshot> ret;
+  ret.reserve(stats_.size());
+  for (const std::shared_ptr<TimingStats>& stats : stats_) {
+    ret.push_back(stats->Read());
+  }
+  return ret;
+}
+
+void PerfRegistry::ResetMax() {
+  absl::MutexLock lock(&mu_);
+  for (const std::shared_ptr<TimingStats>& stats : stats_) stats->ResetMax();
+}
+
+std::string FormatPerfReport(const EngineStats& engine,
+                             const std::vector<TimingStats::Snapshot>& stats) {
+  const TimingStats::Snapshot callback = engine.callback.Read();
+  std::string report = absl::StrFormat(
+      "DSP load %.1f%% (max %.1f%%), jitter max %.1f%%, xruns=%d, "
+      "deadline misses=%d, callback avg %.1fus max %.1fus",
+      100 * engine.load.load(), 100 * engine.max_load.load(),
+      100 * engine.max_jitter.load(), engine.xruns.load(),
+      engine.deadline_misses.load(), callback.average_us, callback.max_us);
+  for (const TimingStats::Snapshot& s : stats) {
+    absl::StrAppend(&report,
+                    absl::StrFormat("\n  %s: avg %.1fus max %.1fus (n=%d)",
+                                    s.name, s.average_us, s.max_us, s.count));
+  }
+  return report;
+}
+
+}  // namespace kodo
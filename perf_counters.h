@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace kodo {
+
+// Reads the CPU timestamp counter (TSC on x86, CNTVCT on arm64). Real-time
+// safe and much cheaper than a clock syscall.
+uint64_t CycleCount();
+
+// Frequency of CycleCount(). Calibrates once on the first call, which may
+// sleep for a few milliseconds, so call it before starting the audio thread.
+double CyclesPerSecond();
+
+// Lock-free duration statistics with a single writer at a time.
+class TimingStats {
+ public:
+  struct Snapshot {
+    std::string name;
+    uint64_t count = 0;
+    double average_us = 0;
+    double max_us = 0;
+  };
+
+  explicit TimingStats(std::string name) : name_(std::move(name)) {}
+
+  // Real-time safe.
+  void Add(uint64_t cycles) {
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_.fetch_add(cycles, std::memory_order_relaxed);
+    if (cycles > max_.load(std::memory_order_relaxed)) {
+      max_.store(cycles, std::memory_order_relaxed);
+    }
+  }
+
+  Snapshot Read() const;
+  // Starts a new worst-case window, e.g. after reporting it.
+  void ResetMax() { max_.store(0, std::memory_order_relaxed); }
+
+  const std::string& name() const { return name_; }
+
+ private:
+  const std::string name_;
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<uint64_t> total_ = 0;
+  std::atomic<uint64_t> max_ = 0;
+};
+
+// Callback health of AudioEngine, written by the audio thread only.
+struct EngineStats {
+  TimingStats callback{"Audio callback"};
+  // Underflow/overflow reported by PortAudio status flags.
+  std::atomic<uint64_t> xruns = 0;
+  // Callbacks that took longer than their buffer duration.
+  std::atomic<uint64_t> deadline_misses = 0;
+  // Callback duration over the buffer duration, last and worst.
+  std::atomic<float> load = 0;
+  std::atomic<float> max_load = 0;
+  // Worst deviation of the time between callbacks from the buffer duration,
+  // over the buffer duration. Hosts buffering more than a block call back in
+  // bursts, which leaves less time than the buffer duration.
+  std::atomic<float> max_jitter = 0;
+  // Worst load and jitter since the last TakeWindow(), apart from the
+  // maxima above which the user resets.
+  std::atomic<float> window_load = 0;
+  std::atomic<float> window_jitter = 0;
+  // Start of the last callback, or 0 to skip the next interval.
+  std::atomic<uint64_t> last_start = 0;
+
+  // Real-time safe.
+  void RecordCallback(uint64_t start, uint64_t cycles, uint64_t deadline_cycles,
+                      bool xrun) {
+    callback.Add(cycles);
+    const float ratio = float(cycles) / deadline_cycles;
+    load.store(ratio, std::memory_order_relaxed);
+    UpdateMax(max_load, ratio);
+    UpdateMax(window_load, ratio);
+    if (const uint64_t last =
+            last_start.exchange(start, std::memory_order_relaxed);
+        last != 0) {
+      const float jitter =
+          std::abs(double(start - last) - deadline_cycles) / deadline_cycles;
+      UpdateMax(max_jitter, jitter);
+      UpdateMax(window_jitter, jitter);
+    }
+    if (cycles > deadline_cycles) {
+      deadline_misses.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (xrun) xruns.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void ResetMax() {
+    max_load.store(0, std::memory_order_relaxed);
+    max_jitter.store(0, std::memory_order_relaxed);
+    callback.ResetMax();
+  }
+  // Returns the worst load and jitter of the window and starts a new one.
+  std::pair<float, float> TakeWindow() {
+    return {window_load.exchange(0, std::memory_order_relaxed),
+            window_jitter.exchange(0, std::memory_order_relaxed)};
+  }
+
+ private:
+  static void UpdateMax(std::atomic<float>& max, float value) {
+    if (value > max.load(std::memory_order_relaxed)) {
+      max.store(value, std::memory_order_relaxed);
+    }
+  }
+};
+
+// Named TimingStats shared between their owners (e.g. render graphs) and
+// reporting. Entries disappear once no owner holds them.
+class PerfRegistry {
+ public:
+  std::shared_ptr<TimingStats> Register(std::string name)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Reads every live entry in registration order.
+  std::vector<TimingStats::Snapshot> Read() ABSL_LOCKS_EXCLUDED(mu_);
+  void ResetMax() ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  absl::Mutex mu_;
+  std::vector<std::shared_ptr<TimingStats>> stats_ ABSL_GUARDED_BY(mu_);
+};
+
+// Multi-line summary for logs when running without GUI.
+std::string FormatPerfReport(const EngineStats& engine,
+                             const std::vector<TimingStats::Snapshot>& stats);
+
+}  // namespace kodo
@@ -0,0 +1,105 @@
+#include "perf_window.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "imgui.h"
+#include "latency_tuner.h"
+#include "perf_counters.h"
+#include "recorder.h"
+#include "trace.h"
+
+namespace kodo {
+
+void RenderPerfWindow(EngineStats& engine, PerfRegistry& registry,
+                      LatencyTuner* tuner, const std::string& trace_path,
+                      const Recorder* recorder) {
+  ImGui::SetNextWindowSize(ImVec2(420, 260), ImGuiCond_FirstUseEver);
+  ImGui::Begin("Performance");
+
+  const float load = engine.load.load(std::memory_order_relaxed);
+  const float max_load = engine.max_load.load(std::memory_order_relaxed);
+  ImGui::ProgressBar(load, ImVec2(-1, 0));
+  ImGui::Text("DSP load %.1f%% (max %.1f%%)", 100 * load, 100 * max_load);
+  ImGui::Text("Xruns: %llu  Deadline misses: %llu",
+              static_cast<unsigned long long>(engine.xruns.load()),
+              static_cast<unsigned long long>(engine.deadline_misses.load()));
+  const TimingStats::Snapshot callback = engine.callback.Read();
+  ImGui::Text("Callback avg %.1f us, max %.1f us, jitter max %.1f%%",
+              callback.average_us, callback.max_us,
+              100 * engine.max_jitter.load(std::memory_order_relaxed));
+  if (ImGui::Button("Reset max")) {
+    engine.ResetMax();
+    registry.ResetMax();
+  }
+  if (tuner) {
+    ImGui::Text("Buffer %d frames", tuner->block_size());
+    if (const int size = tuner->suggestion(); size > 0) {
+      const std::string label =
+          absl::StrCat(size > tuner->block_size() ? "Raise" : "Lower",
+                       " buffer to ", size);
+      if (ImGui::Button(label.c_str())) {
+        if (absl::Status status = tuner->Apply(); !status.ok()) {
+          LOG(ERROR) << status;
+        }
+      }
+    }
+  }
+
+  if (recorder) {
+    const Recorder::Stats stats = recorder->stats();
+    const float capacity = std::max<int64_t>(stats.capacity_frames, 1);
+    ImGui::ProgressBar(stats.pending_frames / capacity, ImVec2(-1, 0));
+    ImGui::Text("Recorder ring %.0f%% (high water %.0f%%)",
+                100 * stats.pending_frames / capacity,
+                100 * stats.high_water_frames / capacity);
+    ImGui::Text("Overruns: %llu  Dropped: %lld frames  Written: %.1f s",
+                static_cast<unsigned long long>(stats.overruns),
+                static_cast<long long>(stats.dropped_frames),
+                stats.frames_written / recorder->options().sample_rate);
+  }
+
+  if (!trace_path.empty()) {
+    bool tracing = TracingEnabled();
+    if (ImGui::Checkbox("Record trace", &tracing)) {
+      if (tracing) {
+        StartTracing();
+      } else {
+        StopTracing();
+      }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Save trace")) {
+      if (absl::Status status = WriteTrace(trace_path); !status.ok()) {
+        LOG(ERROR) << status;
+      }
+    }
+  }
+
+  const std::vector<TimingStats::Snapshot> stats = registry.Read();
+  if (!stats.empty() && ImGui::BeginTable("Plugins", 3)) {
+    ImGui::TableSetupColumn("Plugin");
+    ImGui::TableSetupColumn("Avg us");
+    ImGui::TableSetupColumn("Max us");
+    ImGui::TableHeadersRow();
+    for (const TimingStats::Snapshot& s : stats) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(s.name.c_str());
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f", s.average_us);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f", s.max_us);
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+}  // namespace kodo
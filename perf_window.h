@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include "latency_tuner.h"
+#include "perf_counters.h"
+#include "recorder.h"
+
+namespace kodo {
+
+// Draws the "Performance" window: DSP load, xruns and the per-plugin
+// timings of `registry`. With a `tuner`, also the buffer size and a button
+// switching to the one it suggests. With a `trace_path`, also toggles
+// tracing and saves the trace there. With a `recorder`, also its ring fill
+// and overruns.
+void RenderPerfWindow(EngineStats& engine, PerfRegistry& registry,
+                      LatencyTuner* tuner = nullptr,
+                      const std::string& trace_path = "",
+                      const Recorder* recorder = nullptr);
+
+}  // namespace kodo
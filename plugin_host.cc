@@ -0,0 +1,264 @@
+// Child process of kodo::LoadSandboxedVst3(). Loads one VST3 class and
+// processes the blocks the engine publishes in shared memory.
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/debugging/symbolize.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/initialize.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "midi_event.h"
+#include "param_changes.h"
+#include "plugin_vst3.h"
+#include "public.sdk/source/vst/hosting/hostclasses.h"
+#include "public.sdk/source/vst/hosting/plugprovider.h"
+#include "rt_alloc.h"
+#include "shm_channel.h"
+
+#if defined __linux__
+#include "kodo/platform/linux/runloop.h"
+#include "kodo/platform/linux/vstrunloop.h"
+#endif
+
+ABSL_FLAG(std::string, shm, "", "Shared memory created by the engine.");
+ABSL_FLAG(std::string, vst3, "", "VST3 module to load.");
+ABSL_FLAG(int, class_index, 0, "Class index in the VST3 module.");
+ABSL_FLAG(int, command_fd, -1,
+          "eventfd the engine signals after posting a command, on Linux.");
+
+namespace {
+
+using ::kodo::SandboxShm;
+
+constexpr int64_t kPollNs = 100'000'000;
+constexpr int kPollMs = kPollNs / 1'000'000;
+
+void AudioLoop(SandboxShm* shm, kodo::Plugin* plugin,
+               const std::atomic<bool>* quit) {
+  // The events and parameter changes of every slot a block may merge.
+  std::vector<kodo::ParamChange> params(SandboxShm::kSlots *
+                                        SandboxShm::kMaxParams);
+  std::vector<kodo::MidiEvent> events(SandboxShm::kSlots *
+                                      SandboxShm::kMaxEvents);
+  uint32_t seen = shm->response.load(std::memory_order_relaxed);
+  while (!quit->load(std::memory_order_relaxed)) {
+    const uint32_t seq = shm->request.load(std::memory_order_acquire);
+    if (seq == seen) {
+      kodo::FutexWait(&shm->request, seen, kPollNs);
+      continue;
+    }
+    // Only the latest audio matters: the engine has already bypassed the
+    // older blocks, so skipping them is how a late host catches up. Their
+    // notes and parameter changes still apply, from the start of the latest
+    // block, or notes would hang and edits would be lost. The engine never
+    // reuses a slot before it is acknowledged, so they are intact.
+    int num_params = 0;
+    int num_events = 0;
+    const uint32_t first =
+        seq - std::min<uint32_t>(seq - seen, SandboxShm::kSlots) + 1;
+    for (uint32_t skipped = first; skipped != seq; ++skipped) {
+      const SandboxShm::Slot& slot =
+          shm->slots[skipped % SandboxShm::kSlots];
+      for (int i = 0; i < slot.num_params; ++i) {
+        params[num_params] = slot.params[i];
+        params[num_params++].sample_offset = 0;
+      }
+      for (int i = 0; i < slot.num_events; ++i) {
+        events[num_events] = slot.events[i];
+        events[num_events++].sample_offset = 0;
+      }
+    }
+    const int slot_index = seq % SandboxShm::kSlots;
+    SandboxShm::Slot& slot = shm->slots[slot_index];
+    const kodo::ParamChange* block_params = slot.params;
+    const kodo::MidiEvent* block_events = slot.events;
+    // Copies only behind skipped ones, to keep the order by offset.
+    if (num_params > 0) {
+      std::copy_n(slot.params, slot.num_params, params.data() + num_params);
+      block_params = params.data();
+    }
+    if (num_events > 0) {
+      std::copy_n(slot.events, slot.num_events, events.data() + num_events);
+      block_events = events.data();
+    }
+    const float* inputs[SandboxShm::kChannels];
+    float* outputs[SandboxShm::kChannels];
+    for (int c = 0; c < SandboxShm::kChannels; ++c) {
+      inputs[c] = shm->channel(slot_index, false, c);
+      outputs[c] = shm->channel(slot_index, true, c);
+    }
+    kodo::AudioBlock block;
+    block.inputs = inputs;
+    block.num_inputs = SandboxShm::kChannels;
+    block.outputs = outputs;
+    block.num_outputs = SandboxShm::kChannels;
+    block.num_frames = slot.num_frames;
+    block.param_changes = block_params;
+    block.num_param_changes = num_params + slot.num_params;
+    block.events = block_events;
+    block.num_events = num_events + slot.num_events;
+    {
+      kodo::RealtimeScope realtime;
+      slot.ok = plugin->Process(block);
+    }
+
+    shm->response.store(seq, std::memory_order_release);
+    kodo::FutexWake(&shm->response);
+    seen = seq;
+  }
+}
+
+absl::Status RunCommand(SandboxShm* shm, kodo::Plugin* plugin) {
+  const uint64_t arg = shm->command_arg.load(std::memory_order_relaxed);
+  switch (shm->command.load(std::memory_order_relaxed)) {
+    case SandboxShm::kSetupProcessing: {
+      kodo::ProcessSetup setup;
+      setup.sample_rate = shm->sample_rate;
+      setup.offline = shm->offline != 0;
+      setup.max_block_size = arg;
+      if (absl::Status status = plugin->SetupProcessing(setup);
+          !status.ok()) {
+        return status;
+      }
+      shm->num_inputs = plugin->num_inputs();
+      shm->num_outputs = plugin->num_outputs();
+      return absl::OkStatus();
+    }
+    case SandboxShm::kSetActive:
+      return plugin->SetActive(arg != 0);
+    case SandboxShm::kEmbedEditor:
+      return plugin->EmbedEditor(reinterpret_cast<void*>(arg));
+    default:
+      return absl::InvalidArgumentError("Unknown command.");
+  }
+}
+
+// Runs the command the engine posted last unless it is `*done` already.
+// Returns false once told to quit or once the engine exited.
+bool PollCommand(SandboxShm* shm, kodo::Plugin* plugin, pid_t parent,
+                 uint32_t* done) {
+  if (getppid() != parent) {
+    LOG(ERROR) << "Engine exited; quitting.";
+    return false;
+  }
+  // Latency changes arrive on this thread without a command.
+  shm->latency.store(plugin->latency(), std::memory_order_release);
+  const uint32_t seq = shm->command_seq.load(std::memory_order_acquire);
+  if (seq == *done) return true;
+
+  bool ok = true;
+  const bool quit =
+      shm->command.load(std::memory_order_relaxed) == SandboxShm::kQuit;
+  if (!quit) {
+    if (absl::Status status = RunCommand(shm, plugin); !status.ok()) {
+      LOG(ERROR) << status;
+      ok = false;
+    }
+  }
+  shm->latency.store(plugin->latency(), std::memory_order_release);
+  shm->command_ok.store(ok, std::memory_order_relaxed);
+  shm->command_done.store(seq, std::memory_order_release);
+  kodo::FutexWake(&shm->command_done);
+  *done = seq;
+  return !quit;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+  // Names the frames of trapped real-time allocations.
+  absl::InitializeSymbolizer(argv[0]);
+  const pid_t parent = getppid();
+
+  Steinberg::Vst::HostApplication vst_host_app;
+  Steinberg::Vst::PluginContextFactory::instance().setPluginContext(
+      &vst_host_app);
+
+  absl::StatusOr<std::unique_ptr<kodo::ShmRegion>> region =
+      kodo::ShmRegion::Open(absl::GetFlag(FLAGS_shm));
+  if (!region.ok()) {
+    LOG(ERROR) << region.status();
+    return 1;
+  }
+  auto* shm = static_cast<SandboxShm*>((*region)->data());
+  if ((*region)->size() < sizeof(SandboxShm) ||
+      shm->magic != SandboxShm::kMagic ||
+      (*region)->size() < SandboxShm::Size(shm->max_block_size)) {
+    LOG(ERROR) << "Invalid shared memory " << (*region)->name();
+    return 1;
+  }
+
+#if defined __linux__
+  // Declared first, to outlive the plugin and its editor.
+  kodo::VstRunLoop editor_run_loop;
+  kodo::SetVst3EditorRunLoop(&editor_run_loop);
+#endif
+  absl::StatusOr<std::unique_ptr<kodo::Plugin>> plugin;
+  absl::StatusOr<std::unique_ptr<kodo::PluginModule>> module =
+      kodo::Vst3Module(absl::GetFlag(FLAGS_vst3));
+  if (module.ok()) {
+    plugin = (*module)->Load(absl::GetFlag(FLAGS_class_index));
+  } else {
+    plugin = module.status();
+  }
+  if (!plugin.ok()) {
+    LOG(ERROR) << plugin.status();
+    shm->state.store(SandboxShm::kFailed, std::memory_order_release);
+    return 1;
+  }
+  shm->state.store(SandboxShm::kReady, std::memory_order_release);
+
+  std::atomic<bool> quit = false;
+  std::thread audio(AudioLoop, shm, plugin->get(), &quit);
+  // Best effort: needs rtprio.
+  sched_param param{};
+  param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+  pthread_setschedparam(audio.native_handle(), SCHED_FIFO, &param);
+
+  uint32_t done = shm->command_done.load(std::memory_order_relaxed);
+#if defined __linux__
+  // X11 editors need a run loop for their display connection and timers,
+  // so commands arrive through an eventfd it watches instead of the futex.
+  kodo::RunLoop& run_loop = kodo::RunLoop::instance();
+  const auto poll = [&] {
+    if (!PollCommand(shm, plugin->get(), parent, &done)) run_loop.stop();
+  };
+  const int command_fd = absl::GetFlag(FLAGS_command_fd);
+  if (command_fd >= 0) {
+    run_loop.registerFileDescriptor(command_fd, [&poll](int fd) {
+      uint64_t count;  // Resets the counter, which epoll saw nonzero.
+      if (read(fd, &count, sizeof(count)) == sizeof(count)) poll();
+    });
+  }
+  // Also notices an exited engine and latency changes.
+  const kodo::TimerID timer =
+      run_loop.registerTimer(kPollMs, [&poll](kodo::TimerID) { poll(); });
+  run_loop.run();
+  run_loop.unregisterTimer(timer);
+  if (command_fd >= 0) run_loop.unregisterFileDescriptor(command_fd);
+#else
+  do {
+    kodo::FutexWait(&shm->command_seq, done, kPollNs);
+  } while (PollCommand(shm, plugin->get(), parent, &done));
+#endif
+
+  quit.store(true);
+  kodo::FutexWake(&shm->request);
+  audio.join();
+  return 0;
+}
@@ -0,0 +1,199 @@
+#include "plugin_loader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "kodo.pb.h"
+#include "plugin_vst3.h"
+
+namespace kodo {
+namespace {
+
+// Creates, restores and activates one plugin of `module`.
+absl::StatusOr<std::unique_ptr<Plugin>> Instantiate(
+    PluginModule& module, const PluginLoader::Instance& instance,
+    const ProcessSetup& setup) {
+  absl::StatusOr<std::unique_ptr<Plugin>> plugin =
+      module.Load(instance.instance->class_index());
+  if (!plugin.ok()) return plugin.status();
+  const std::string& component_state =
+      instance.saved_state ? instance.saved_state->component_state()
+                           : instance.instance->component_state();
+  const std::string& controller_state =
+      instance.saved_state ? instance.saved_state->controller_state()
+                           : instance.instance->controller_state();
+  if (!component_state.empty() || !controller_state.empty()) {
+    absl::Status status =
+        (*plugin)->SetState(component_state, controller_state);
+    if (absl::IsUnimplemented(status)) {
+      LOG(WARNING) << instance.instance->path() << ": " << status
+                   << " Starting from defaults.";
+    } else if (!status.ok()) {
+      return status;
+    }
+  }
+  if (absl::Status status = (*plugin)->SetupProcessing(setup); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = (*plugin)->SetActive(true); !status.ok()) {
+    return status;
+  }
+  return plugin;
+}
+
+}  // namespace
+
+std::unique_ptr<PluginLoader> PluginLoader::Create(
+    const Project& project, const PluginLoaderOptions& options) {
+  std::unique_ptr<PluginLoader> ret(new PluginLoader(options));
+  std::unordered_map<int64_t, const PluginState*> saved_states;
+  for (const PluginState& state : project.plugin_states()) {
+    saved_states[state.plugin_id()] = &state;
+  }
+  auto add = [&](const Track& track) {
+    if (track.has_freeze()) return;  // Plays its rendering instead.
+    for (const PluginInstance& instance : track.plugins()) {
+      ret->instances_by_path_[instance.path()].push_back(
+          ret->instances_.size());
+      auto it = saved_states.find(instance.id());
+      ret->instances_.push_back(
+          {&track, &instance,
+           it == saved_states.end() ? nullptr : it->second});
+      ++ret->remaining_[&track];
+    }
+  };
+  for (const Track& track : project.tracks()) add(track);
+  for (const Track& bus : project.buses()) add(bus);
+  add(project.master());
+
+  {
+    absl::MutexLock lock(&ret->mu_);
+    for (const auto& [path, indices] : ret->instances_by_path_) {
+      ret->jobs_.push_back({path});
+    }
+  }
+  const int num_threads = std::min<int>(std::max(options.num_threads, 1),
+                                        ret->instances_by_path_.size());
+  for (int i = 0; i < num_threads; ++i) {
+    ret->threads_.emplace_back(&PluginLoader::Loop, ret.get());
+  }
+  LOG(INFO) << "Loading " << ret->instances_.size() << " plugins from "
+            << ret->instances_by_path_.size() << " modules";
+  return ret;
+}
+
+PluginLoader::~PluginLoader() {
+  {
+    absl::MutexLock lock(&mu_);
+    quit_ = true;
+  }
+  for (std::thread& thread : threads_) thread.join();
+}
+
+void PluginLoader::Loop() {
+  while (true) {
+    Job job;
+    {
+      absl::MutexLock lock(&mu_);
+      mu_.Await(absl::Condition(this, &PluginLoader::HasJob));
+      if (quit_) return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+
+    const std::vector<int>& indices = instances_by_path_.at(job.path);
+    if (job.index >= 0) {
+      absl::StatusOr<std::unique_ptr<Plugin>> plugin =
+          Instantiate(*job.module, instances_[job.index], options_.setup);
+      absl::MutexLock lock(&mu_);
+      opened_.push_back({job.index, nullptr, std::move(plugin)});
+      continue;
+    }
+
+    // Opening is the slow part: loading the library and its dependencies.
+    absl::StatusOr<std::unique_ptr<PluginModule>> opened =
+        options_.open_module(job.path);
+    absl::MutexLock lock(&mu_);
+    if (!opened.ok()) {
+      for (int index : indices) {
+        opened_.push_back({index, nullptr, opened.status()});
+      }
+      continue;
+    }
+    std::shared_ptr<PluginModule> module = std::move(*opened);
+    for (int index : indices) {
+      if (module->thread_safe()) {
+        // Instances of one module load in parallel too.
+        jobs_.push_back({job.path, index, module});
+      } else {
+        opened_.push_back({index, module, nullptr});
+      }
+    }
+  }
+}
+
+int PluginLoader::Poll() {
+  const absl::Time deadline = absl::Now() + options_.poll_budget;
+  int completed = 0;
+  do {
+    Opened opened;
+    {
+      absl::MutexLock lock(&mu_);
+      if (opened_.empty()) break;
+      opened = std::move(opened_.front());
+      opened_.pop_front();
+    }
+    if (opened.module) {
+      opened.plugin = Instantiate(*opened.module, instances_[opened.index],
+                                  options_.setup);
+    }
+    completed += Complete(opened.index, std::move(opened.plugin));
+  } while (absl::Now() < deadline);
+  return completed;
+}
+
+void PluginLoader::Finish() {
+  while (!done()) {
+    {
+      absl::MutexLock lock(&mu_);
+      mu_.Await(absl::Condition(this, &PluginLoader::HasOpened));
+    }
+    Poll();
+  }
+}
+
+Plugin* PluginLoader::Find(int64_t id) const {
+  auto it = ready_.find(id);
+  return it == ready_.end() ? nullptr : it->second;
+}
+
+bool PluginLoader::Complete(int index,
+                            absl::StatusOr<std::unique_ptr<Plugin>> plugin) {
+  Instance& instance = instances_[index];
+  if (plugin.ok()) {
+    instance.plugin = std::move(*plugin);
+    instance.state = State::kReady;
+    ready_[instance.instance->id()] = instance.plugin.get();
+  } else {
+    LOG(ERROR) << instance.track->name() << ": " << instance.instance->path()
+               << ": " << plugin.status();
+    instance.status = plugin.status();
+    instance.state = State::kFailed;
+  }
+  ++num_done_;
+  return --remaining_[instance.track] == 0;
+}
+
+}  // namespace kodo
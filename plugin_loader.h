@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "kodo.pb.h"
+#include "plugin_vst3.h"
+
+namespace kodo {
+
+struct PluginLoaderOptions {
+  // Worker threads opening modules, at most one per distinct path.
+  int num_threads = 4;
+  // Every plugin is set up with this, then activated.
+  ProcessSetup setup;
+  // Opens the module of a PluginInstance::path. Runs on a worker thread.
+  std::function<absl::StatusOr<std::unique_ptr<PluginModule>>(
+      const std::string& path)>
+      open_module = [](const std::string& path) { return Vst3Module(path); };
+  // Main thread time per Poll(). At least one plugin is initialized per call.
+  absl::Duration poll_budget = absl::Milliseconds(8);
+};
+
+// Instantiates every plugin of a project in the background. Modules open in
+// parallel on worker threads, once per path however many instances share it.
+// The steps VST3 confines to the main thread, i.e. PlugProvider::initialize()
+// and setState(), queue up for Poll(), which runs a batch of them between GUI
+// frames. Modules that are thread_safe() load on the workers entirely.
+class PluginLoader {
+ public:
+  enum class State { kLoading, kReady, kFailed };
+
+  struct Instance {
+    const Track* track;
+    const PluginInstance* instance;
+    // From Project.plugin_states, overriding the state in `instance`.
+    const PluginState* saved_state = nullptr;
+    State state = State::kLoading;
+    absl::Status status;  // Why it failed.
+    std::unique_ptr<Plugin> plugin;
+  };
+
+  // Starts loading the plugins of the tracks, buses and master of `project`,
+  // which must outlive the loader. Frozen tracks are skipped.
+  static std::unique_ptr<PluginLoader> Create(
+      const Project& project, const PluginLoaderOptions& options);
+
+  // Joins the workers, then deletes the plugins. Renderers using them must
+  // be gone.
+  ~PluginLoader();
+
+  // Main thread. Initializes plugins whose modules are open for up to
+  // poll_budget. Returns the number of tracks whose chains finished loading,
+  // successfully or not, during this call.
+  int Poll();
+  // Main thread. Polls until every plugin is ready or failed.
+  void Finish();
+
+  // Main thread. The ready plugin of PluginInstance::id, or nullptr.
+  Plugin* Find(int64_t id) const;
+
+  // Main thread. Every plugin of the project in track order.
+  const std::vector<Instance>& instances() const { return instances_; }
+  int num_done() const { return num_done_; }
+  bool done() const { return num_done_ == instances_.size(); }
+
+ private:
+  // Worker thread tasks.
+  struct Job {
+    std::string path;
+    // Into instances_ to load from `module`, or -1 to open `path`.
+    int index = -1;
+    std::shared_ptr<PluginModule> module;
+  };
+  // Main thread tasks.
+  struct Opened {
+    int index;  // Into instances_.
+    // Set to initialize the plugin on the main thread. Otherwise a worker
+    // already loaded `plugin`.
+    std::shared_ptr<PluginModule> module;
+    absl::StatusOr<std::unique_ptr<Plugin>> plugin;
+  };
+
+  explicit PluginLoader(const PluginLoaderOptions& options)
+      : options_(options) {}  // Use Create().
+
+  void Loop();
+  // Records the outcome of instances_[index]. Returns whether this finished
+  // its track.
+  bool Complete(int index, absl::StatusOr<std::unique_ptr<Plugin>> plugin);
+
+  bool HasJob() const ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+    return quit_ || !jobs_.empty();
+  }
+  bool HasOpened() const ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+    return !opened_.empty();
+  }
+
+  const PluginLoaderOptions options_;
+  // Written by Create() before the workers start.
+  std::vector<Instance> instances_;
+  std::unordered_map<std::string, std::vector<int>> instances_by_path_;
+
+  // Main thread.
+  std::unordered_map<int64_t, Plugin*> ready_;
+  std::unordered_map<const Track*, int> remaining_;  // Plugins loading.
+  int num_done_ = 0;
+
+  absl::Mutex mu_;
+  std::deque<Job> jobs_ ABSL_GUARDED_BY(mu_);
+  std::deque<Opened> opened_ ABSL_GUARDED_BY(mu_);
+  bool quit_ ABSL_GUARDED_BY(mu_) = false;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace kodo
@@ -0,0 +1,388 @@
+#include "plugin_sandbox.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "imgui.h"
+#include "shm_channel.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+extern char** environ;
+#endif
+
+namespace kodo {
+
+namespace {
+
+#ifndef _WIN32
+
+constexpr auto kStartTimeout = std::chrono::seconds(10);
+constexpr auto kCommandTimeout = std::chrono::seconds(2);
+
+class SandboxedVst3Plugin : public Plugin {
+ public:
+  static absl::StatusOr<std::unique_ptr<SandboxedVst3Plugin>> Init(
+      const SandboxOptions& options) {
+    static std::atomic<int> counter = 0;
+    const std::string name =
+        absl::StrCat("/kodo_", getpid(), "_", counter.fetch_add(1));
+    absl::StatusOr<std::unique_ptr<ShmRegion>> shm =
+        ShmRegion::Create(name, SandboxShm::Size(options.max_block_size));
+    if (!shm.ok()) return shm.status();
+
+    std::unique_ptr<SandboxedVst3Plugin> ret(new SandboxedVst3Plugin);
+    ret->options_ = options;
+    ret->region_ = std::move(*shm);
+    ret->shm_ = new (ret->region_->data()) SandboxShm{};
+    ret->shm_->magic = SandboxShm::kMagic;
+    ret->shm_->max_block_size = options.max_block_size;
+
+    std::string shm_flag = absl::StrCat("--shm=", name);
+    std::string vst3_flag = absl::StrCat("--vst3=", options.vst3_path);
+    std::string index_flag =
+        absl::StrCat("--class_index=", options.class_index);
+    std::vector<char*> argv = {
+        const_cast<char*>(options.host_command.c_str()), shm_flag.data(),
+        vst3_flag.data(), index_flag.data()};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+#ifdef __linux__
+    // Commands wake the run loop of the host, which X11 editors need, through
+    // this rather than the futex.
+    ret->command_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ret->command_fd_ < 0) {
+      posix_spawn_file_actions_destroy(&actions);
+      return absl::InternalError(
+          absl::StrCat("Cannot create an eventfd: ", std::strerror(errno)));
+    }
+    // To the same number, which only clears FD_CLOEXEC in the child.
+    posix_spawn_file_actions_adddup2(&actions, ret->command_fd_,
+                                     ret->command_fd_);
+    std::string fd_flag = absl::StrCat("--command_fd=", ret->command_fd_);
+    argv.push_back(fd_flag.data());
+#endif
+    argv.push_back(nullptr);
+    const int err = posix_spawn(&ret->pid_, options.host_command.c_str(),
+                                &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+      ret->pid_ = -1;
+      return absl::InternalError(absl::StrCat(
+          "Cannot spawn ", options.host_command, ": ", std::strerror(err)));
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + kStartTimeout;
+    while (ret->shm_->state.load(std::memory_order_acquire) ==
+           SandboxShm::kStarting) {
+      if (!ret->Alive() || std::chrono::steady_clock::now() > deadline) {
+        return absl::UnavailableError(
+            absl::StrCat("plugin_host did not start for ", options.vst3_path));
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (ret->shm_->state.load() != SandboxShm::kReady) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("plugin_host cannot load ", options.vst3_path));
+    }
+    // The host has mapped the region; nobody else needs the name.
+    ret->region_->Unlink();
+    return ret;
+  }
+
+  ~SandboxedVst3Plugin() override {
+    if (pid_ > 0) {
+      if (Alive()) SendCommand(SandboxShm::kQuit, 0).IgnoreError();
+      const auto deadline =
+          std::chrono::steady_clock::now() + kCommandTimeout;
+      while (Alive() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      if (Alive()) {
+        LOG(WARNING) << "Killing plugin_host pid=" << pid_;
+        kill(pid_, SIGKILL);
+        waitpid(pid_, nullptr, 0);
+      }
+    }
+    if (command_fd_ >= 0) close(command_fd_);
+  }
+
+  std::string name() const override {
+    const std::filesystem::path path(options_.vst3_path);
+    return absl::StrCat(path.stem().string(), " (sandboxed)");
+  }
+
+  absl::Status Render(void* window_handle) override {
+    if (!embedded_ && Alive()) {
+      embedded_ = true;  // Do not retry every frame.
+      editor_status_ = EmbedEditor(window_handle);
+      LOG_IF(ERROR, !editor_status_.ok()) << editor_status_;
+    }
+    ImGui::Begin(options_.vst3_path.c_str());
+    if (Alive()) {
+      ImGui::Text("Sandboxed in pid %d", pid_);
+    } else {
+      ImGui::Text("plugin_host exited with %d", exit_status_);
+    }
+    if (!editor_status_.ok()) {
+      ImGui::TextWrapped("No editor: %s",
+                         std::string(editor_status_.message()).c_str());
+    }
+    ImGui::Text("Late blocks: %llu", static_cast<unsigned long long>(
+                                         late_blocks_.load()));
+    ImGui::End();
+    return absl::OkStatus();
+  }
+
+  // On Linux `parent_window` is the XEmbed parent of Gui::GetHandle(). X11
+  // windows are shared by the whole display, so the host attaches the view
+  // to it directly and runs its events on its own connection.
+  absl::Status EmbedEditor(void* parent_window) override {
+    return SendCommand(SandboxShm::kEmbedEditor,
+                       reinterpret_cast<uintptr_t>(parent_window));
+  }
+
+  absl::Status SetupProcessing(const ProcessSetup& setup) override {
+    if (active_) {
+      return absl::FailedPreconditionError(
+          "SetupProcessing() must be called while inactive.");
+    }
+    if (setup.max_block_size > shm_->max_block_size) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "max_block_size=", setup.max_block_size, " exceeds sandbox ",
+          shm_->max_block_size));
+    }
+    shm_->sample_rate = setup.sample_rate;
+    shm_->offline = setup.offline;
+    if (absl::Status status =
+            SendCommand(SandboxShm::kSetupProcessing, setup.max_block_size);
+        !status.ok()) {
+      return status;
+    }
+    setup_ = setup;
+    // 1e9 ns per second times the budget fraction of one block.
+    budget_ns_ = static_cast<int64_t>(1e9 * options_.latency_budget *
+                                      setup.max_block_size /
+                                      setup.sample_rate);
+    // Without a deadline, wait for the host unless it is hung.
+    if (setup.offline) budget_ns_ = int64_t{10} * 1000000000;
+    return absl::OkStatus();
+  }
+
+  absl::Status SetActive(bool active) override {
+    if (active == active_) return absl::OkStatus();
+    if (absl::Status status = SendCommand(SandboxShm::kSetActive, active);
+        !status.ok()) {
+      return status;
+    }
+    active_ = active;
+    SyncLatency();
+    return absl::OkStatus();
+  }
+
+  int num_inputs() const override { return shm_->num_inputs; }
+  int num_outputs() const override { return shm_->num_outputs; }
+  int latency() const override {
+    return latency_.load(std::memory_order_relaxed);
+  }
+
+  bool Process(const AudioBlock& block) override {
+    SyncLatency();
+    if (!active_ || block.num_frames > setup_.max_block_size) return false;
+    // The host is stuck on every slot; do not overwrite its input.
+    const uint32_t seq = sent_ + 1;
+    if (seq - shm_->response.load(std::memory_order_acquire) >
+        SandboxShm::kSlots) {
+      late_blocks_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    const int slot_index = seq % SandboxShm::kSlots;
+    SandboxShm::Slot& slot = shm_->slots[slot_index];
+    slot.num_frames = block.num_frames;
+    slot.num_params =
+        std::min(block.num_param_changes, SandboxShm::kMaxParams);
+    std::copy_n(block.param_changes, slot.num_params, slot.params);
+    slot.num_events = std::min(block.num_events, SandboxShm::kMaxEvents);
+    std::copy_n(block.events, slot.num_events, slot.events);
+    for (int c = 0; c < SandboxShm::kChannels; ++c) {
+      float* dst = shm_->channel(slot_index, false, c);
+      if (c < block.num_inputs) {
+        std::copy_n(block.inputs[c], block.num_frames, dst);
+      } else {
+        std::fill_n(dst, block.num_frames, 0.0f);
+      }
+    }
+    sent_ = seq;
+    shm_->request.store(seq, std::memory_order_release);
+    FutexWake(&shm_->request);
+
+    // Wait within the budget. A late block is bypassed and its result is
+    // dropped when it eventually arrives.
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::nanoseconds(budget_ns_);
+    uint32_t done;
+    while (static_cast<int32_t>(
+               (done = shm_->response.load(std::memory_order_acquire)) -
+               seq) < 0) {
+      const int64_t remaining =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              deadline - std::chrono::steady_clock::now())
+              .count();
+      if (remaining <= 0) {
+        late_blocks_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      FutexWait(&shm_->response, done, remaining);
+    }
+    if (!slot.ok) return false;
+
+    const int channels = std::min(block.num_outputs, SandboxShm::kChannels);
+    for (int c = 0; c < channels; ++c) {
+      std::copy_n(shm_->channel(slot_index, true, c), block.num_frames,
+                  block.outputs[c]);
+    }
+    return true;
+  }
+
+ private:
+  SandboxedVst3Plugin() {}  // Use Init().
+
+  // Reaps the child if it exited.
+  bool Alive() {
+    if (pid_ <= 0) return false;
+    int status = 0;
+    if (waitpid(pid_, &status, WNOHANG) == pid_) {
+      exit_status_ =
+          WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+      LOG_IF(ERROR, exit_status_ != 0)
+          << "plugin_host pid=" << pid_ << " exited with " << exit_status_;
+      pid_ = -1;
+      return false;
+    }
+    return true;
+  }
+
+  // Picks up the latency the host last reported. The host polls its plugin,
+  // so changes are noticed here rather than pushed.
+  void SyncLatency() {
+    const int latency = shm_->latency.load(std::memory_order_acquire);
+    if (latency != latency_.load(std::memory_order_relaxed)) {
+      latency_.store(latency, std::memory_order_relaxed);
+      NotifyLatencyChanged();
+    }
+  }
+
+  // Runs one control command on the host main thread. Not real-time safe.
+  absl::Status SendCommand(SandboxShm::Command command, uint64_t arg) {
+    shm_->command.store(command, std::memory_order_relaxed);
+    shm_->command_arg.store(arg, std::memory_order_relaxed);
+    const uint32_t seq =
+        shm_->command_seq.fetch_add(1, std::memory_order_release) + 1;
+    FutexWake(&shm_->command_seq);
+    if (command_fd_ >= 0) {
+      const uint64_t count = 1;
+      if (write(command_fd_, &count, sizeof(count)) != sizeof(count)) {
+        // The host still polls for commands, only later.
+        LOG(WARNING) << "Cannot signal plugin_host: " << std::strerror(errno);
+      }
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + kCommandTimeout;
+    uint32_t done;
+    while ((done = shm_->command_done.load(std::memory_order_acquire)) !=
+           seq) {
+      if (!Alive()) {
+        return absl::UnavailableError("plugin_host is not running.");
+      }
+      if (std::chrono::steady_clock::now() > deadline) {
+        return absl::DeadlineExceededError(
+            absl::StrCat("plugin_host command ", command, " timed out."));
+      }
+      FutexWait(&shm_->command_done, done, 10'000'000);
+    }
+    if (!shm_->command_ok.load(std::memory_order_relaxed)) {
+      return absl::InternalError(
+          absl::StrCat("plugin_host command ", command, " failed."));
+    }
+    return absl::OkStatus();
+  }
+
+  SandboxOptions options_;
+  std::unique_ptr<ShmRegion> region_;
+  SandboxShm* shm_ = nullptr;  // Placed in `region_`.
+  pid_t pid_ = -1;
+  int command_fd_ = -1;  // eventfd shared with the host, on Linux.
+  int exit_status_ = 0;
+  bool embedded_ = false;
+  absl::Status editor_status_;
+
+  bool active_ = false;
+  ProcessSetup setup_;
+  int64_t budget_ns_ = 0;
+  uint32_t sent_ = 0;  // Last request sequence, audio thread only.
+  std::atomic<uint64_t> late_blocks_ = 0;
+  std::atomic<int> latency_ = 0;  // Mirrors SandboxShm::latency.
+};
+
+#endif
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<Plugin>> LoadSandboxedVst3(
+    const SandboxOptions& options) {
+#ifdef _WIN32
+  return absl::UnimplementedError("Plugin sandbox needs POSIX.");
+#else
+  return SandboxedVst3Plugin::Init(options);
+#endif
+}
+
+namespace {
+
+class SandboxedVst3PluginModule : public PluginModule {
+ public:
+  explicit SandboxedVst3PluginModule(const SandboxOptions& options)
+      : options_(options) {}
+
+  absl::StatusOr<std::unique_ptr<Plugin>> Load(int index) override {
+    SandboxOptions options = options_;
+    options.class_index = index;
+    return LoadSandboxedVst3(options);
+  }
+
+  bool thread_safe() const override { return true; }
+
+ private:
+  const SandboxOptions options_;
+};
+
+}  // namespace
+
+std::unique_ptr<PluginModule> SandboxedVst3Module(
+    const SandboxOptions& options) {
+  return std::make_unique<SandboxedVst3PluginModule>(options);
+}
+
+}  // namespace kodo
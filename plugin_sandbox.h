@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "plugin_vst3.h"
+
+namespace kodo {
+
+struct SandboxOptions {
+  // Path to the plugin_host binary.
+  std::string host_command;
+  std::string vst3_path;
+  int class_index = 0;
+  // Largest ProcessSetup::max_block_size accepted later.
+  int max_block_size = 4096;
+  // Fraction of the block duration Process() waits for the host before it
+  // bypasses the plugin for that block.
+  double latency_budget = 0.5;
+};
+
+// Loads a VST3 class in a plugin_host child process. The returned Plugin
+// exchanges blocks with it through shared memory, so a crashing or stalling
+// plugin only drops its own audio instead of the whole session.
+absl::StatusOr<std::unique_ptr<Plugin>> LoadSandboxedVst3(
+    const SandboxOptions& options);
+
+// Module whose Load(index) starts a LoadSandboxedVst3() host for class
+// `index` of options.vst3_path. No plugin code runs in this process, so it is
+// thread_safe().
+std::unique_ptr<PluginModule> SandboxedVst3Module(
+    const SandboxOptions& options);
+
+}  // namespace kodo
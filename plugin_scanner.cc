@@ -0,0 +1,350 @@
+#include "plugin_scanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "plugin_cache.pb.h"
+#include "pluginterfaces/vst/ivstaudioprocessor.h"
+#include "pluginterfaces/vst/ivstcomponent.h"
+#include "public.sdk/source/vst/hosting/hostclasses.h"
+#include "public.sdk/source/vst/hosting/module.h"
+#include "public.sdk/source/vst/utility/stringconvert.h"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace kodo {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+struct ModuleStamp {
+  int64_t size = 0;
+  int64_t mtime = 0;
+};
+
+// Sums sizes and takes the latest mtime, recursing into bundles.
+ModuleStamp Stamp(const fs::path& path) {
+  ModuleStamp stamp;
+  std::error_code ec;
+  auto add = [&](const fs::path& p) {
+    if (fs::is_regular_file(p, ec)) stamp.size += fs::file_size(p, ec);
+    stamp.mtime = std::max<int64_t>(
+        stamp.mtime, fs::last_write_time(p, ec).time_since_epoch().count());
+  };
+  add(path);
+  if (fs::is_directory(path, ec)) {
+    for (const fs::directory_entry& entry :
+         fs::recursive_directory_iterator(path, ec)) {
+      add(entry.path());
+    }
+  }
+  return stamp;
+}
+
+std::vector<fs::path> FindModules(const std::vector<std::string>& dirs) {
+  std::vector<fs::path> modules;
+  for (const std::string& dir : dirs) {
+    std::error_code ec;
+    auto it = fs::recursive_directory_iterator(
+        dir, fs::directory_options::skip_permission_denied, ec);
+    if (ec) continue;  // Missing standard directories are common.
+    for (auto end = fs::recursive_directory_iterator(); it != end;
+         it.increment(ec)) {
+      if (ec) break;
+      if (it->path().extension() != ".vst3") continue;
+      modules.push_back(it->path());
+      // Do not look for modules inside a bundle.
+      if (it->is_directory(ec)) it.disable_recursion_pending();
+    }
+  }
+  return modules;
+}
+
+// A new empty file for the result of one scan, unique even across
+// concurrent scans of several processes.
+absl::StatusOr<fs::path> MakeScanFile() {
+  std::error_code ec;
+  const fs::path dir = fs::temp_directory_path(ec);
+  if (ec) {
+    return absl::InternalError(
+        absl::StrCat("No temporary directory: ", ec.message()));
+  }
+#ifdef _WIN32
+  static std::atomic<int> counter = 0;
+  return dir / absl::StrCat("kodo_scan_", _getpid(), "_",
+                            counter.fetch_add(1), ".binpb");
+#else
+  std::string path = (dir / "kodo_scan_XXXXXX").string();
+  const int fd = mkstemp(path.data());
+  if (fd < 0) {
+    return absl::InternalError(
+        absl::StrCat("Cannot create ", path, ": ", std::strerror(errno)));
+  }
+  close(fd);
+  return path;
+#endif
+}
+
+// Runs `argv` without a shell, so paths need no quoting, and returns its
+// exit code.
+absl::StatusOr<int> RunProcess(const std::vector<std::string>& args) {
+#ifdef _WIN32
+  // _spawnv() joins arguments with spaces and the child splits them again.
+  std::vector<std::string> quoted;
+  for (const std::string& arg : args) {
+    quoted.push_back(absl::StrCat("\"", arg, "\""));
+  }
+  std::vector<const char*> argv;
+  for (const std::string& arg : quoted) argv.push_back(arg.c_str());
+  argv.push_back(nullptr);
+  const intptr_t code = _spawnv(_P_WAIT, args[0].c_str(), argv.data());
+  if (code < 0) {
+    return absl::InternalError(absl::StrCat(
+        "Cannot spawn ", args[0], ": ", std::strerror(errno)));
+  }
+  return static_cast<int>(code);
+#else
+  std::vector<char*> argv;
+  for (const std::string& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  pid_t pid;
+  // posix_spawnp() finds a bare argv[0] on PATH as a shell would.
+  if (int err = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(),
+                             environ);
+      err != 0) {
+    return absl::InternalError(
+        absl::StrCat("Cannot spawn ", args[0], ": ", std::strerror(err)));
+  }
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return absl::InternalError(
+          absl::StrCat("Cannot wait for ", args[0], ": ",
+                       std::strerror(errno)));
+    }
+  }
+  if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+  return WEXITSTATUS(status);
+#endif
+}
+
+// Runs `scanner_command` on one module and reads back its result.
+absl::StatusOr<PluginModuleInfo> ScanOutOfProcess(
+    const std::string& scanner_command, const std::string& path) {
+  absl::StatusOr<fs::path> out = MakeScanFile();
+  if (!out.ok()) return out.status();
+  absl::Cleanup remove = [&]() {
+    std::error_code ec;
+    fs::remove(*out, ec);
+  };
+  absl::StatusOr<int> code = RunProcess(
+      {scanner_command, absl::StrCat("--scan_vst3_module=", path),
+       absl::StrCat("--scan_out=", out->string())});
+  if (!code.ok()) return code.status();
+  if (*code != 0) {
+    return absl::InternalError(
+        absl::StrCat("Scanner exited with ", *code, " for ", path));
+  }
+  std::ifstream input(*out, std::ios::binary);
+  PluginModuleInfo info;
+  if (!info.ParseFromIstream(&input)) {
+    return absl::DataLossError(absl::StrCat("Cannot parse scan of ", path));
+  }
+  return info;
+}
+
+absl::StatusOr<PluginCache> ReadCache(const std::string& path) {
+  PluginCache cache;
+  std::ifstream input(path, std::ios::binary);
+  if (!input) return cache;  // First run.
+  if (!cache.ParseFromIstream(&input)) {
+    return absl::DataLossError(absl::StrCat("Corrupted plugin cache ", path));
+  }
+  return cache;
+}
+
+absl::Status WriteCache(const PluginCache& cache, const std::string& path) {
+  // Write then rename, so a crash never leaves a truncated cache.
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream output(tmp, std::ios::binary | std::ios::trunc);
+    if (!cache.SerializeToOstream(&output)) {
+      return absl::InternalError(absl::StrCat("Cannot write ", tmp));
+    }
+  }
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    return absl::InternalError(
+        absl::StrCat("Cannot rename ", tmp, ": ", ec.message()));
+  }
+  return absl::OkStatus();
+}
+
+void AddBuses(Steinberg::Vst::IComponent* component,
+              PluginClassInfo* class_info) {
+  using namespace Steinberg::Vst;
+  for (MediaType type : {kAudio, kEvent}) {
+    for (BusDirection dir : {kInput, kOutput}) {
+      const int n = component->getBusCount(type, dir);
+      for (int i = 0; i < n; ++i) {
+        BusInfo bus{};
+        if (component->getBusInfo(type, dir, i, bus) != Steinberg::kResultOk) {
+          continue;
+        }
+        PluginBusInfo* info = class_info->add_buses();
+        info->set_name(VST3::StringConvert::convert(bus.name));
+        info->set_is_input(dir == kInput);
+        info->set_is_event(type == kEvent);
+        info->set_channel_count(bus.channelCount);
+        info->set_default_active(bus.flags & BusInfo::kDefaultActive);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<std::string> DefaultVst3Directories() {
+  // https://steinbergmedia.github.io/vst3_dev_portal/pages/Technical+Documentation/Locations+Format/Plugin+Locations.html
+  std::vector<std::string> dirs;
+#if defined _WIN32
+  if (const char* common = std::getenv("COMMONPROGRAMFILES")) {
+    dirs.push_back(absl::StrCat(common, "\\VST3"));
+  }
+#elif defined __APPLE__
+  if (const char* home = std::getenv("HOME")) {
+    dirs.push_back(absl::StrCat(home, "/Library/Audio/Plug-Ins/VST3"));
+  }
+  dirs.push_back("/Library/Audio/Plug-Ins/VST3");
+#elif defined __linux__
+  if (const char* home = std::getenv("HOME")) {
+    dirs.push_back(absl::StrCat(home, "/.vst3"));
+  }
+  dirs.push_back("/usr/lib/vst3");
+  dirs.push_back("/usr/local/lib/vst3");
+#endif
+  return dirs;
+}
+
+absl::StatusOr<PluginModuleInfo> ScanVst3Module(const std::string& path) {
+  std::string error;
+  VST3::Hosting::Module::Ptr module =
+      VST3::Hosting::Module::create(path, error);
+  if (module == nullptr) {
+    return absl::NotFoundError(absl::StrCat(error, " in file ", path));
+  }
+
+  PluginModuleInfo info;
+  info.set_path(path);
+  VST3::Hosting::PluginFactory factory = module->getFactory();
+  int index = 0;
+  for (const VST3::Hosting::ClassInfo& class_info : factory.classInfos()) {
+    PluginClassInfo* c = info.add_classes();
+    c->set_index(index++);
+    c->set_name(class_info.name());
+    c->set_category(class_info.category());
+    c->set_sub_categories(class_info.subCategoriesString());
+    c->set_vendor(class_info.vendor());
+    c->set_version(class_info.version());
+    c->set_uid(class_info.ID().toString());
+    if (class_info.category() != kVstAudioEffectClass) continue;
+
+    Steinberg::IPtr<Steinberg::Vst::IComponent> component =
+        factory.createInstance<Steinberg::Vst::IComponent>(class_info.ID());
+    if (!component) continue;
+    if (component->initialize(
+            Steinberg::Vst::PluginContextFactory::instance()
+                .getPluginContext()) != Steinberg::kResultOk) {
+      LOG(WARNING) << "Cannot initialize " << class_info.name();
+      continue;
+    }
+    AddBuses(component, c);
+    component->terminate();
+  }
+  return info;
+}
+
+absl::StatusOr<PluginCache> ScanPlugins(const PluginScanOptions& options) {
+  PluginCache old_cache;
+  if (!options.cache_path.empty()) {
+    absl::StatusOr<PluginCache> cache = ReadCache(options.cache_path);
+    if (cache.ok()) {
+      old_cache = std::move(*cache);
+    } else {
+      LOG(WARNING) << cache.status() << "; rescanning everything.";
+    }
+  }
+  std::unordered_map<std::string, const PluginModuleInfo*> cached;
+  for (const PluginModuleInfo& info : old_cache.modules()) {
+    cached.emplace(info.path(), &info);
+  }
+
+  PluginCache cache;
+  int num_scanned = 0;
+  for (const fs::path& module_path : FindModules(options.directories)) {
+    const std::string path = module_path.string();
+    const ModuleStamp stamp = Stamp(module_path);
+    if (auto it = cached.find(path); it != cached.end() &&
+                                     it->second->size() == stamp.size &&
+                                     it->second->mtime() == stamp.mtime) {
+      *cache.add_modules() = *it->second;
+      continue;
+    }
+
+    ++num_scanned;
+    absl::StatusOr<PluginModuleInfo> info =
+        options.scanner_command.empty()
+            ? ScanVst3Module(path)
+            : ScanOutOfProcess(options.scanner_command, path);
+    PluginModuleInfo* entry = cache.add_modules();
+    if (info.ok()) {
+      *entry = std::move(*info);
+    } else {
+      // Keep the failure so a broken module is not retried until it changes.
+      LOG(WARNING) << info.status();
+      entry->set_error(std::string(info.status().message()));
+    }
+    entry->set_path(path);
+    entry->set_size(stamp.size);
+    entry->set_mtime(stamp.mtime);
+  }
+  LOG(INFO) << "Plugin scan: " << cache.modules_size() << " modules, "
+            << num_scanned << " rescanned.";
+
+  if (!options.cache_path.empty()) {
+    if (absl::Status status = WriteCache(cache, options.cache_path);
+        !status.ok()) {
+      return status;
+    }
+  }
+  return cache;
+}
+
+}  // namespace kodo
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "plugin_cache.pb.h"
+
+namespace kodo {
+
+struct PluginScanOptions {
+  // Directories searched recursively for *.vst3.
+  std::vector<std::string> directories;
+  // Binary PluginCache file. Empty disables the cache.
+  std::string cache_path;
+  // Executable that scans a single module in a child process, invoked as
+  // `<command> --scan_vst3_module=<path> --scan_out=<file>`. A crashing
+  // plugin then only kills the child. Empty scans in this process.
+  std::string scanner_command;
+};
+
+// Standard VST3 locations of this platform.
+std::vector<std::string> DefaultVst3Directories();
+
+// Loads the module at `path` and records the ClassInfo and bus layout of
+// every class. Runs plugin code, so prefer ScanPlugins() with a
+// scanner_command.
+absl::StatusOr<PluginModuleInfo> ScanVst3Module(const std::string& path);
+
+// Enumerates VST3 modules, reuses cache entries whose size and mtime are
+// unchanged, rescans the rest and writes the updated cache back.
+absl::StatusOr<PluginCache> ScanPlugins(const PluginScanOptions& options);
+
+}  // namespace kodo
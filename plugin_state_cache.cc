@@ -0,0 +1,107 @@
+#include "plugin_state_cache.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "kodo.pb.h"
+#include "plugin_vst3.h"
+
+namespace kodo {
+
+void PluginStateCache::Add(int64_t id, Plugin* plugin) {
+  const uint64_t version = plugin->state_version();
+  entries_[id] = {plugin, nullptr, version, version, absl::Now()};
+}
+
+void PluginStateCache::Poll(absl::Duration budget) {
+  const absl::Time now = absl::Now();
+  const absl::Time deadline = now + budget;
+  for (auto& [id, entry] : entries_) {
+    const uint64_t version = entry.plugin->state_version();
+    if (version == entry.captured_version) continue;
+    if (version != entry.seen_version) {
+      entry.seen_version = version;
+      entry.seen_time = now;
+      continue;
+    }
+    if (now - entry.seen_time < settle_) continue;
+    Capture(id, entry);
+    if (absl::Now() >= deadline) break;
+  }
+}
+
+void PluginStateCache::Flush() {
+  for (auto& [id, entry] : entries_) {
+    if (entry.plugin->state_version() != entry.captured_version) {
+      Capture(id, entry);
+    }
+  }
+}
+
+std::vector<std::shared_ptr<const PluginState>>
+PluginStateCache::TakeChanges() {
+  return std::exchange(changes_, {});
+}
+
+std::shared_ptr<const PluginState> PluginStateCache::Get(int64_t id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end()) return nullptr;
+  Entry& entry = it->second;
+  if (entry.state == nullptr ||
+      entry.plugin->state_version() != entry.captured_version) {
+    if (!Capture(id, entry)) return nullptr;
+  }
+  return entry.state;
+}
+
+absl::Status PluginStateCache::Restore(
+    std::shared_ptr<const PluginState> state) {
+  auto it = entries_.find(state->plugin_id());
+  if (it == entries_.end()) {
+    return absl::NotFoundError(
+        absl::StrCat("No plugin id=", state->plugin_id()));
+  }
+  Entry& entry = it->second;
+  if (absl::Status status = entry.plugin->SetState(state->component_state(),
+                                                   state->controller_state());
+      !status.ok()) {
+    return status;
+  }
+  // Includes the restartComponent() of the plugin reacting to it.
+  entry.captured_version = entry.seen_version = entry.plugin->state_version();
+  entry.state = state;
+  changes_.push_back(std::move(state));
+  return absl::OkStatus();
+}
+
+bool PluginStateCache::dirty(int64_t id) const {
+  auto it = entries_.find(id);
+  return it != entries_.end() &&
+         it->second.plugin->state_version() != it->second.captured_version;
+}
+
+bool PluginStateCache::Capture(int64_t id, Entry& entry) {
+  // A plugin editing itself during GetState() stays dirty.
+  const uint64_t version = entry.plugin->state_version();
+  entry.captured_version = entry.seen_version = version;
+  auto state = std::make_shared<PluginState>();
+  state->set_plugin_id(id);
+  if (absl::Status status = entry.plugin->GetState(
+          state->mutable_component_state(), state->mutable_controller_state());
+      !status.ok()) {
+    LOG(ERROR) << entry.plugin->name() << ": " << status;
+    return false;
+  }
+  entry.state = state;
+  changes_.push_back(std::move(state));
+  return true;
+}
+
+}  // namespace kodo
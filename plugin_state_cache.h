@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "kodo.pb.h"
+#include "plugin_vst3.h"
+
+namespace kodo {
+
+// Last serialized state of every live plugin, so that saving a project and
+// comparing presets never asks an unchanged plugin for its state again. A
+// plugin is dirty once its state_version() moved past the cached blob, i.e.
+// after performEdit(), restartComponent() or SetState(). Blobs are immutable
+// and shared with project snapshots, which the autosaver writes on its
+// thread. GUI thread only.
+class PluginStateCache {
+ public:
+  // Dirty plugins are serialized by Poll() once they have not changed for
+  // `settle`, e.g. after a knob is let go.
+  explicit PluginStateCache(absl::Duration settle = absl::Milliseconds(500))
+      : settle_(settle) {}
+
+  // Tracks `plugin` of PluginInstance::id `id` until Remove(). Its state is
+  // that of the project as loaded, so it starts clean.
+  void Add(int64_t id, Plugin* plugin);
+  void Remove(int64_t id) { entries_.erase(id); }
+  bool contains(int64_t id) const { return entries_.contains(id); }
+
+  // Serializes settled dirty plugins for at most `budget`. Call once per
+  // frame.
+  void Poll(absl::Duration budget);
+  // Serializes every dirty plugin, e.g. right before saving.
+  void Flush();
+  // Blobs captured or restored since the last call, for
+  // ProjectModel::SetPluginState().
+  std::vector<std::shared_ptr<const PluginState>> TakeChanges();
+
+  // The current state of `id`, serialized first if dirty or never captured.
+  // nullptr for unknown ids and plugins failing GetState().
+  std::shared_ptr<const PluginState> Get(int64_t id);
+  // Applies `state` to its plugin, e.g. preset B of an A/B comparison kept
+  // from Get(). The blob becomes the cached state as is, so switching back
+  // and forth never serializes anything.
+  absl::Status Restore(std::shared_ptr<const PluginState> state);
+
+  bool dirty(int64_t id) const;
+
+ private:
+  struct Entry {
+    Plugin* plugin;
+    // nullptr until the first capture: the project holds the loaded state.
+    std::shared_ptr<const PluginState> state;
+    uint64_t captured_version = 0;  // Of `state`, or as loaded.
+    // Last version seen by Poll() and when, to tell settled edits apart.
+    uint64_t seen_version = 0;
+    absl::Time seen_time;
+  };
+
+  // Serializes `entry`. Returns false on failure, after which the entry
+  // counts as clean until it changes again.
+  bool Capture(int64_t id, Entry& entry);
+
+  const absl::Duration settle_;
+  std::unordered_map<int64_t, Entry> entries_;
+  std::vector<std::shared_ptr<const PluginState>> changes_;
+};
+
+}  // namespace kodo
@@ -3,20 +3,33 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <atomic>
 #include <iomanip>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "component_handler.h"
 #include "imgui_internal.h"
+#include "midi_event.h"
+#include "param_changes.h"
 #include "pluginterfaces/gui/iplugview.h"
+#include "pluginterfaces/vst/ivstaudioprocessor.h"
+#include "pluginterfaces/vst/ivstcomponent.h"
 #include "pluginterfaces/vst/ivsteditcontroller.h"
+#include "pluginterfaces/vst/ivstevents.h"
+#include "pluginterfaces/vst/ivstmidicontrollers.h"
+#include "pluginterfaces/vst/ivstprocesscontext.h"
+#include "public.sdk/source/common/memorystream.h"
+#include "public.sdk/source/vst/hosting/eventlist.h"
 #include "public.sdk/source/vst/hosting/module.h"
 #include "public.sdk/source/vst/hosting/plugprovider.h"
 
@@ -79,6 +92,12 @@ absl::StatusCode TResultToStatus(Steinberg::tresult code) {
   }
 }
 
+// Reads `state` in place, which must outlive the stream.
+Steinberg::IPtr<Steinberg::MemoryStream> StateStream(std::string_view state) {
+  return Steinberg::owned(new Steinberg::MemoryStream(
+      const_cast<char*>(state.data()), state.size()));
+}
+
 template <FChild T>
 absl::StatusOr<FUniquePtr<T>> Query(Steinberg::FUnknown* p) {
   T* ret;
@@ -89,59 +108,95 @@ absl::StatusOr<FUniquePtr<T>> Query(Steinberg::FUnknown* p) {
   return absl::Status(TResultToStatus(res), "Failed to queryInterface.");
 }
 
-class ImPlugFrame : public Steinberg::IPlugFrame {
+bool operator==(const Steinberg::ViewRect& a, const Steinberg::ViewRect& b) {
+  return a.left == b.left && a.top == b.top && a.right == b.right &&
+         a.bottom == b.bottom;
+}
+
+// Owns an IPlugView across GUI frames and hosts it inside an ImGui window.
+// The view is attached once, receives onSize() only when the ImGui content
+// rect changes, and is detached while the window is hidden.
+class EditorSession : public Steinberg::IPlugFrame {
  public:
-  explicit ImPlugFrame(const Steinberg::IPtr<Steinberg::IPlugView>& plug_view)
-      : plug_view_(plug_view) {}
+  // `instance_id` tells apart the windows of instances of one plugin class,
+  // which ImGui would otherwise merge as they share a title.
+  EditorSession(const Steinberg::IPtr<Steinberg::IPlugView>& plug_view,
+                std::string title, int instance_id)
+      : plug_view_(plug_view),
+        title_(std::move(title)),
+        window_id_(absl::StrCat(title_, "##", instance_id)) {
+    plug_view_->getSize(&view_size_);
+  }
+
+  ~EditorSession() { Detach(); }
+
+  EditorSession(const EditorSession&) = delete;
+  EditorSession& operator=(const EditorSession&) = delete;
 
   absl::Status Render(void* handle) {
-    // ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, {0, 0});
-    // absl::Cleanup pop_style = []() { ImGui::PopStyleVar(); };
-
-    Steinberg::ViewRect curr_rect;
-    plug_view_->getSize(&curr_rect);
-    ImVec2 curr_size;
-    curr_size.x = curr_rect.getWidth();
-    curr_size.y = curr_rect.getHeight();
-    ImGui::SetNextWindowContentSize(curr_size);
-    // ImVec2 curr_pos;
-    // curr_pos.x = curr_rect.left;
-    // curr_pos.y = curr_rect.top;
-    // ImGui::SetNextWindowPos(curr_pos, 0, {0.5, 0.5});
-    ImGui::Begin("PlugFrame");
+    ImVec2 content_size;
+    content_size.x = view_size_.getWidth();
+    content_size.y = view_size_.getHeight();
+    ImGui::SetNextWindowContentSize(content_size);
+    absl::Cleanup end = []() { ImGui::End(); };
+    if (!ImGui::Begin(window_id_.c_str())) {
+      // Collapsed or fully clipped.
+      Detach();
+      return absl::OkStatus();
+    }
+
+    if (!attached_) {
+      if (plug_view_->setFrame(this) != Steinberg::kResultOk) {
+        return absl::InvalidArgumentError("cannot call setFrame(this).");
+      }
+      if (absl::Status status = Attach(handle); !status.ok()) {
+        plug_view_->setFrame(nullptr);
+        return status;
+      }
+      attached_ = true;
+      // Force onSize() for the first rect after (re-)attaching.
+      has_content_rect_ = false;
+    }
 
     Steinberg::ViewRect new_rect;
     new_rect.left = ImGui::GetCursorPosX();
     new_rect.top = ImGui::GetCursorPosY();
     new_rect.right = ImGui::GetContentRegionMax().x;
     new_rect.bottom = ImGui::GetContentRegionMax().y;
+    if (!has_content_rect_ || !(new_rect == content_rect_)) {
+      if (plug_view_->onSize(&new_rect) != Steinberg::kResultOk) {
+        return absl::InvalidArgumentError("cannot call onSize(new_rect).");
+      }
+      content_rect_ = new_rect;
+      has_content_rect_ = true;
+    }
+    return absl::OkStatus();
+  }
 
-    // LOG(INFO) << "Cursor X=" << ImGui::GetCursorPosX()
-    //           << " Y=" << ImGui::GetCursorPosY();
-    if (plug_view_->onSize(&new_rect) != Steinberg::kResultOk) {
-      return absl::InvalidArgumentError("cannot call onSize(new_rect).");
+  // Attaches the view straight to `handle` at the size it asks for, without
+  // an ImGui window around it.
+  absl::Status Embed(void* handle) {
+    Detach();
+#if defined __linux__
+    // X11 views take their timers and file descriptors from the frame.
+    if (editor_run_loop == nullptr) {
+      return absl::FailedPreconditionError(
+          "Embedded X11 editors need SetVst3EditorRunLoop().");
     }
+#endif
     if (plug_view_->setFrame(this) != Steinberg::kResultOk) {
       return absl::InvalidArgumentError("cannot call setFrame(this).");
     }
-
     if (absl::Status status = Attach(handle); !status.ok()) {
+      plug_view_->setFrame(nullptr);
       return status;
     }
-
-    // ImVec2 min = ImGui::GetCursorPos();
-    // ImVec2 max = ImGui::GetContentRegionMax();
-    // // ImVec2 region_avail = ImGui::GetContentRegionAvail();
-    // Steinberg::ViewRect new_rect;
-    // new_rect.left = min.x;
-    // new_rect.right = max.x;
-    // new_rect.top = min.x;
-    // new_rect.bottom = max.y;
-
-    // resizeView(plug_view_, &new_rect);
-    // plug_view_->onSize(&new_rect);
-
-    ImGui::End();
+    attached_ = true;
+    content_rect_ = view_size_;
+    has_content_rect_ = true;
+    if (plug_view_->onSize(&content_rect_) != Steinberg::kResultOk) {
+      return absl::InvalidArgumentError("cannot call onSize(view_size).");
+    }
     return absl::OkStatus();
   }
 
@@ -151,18 +206,31 @@ class ImPlugFrame : public Steinberg::IPlugFrame {
       Steinberg::IPlugView* view, Steinberg::ViewRect* newSize) override {
     if (newSize == nullptr || view == nullptr || view != plug_view_)
       return Steinberg::kInvalidArgument;
-
-    using Steinberg::ViewRect;
-    Steinberg::ViewRect r;
-    if (plug_view_->getSize(&r) != Steinberg::kResultTrue)
-      return Steinberg::kInternalError;
-    // if (r == *newSize) return Steinberg::kResultTrue;
-
-    // TODO
-    return Steinberg::kResultOk;
+    if (!attached_) return Steinberg::kInternalError;
+    if (*newSize == view_size_) return Steinberg::kResultTrue;
+
+    // The ImGui window follows on the next frame through
+    // SetNextWindowContentSize(); acknowledge the new size right away.
+    view_size_ = *newSize;
+    if (plug_view_->onSize(newSize) != Steinberg::kResultOk) {
+      return Steinberg::kResultFalse;
+    }
+    content_rect_ = *newSize;
+    has_content_rect_ = true;
+    return Steinberg::kResultTrue;
   }
 
  private:
+  // Detaches the plug-in editor if it is attached.
+  void Detach() {
+    if (!attached_) return;
+    plug_view_->setFrame(nullptr);
+    if (plug_view_->removed() != Steinberg::kResultOk) {
+      LOG(ERROR) << "IPlugView::removed() failed for " << title_;
+    }
+    attached_ = false;
+  }
+
   // Attaches the plug-in editor with platform-specific window handle.
   absl::Status Attach(void* handle) {
 #if defined _WIN32
@@ -230,6 +298,15 @@ class ImPlugFrame : public Steinberg::IPlugFrame {
       addRef();
       return Steinberg::kResultTrue;
     }
+#if defined __linux__
+    if (editor_run_loop != nullptr &&
+        Steinberg::FUnknownPrivate::iidEqual(_iid,
+                                             Steinberg::Linux::IRunLoop::iid)) {
+      *obj = editor_run_loop;
+      editor_run_loop->addRef();
+      return Steinberg::kResultTrue;
+    }
+#endif
     return Steinberg::kNoInterface;
   }
 
@@ -239,6 +316,15 @@ class ImPlugFrame : public Steinberg::IPlugFrame {
   uint32_t PLUGIN_API release() override { return 1000; }
 
   Steinberg::IPtr<Steinberg::IPlugView> plug_view_;
+  std::string title_;
+  // The ImGui window: the title, then a hidden unique suffix.
+  const std::string window_id_;
+  bool attached_ = false;
+  // Size the plug-in asked for, used as the ImGui content size.
+  Steinberg::ViewRect view_size_;
+  // Last rect passed to onSize().
+  Steinberg::ViewRect content_rect_;
+  bool has_content_rect_ = false;
 };
 
 // ImRect ViewRectToImRect(Steinberg::ViewRect r) {
@@ -250,6 +336,13 @@ class ImPlugFrame : public Steinberg::IPlugFrame {
 //   return result;
 // }
 
+// Owned audio buffers of a single VST3 audio bus.
+struct BusStorage {
+  std::vector<float> samples;    // num_channels * max_block_size.
+  std::vector<float*> channels;  // Points into `samples` or caller buffers.
+  std::vector<float*> own;       // Points into `samples` only.
+};
+
 class Vst3Plugin : public Plugin {
  public:
   static absl::StatusOr<std::unique_ptr<Vst3Plugin>> Init(
@@ -281,6 +374,8 @@ class Vst3Plugin : public Plugin {
     if (!provider->initialize()) {
       return absl::FailedPreconditionError("PlugProvider::initialize() failed");
     }
+    // Keep the provider alive: its destructor terminates the component.
+    ret->provider_ = provider;
     Steinberg::Vst::IEditController* controller = provider->getController();
     if (!controller) {
       return absl::NotFoundError(
@@ -288,28 +383,401 @@ class Vst3Plugin : public Plugin {
     }
     LOG(INFO) << "#Params=" << controller->getParameterCount();
     ret->controller_ = controller;
+    controller->setComponentHandler(&ret->component_handler_);
 
+    ret->component_ = Steinberg::owned(provider->getComponent());
+    if (!ret->component_) {
+      return absl::NotFoundError("No IComponent found.");
+    }
+    ret->processor_ =
+        Steinberg::FUnknownPtr<Steinberg::Vst::IAudioProcessor>(
+            ret->component_);
+    if (!ret->processor_) {
+      return absl::NotFoundError("IComponent is not an IAudioProcessor.");
+    }
     return ret;
   }
 
-  ~Vst3Plugin() override { controller_->release(); }
+  ~Vst3Plugin() override {
+    editor_.reset();  // Detach the view before releasing its controller.
+    if (active_) SetActive(false).IgnoreError();
+    processor_ = nullptr;
+    component_ = nullptr;
+    if (controller_) {
+      controller_->setComponentHandler(nullptr);
+      controller_->release();
+    }
+    provider_ = nullptr;
+  }
+
+  std::string name() const override { return class_info_.name(); }
 
   absl::Status Render(void* window_handle) override {
+    if (absl::Status status = CreateEditor(); !status.ok()) return status;
+    return editor_->Render(window_handle);
+  }
+
+  absl::Status EmbedEditor(void* parent_window) override {
+    if (parent_window == nullptr) {
+      editor_.reset();
+      return absl::OkStatus();
+    }
+    if (absl::Status status = CreateEditor(); !status.ok()) return status;
+    return editor_->Embed(parent_window);
+  }
+
+  absl::Status SetupProcessing(const ProcessSetup& setup) override {
+    using namespace Steinberg::Vst;
+    if (active_) {
+      return absl::FailedPreconditionError(
+          "SetupProcessing() must be called while inactive.");
+    }
+    if (processor_->canProcessSampleSize(kSample32) != Steinberg::kResultOk) {
+      return absl::UnimplementedError("32-bit float processing unsupported.");
+    }
+
+    Steinberg::Vst::ProcessSetup vst_setup{};
+    vst_setup.processMode = setup.offline ? kOffline : kRealtime;
+    vst_setup.symbolicSampleSize = kSample32;
+    vst_setup.maxSamplesPerBlock = setup.max_block_size;
+    vst_setup.sampleRate = setup.sample_rate;
+    if (Steinberg::tresult res = processor_->setupProcessing(vst_setup);
+        res != Steinberg::kResultOk) {
+      return absl::Status(TResultToStatus(res), "setupProcessing failed.");
+    }
+    setup_ = vst_setup;
+
+    // Allocate everything the audio thread touches, once.
+    AllocateBuses(kInput, setup.max_block_size, inputs_, input_storage_);
+    AllocateBuses(kOutput, setup.max_block_size, outputs_, output_storage_);
+    input_events_ = std::make_unique<EventList>(kMaxEvents);
+    const bool has_events = component_->getBusCount(kEvent, kInput) > 0;
+    if (has_events) component_->activateBus(kEvent, kInput, 0, true);
+    MapMidiControllers(has_events);
+    output_events_ = std::make_unique<EventList>(kMaxEvents);
+    const int num_params =
+        std::min<int>(controller_->getParameterCount(), kMaxChangedParams);
+    input_params_ = std::make_unique<ParameterChangeList>(
+        num_params, kMaxPointsPerParam);
+    output_params_ = std::make_unique<ParameterChangeList>(
+        num_params, kMaxPointsPerParam);
+
+    context_ = {};
+    context_.sampleRate = setup.sample_rate;
+    context_.tempo = 120;
+    context_.timeSigNumerator = 4;
+    context_.timeSigDenominator = 4;
+    context_.state =
+        ProcessContext::kTempoValid | ProcessContext::kTimeSigValid;
+
+    data_ = {};
+    data_.processMode = vst_setup.processMode;
+    data_.symbolicSampleSize = kSample32;
+    data_.numInputs = inputs_.size();
+    data_.inputs = inputs_.data();
+    data_.numOutputs = outputs_.size();
+    data_.outputs = outputs_.data();
+    data_.inputParameterChanges = input_params_.get();
+    data_.outputParameterChanges = output_params_.get();
+    data_.inputEvents = input_events_.get();
+    data_.outputEvents = output_events_.get();
+    data_.processContext = &context_;
+    UpdateLatency();
+    return absl::OkStatus();
+  }
+
+  absl::Status SetActive(bool active) override {
+    if (active == active_) return absl::OkStatus();
+    if (active && data_.processContext == nullptr) {
+      return absl::FailedPreconditionError("Call SetupProcessing() first.");
+    }
+    if (active) {
+      if (Steinberg::tresult res = component_->setActive(true);
+          res != Steinberg::kResultOk) {
+        return absl::Status(TResultToStatus(res), "setActive(true) failed.");
+      }
+      // Some plugins return kNotImplemented here but still process.
+      processor_->setProcessing(true);
+    } else {
+      processor_->setProcessing(false);
+      component_->setActive(false);
+    }
+    active_ = active;
+    // Many plugins settle their latency on activation.
+    if (active) UpdateLatency();
+    return absl::OkStatus();
+  }
+
+  absl::Status SetState(std::string_view component_state,
+                        std::string_view controller_state) override {
+    MarkStateChanged();
+    if (!component_state.empty()) {
+      Steinberg::IPtr<Steinberg::MemoryStream> stream =
+          StateStream(component_state);
+      if (Steinberg::tresult res = component_->setState(stream);
+          res != Steinberg::kResultOk) {
+        return absl::Status(TResultToStatus(res),
+                            "IComponent::setState() failed.");
+      }
+      // The controller mirrors the restored parameters.
+      stream->seek(0, Steinberg::IBStream::kIBSeekSet, nullptr);
+      controller_->setComponentState(stream);
+    }
+    if (!controller_state.empty()) {
+      if (Steinberg::tresult res =
+              controller_->setState(StateStream(controller_state));
+          res != Steinberg::kResultOk) {
+        return absl::Status(TResultToStatus(res),
+                            "IEditController::setState() failed.");
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status GetState(std::string* component_state,
+                        std::string* controller_state) override {
+    auto stream = Steinberg::owned(new Steinberg::MemoryStream);
+    if (Steinberg::tresult res = component_->getState(stream);
+        res != Steinberg::kResultOk) {
+      return absl::Status(TResultToStatus(res),
+                          "IComponent::getState() failed.");
+    }
+    component_state->assign(stream->getData(), stream->getSize());
+    // Controllers without their own state return kNotImplemented.
+    stream = Steinberg::owned(new Steinberg::MemoryStream);
+    controller_state->clear();
+    if (controller_->getState(stream) == Steinberg::kResultOk) {
+      controller_state->assign(stream->getData(), stream->getSize());
+    }
+    return absl::OkStatus();
+  }
+
+  int num_inputs() const override {
+    return inputs_.empty() ? 0 : inputs_[0].numChannels;
+  }
+
+  int num_outputs() const override {
+    return outputs_.empty() ? 0 : outputs_[0].numChannels;
+  }
+
+  int latency() const override {
+    return latency_.load(std::memory_order_relaxed);
+  }
+
+  bool Process(const AudioBlock& block) override {
+    if (!active_ || block.num_frames > setup_.maxSamplesPerBlock) return false;
+
+    // Route the main buses to the caller buffers where channels exist and to
+    // preallocated scratch otherwise. Only pointers are written here.
+    if (!inputs_.empty()) {
+      BusStorage& bus = input_storage_[0];
+      for (int c = 0; c < inputs_[0].numChannels; ++c) {
+        bus.channels[c] = c < block.num_inputs
+                              ? const_cast<float*>(block.inputs[c])
+                              : bus.own[c];
+      }
+    }
+    if (!outputs_.empty()) {
+      BusStorage& bus = output_storage_[0];
+      for (int c = 0; c < outputs_[0].numChannels; ++c) {
+        bus.channels[c] = c < block.num_outputs ? block.outputs[c] : bus.own[c];
+      }
+    }
+
+    input_params_->Drain(param_queue_, block.num_frames);
+    for (int i = 0; i < block.num_param_changes; ++i) {
+      const ParamChange& change = block.param_changes[i];
+      input_params_->Add(change.id, change.sample_offset, change.value);
+    }
+    AddMidiEvents(block);
+    data_.numSamples = block.num_frames;
+    Steinberg::tresult res = processor_->process(data_);
+
+    input_events_->clear();
+    output_events_->clear();
+    input_params_->Clear();
+    output_params_->Clear();
+    context_.projectTimeSamples += block.num_frames;
+    return res == Steinberg::kResultOk;
+  }
+
+ private:
+  static constexpr int kMaxEvents = 512;
+  // Distinct parameters and points per parameter changed within one block.
+  static constexpr int kMaxChangedParams = 256;
+  static constexpr int kMaxPointsPerParam = 64;
+  static constexpr int kMidiChannels = 16;
+
+  Vst3Plugin() {}
+
+  static inline std::atomic<int> next_instance_id_ = 0;
+
+  absl::Status CreateEditor() {
+    if (editor_) return absl::OkStatus();
     Steinberg::IPtr<Steinberg::IPlugView> view = Steinberg::owned(
         controller_->createView(Steinberg::Vst::ViewType::kEditor));
     if (!view) {
       return absl::FailedPreconditionError("Could not create window.");
     }
-    ImPlugFrame frame(view);
-    return frame.Render(window_handle);
+    editor_ = std::make_unique<EditorSession>(view, class_info_.name(),
+                                              instance_id_);
+    return absl::OkStatus();
   }
 
- private:
-  Vst3Plugin() {}
+  // Rereads getLatencySamples(), from SetupProcessing(), SetActive() or a
+  // restartComponent(kLatencyChanged) on the GUI thread. The spec suggests
+  // reactivating the component, which would race with the audio thread;
+  // the new value is taken as is instead.
+  void UpdateLatency() {
+    if (!processor_) return;
+    const int latency = processor_->getLatencySamples();
+    if (latency_.exchange(latency, std::memory_order_relaxed) != latency) {
+      NotifyLatencyChanged();
+    }
+  }
 
+  // Caches the parameters the controller assigns to MIDI controllers, pitch
+  // bend and channel pressure, so Process() needs no controller calls.
+  void MapMidiControllers(bool has_events) {
+    using namespace Steinberg::Vst;
+    midi_params_.assign(kMidiChannels * kCountCtrlNumber, kNoParamId);
+    Steinberg::FUnknownPtr<IMidiMapping> mapping(controller_);
+    if (!has_events || !mapping) return;
+    for (int channel = 0; channel < kMidiChannels; ++channel) {
+      for (int number = 0; number < kCountCtrlNumber; ++number) {
+        ParamID id;
+        if (mapping->getMidiControllerAssignment(0, channel, number, id) ==
+            Steinberg::kResultOk) {
+          midi_params_[channel * kCountCtrlNumber + number] = id;
+        }
+      }
+    }
+  }
+
+  // Converts the MIDI of `block` into note events and mapped parameter
+  // points. Audio thread.
+  void AddMidiEvents(const AudioBlock& block) {
+    using namespace Steinberg::Vst;
+    for (int i = 0; i < block.num_events; ++i) {
+      const MidiEvent& midi = block.events[i];
+      const int channel = midi.status & 0x0f;
+      Event event{};
+      event.sampleOffset = midi.sample_offset;
+      event.flags = Event::kIsLive;
+      switch (midi.status & 0xf0) {
+        case 0x90:
+          if (midi.data2 > 0) {
+            event.type = Event::kNoteOnEvent;
+            event.noteOn.channel = channel;
+            event.noteOn.pitch = midi.data1;
+            event.noteOn.velocity = midi.data2 / 127.0f;
+            event.noteOn.noteId = -1;
+            input_events_->addEvent(event);
+            break;
+          }
+          [[fallthrough]];  // Note on with velocity 0 is a note off.
+        case 0x80:
+          event.type = Event::kNoteOffEvent;
+          event.noteOff.channel = channel;
+          event.noteOff.pitch = midi.data1;
+          event.noteOff.velocity = midi.data2 / 127.0f;
+          event.noteOff.noteId = -1;
+          input_events_->addEvent(event);
+          break;
+        case 0xa0:
+          event.type = Event::kPolyPressureEvent;
+          event.polyPressure.channel = channel;
+          event.polyPressure.pitch = midi.data1;
+          event.polyPressure.pressure = midi.data2 / 127.0f;
+          event.polyPressure.noteId = -1;
+          input_events_->addEvent(event);
+          break;
+        case 0xb0:
+          AddMidiParam(channel, midi.data1 & 0x7f, midi.sample_offset,
+                       midi.data2 / 127.0);
+          break;
+        case 0xd0:
+          AddMidiParam(channel, kAfterTouch, midi.sample_offset,
+                       midi.data1 / 127.0);
+          break;
+        case 0xe0:
+          AddMidiParam(channel, kPitchBend, midi.sample_offset,
+                       ((midi.data2 << 7) | midi.data1) / 16383.0);
+          break;
+      }
+    }
+  }
+
+  void AddMidiParam(int channel, int number, Steinberg::int32 sample_offset,
+                    Steinberg::Vst::ParamValue value) {
+    const Steinberg::Vst::ParamID id =
+        midi_params_[channel * Steinberg::Vst::kCountCtrlNumber + number];
+    if (id != Steinberg::Vst::kNoParamId) {
+      input_params_->Add(id, sample_offset, value);
+    }
+  }
+
+  // Activates the main bus (and default-active aux buses) of `dir` and
+  // preallocates their channel buffers.
+  void AllocateBuses(Steinberg::Vst::BusDirection dir, int max_block_size,
+                     std::vector<Steinberg::Vst::AudioBusBuffers>& buffers,
+                     std::vector<BusStorage>& storage) {
+    using namespace Steinberg::Vst;
+    const int num_buses = component_->getBusCount(kAudio, dir);
+    buffers.assign(num_buses, AudioBusBuffers{});
+    storage.assign(num_buses, BusStorage{});
+    for (int i = 0; i < num_buses; ++i) {
+      BusInfo info{};
+      component_->getBusInfo(kAudio, dir, i, info);
+      const bool active = i == 0 || (info.flags & BusInfo::kDefaultActive);
+      component_->activateBus(kAudio, dir, i, active);
+
+      BusStorage& bus = storage[i];
+      bus.samples.assign(info.channelCount * max_block_size, 0.0f);
+      for (int c = 0; c < info.channelCount; ++c) {
+        bus.own.push_back(bus.samples.data() + c * max_block_size);
+      }
+      bus.channels = bus.own;
+      buffers[i].numChannels = info.channelCount;
+      buffers[i].channelBuffers32 = bus.channels.data();
+    }
+  }
+
+  // Unique in the process, for the editor window.
+  const int instance_id_ = next_instance_id_.fetch_add(1);
   Steinberg::IPtr<Steinberg::IPluginFactory> factory_;
   VST3::Hosting::ClassInfo class_info_;
-  Steinberg::Vst::IEditController* controller_;
+  Steinberg::IPtr<Steinberg::Vst::PlugProvider> provider_;
+  Steinberg::Vst::IEditController* controller_ = nullptr;
+  Steinberg::IPtr<Steinberg::Vst::IComponent> component_;
+  Steinberg::IPtr<Steinberg::Vst::IAudioProcessor> processor_;
+  std::unique_ptr<EditorSession> editor_;
+
+  // Processing state preallocated by SetupProcessing().
+  bool active_ = false;
+  Steinberg::Vst::ProcessSetup setup_{};
+  Steinberg::Vst::ProcessData data_{};
+  Steinberg::Vst::ProcessContext context_{};
+  std::vector<Steinberg::Vst::AudioBusBuffers> inputs_;
+  std::vector<Steinberg::Vst::AudioBusBuffers> outputs_;
+  std::vector<BusStorage> input_storage_;
+  std::vector<BusStorage> output_storage_;
+  std::unique_ptr<Steinberg::Vst::EventList> input_events_;
+  std::unique_ptr<Steinberg::Vst::EventList> output_events_;
+  std::unique_ptr<ParameterChangeList> input_params_;
+  std::unique_ptr<ParameterChangeList> output_params_;
+  // ParamID per MIDI channel and ControllerNumbers, or kNoParamId.
+  std::vector<Steinberg::Vst::ParamID> midi_params_;
+
+  // Frames reported by getLatencySamples().
+  std::atomic<int> latency_ = 0;
+
+  // Edits from the controller (GUI thread) to Process() (audio thread).
+  ParamChangeQueue param_queue_;
+  ComponentHandler component_handler_{&param_queue_,
+                                      [this] { UpdateLatency(); },
+                                      [this] { MarkStateChanged(); }};
+
   VST3::Hosting::Module::Ptr module_;  // Not to exceed lifetime beyond module.
 };
 
@@ -347,4 +815,10 @@ absl::StatusOr<std::unique_ptr<PluginModule>> Vst3Module(
   return Vst3PluginModule::Init(path);
 }
 
+#if defined __linux__
+void SetVst3EditorRunLoop(Steinberg::Linux::IRunLoop* run_loop) {
+  editor_run_loop = run_loop;
+}
+#endif
+
 }  // namespace kodo
@@ -1,25 +1,136 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <string_view>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "midi_event.h"
+#include "param_changes.h"
+#include "pluginterfaces/gui/iplugview.h"
 
 namespace kodo {
 
+struct ProcessSetup {
+  double sample_rate = 48000;
+  // Upper bound of AudioBlock::num_frames passed to Process().
+  int max_block_size = 1024;
+  // Rendering without a real-time deadline, e.g. bouncing to a file. Plugins
+  // may then use higher quality algorithms.
+  bool offline = false;
+};
+
+// Non-interleaved channels of the main audio buses for one block. The caller
+// owns the buffers; Process() only reads `inputs` and writes `outputs`.
+struct AudioBlock {
+  const float* const* inputs = nullptr;
+  int num_inputs = 0;
+  float* const* outputs = nullptr;
+  int num_outputs = 0;
+  int num_frames = 0;
+  // Engine-side parameter changes for this block, sorted by sample_offset.
+  const ParamChange* param_changes = nullptr;
+  int num_param_changes = 0;
+  // MIDI input for the event bus of instruments, sorted by sample_offset.
+  const MidiEvent* events = nullptr;
+  int num_events = 0;
+};
+
 class Plugin {
  public:
   virtual ~Plugin() {}
+  virtual std::string name() const = 0;
   virtual absl::Status Render(void* window_handle) = 0;
+
+  // Attaches the editor to a native `parent_window` outside of ImGui, e.g.
+  // from another process, or removes it for nullptr.
+  virtual absl::Status EmbedEditor(void* parent_window) {
+    return absl::UnimplementedError("EmbedEditor() is not supported.");
+  }
+
+  // Allocates every buffer the audio thread needs. Call while inactive.
+  virtual absl::Status SetupProcessing(const ProcessSetup& setup) = 0;
+
+  // Starts or stops processing. Call after SetupProcessing().
+  virtual absl::Status SetActive(bool active) = 0;
+
+  // Restores PluginInstance::component_state and controller_state; either
+  // may be empty. Call on the main thread.
+  virtual absl::Status SetState(std::string_view component_state,
+                                std::string_view controller_state) {
+    return absl::UnimplementedError("SetState() is not supported.");
+  }
+
+  // Serializes what SetState() restores. May be slow and large. Call on the
+  // main thread.
+  virtual absl::Status GetState(std::string* component_state,
+                                std::string* controller_state) {
+    return absl::UnimplementedError("GetState() is not supported.");
+  }
+
+  // Incremented whenever the state may have changed since, e.g. by an edit
+  // in the editor or a preset load, so that unchanged plugins need not be
+  // serialized again. Safe to call from any thread.
+  uint64_t state_version() const {
+    return state_version_.load(std::memory_order_relaxed);
+  }
+
+  // Channel counts of the main input/output buses after SetupProcessing().
+  virtual int num_inputs() const = 0;
+  virtual int num_outputs() const = 0;
+
+  // Processes one block on the audio thread. Touches no heap and never
+  // locks. Returns false if the plugin is inactive or failed.
+  virtual bool Process(const AudioBlock& block) = 0;
+
+  // Frames by which the output lags the input, e.g. for lookahead. The
+  // render graph delays parallel paths to match. Safe to call from any
+  // thread.
+  virtual int latency() const { return 0; }
+
+  // Incremented whenever the latency() of any plugin changes, so the audio
+  // thread rereads latencies only after a change.
+  static uint64_t latency_epoch() {
+    return latency_epoch_.load(std::memory_order_acquire);
+  }
+
+ protected:
+  // Call after latency() returns a new value.
+  static void NotifyLatencyChanged() {
+    latency_epoch_.fetch_add(1, std::memory_order_release);
+  }
+
+  // Call whenever GetState() may return something new.
+  void MarkStateChanged() {
+    state_version_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  inline static std::atomic<uint64_t> latency_epoch_ = 0;
+  std::atomic<uint64_t> state_version_ = 0;
 };
 
 class PluginModule {
  public:
   virtual ~PluginModule() {}
   virtual absl::StatusOr<std::unique_ptr<Plugin>> Load(int index) = 0;
+
+  // Whether Load() and the Plugin setup calls may run on any thread. VST3
+  // initializes components on the main thread only.
+  virtual bool thread_safe() const { return false; }
 };
 
 absl::StatusOr<std::unique_ptr<PluginModule>> Vst3Module(std::string_view path);
 
+#if defined __linux__
+// Offers `run_loop` to the X11 editors of every Vst3Module() plugin, which
+// watch their file descriptors and run their timers on it. EmbedEditor()
+// fails without one. Not owned: it must outlive the editors and run on the
+// thread calling EmbedEditor().
+void SetVst3EditorRunLoop(Steinberg::Linux::IRunLoop* run_loop);
+#endif
+
 }  // namespace kodo
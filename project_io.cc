@@ -0,0 +1,214 @@
+#include "project_io.h"
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/arena.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/message_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "kodo.pb.h"
+
+namespace kodo {
+namespace {
+
+using google::protobuf::internal::WireFormatLite;
+
+// Runs `write` on a stream to `path`.tmp, then renames it over `path`, so a
+// crash never leaves a truncated project behind.
+template <typename Write>
+absl::Status WriteAtomically(const std::string& path, Write write) {
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream output(tmp, std::ios::binary | std::ios::trunc);
+    bool ok = false;
+    {
+      google::protobuf::io::OstreamOutputStream stream(&output);
+      google::protobuf::io::CodedOutputStream coded(&stream);
+      ok = write(coded) && !coded.HadError();
+    }
+    output.flush();
+    if (!ok || !output) {
+      return absl::InternalError(absl::StrCat("Cannot write ", tmp));
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    return absl::InternalError(
+        absl::StrCat("Cannot rename ", tmp, ": ", ec.message()));
+  }
+  return absl::OkStatus();
+}
+
+// Writes `message` as if it were field `number` of a Project.
+void WriteField(int number, const google::protobuf::MessageLite& message,
+                google::protobuf::io::CodedOutputStream& coded) {
+  coded.WriteTag(WireFormatLite::MakeTag(
+      number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+  coded.WriteVarint64(message.ByteSizeLong());
+  message.SerializeWithCachedSizes(&coded);
+}
+
+}  // namespace
+
+absl::StatusOr<Project*> LoadProject(const std::string& path,
+                                     google::protobuf::Arena* arena) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input) return absl::NotFoundError(absl::StrCat("Cannot open ", path));
+  Project* project = google::protobuf::Arena::Create<Project>(arena);
+  google::protobuf::io::IstreamInputStream stream(&input);
+  if (!project->ParseFromZeroCopyStream(&stream)) {
+    return absl::DataLossError(absl::StrCat("Cannot parse ", path));
+  }
+  return project;
+}
+
+absl::Status SaveProject(const Project& project, const std::string& path) {
+  return WriteAtomically(path, [&](google::protobuf::io::CodedOutputStream& c) {
+    return project.SerializeToCodedStream(&c);
+  });
+}
+
+absl::Status SaveProject(const ProjectModel::Snapshot& snapshot,
+                         const std::string& path) {
+  return WriteAtomically(path, [&](google::protobuf::io::CodedOutputStream& c) {
+    // Concatenated messages merge, so the header and each track can be
+    // written as their own Project fields.
+    if (!snapshot.header->SerializeToCodedStream(&c)) return false;
+    for (const std::shared_ptr<const Track>& track : snapshot.tracks) {
+      WriteField(Project::kTracksFieldNumber, *track, c);
+    }
+    for (const std::shared_ptr<const Track>& bus : snapshot.buses) {
+      WriteField(Project::kBusesFieldNumber, *bus, c);
+    }
+    if (snapshot.master) {
+      WriteField(Project::kMasterFieldNumber, *snapshot.master, c);
+    }
+    for (const std::shared_ptr<const PluginState>& state :
+         snapshot.plugin_states) {
+      WriteField(Project::kPluginStatesFieldNumber, *state, c);
+    }
+    return true;
+  });
+}
+
+ProjectModel::ProjectModel(const Project& project) {
+  auto header = std::make_shared<Project>(project);
+  header->clear_tracks();
+  header->clear_buses();
+  header->clear_master();
+  header->clear_plugin_states();
+  snapshot_.header = std::move(header);
+  for (const Track& track : project.tracks()) {
+    snapshot_.tracks.push_back(std::make_shared<Track>(track));
+  }
+  for (const Track& bus : project.buses()) {
+    snapshot_.buses.push_back(std::make_shared<Track>(bus));
+  }
+  if (project.has_master()) {
+    snapshot_.master = std::make_shared<Track>(project.master());
+  }
+  for (const PluginState& state : project.plugin_states()) {
+    snapshot_.plugin_states.push_back(std::make_shared<PluginState>(state));
+  }
+}
+
+template <typename T>
+T* ProjectModel::Unshare(std::shared_ptr<const T>& message) {
+  ++generation_;
+  if (message.use_count() > 1) message = std::make_shared<T>(*message);
+  // Sole owner now, and never allocated as const.
+  return const_cast<T*>(message.get());
+}
+
+Project* ProjectModel::mutable_header() { return Unshare(snapshot_.header); }
+
+Track* ProjectModel::mutable_track(int index) {
+  return Unshare(snapshot_.tracks[index]);
+}
+
+void ProjectModel::SetPluginState(std::shared_ptr<const PluginState> state) {
+  ++generation_;
+  for (std::shared_ptr<const PluginState>& old : snapshot_.plugin_states) {
+    if (old->plugin_id() == state->plugin_id()) {
+      old = std::move(state);
+      return;
+    }
+  }
+  snapshot_.plugin_states.push_back(std::move(state));
+}
+
+Track* ProjectModel::add_track() {
+  ++generation_;
+  auto track = std::make_shared<Track>();
+  Track* ret = track.get();
+  snapshot_.tracks.push_back(std::move(track));
+  return ret;
+}
+
+void ProjectModel::ToProto(Project* project) const {
+  *project = *snapshot_.header;
+  for (const std::shared_ptr<const Track>& track : snapshot_.tracks) {
+    *project->add_tracks() = *track;
+  }
+  for (const std::shared_ptr<const Track>& bus : snapshot_.buses) {
+    *project->add_buses() = *bus;
+  }
+  if (snapshot_.master) *project->mutable_master() = *snapshot_.master;
+  for (const std::shared_ptr<const PluginState>& state :
+       snapshot_.plugin_states) {
+    *project->add_plugin_states() = *state;
+  }
+}
+
+std::unique_ptr<ProjectAutosaver> ProjectAutosaver::Create(std::string path) {
+  std::unique_ptr<ProjectAutosaver> ret(new ProjectAutosaver(std::move(path)));
+  ret->thread_ = std::thread(&ProjectAutosaver::Loop, ret.get());
+  return ret;
+}
+
+ProjectAutosaver::~ProjectAutosaver() {
+  {
+    absl::MutexLock lock(&mu_);
+    quit_ = true;
+  }
+  thread_.join();
+}
+
+void ProjectAutosaver::Save(ProjectModel::Snapshot snapshot) {
+  auto pending = std::make_unique<ProjectModel::Snapshot>(std::move(snapshot));
+  absl::MutexLock lock(&mu_);
+  // Drops an older pending snapshot after unlocking.
+  std::swap(pending_, pending);
+}
+
+void ProjectAutosaver::Loop() {
+  while (true) {
+    std::unique_ptr<ProjectModel::Snapshot> snapshot;
+    {
+      absl::MutexLock lock(&mu_);
+      mu_.Await(absl::Condition(this, &ProjectAutosaver::HasWork));
+      if (pending_ == nullptr) return;  // Quit with nothing left to save.
+      snapshot = std::move(pending_);
+    }
+    if (absl::Status status = SaveProject(*snapshot, path_); !status.ok()) {
+      LOG(ERROR) << "Autosave failed: " << status;
+    } else {
+      LOG(INFO) << "Autosaved " << path_;
+    }
+  }
+}
+
+}  // namespace kodo
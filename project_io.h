@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/arena.h"
+#include "kodo.pb.h"
+
+namespace kodo {
+
+// Parses the binary project at `path` into a message owned by `arena`, so
+// its thousands of clips and note arrays come from a few arena blocks.
+absl::StatusOr<Project*> LoadProject(const std::string& path,
+                                     google::protobuf::Arena* arena);
+
+// Writes `project` to `path` through a temporary file.
+absl::Status SaveProject(const Project& project, const std::string& path);
+
+// Copy-on-write project edited on the GUI thread. The top-level fields and
+// every track, bus and the master are separate immutable messages, so a
+// snapshot only copies pointers and an edit copies just the track it changes.
+class ProjectModel {
+ public:
+  // Immutable view of the model at one point in time.
+  struct Snapshot {
+    // Project fields other than the tracks, buses and master.
+    std::shared_ptr<const Project> header;
+    std::vector<std::shared_ptr<const Track>> tracks;
+    std::vector<std::shared_ptr<const Track>> buses;
+    std::shared_ptr<const Track> master;
+    // Project.plugin_states, each shared until the plugin changes again.
+    std::vector<std::shared_ptr<const PluginState>> plugin_states;
+  };
+
+  explicit ProjectModel(const Project& project);
+
+  Snapshot snapshot() const { return snapshot_; }
+  // Incremented by every mutable accessor.
+  int64_t generation() const { return generation_; }
+
+  const Project& header() const { return *snapshot_.header; }
+  int tracks_size() const { return snapshot_.tracks.size(); }
+  const Track& track(int index) const { return *snapshot_.tracks[index]; }
+
+  // The returned pointers are valid until the next snapshot() or edit.
+  Project* mutable_header();
+  Track* mutable_track(int index);
+  Track* add_track();
+  // Replaces the state of state->plugin_id, without copying any track.
+  void SetPluginState(std::shared_ptr<const PluginState> state);
+
+  // Assembles the whole model, e.g. to build a render graph from it.
+  void ToProto(Project* project) const;
+
+ private:
+  // Copies `message` first if a snapshot still shares it.
+  template <typename T>
+  T* Unshare(std::shared_ptr<const T>& message);
+
+  Snapshot snapshot_;
+  int64_t generation_ = 0;
+};
+
+// Writes `snapshot` to `path` in the Project wire format without assembling a
+// Project message first.
+absl::Status SaveProject(const ProjectModel::Snapshot& snapshot,
+                         const std::string& path);
+
+// Serializes project snapshots on a background thread, so saving a huge
+// arrangement never blocks the GUI frame or the audio callback.
+class ProjectAutosaver {
+ public:
+  static std::unique_ptr<ProjectAutosaver> Create(std::string path);
+
+  // Finishes the pending save, then joins the thread.
+  ~ProjectAutosaver();
+
+  // Schedules `snapshot` to be written. Replaces an older pending one.
+  void Save(ProjectModel::Snapshot snapshot) ABSL_LOCKS_EXCLUDED(mu_);
+
+  const std::string& path() const { return path_; }
+
+ private:
+  explicit ProjectAutosaver(std::string path) : path_(std::move(path)) {}
+
+  void Loop();
+  bool HasWork() const ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+    return quit_ || pending_ != nullptr;
+  }
+
+  const std::string path_;
+  absl::Mutex mu_;
+  std::unique_ptr<ProjectModel::Snapshot> pending_ ABSL_GUARDED_BY(mu_);
+  bool quit_ ABSL_GUARDED_BY(mu_) = false;
+  std::thread thread_;
+};
+
+}  // namespace kodo
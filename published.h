@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace kodo {
+
+// Hands immutable values from one writer thread, e.g. the GUI, to a single
+// reader on the audio thread. Publishing is an atomic pointer swap; the
+// reader announces the value it uses, so the writer frees a replaced value
+// only once the reader moved past it. The reader never frees or locks.
+template <typename T>
+class Published {
+ public:
+  explicit Published(std::shared_ptr<const T> value)
+      : latest_(value.get()), reading_(value.get()) {
+    values_.push_back(std::move(value));
+  }
+
+  Published(const Published&) = delete;
+  Published& operator=(const Published&) = delete;
+
+  // Writer thread. Makes `value` the next one Acquire() returns.
+  void Publish(std::shared_ptr<const T> value) {
+    latest_.store(value.get(), std::memory_order_seq_cst);
+    const T* reading = reading_.load(std::memory_order_seq_cst);
+    // Anything but the value being read and the new one is unreachable now.
+    std::erase_if(values_, [&](const std::shared_ptr<const T>& old) {
+      return old.get() != reading;
+    });
+    values_.push_back(std::move(value));
+  }
+
+  // Writer thread. The last published value.
+  const std::shared_ptr<const T>& latest() const { return values_.back(); }
+
+  // Reader thread. The value of the last Acquire(), valid until the next.
+  const T* current() const {
+    return reading_.load(std::memory_order_relaxed);
+  }
+  // Reader thread. Whether Acquire() would return a newer value.
+  bool HasUpdate() const {
+    return latest_.load(std::memory_order_seq_cst) != current();
+  }
+  // Reader thread. Switches to the latest value. Lock-free: only retries
+  // while the writer publishes.
+  const T* Acquire() {
+    const T* value = latest_.load(std::memory_order_seq_cst);
+    while (true) {
+      reading_.store(value, std::memory_order_seq_cst);
+      const T* latest = latest_.load(std::memory_order_seq_cst);
+      if (latest == value) return value;
+      value = latest;
+    }
+  }
+
+ private:
+  std::atomic<const T*> latest_;
+  std::atomic<const T*> reading_;
+  // Writer thread. Values published but perhaps still read, latest last.
+  std::vector<std::shared_ptr<const T>> values_;
+};
+
+}  // namespace kodo
@@ -0,0 +1,197 @@
+#include "recorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "audio_file.h"
+
+namespace kodo {
+
+absl::StatusOr<std::unique_ptr<Recorder>> Recorder::Create(
+    const RecorderOptions& options) {
+  if (options.num_channels <= 0 || options.sample_rate <= 0 ||
+      options.write_frames <= 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Cannot record ", options.num_channels, " channels at ",
+        options.sample_rate, " Hz in writes of ", options.write_frames,
+        " frames."));
+  }
+  absl::StatusOr<std::unique_ptr<AudioFileWriter>> writer = CreateWavFile(
+      options.path, options.sample_rate, options.num_channels, options.bits);
+  if (!writer.ok()) return writer.status();
+
+  // Room for a write in progress plus the next one, at least.
+  const int64_t capacity = std::bit_ceil(static_cast<uint64_t>(
+      std::max<int64_t>(options.buffer_seconds * options.sample_rate,
+                        2 * int64_t{options.write_frames})));
+  std::unique_ptr<Recorder> ret(
+      new Recorder(options, std::move(*writer), capacity));
+  ret->thread_ = std::thread(&Recorder::Loop, ret.get());
+  LOG(INFO) << "Recording " << options.path << " with "
+            << options.num_channels << " channels and a ring of " << capacity
+            << " frames";
+  return ret;
+}
+
+Recorder::Recorder(const RecorderOptions& options,
+                   std::unique_ptr<AudioFileWriter> writer, int64_t capacity)
+    : options_(options),
+      writer_(std::move(writer)),
+      capacity_(capacity),
+      ring_(options.num_channels * capacity),
+      silence_(options.write_frames, 0.0f),
+      channels_(options.num_channels) {}
+
+Recorder::~Recorder() { Stop().IgnoreError(); }
+
+// Runs on the audio thread. No locks, allocations or logging below.
+void Recorder::Write(const float* const* inputs, int num_frames) {
+  const int64_t tail = tail_.load(std::memory_order_relaxed);
+  if (pending_gap_ > 0 && gaps_.Push({tail, pending_gap_})) pending_gap_ = 0;
+
+  int64_t used = tail - head_cache_;
+  if (used + num_frames > capacity_) {
+    head_cache_ = head_.load(std::memory_order_acquire);
+    used = tail - head_cache_;
+  }
+  // Frames after an unqueued gap would be misplaced, so they drop too.
+  if (pending_gap_ > 0 || used + num_frames > capacity_) {
+    pending_gap_ += num_frames;
+    overruns_.fetch_add(1, std::memory_order_relaxed);
+    dropped_frames_.fetch_add(num_frames, std::memory_order_relaxed);
+    return;
+  }
+
+  const int64_t start = tail & (capacity_ - 1);
+  const int64_t first = std::min<int64_t>(num_frames, capacity_ - start);
+  for (int c = 0; c < options_.num_channels; ++c) {
+    float* ring = ring_.data() + c * capacity_;
+    std::copy_n(inputs[c], first, ring + start);
+    std::copy_n(inputs[c] + first, num_frames - first, ring);
+  }
+  tail_.store(tail + num_frames, std::memory_order_release);
+
+  used += num_frames;
+  if (used > high_water_.load(std::memory_order_relaxed)) {
+    high_water_.store(used, std::memory_order_relaxed);
+  }
+}
+
+absl::Status Recorder::Stop() {
+  Finish();
+  if (thread_.joinable()) thread_.join();
+  return status_;
+}
+
+void Recorder::Finish() {
+  absl::MutexLock lock(&mu_);
+  stop_ = true;
+}
+
+Recorder::Stats Recorder::stats() const {
+  Stats stats;
+  stats.capacity_frames = capacity_;
+  stats.pending_frames = tail_.load(std::memory_order_relaxed) -
+                         head_.load(std::memory_order_relaxed);
+  stats.frames_written = frames_written_.load(std::memory_order_relaxed);
+  stats.high_water_frames = high_water_.load(std::memory_order_relaxed);
+  stats.overruns = overruns_.load(std::memory_order_relaxed);
+  stats.dropped_frames = dropped_frames_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void Recorder::Loop() {
+  // Polls a few times per write, as the audio thread cannot signal.
+  const absl::Duration period = std::clamp(
+      absl::Seconds(options_.write_frames / options_.sample_rate / 4),
+      absl::Milliseconds(1), absl::Milliseconds(50));
+  bool stop = false;
+  while (!stop) {
+    {
+      absl::MutexLock lock(&mu_);
+      mu_.AwaitWithTimeout(absl::Condition(this, &Recorder::HasWork), period);
+      stop = stop_;
+    }
+    const int64_t end = tail_.load(std::memory_order_acquire);
+    if (stop || end - head_.load(std::memory_order_relaxed) >=
+                    options_.write_frames) {
+      Drain(end);
+    }
+  }
+  // Write() has stopped, so its last gap is final.
+  for (int64_t left = pending_gap_; left > 0; left -= options_.write_frames) {
+    std::fill(channels_.begin(), channels_.end(), silence_.data());
+    WriteFile(channels_.data(), std::min<int64_t>(left, options_.write_frames));
+  }
+  if (absl::Status status = writer_->Close(); !status.ok()) {
+    LOG(ERROR) << "Finalizing " << options_.path << " failed: " << status;
+    status_.Update(status);
+  }
+  LOG(INFO) << "Recorded " << frames_written_.load() << " frames into "
+            << options_.path << ", " << FormatRecorderStats(stats());
+  finished_.store(true, std::memory_order_release);
+}
+
+void Recorder::Drain(int64_t end) {
+  int64_t head = head_.load(std::memory_order_relaxed);
+  while (true) {
+    if (!has_gap_) has_gap_ = gaps_.Pop(&gap_);
+    if (has_gap_ && gap_.position <= head) {
+      // Silence where Write() dropped frames.
+      std::fill(channels_.begin(), channels_.end(), silence_.data());
+      for (int64_t left = gap_.frames; left > 0;
+           left -= options_.write_frames) {
+        WriteFile(channels_.data(),
+                  std::min<int64_t>(left, options_.write_frames));
+      }
+      has_gap_ = false;
+      continue;
+    }
+    // A gap past `end` waits for the frames before it.
+    const int64_t stop = has_gap_ ? std::min(end, gap_.position) : end;
+    if (head >= stop) break;
+    const int64_t start = head & (capacity_ - 1);
+    const int n = std::min<int64_t>(
+        {stop - head, capacity_ - start, options_.write_frames});
+    for (int c = 0; c < options_.num_channels; ++c) {
+      channels_[c] = ring_.data() + c * capacity_ + start;
+    }
+    WriteFile(channels_.data(), n);
+    head += n;
+    head_.store(head, std::memory_order_release);
+  }
+}
+
+void Recorder::WriteFile(const float* const* inputs, int num_frames) {
+  if (!status_.ok()) return;  // Keep draining so Write() never overruns.
+  status_ = writer_->Write(inputs, num_frames);
+  if (status_.ok()) {
+    frames_written_.fetch_add(num_frames, std::memory_order_relaxed);
+  } else {
+    LOG(ERROR) << "Recording " << options_.path << " failed: " << status_;
+  }
+}
+
+std::string FormatRecorderStats(const Recorder::Stats& stats) {
+  const double capacity = std::max<int64_t>(stats.capacity_frames, 1);
+  return absl::StrFormat(
+      "ring %.0f%% (high water %.0f%%), %d overruns dropped %d frames",
+      100 * stats.pending_frames / capacity,
+      100 * stats.high_water_frames / capacity, stats.overruns,
+      stats.dropped_frames);
+}
+
+}  // namespace kodo
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "audio_file.h"
+#include "spsc_queue.h"
+
+namespace kodo {
+
+struct RecorderOptions {
+  std::string path;  // WAV file to create.
+  double sample_rate = 48000;
+  int num_channels = 2;
+  int bits = 32;
+  // Ring capacity, i.e. how long the disk may stall before an overrun.
+  double buffer_seconds = 4;
+  // Frames per channel handed to the file in one write.
+  int write_frames = 32768;
+};
+
+// Streams blocks from the audio thread into a WAV file. The audio thread only
+// copies into a preallocated ring per channel; a writer thread drains it to
+// disk in large writes.
+class Recorder {
+ public:
+  struct Stats {
+    int64_t capacity_frames = 0;
+    // Frames waiting in the ring now.
+    int64_t pending_frames = 0;
+    int64_t frames_written = 0;  // Including silence for dropped frames.
+    // Most frames ever waiting in the ring.
+    int64_t high_water_frames = 0;
+    // Write() calls that found the ring full, and the frames they dropped.
+    uint64_t overruns = 0;
+    int64_t dropped_frames = 0;
+  };
+
+  static absl::StatusOr<std::unique_ptr<Recorder>> Create(
+      const RecorderOptions& options);
+
+  // Stop()s unless stopped already. The writer logs any error.
+  ~Recorder();
+
+  Recorder(const Recorder&) = delete;
+  Recorder& operator=(const Recorder&) = delete;
+
+  // Audio thread. Appends `inputs[num_channels][num_frames]`. Real-time safe:
+  // a full ring drops the block, which is counted and written as silence so
+  // the take stays in time.
+  void Write(const float* const* inputs, int num_frames);
+
+  // Drains the ring, finalizes the file and joins the writer. Call after the
+  // audio thread stopped calling Write(). Returns the first disk error.
+  absl::Status Stop() ABSL_LOCKS_EXCLUDED(mu_);
+  // Like Stop(), but returns at once while the writer drains and finalizes
+  // in the background, e.g. on the GUI thread. Errors are logged.
+  void Finish() ABSL_LOCKS_EXCLUDED(mu_);
+  // Whether the file is finalized after Finish(), so destroying the
+  // recorder does not block.
+  bool finished() const { return finished_.load(std::memory_order_acquire); }
+
+  // Any thread, also while recording.
+  Stats stats() const;
+  const RecorderOptions& options() const { return options_; }
+
+ private:
+  static constexpr size_t kCacheLine = 64;
+
+  // Frames dropped before the ring frame `position`.
+  struct Gap {
+    int64_t position;
+    int64_t frames;
+  };
+
+  Recorder(const RecorderOptions& options,
+           std::unique_ptr<AudioFileWriter> writer, int64_t capacity);
+
+  void Loop() ABSL_LOCKS_EXCLUDED(mu_);
+  // Writes ring frames [head_, end) and the gaps before them.
+  void Drain(int64_t end);
+  void WriteFile(const float* const* inputs, int num_frames);
+  bool HasWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) { return stop_; }
+
+  const RecorderOptions options_;
+  std::unique_ptr<AudioFileWriter> writer_;
+  const int64_t capacity_;  // Power of two.
+  std::vector<float> ring_;  // num_channels x capacity_.
+
+  // Consumer side.
+  alignas(kCacheLine) std::atomic<int64_t> head_{0};
+  // Producer side.
+  alignas(kCacheLine) std::atomic<int64_t> tail_{0};
+  int64_t head_cache_ = 0;
+  int64_t pending_gap_ = 0;  // Dropped frames not queued in gaps_ yet.
+  SpscQueue<Gap, 64> gaps_;
+
+  std::atomic<int64_t> frames_written_{0};
+  std::atomic<int64_t> high_water_{0};
+  std::atomic<uint64_t> overruns_{0};
+  std::atomic<int64_t> dropped_frames_{0};
+  std::atomic<bool> finished_{false};
+
+  // Writer thread only, and after it finished.
+  Gap gap_;  // Popped from gaps_ but not reached yet, if has_gap_.
+  bool has_gap_ = false;
+  std::vector<float> silence_;
+  std::vector<const float*> channels_;
+  absl::Status status_;
+
+  absl::Mutex mu_;
+  bool stop_ ABSL_GUARDED_BY(mu_) = false;
+  std::thread thread_;
+};
+
+// One line for logs, e.g.
+// "ring 12% (high water 40%), 0 overruns dropped 0 frames".
+std::string FormatRecorderStats(const Recorder::Stats& stats);
+
+}  // namespace kodo
@@ -0,0 +1,107 @@
+#include "recorder.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "audio_file.h"
+#include "gtest/gtest.h"
+
+namespace kodo {
+namespace {
+
+RecorderOptions Options(const std::string& name, int write_frames) {
+  RecorderOptions options;
+  options.path = testing::TempDir() + "/" + name + ".wav";
+  options.sample_rate = 1000;
+  options.num_channels = 1;
+  // The smallest ring: two writes.
+  options.buffer_seconds = 0;
+  options.write_frames = write_frames;
+  return options;
+}
+
+std::unique_ptr<Recorder> MakeRecorder(const RecorderOptions& options) {
+  absl::StatusOr<std::unique_ptr<Recorder>> recorder =
+      Recorder::Create(options);
+  EXPECT_TRUE(recorder.ok()) << recorder.status();
+  return *std::move(recorder);
+}
+
+void Write(Recorder& recorder, const std::vector<float>& block) {
+  const float* channels[] = {block.data()};
+  recorder.Write(channels, block.size());
+}
+
+std::vector<float> ReadBack(const std::string& path) {
+  absl::StatusOr<std::unique_ptr<AudioFileReader>> reader = OpenWavFile(path);
+  EXPECT_TRUE(reader.ok()) << reader.status();
+  if (!reader.ok()) return {};
+  std::vector<float> frames((*reader)->num_frames());
+  float* outputs[] = {frames.data()};
+  EXPECT_TRUE((*reader)->Read(0, frames.size(), outputs).ok());
+  return frames;
+}
+
+TEST(RecorderTest, StatsCountFramesWaitingInTheRing) {
+  const RecorderOptions options = Options("pending", 1024);
+  std::unique_ptr<Recorder> recorder = MakeRecorder(options);
+  // Less than a write, so the writer leaves it in the ring.
+  Write(*recorder, std::vector<float>(100, 0.5f));
+  Write(*recorder, std::vector<float>(50, 0.5f));
+  Recorder::Stats stats = recorder->stats();
+  EXPECT_EQ(stats.capacity_frames, 2048);
+  EXPECT_EQ(stats.pending_frames, 150);
+  EXPECT_EQ(stats.high_water_frames, 150);
+  EXPECT_EQ(stats.frames_written, 0);
+
+  ASSERT_TRUE(recorder->Stop().ok());
+  stats = recorder->stats();
+  EXPECT_EQ(stats.pending_frames, 0);
+  EXPECT_EQ(stats.high_water_frames, 150);
+  EXPECT_EQ(stats.frames_written, 150);
+}
+
+TEST(RecorderTest, FinishFinalizesInTheBackground) {
+  const RecorderOptions options = Options("finish", 64);
+  std::unique_ptr<Recorder> recorder = MakeRecorder(options);
+  std::vector<float> ramp(300);
+  for (int i = 0; i < ramp.size(); ++i) ramp[i] = i / 1000.0f;
+  for (int i = 0; i < ramp.size(); i += 50) {
+    Write(*recorder, std::vector<float>(ramp.begin() + i,
+                                        ramp.begin() + i + 50));
+    absl::SleepFor(absl::Milliseconds(20));  // Lets the writer keep up.
+  }
+  recorder->Finish();
+  const absl::Time deadline = absl::Now() + absl::Seconds(5);
+  while (!recorder->finished() && absl::Now() < deadline) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  ASSERT_TRUE(recorder->finished());
+  EXPECT_EQ(recorder->stats().overruns, 0);
+  EXPECT_EQ(ReadBack(options.path), ramp);
+  EXPECT_TRUE(recorder->Stop().ok());
+}
+
+TEST(RecorderTest, OverrunIsWrittenAsSilence) {
+  const RecorderOptions options = Options("overrun", 64);
+  std::unique_ptr<Recorder> recorder = MakeRecorder(options);
+  // More than the 128 frames of the ring at once.
+  Write(*recorder, std::vector<float>(200, 0.5f));
+  Write(*recorder, std::vector<float>(10, 0.25f));
+  ASSERT_TRUE(recorder->Stop().ok());
+  const Recorder::Stats stats = recorder->stats();
+  EXPECT_EQ(stats.overruns, 1);
+  EXPECT_EQ(stats.dropped_frames, 200);
+  EXPECT_EQ(stats.frames_written, 210);
+  std::vector<float> expected(200, 0.0f);
+  expected.resize(210, 0.25f);
+  EXPECT_EQ(ReadBack(options.path), expected);
+}
+
+}  // namespace
+}  // namespace kodo
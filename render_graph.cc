@@ -0,0 +1,419 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "dsp.h"
+#include "graph_scheduler.h"
+#include "perf_counters.h"
+#include "trace.h"
+
+namespace kodo {
+namespace {
+
+int ChainLatency(const std::vector<Plugin*>& chain) {
+  int latency = 0;
+  for (const Plugin* plugin : chain) latency += std::max(plugin->latency(), 0);
+  return latency;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<RenderGraph>> RenderGraph::Create(
+    std::vector<RenderNodeSpec> specs, const RenderGraphOptions& options) {
+  const int n = specs.size();
+  if (n > kMaxNodes) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat("#nodes=", n, " exceeds ", kMaxNodes));
+  }
+  if (options.num_channels <= 0 || options.max_block_size <= 0 ||
+      options.max_latency < 0) {
+    return absl::InvalidArgumentError("Invalid RenderGraphOptions.");
+  }
+
+  std::unique_ptr<RenderGraph> ret(new RenderGraph);
+  ret->options_ = options;
+  ret->nodes_.resize(n);
+  for (int i = 0; i < n; ++i) {
+    const int output = specs[i].output;
+    if (output < -1 || output >= n || output == i) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Node ", specs[i].name, " has invalid output=", output));
+    }
+    if (output == -1) {
+      ret->sinks_.push_back(i);
+    } else {
+      ret->nodes_[output].inputs.push_back(i);
+    }
+    Node& node = ret->nodes_[i];
+    node.spec = std::move(specs[i]);
+    node.trace_name = InternTraceName(node.spec.name);
+    node.plugin_stats.resize(node.spec.chain.size());
+    if (node.spec.notes) {
+      node.events = ret->arena_.NewArray<MidiEvent>(3 * kMaxEvents);
+    }
+    if (options.perf == nullptr) continue;
+    for (int k = 0; k < node.spec.chain.size(); ++k) {
+      node.plugin_stats[k] = options.perf->Register(
+          absl::StrCat(node.spec.name, " / ", node.spec.chain[k]->name()));
+    }
+  }
+
+  // Kahn's algorithm. Also rejects cycles.
+  std::vector<int> in_degree(n);
+  for (int i = 0; i < n; ++i) {
+    in_degree[i] = ret->nodes_[i].inputs.size();
+    if (in_degree[i] == 0) {
+      ret->roots_.push_back(i);
+      ret->order_.push_back(i);
+    }
+  }
+  for (int k = 0; k < ret->order_.size(); ++k) {
+    const int output = ret->nodes_[ret->order_[k]].spec.output;
+    if (output != -1 && --in_degree[output] == 0) {
+      ret->order_.push_back(output);
+    }
+  }
+  if (ret->order_.size() != n) {
+    return absl::InvalidArgumentError("Render graph has a cycle.");
+  }
+
+  // Two buffers per node for the ping-pong plugin chain. Each node starts
+  // on its own cache line, as nodes run on different workers.
+  const int channels = options.num_channels;
+  const size_t block = options.max_block_size;
+  for (Node& node : ret->nodes_) {
+    float* p = ret->arena_.NewArray<float>(2 * channels * block);
+    for (std::vector<float*>& buffer : node.channels) {
+      for (int c = 0; c < channels; ++c, p += block) buffer.push_back(p);
+    }
+  }
+  ret->pending_ = std::make_unique<std::atomic<int>[]>(n);
+
+  // Delay lines only where two or more paths meet, each with room for a
+  // block beyond the longest delay.
+  auto num_paths = [](const Node& node) {
+    return node.inputs.size() + (node.spec.source ? 1 : 0);
+  };
+  const int num_sinks = ret->sinks_.size();
+  ret->delay_capacity_ = options.max_latency + options.max_block_size;
+  auto add_lines = [&](std::vector<DelayLine>& lines, int count) {
+    lines.resize(count);
+    for (DelayLine& line : lines) {
+      float* d = ret->arena_.NewArray<float>(channels * ret->delay_capacity_);
+      for (int c = 0; c < channels; ++c, d += ret->delay_capacity_) {
+        line.ring.push_back(d);
+      }
+    }
+  };
+  for (Node& node : ret->nodes_) {
+    if (num_paths(node) > 1) add_lines(node.delays, num_paths(node));
+  }
+  if (num_sinks > 1 && options.mix_outputs) {
+    add_lines(ret->sink_delays_, num_sinks);
+  }
+
+  ret->latency_epoch_ = Plugin::latency_epoch();
+  for (Node& node : ret->nodes_) {
+    node.chain_latency = ChainLatency(node.spec.chain);
+  }
+  for (int index : ret->order_) ret->UpdateJunction(index);
+  ret->UpdateJunction(-1);
+  return ret;
+}
+
+void RenderGraph::BeginBlock(int num_frames) {
+  num_frames_ = num_frames;
+  if (const uint64_t epoch = Plugin::latency_epoch();
+      epoch != latency_epoch_) {
+    latency_epoch_ = epoch;
+    UpdateLatencies();
+  }
+  for (int i = 0; i < nodes_.size(); ++i) {
+    pending_[i].store(nodes_[i].inputs.size(), std::memory_order_relaxed);
+  }
+}
+
+int RenderGraph::ProcessNode(int index) {
+  Node& node = nodes_[index];
+  TraceScope trace(node.trace_name);
+  const int channels = options_.num_channels;
+  const int frames = num_frames_;
+
+  float* const* mix = node.channels[0].data();
+  if (!node.delays.empty()) {
+    // Paths of different latency meet here; align them to the slowest.
+    for (int c = 0; c < channels; ++c) std::fill_n(mix[c], frames, 0.0f);
+    for (int k = 0; k < node.inputs.size(); ++k) {
+      const Node& in = nodes_[node.inputs[k]];
+      AddDelayed(node.delays[k], in.channels[in.result].data(), mix,
+                 channels, frames);
+    }
+    if (node.spec.source) {
+      // The other buffer is free until the chain runs.
+      float* const* scratch = node.channels[1].data();
+      node.spec.source->Render(scratch, channels, frames);
+      AddDelayed(node.delays.back(), scratch, mix, channels, frames);
+    }
+  } else {
+    if (node.spec.source) {
+      node.spec.source->Render(mix, channels, frames);
+    } else {
+      for (int c = 0; c < channels; ++c) std::fill_n(mix[c], frames, 0.0f);
+    }
+    // Inputs finished before our counter reached zero (acquire below).
+    for (int input : node.inputs) {
+      const Node& in = nodes_[input];
+      const float* const* src = in.channels[in.result].data();
+      for (int c = 0; c < channels; ++c) Dsp().add(src[c], mix[c], frames);
+    }
+  }
+
+  const MidiEvent* events = node.spec.receives_midi ? events_ : nullptr;
+  int num_events = node.spec.receives_midi ? num_events_ : 0;
+  if (node.spec.notes && (!node.spec.chain.empty() || node.spec.muted)) {
+    MidiEvent* notes = node.events;
+    const int num_notes = node.spec.notes->Render(frames, notes, kMaxEvents);
+    if (num_events == 0) {
+      events = notes;
+      num_events = num_notes;
+    } else {
+      MidiEvent* merged = notes + kMaxEvents;
+      num_events =
+          std::merge(notes, notes + num_notes, events, events + num_events,
+                     merged,
+                     [](const MidiEvent& a, const MidiEvent& b) {
+                       return a.sample_offset < b.sample_offset;
+                     }) -
+          merged;
+      events = merged;
+    }
+  }
+
+  AutomationPlayer* automation = node.spec.automation;
+  if (automation) automation->Render(frames);
+
+  int cur = 0;
+  for (int k = 0; k < node.spec.chain.size(); ++k) {
+    Plugin* plugin = node.spec.chain[k];
+    AudioBlock block;
+    block.inputs = node.channels[cur].data();
+    block.num_inputs = channels;
+    block.outputs = node.channels[1 - cur].data();
+    block.num_outputs = channels;
+    block.num_frames = frames;
+    if (k == 0) {
+      block.events = events;
+      block.num_events = num_events;
+    }
+    if (automation) {
+      automation->Changes(k, &block.param_changes, &block.num_param_changes);
+    }
+    const uint64_t start = CycleCount();
+    // Bypass plugins that are inactive or failed this block.
+    if (plugin->Process(block)) cur = 1 - cur;
+    if (TimingStats* stats = node.plugin_stats[k].get()) {
+      stats->Add(CycleCount() - start);
+    }
+  }
+  node.result = cur;
+  if (node.spec.muted) {
+    for (int c = 0; c < channels; ++c) {
+      std::fill_n(node.channels[cur][c], frames, 0.0f);
+    }
+  }
+  if (node.spec.meter) {
+    node.spec.meter->Process(node.channels[cur].data(), channels, frames);
+  }
+
+  const int output = node.spec.output;
+  if (output != -1 &&
+      pending_[output].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    return output;
+  }
+  return -1;
+}
+
+void RenderGraph::MixOutput(float* const* outputs, int num_channels,
+                            int num_frames) {
+  for (int c = 0; c < num_channels; ++c) {
+    std::fill_n(outputs[c], num_frames, 0.0f);
+  }
+  const int channels = std::min(num_channels, options_.num_channels);
+  for (int k = 0; k < sinks_.size(); ++k) {
+    const Node& node = nodes_[sinks_[k]];
+    const float* const* src = node.channels[node.result].data();
+    if (!sink_delays_.empty()) {
+      AddDelayed(sink_delays_[k], src, outputs, channels, num_frames);
+      continue;
+    }
+    for (int c = 0; c < channels; ++c) {
+      Dsp().add(src[c], outputs[c], num_frames);
+    }
+  }
+}
+
+void RenderGraph::UpdateLatencies() {
+  for (int i = 0; i < nodes_.size(); ++i) {
+    Node& node = nodes_[i];
+    const int latency = ChainLatency(node.spec.chain);
+    if (latency == node.chain_latency) continue;
+    node.chain_latency = latency;
+    // Only junctions downstream can change, and only up to the first whose
+    // output latency stays the same.
+    for (int index = i; UpdateJunction(index) && index != -1;) {
+      index = nodes_[index].spec.output;
+    }
+  }
+}
+
+bool RenderGraph::UpdateJunction(int index) {
+  const std::vector<int>& inputs =
+      index == -1 ? sinks_ : nodes_[index].inputs;
+  std::vector<DelayLine>& delays =
+      index == -1 ? sink_delays_ : nodes_[index].delays;
+  int latency = 0;  // The source has none.
+  for (int input : inputs) latency = std::max(latency, nodes_[input].latency);
+  if (!delays.empty()) {
+    for (int k = 0; k < inputs.size(); ++k) {
+      delays[k].delay = std::min(latency - nodes_[inputs[k]].latency,
+                                 options_.max_latency);
+    }
+    if (delays.size() > inputs.size()) {
+      delays.back().delay = std::min(latency, options_.max_latency);
+    }
+  }
+
+  if (index == -1) {
+    return latency_.exchange(latency, std::memory_order_relaxed) != latency;
+  }
+  Node& node = nodes_[index];
+  latency += node.chain_latency;
+  if (latency == node.latency) return false;
+  node.latency = latency;
+  return true;
+}
+
+// Runs on the audio thread. Writes the block first, so delays shorter than
+// the block read part of it back.
+void RenderGraph::AddDelayed(DelayLine& line, const float* const* src,
+                             float* const* dst, int num_channels,
+                             int num_frames) {
+  const int capacity = delay_capacity_;
+  const int write = line.write;
+  const int read = (write - line.delay + capacity) % capacity;
+  const int write_head = std::min(num_frames, capacity - write);
+  const int read_head = std::min(num_frames, capacity - read);
+  for (int c = 0; c < num_channels; ++c) {
+    float* ring = line.ring[c];
+    std::copy_n(src[c], write_head, ring + write);
+    std::copy_n(src[c] + write_head, num_frames - write_head, ring);
+    Dsp().add(ring + read, dst[c], read_head);
+    Dsp().add(ring, dst[c] + read_head, num_frames - read_head);
+  }
+  line.write = (write + num_frames) % capacity;
+}
+
+absl::StatusOr<std::unique_ptr<RenderGraph>> BuildRenderGraph(
+    const Project& project, const RenderGraphOptions& options,
+    const PluginResolver& resolver, const SourceResolver& sources,
+    const NoteResolver& notes, const AutomationResolver& automation) {
+  absl::StatusOr<std::vector<RenderNodeSpec>> specs =
+      BuildRenderNodes(project, options, resolver, sources, notes, automation);
+  if (!specs.ok()) return specs.status();
+  return RenderGraph::Create(*std::move(specs), options);
+}
+
+absl::StatusOr<std::vector<RenderNodeSpec>> BuildRenderNodes(
+    const Project& project, const RenderGraphOptions& options,
+    const PluginResolver& resolver, const SourceResolver& sources,
+    const NoteResolver& notes, const AutomationResolver& automation) {
+  const int num_tracks = project.tracks_size();
+  const int num_buses = project.buses_size();
+  const int master = num_tracks + num_buses;
+
+  std::vector<RenderNodeSpec> specs(master + 1);
+  auto add = [&](const Track& track, int index) -> absl::Status {
+    RenderNodeSpec& spec = specs[index];
+    spec.name = track.name();
+    spec.receives_midi = index == options.midi_track;
+    if (sources) spec.source = sources(track);
+    // The source of a frozen track plays the rendering of all of it.
+    const bool frozen = track.has_freeze();
+    if (notes && !frozen) spec.notes = notes(track);
+    if (automation && !frozen) spec.automation = automation(track);
+    for (const PluginInstance& instance : track.plugins()) {
+      if (frozen) break;
+      Plugin* plugin = resolver(instance);
+      if (plugin == nullptr) {
+        // A failed plugin mutes its track rather than the whole project. A
+        // partial chain could be a synth without its limiter.
+        LOG_IF(WARNING, !options.plugins_loading)
+            << "Muting " << track.name() << ": plugin id=" << instance.id()
+            << " " << instance.path() << " is not loaded.";
+        spec.chain.clear();
+        spec.muted = true;
+        break;
+      }
+      spec.chain.push_back(plugin);
+    }
+    if (index == master) {
+      spec.output = -1;
+    } else if (!track.has_output_bus()) {
+      spec.output = master;
+    } else if (track.output_bus() < 0 || track.output_bus() >= num_buses) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          track.name(), " has invalid output_bus=", track.output_bus()));
+    } else {
+      spec.output = num_tracks + track.output_bus();
+    }
+    return absl::OkStatus();
+  };
+
+  for (int i = 0; i < num_tracks; ++i) {
+    if (absl::Status status = add(project.tracks(i), i); !status.ok()) {
+      return status;
+    }
+  }
+  for (int i = 0; i < num_buses; ++i) {
+    if (absl::Status status = add(project.buses(i), num_tracks + i);
+        !status.ok()) {
+      return status;
+    }
+  }
+  if (absl::Status status = add(project.master(), master); !status.ok()) {
+    return status;
+  }
+  if (specs[master].name.empty()) specs[master].name = "Master";
+  return specs;
+}
+
+void GraphRenderer::Render(float* const* outputs, int num_channels,
+                           int num_frames) {
+  const int max_block = graph_->options().max_block_size;
+  const int num_events =
+      midi_ ? midi_->Drain(num_frames, events_.data(), events_.size()) : 0;
+  int event = 0;
+  float* block[AudioEngine::kMaxChannels];
+  for (int offset = 0; offset < num_frames; offset += max_block) {
+    const int n = std::min(max_block, num_frames - offset);
+    for (int c = 0; c < num_channels; ++c) block[c] = outputs[c] + offset;
+    // Rebase the events of this sub-block, which are sorted by offset.
+    const int first = event;
+    for (; event < num_events && events_[event].sample_offset < offset + n;
+         ++event) {
+      events_[event].sample_offset -= offset;
+    }
+    graph_->SetMidiEvents(events_.data() + first, event - first);
+    scheduler_->Run(*graph_, n);
+    graph_->MixOutput(block, num_channels, n);
+  }
+}
+
+}  // namespace kodo
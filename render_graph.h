@@ -0,0 +1,234 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "audio_engine.h"
+#include "automation.h"
+#include "kodo.pb.h"
+#include "meter.h"
+#include "midi_event.h"
+#include "midi_input.h"
+#include "note_store.h"
+#include "perf_counters.h"
+#include "plugin_vst3.h"
+#include "rt_alloc.h"
+
+namespace kodo {
+
+class GraphScheduler;
+
+struct RenderGraphOptions {
+  int num_channels = 2;
+  int max_block_size = 1024;
+  // Receives per-plugin Process() timings if set. Must outlive the graph.
+  PerfRegistry* perf = nullptr;
+  // Project track whose node receives_midi in BuildRenderGraph(), or -1.
+  int midi_track = -1;
+  // Longest delay, in frames, of the lines compensating plugin latency where
+  // paths meet. Larger differences are only compensated up to this.
+  int max_latency = 8192;
+  // BuildRenderGraph() mutes tracks holding a plugin the resolver does not
+  // find, and renders the rest. Set while plugins are still loading, when
+  // that is expected; otherwise each such track logs a warning.
+  bool plugins_loading = false;
+  // Whether MixOutput() sums the output nodes, aligned by delay lines where
+  // their latencies differ. Graphs whose outputs are read one by one with
+  // node_output() skip the delay lines.
+  bool mix_outputs = true;
+};
+
+// One vertex of the render graph. Its block is the sum of its source and
+// every node that outputs into it, then processed by `chain` in order.
+struct RenderNodeSpec {
+  std::string name;
+  // Borrowed. Renders into the node buffer before inputs are added.
+  AudioRenderer* source = nullptr;
+  // Borrowed. Already set up and activated for the graph block size.
+  std::vector<Plugin*> chain;
+  // Index of the node this one feeds, or -1 for the graph output.
+  int output = -1;
+  // Whether the first plugin of `chain` gets the MIDI input, e.g. a synth.
+  bool receives_midi = false;
+  // Borrowed. Notes played by the first plugin of `chain`, merged with the
+  // MIDI input.
+  NotePlayer* notes = nullptr;
+  // Borrowed. Parameter points for `chain`, whose indices match the plugins
+  // of the automated track.
+  AutomationPlayer* automation = nullptr;
+  // Outputs silence while `source`, `notes` and `automation` keep their
+  // playheads moving, so the node plays in sync once unmuted.
+  bool muted = false;
+  // Borrowed. Measures the node output after `chain` and muting.
+  Meter* meter = nullptr;
+};
+
+// Immutable, fully preallocated processing graph. Built on a non-real-time
+// thread and handed to the audio thread as a whole, so the callback never
+// sees a half-built graph.
+class RenderGraph {
+ public:
+  // Upper bound of nodes, matching the capacity of scheduler task queues.
+  static constexpr int kMaxNodes = 4096;
+  // Upper bound of MIDI events per block from each of the MIDI input and a
+  // NotePlayer.
+  static constexpr int kMaxEvents = 512;
+
+  static absl::StatusOr<std::unique_ptr<RenderGraph>> Create(
+      std::vector<RenderNodeSpec> specs, const RenderGraphOptions& options);
+
+  int num_nodes() const { return nodes_.size(); }
+  const RenderGraphOptions& options() const { return options_; }
+  const RenderNodeSpec& node(int index) const { return nodes_[index].spec; }
+  // The last block processed by node `index`, and the frames by which it
+  // lags the sources. Valid on the rendering thread between blocks.
+  const float* const* node_output(int index) const {
+    return nodes_[index].channels[nodes_[index].result].data();
+  }
+  int node_latency(int index) const { return nodes_[index].latency; }
+  // Node indices in a topological order.
+  const std::vector<int>& order() const { return order_; }
+  // Frames by which MixOutput() lags the sources, i.e. the latency of the
+  // slowest path. Safe to call from any thread.
+  int latency() const { return latency_.load(std::memory_order_relaxed); }
+
+  // The following are called by GraphScheduler on the audio thread and its
+  // workers. None of them allocates or locks.
+
+  // Resets the dependency counters for a block of `num_frames`. After a
+  // plugin reported a new latency, also retunes the delay lines on the
+  // paths from its node to the output.
+  void BeginBlock(int num_frames);
+  // MIDI for the next block, borrowed until it is processed. Call before
+  // GraphScheduler::Run().
+  void SetMidiEvents(const MidiEvent* events, int num_events) {
+    events_ = events;
+    num_events_ = num_events;
+  }
+  // Nodes without inputs, ready at the beginning of a block.
+  const std::vector<int>& roots() const { return roots_; }
+  // Processes node `index` whose inputs are complete. Returns the index of
+  // the downstream node if this made it ready, or -1.
+  int ProcessNode(int index);
+  // Sums every graph output node into `outputs`.
+  void MixOutput(float* const* outputs, int num_channels, int num_frames);
+
+ private:
+  // The last frames of one path into a junction, replayed `delay` frames
+  // late.
+  struct DelayLine {
+    std::vector<float*> ring;  // Per channel, of delay_capacity_ frames.
+    int write = 0;
+    int delay = 0;
+  };
+
+  struct Node {
+    RenderNodeSpec spec;
+    const char* trace_name = nullptr;  // InternTraceName(spec.name).
+    std::vector<int> inputs;
+    // Ping-pong channel buffers for the plugin chain.
+    std::vector<float*> channels[2];
+    int result = 0;  // Which of `channels` holds the processed block.
+    // Parallel to spec.chain, each nullptr without RenderGraphOptions::perf.
+    std::vector<std::shared_ptr<TimingStats>> plugin_stats;
+    // With spec.notes, kMaxEvents notes followed by 2 * kMaxEvents merged
+    // with the MIDI input.
+    MidiEvent* events = nullptr;
+    // Sum of the latencies of `chain`, and of the node output from the
+    // sources.
+    int chain_latency = 0;
+    int latency = 0;
+    // Only where paths meet, i.e. for two or more of the inputs and the
+    // source: parallel to `inputs`, then one for the source.
+    std::vector<DelayLine> delays;
+  };
+
+  RenderGraph() {}  // Use Create().
+
+  // Rereads every plugin latency and updates the paths that changed.
+  void UpdateLatencies();
+  // Retunes the delay lines where the paths into node `index`, or into the
+  // output for -1, meet. Returns whether the latency of its output changed.
+  bool UpdateJunction(int index);
+  // Adds `src` to `dst` through `line`.
+  void AddDelayed(DelayLine& line, const float* const* src, float* const* dst,
+                  int num_channels, int num_frames);
+
+  RenderGraphOptions options_;
+  std::vector<Node> nodes_;
+  std::vector<int> order_;
+  std::vector<int> roots_;
+  std::vector<int> sinks_;
+  std::vector<DelayLine> sink_delays_;  // Parallel to sinks_ if several.
+  // Node buffers, delay lines and events, a few nodes per block.
+  Arena arena_{size_t{1} << 20};
+  int delay_capacity_ = 0;
+  uint64_t latency_epoch_ = 0;
+  std::atomic<int> latency_ = 0;
+  std::unique_ptr<std::atomic<int>[]> pending_;
+  int num_frames_ = 0;
+  const MidiEvent* events_ = nullptr;
+  int num_events_ = 0;
+};
+
+// Finds the live instance of a project plugin, or returns nullptr.
+using PluginResolver = std::function<Plugin*(const PluginInstance&)>;
+
+// Finds the source of a track node, e.g. its clips, or returns nullptr.
+using SourceResolver = std::function<AudioRenderer*(const Track&)>;
+
+// Finds the player of the notes of a track, or returns nullptr.
+using NoteResolver = std::function<NotePlayer*(const Track&)>;
+
+// Finds the player of the automation of a track, or returns nullptr.
+using AutomationResolver = std::function<AutomationPlayer*(const Track&)>;
+
+// Builds a graph of project tracks -> buses -> master. Tracks and buses
+// without output_bus go to the master node. Frozen tracks get only their
+// source, which should play Track.freeze.
+absl::StatusOr<std::unique_ptr<RenderGraph>> BuildRenderGraph(
+    const Project& project, const RenderGraphOptions& options,
+    const PluginResolver& resolver, const SourceResolver& sources = nullptr,
+    const NoteResolver& notes = nullptr,
+    const AutomationResolver& automation = nullptr);
+
+// The nodes of BuildRenderGraph() before RenderGraph::Create(): one per
+// track, then per bus, then the master.
+absl::StatusOr<std::vector<RenderNodeSpec>> BuildRenderNodes(
+    const Project& project, const RenderGraphOptions& options,
+    const PluginResolver& resolver, const SourceResolver& sources = nullptr,
+    const NoteResolver& notes = nullptr,
+    const AutomationResolver& automation = nullptr);
+
+// Renders a graph on a scheduler. The engine owns it through SetRenderer(),
+// which makes replacing the graph an atomic pointer swap on the audio thread.
+class GraphRenderer : public AudioRenderer {
+ public:
+  // `scheduler` and `midi`, if set, must outlive this renderer. MIDI goes
+  // to the nodes with RenderNodeSpec::receives_midi.
+  GraphRenderer(std::unique_ptr<RenderGraph> graph, GraphScheduler* scheduler,
+                MidiInput* midi = nullptr)
+      : graph_(std::move(graph)),
+        scheduler_(scheduler),
+        midi_(midi),
+        events_(midi ? RenderGraph::kMaxEvents : 0) {}
+
+  void Render(float* const* outputs, int num_channels,
+              int num_frames) override;
+
+  // RenderGraph::latency().
+  int latency() const { return graph_->latency(); }
+
+ private:
+  std::unique_ptr<RenderGraph> graph_;
+  GraphScheduler* scheduler_;
+  MidiInput* midi_;
+  std::vector<MidiEvent> events_;
+};
+
+}  // namespace kodo
@@ -0,0 +1,299 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <numbers>
+#include <numeric>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "audio_file.h"
+#include "dsp.h"
+
+namespace kodo {
+namespace {
+
+constexpr int kMaxPhases = 4096;
+
+struct Preset {
+  int taps;
+  double attenuation_db;
+};
+
+Preset GetPreset(ResamplerQuality quality) {
+  switch (quality) {
+    case ResamplerQuality::kFast:
+      return {32, 70};
+    case ResamplerQuality::kStandard:
+      return {64, 90};
+    case ResamplerQuality::kBest:
+      return {128, 120};
+  }
+  return {64, 90};
+}
+
+// Zeroth-order modified Bessel function of the first kind.
+double BesselI0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; term > 1e-12 * sum; ++k) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+absl::StatusOr<int64_t> IntegerRate(double rate) {
+  const int64_t ret = std::llround(rate);
+  if (ret <= 0 || std::abs(rate - ret) > 1e-6) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot resample from or to ", rate, " Hz."));
+  }
+  return ret;
+}
+
+absl::Mutex filters_mu(absl::kConstInit);
+std::map<std::tuple<int, int, ResamplerQuality>,
+         std::shared_ptr<const ResamplerFilter>>& Filters()
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(filters_mu) {
+  static auto* filters =
+      new std::map<std::tuple<int, int, ResamplerQuality>,
+                   std::shared_ptr<const ResamplerFilter>>;
+  return *filters;
+}
+
+}  // namespace
+
+ResamplerFilter::ResamplerFilter(int up, int down, ResamplerQuality quality)
+    : up_(up), down_(down) {
+  const Preset preset = GetPreset(quality);
+  // Cutoff relative to the input Nyquist frequency.
+  const double scale = std::min(1.0, double(up) / down);
+  taps_ = (static_cast<int>(std::ceil(preset.taps / scale)) + 7) / 8 * 8;
+
+  // Kaiser's estimates of beta and of the transition width in cycles per
+  // input frame. The stopband starts at the lower Nyquist frequency.
+  const double beta = 0.1102 * (preset.attenuation_db - 8.7);
+  const double transition =
+      (preset.attenuation_db - 8) / (2.285 * 2 * std::numbers::pi * taps_);
+  const double cutoff = 0.5 * scale - transition / 2;
+  const double half = taps_ / 2;
+  const double window_norm = 1 / BesselI0(beta);
+
+  coefficients_.resize(static_cast<size_t>(up_) * taps_);
+  std::vector<double> phase(taps_);
+  for (int p = 0; p < up_; ++p) {
+    double sum = 0;
+    for (int t = 0; t < taps_; ++t) {
+      // Distance of input frame t from the output position.
+      const double x = double(p) / up_ + half - 1 - t;
+      const double arg = std::numbers::pi * 2 * cutoff * x;
+      const double sinc = x == 0 ? 1 : std::sin(arg) / arg;
+      const double r = x / half;
+      const double window =
+          r * r < 1 ? BesselI0(beta * std::sqrt(1 - r * r)) * window_norm : 0;
+      phase[t] = 2 * cutoff * sinc * window;
+      sum += phase[t];
+    }
+    // Unity gain at DC for every phase.
+    for (int t = 0; t < taps_; ++t) {
+      coefficients_[static_cast<size_t>(p) * taps_ + t] = phase[t] / sum;
+    }
+  }
+}
+
+absl::StatusOr<std::shared_ptr<const ResamplerFilter>> ResamplerFilter::Get(
+    double from_rate, double to_rate, ResamplerQuality quality) {
+  absl::StatusOr<int64_t> from = IntegerRate(from_rate);
+  if (!from.ok()) return from.status();
+  absl::StatusOr<int64_t> to = IntegerRate(to_rate);
+  if (!to.ok()) return to.status();
+  const int64_t gcd = std::gcd(*from, *to);
+  const int64_t up = *to / gcd;
+  const int64_t down = *from / gcd;
+  if (up > kMaxPhases || down > kMaxPhases) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Ratio ", up, "/", down, " of ", from_rate, " to ", to_rate,
+        " Hz needs too many filter phases."));
+  }
+
+  absl::MutexLock lock(&filters_mu);
+  std::shared_ptr<const ResamplerFilter>& filter =
+      Filters()[{static_cast<int>(up), static_cast<int>(down), quality}];
+  if (filter == nullptr) {
+    filter.reset(new ResamplerFilter(up, down, quality));
+  }
+  return filter;
+}
+
+void PrecomputeResamplerFilters(ResamplerQuality quality) {
+  constexpr double kRates[] = {44100, 48000, 88200, 96000};
+  for (double from : kRates) {
+    for (double to : kRates) {
+      if (from != to) ResamplerFilter::Get(from, to, quality).IgnoreError();
+    }
+  }
+}
+
+namespace {
+
+class ResamplingReader : public AudioFileReader {
+ public:
+  ResamplingReader(std::unique_ptr<AudioFileReader> source,
+                   std::shared_ptr<const ResamplerFilter> filter,
+                   double sample_rate)
+      : source_(std::move(source)),
+        filter_(std::move(filter)),
+        sample_rate_(sample_rate),
+        // Outputs up to the last position at or before the last input frame.
+        num_frames_(source_->num_frames() == 0
+                        ? 0
+                        : (source_->num_frames() - 1) * filter_->up() /
+                                  filter_->down() +
+                              1),
+        context_(source_->num_channels()) {}
+
+  double sample_rate() const override { return sample_rate_; }
+  int num_channels() const override { return source_->num_channels(); }
+  int64_t num_frames() const override { return num_frames_; }
+
+  absl::Status Read(int64_t frame, int num_frames,
+                    float* const* outputs) override {
+    if (frame < 0 || num_frames < 0 || frame + num_frames > num_frames_) {
+      return absl::OutOfRangeError(
+          absl::StrCat("Frames [", frame, ", ", frame + num_frames,
+                       ") exceed ", num_frames_));
+    }
+    if (num_frames == 0) return absl::OkStatus();
+
+    // Input frames [first, end) cover every tap, padded with silence beyond
+    // the source.
+    const ResamplerFilter& filter = *filter_;
+    const int taps = filter.taps();
+    const int64_t first = filter.Base(frame) - taps / 2 + 1;
+    const int64_t end = filter.Base(frame + num_frames - 1) + taps / 2 + 1;
+    const int64_t read_begin = std::max<int64_t>(first, 0);
+    const int64_t read_end = std::min(end, source_->num_frames());
+    std::vector<float*> channels(context_.size());
+    for (int c = 0; c < context_.size(); ++c) {
+      context_[c].assign(end - first, 0.0f);
+      channels[c] = context_[c].data() + (read_begin - first);
+    }
+    if (read_begin < read_end) {
+      if (absl::Status status = source_->Read(
+              read_begin, read_end - read_begin, channels.data());
+          !status.ok()) {
+        return status;
+      }
+    }
+
+    const DspKernels& dsp = Dsp();
+    int64_t base = filter.Base(frame);
+    int phase = filter.Phase(frame);
+    for (int i = 0; i < num_frames; ++i) {
+      const float* coefficients = filter.phase(phase);
+      const int64_t offset = base - taps / 2 + 1 - first;
+      for (int c = 0; c < context_.size(); ++c) {
+        outputs[c][i] =
+            dsp.dot(context_[c].data() + offset, coefficients, taps);
+      }
+      phase += filter.down();
+      base += phase / filter.up();
+      phase %= filter.up();
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  const std::unique_ptr<AudioFileReader> source_;
+  const std::shared_ptr<const ResamplerFilter> filter_;
+  const double sample_rate_;
+  const int64_t num_frames_;
+  std::vector<std::vector<float>> context_;
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<AudioFileReader>> ResampleAudioFile(
+    std::unique_ptr<AudioFileReader> source, double sample_rate,
+    ResamplerQuality quality) {
+  absl::StatusOr<std::shared_ptr<const ResamplerFilter>> filter =
+      ResamplerFilter::Get(source->sample_rate(), sample_rate, quality);
+  if (!filter.ok()) return filter.status();
+  return std::make_unique<ResamplingReader>(std::move(source),
+                                            std::move(*filter), sample_rate);
+}
+
+absl::StatusOr<std::unique_ptr<StreamResampler>> StreamResampler::Create(
+    double from_rate, double to_rate, int num_channels, int max_output_frames,
+    ResamplerQuality quality) {
+  absl::StatusOr<std::shared_ptr<const ResamplerFilter>> filter =
+      ResamplerFilter::Get(from_rate, to_rate, quality);
+  if (!filter.ok()) return filter.status();
+  return std::unique_ptr<StreamResampler>(new StreamResampler(
+      std::move(*filter), num_channels, max_output_frames));
+}
+
+StreamResampler::StreamResampler(std::shared_ptr<const ResamplerFilter> filter,
+                                 int num_channels, int max_output_frames)
+    : filter_(std::move(filter)),
+      num_channels_(num_channels) {
+  const int taps = filter_->taps();
+  // Silence before the first input centers output 0 on input frame 0.
+  buffered_ = taps / 2 - 1;
+  max_input_ = static_cast<int>(
+                   (int64_t{max_output_frames} * filter_->down() +
+                    filter_->up() - 1) /
+                   filter_->up()) +
+               taps;
+  history_.resize(num_channels, std::vector<float>(taps + max_input_, 0.0f));
+}
+
+int StreamResampler::InputFramesNeeded(int num_output_frames) const {
+  if (num_output_frames <= 0) return 0;
+  const int64_t last =
+      next_ + (phase_ + int64_t{num_output_frames - 1} * filter_->down()) /
+                  filter_->up();
+  return std::max<int64_t>(last + filter_->taps() - buffered_, 0);
+}
+
+void StreamResampler::Process(const float* const* inputs,
+                              int num_input_frames, float* const* outputs,
+                              int num_output_frames) {
+  const ResamplerFilter& filter = *filter_;
+  const int taps = filter.taps();
+  for (int c = 0; c < num_channels_; ++c) {
+    std::copy_n(inputs[c], num_input_frames,
+                history_[c].begin() + buffered_);
+  }
+  buffered_ += num_input_frames;
+
+  const DspKernels& dsp = Dsp();
+  for (int i = 0; i < num_output_frames; ++i) {
+    const float* coefficients = filter.phase(phase_);
+    for (int c = 0; c < num_channels_; ++c) {
+      outputs[c][i] = dsp.dot(history_[c].data() + next_, coefficients, taps);
+    }
+    phase_ += filter.down();
+    next_ += phase_ / filter.up();
+    phase_ %= filter.up();
+  }
+
+  // Drops input no later output reads.
+  for (std::vector<float>& channel : history_) {
+    std::copy(channel.begin() + next_, channel.begin() + buffered_,
+              channel.begin());
+  }
+  buffered_ -= next_;
+  next_ = 0;
+}
+
+}  // namespace kodo
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "audio_file.h"
+
+namespace kodo {
+
+// Presets trade CPU for passband width and alias rejection. Taps grow
+// by the ratio when converting down.
+enum class ResamplerQuality {
+  kFast,      // 32 taps, 70 dB stopband, flat to about 73% of Nyquist.
+  kStandard,  // 64 taps, 90 dB stopband, flat to about 82% of Nyquist.
+  kBest,      // 128 taps, 120 dB stopband, flat to about 88% of Nyquist.
+};
+
+// Kaiser-windowed sinc split into one FIR phase per output position between
+// two input frames, for a rational ratio up() / down() of sample rates.
+// Filters are immutable and shared by every converter of the same ratio.
+class ResamplerFilter {
+ public:
+  // Fails for rates whose reduced ratio needs more than 4096 phases.
+  static absl::StatusOr<std::shared_ptr<const ResamplerFilter>> Get(
+      double from_rate, double to_rate, ResamplerQuality quality);
+
+  int up() const { return up_; }
+  int down() const { return down_; }
+  // Taps per phase, a multiple of 8.
+  int taps() const { return taps_; }
+
+  // Output frame k lies at input position k * down() / up(), i.e. frame
+  // Base(k) plus phase Phase(k) / up(). Its taps apply to input frames
+  // [Base(k) - taps() / 2 + 1, Base(k) + taps() / 2].
+  int64_t Base(int64_t k) const { return k * down_ / up_; }
+  int Phase(int64_t k) const { return k * down_ % up_; }
+  const float* phase(int p) const {
+    return &coefficients_[static_cast<size_t>(p) * taps_];
+  }
+
+ private:
+  ResamplerFilter(int up, int down, ResamplerQuality quality);
+
+  int up_;
+  int down_;
+  int taps_;
+  std::vector<float> coefficients_;  // up_ x taps_.
+};
+
+// Builds the filters between 44.1, 48, 88.2 and 96 kHz ahead of use.
+void PrecomputeResamplerFilters(ResamplerQuality quality);
+
+// Converts `source` to `sample_rate` on random access. Frames near each read
+// are decoded as context, so conversion adds no latency. Not real-time safe,
+// like any AudioFileReader.
+absl::StatusOr<std::unique_ptr<AudioFileReader>> ResampleAudioFile(
+    std::unique_ptr<AudioFileReader> source, double sample_rate,
+    ResamplerQuality quality);
+
+// Streaming converter of non-interleaved blocks for the audio thread. The
+// caller asks for the input needed by each output block, so outputs always
+// come out in full. Real-time safe after Create().
+class StreamResampler {
+ public:
+  static absl::StatusOr<std::unique_ptr<StreamResampler>> Create(
+      double from_rate, double to_rate, int num_channels,
+      int max_output_frames, ResamplerQuality quality);
+
+  // Input frames the next Process() of `num_output_frames` consumes, at most
+  // max_input_frames() while `num_output_frames` <= max_output_frames.
+  int InputFramesNeeded(int num_output_frames) const;
+  int max_input_frames() const { return max_input_; }
+
+  // Consumes exactly InputFramesNeeded(num_output_frames) frames.
+  void Process(const float* const* inputs, int num_input_frames,
+               float* const* outputs, int num_output_frames);
+
+  // Input frames the caller runs ahead of what comes out: half the filter.
+  int latency() const { return filter_->taps() / 2; }
+
+ private:
+  StreamResampler(std::shared_ptr<const ResamplerFilter> filter,
+                  int num_channels, int max_output_frames);
+
+  std::shared_ptr<const ResamplerFilter> filter_;
+  int num_channels_;
+  int max_input_;
+  // Input frames kept for the filter, followed by the next block.
+  std::vector<std::vector<float>> history_;
+  int buffered_;
+  // The taps of the next output start at history_[c][next_], at phase_.
+  int next_ = 0;
+  int phase_ = 0;
+};
+
+}  // namespace kodo
@@ -0,0 +1,167 @@
+#include "rt_alloc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#ifdef KODO_RT_ALLOC_TRAP
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "absl/debugging/stacktrace.h"
+#include "absl/debugging/symbolize.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#endif
+#endif
+
+namespace kodo {
+namespace {
+
+thread_local int realtime_depth = 0;
+std::atomic<uint64_t> trapped_allocations = 0;
+
+#ifdef KODO_RT_ALLOC_TRAP
+
+thread_local bool in_trap = false;
+
+void WriteStderr(const char* text, int size) {
+  if (size > 0) write(2, text, size);
+}
+
+// Called from the allocator itself, so it formats into stack buffers and
+// writes with a raw syscall. The symbolizer does not use the heap either.
+void Trap(const char* call, size_t size) {
+  if (realtime_depth == 0 || in_trap) return;
+  in_trap = true;
+  trapped_allocations.fetch_add(1, std::memory_order_relaxed);
+  char line[512];
+  WriteStderr(line, std::snprintf(line, sizeof(line),
+                                  "%s(%zu) on a real-time thread\n", call,
+                                  size));
+  void* frames[32];
+  const int depth = absl::GetStackTrace(frames, 32, /*skip_count=*/1);
+  for (int i = 0; i < depth; ++i) {
+    char symbol[256];
+    if (!absl::Symbolize(frames[i], symbol, sizeof(symbol))) {
+      std::strcpy(symbol, "(unknown)");
+    }
+    WriteStderr(line, std::snprintf(line, sizeof(line), "    @ %p %s\n",
+                                    frames[i], symbol));
+  }
+  in_trap = false;
+}
+
+#endif
+
+}  // namespace
+
+void* Arena::Allocate(size_t size, size_t align) {
+  bytes_used_ += size;
+  auto align_up = [align](std::byte* p) {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<std::byte*>((address + align - 1) &
+                                        ~uintptr_t{align - 1});
+  };
+  if (next_ != nullptr && align_up(next_) + size <= end_) {
+    std::byte* p = align_up(next_);
+    next_ = p + size;
+    return p;
+  }
+  // make_unique value-initializes, so every block starts zeroed.
+  const size_t block = std::max(block_size_, size + align);
+  blocks_.push_back(std::make_unique<std::byte[]>(block));
+  std::byte* p = align_up(blocks_.back().get());
+  // Keep filling the current block after a large array.
+  if (size > block_size_ / 4 && next_ != nullptr) return p;
+  next_ = p + size;
+  end_ = blocks_.back().get() + block;
+  return p;
+}
+
+RealtimeScope::RealtimeScope() { ++realtime_depth; }
+
+RealtimeScope::~RealtimeScope() { --realtime_depth; }
+
+bool IsRealtimeThread() { return realtime_depth > 0; }
+
+uint64_t TrappedAllocations() {
+  return trapped_allocations.load(std::memory_order_relaxed);
+}
+
+}  // namespace kodo
+
+#ifdef KODO_RT_ALLOC_TRAP
+
+#ifdef __GLIBC__
+
+// glibc exports its allocator under these names, so the public entry points
+// can be interposed for the whole process, including C code in plugins.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t align, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) noexcept {
+  kodo::Trap("malloc", size);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+  kodo::Trap("calloc", count * size);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept {
+  kodo::Trap("realloc", size);
+  return __libc_realloc(ptr, size);
+}
+
+void* aligned_alloc(size_t align, size_t size) noexcept {
+  kodo::Trap("aligned_alloc", size);
+  return __libc_memalign(align, size);
+}
+
+int posix_memalign(void** ptr, size_t align, size_t size) noexcept {
+  kodo::Trap("posix_memalign", size);
+  void* p = __libc_memalign(align, size);
+  if (p == nullptr) return ENOMEM;
+  *ptr = p;
+  return 0;
+}
+
+void free(void* ptr) noexcept {
+  if (ptr != nullptr) kodo::Trap("free", 0);
+  __libc_free(ptr);
+}
+}
+
+#else
+
+// Elsewhere only C++ allocations are trapped. The other forms of operator
+// new and delete forward to these by default.
+void* operator new(size_t size) {
+  kodo::Trap("operator new", size);
+  if (void* p = std::malloc(size)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr != nullptr) kodo::Trap("operator delete", 0);
+  std::free(ptr);
+}
+
+#endif
+
+#endif
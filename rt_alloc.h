@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace kodo {
+
+// Monotonic allocator for buffers that live as long as their owner, e.g.
+// every node buffer of one RenderGraph. Allocation happens while building
+// on a non-real-time thread; the audio thread only touches the memory. A
+// few large blocks instead of many small vectors keep the working set
+// contiguous, and cache-line alignment keeps buffers written by different
+// workers off each other's lines. Everything is freed with the arena.
+class Arena {
+ public:
+  static constexpr size_t kCacheLine = 64;
+
+  explicit Arena(size_t block_size = size_t{1} << 16)
+      : block_size_(block_size) {}
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Zero-filled array of `n` elements. Not real-time safe.
+  template <typename T>
+  T* NewArray(size_t n, size_t align = kCacheLine) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Arena never runs destructors.");
+    return static_cast<T*>(
+        Allocate(n * sizeof(T), std::max(align, alignof(T))));
+  }
+
+  // Bytes handed out so far, excluding alignment padding.
+  size_t bytes_used() const { return bytes_used_; }
+
+ private:
+  void* Allocate(size_t size, size_t align);
+
+  const size_t block_size_;
+  std::vector<std::unique_ptr<std::byte[]>> blocks_;
+  std::byte* next_ = nullptr;
+  std::byte* end_ = nullptr;
+  size_t bytes_used_ = 0;
+};
+
+// Marks the calling thread real-time while in scope. Nests. In builds with
+// KODO_RT_ALLOC_TRAP (bazel -c dbg), malloc and free on a marked thread log
+// the call and a stack trace to stderr, and count as a trapped allocation.
+// Otherwise it only sets a thread-local counter.
+class RealtimeScope {
+ public:
+  RealtimeScope();
+  ~RealtimeScope();
+
+  RealtimeScope(const RealtimeScope&) = delete;
+  RealtimeScope& operator=(const RealtimeScope&) = delete;
+};
+
+// Whether the calling thread is inside a RealtimeScope.
+bool IsRealtimeThread();
+
+// Heap calls trapped on real-time threads since start. Always 0 without
+// KODO_RT_ALLOC_TRAP.
+uint64_t TrappedAllocations();
+
+}  // namespace kodo
@@ -0,0 +1,145 @@
+#include "shm_channel.h"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+
+#ifdef _WIN32
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+namespace kodo {
+
+void FutexWait(std::atomic<uint32_t>* word, uint32_t expected,
+               int64_t timeout_ns) {
+#ifdef __linux__
+  timespec ts;
+  ts.tv_sec = timeout_ns / 1000000000;
+  ts.tv_nsec = timeout_ns % 1000000000;
+  // Not FUTEX_PRIVATE_FLAG: the word is shared with another process.
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected,
+          &ts, nullptr, 0);
+#else
+  if (word->load(std::memory_order_acquire) != expected) return;
+  std::this_thread::sleep_for(std::chrono::nanoseconds(
+      std::min<int64_t>(timeout_ns, 50'000)));
+#endif
+}
+
+void FutexWake(std::atomic<uint32_t>* word) {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT32_MAX,
+          nullptr, nullptr, 0);
+#else
+  (void)word;  // Waiters poll.
+#endif
+}
+
+#ifdef _WIN32
+
+absl::StatusOr<std::unique_ptr<ShmRegion>> ShmRegion::Create(
+    const std::string& name, size_t size) {
+  return absl::UnimplementedError("Shared memory is not supported yet.");
+}
+
+absl::StatusOr<std::unique_ptr<ShmRegion>> ShmRegion::Open(
+    const std::string& name) {
+  return absl::UnimplementedError("Shared memory is not supported yet.");
+}
+
+ShmRegion::~ShmRegion() {}
+
+void ShmRegion::Unlink() {}
+
+#else
+
+absl::StatusOr<std::unique_ptr<ShmRegion>> ShmRegion::Create(
+    const std::string& name, size_t size) {
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return absl::InternalError(
+        absl::StrCat("shm_open(", name, "): ", std::strerror(errno)));
+  }
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    return absl::InternalError(
+        absl::StrCat("ftruncate(", name, "): ", std::strerror(errno)));
+  }
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return absl::InternalError(
+        absl::StrCat("mmap(", name, "): ", std::strerror(errno)));
+  }
+  // Never page-fault on the audio thread.
+  mlock(data, size);
+
+  std::unique_ptr<ShmRegion> ret(new ShmRegion);
+  ret->name_ = name;
+  ret->data_ = data;
+  ret->size_ = size;
+  ret->owner_ = true;
+  return ret;
+}
+
+absl::StatusOr<std::unique_ptr<ShmRegion>> ShmRegion::Open(
+    const std::string& name) {
+  int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd < 0) {
+    return absl::NotFoundError(
+        absl::StrCat("shm_open(", name, "): ", std::strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return absl::InternalError(
+        absl::StrCat("fstat(", name, "): ", std::strerror(errno)));
+  }
+  void* data =
+      mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return absl::InternalError(
+        absl::StrCat("mmap(", name, "): ", std::strerror(errno)));
+  }
+  mlock(data, st.st_size);
+
+  std::unique_ptr<ShmRegion> ret(new ShmRegion);
+  ret->name_ = name;
+  ret->data_ = data;
+  ret->size_ = st.st_size;
+  return ret;
+}
+
+ShmRegion::~ShmRegion() {
+  Unlink();
+  if (data_) munmap(data_, size_);
+}
+
+void ShmRegion::Unlink() {
+  if (!owner_) return;
+  shm_unlink(name_.c_str());
+  owner_ = false;
+}
+
+#endif
+
+}  // namespace kodo
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "midi_event.h"
+#include "param_changes.h"
+
+namespace kodo {
+
+// Blocks until `*word != expected`, a wake-up or `timeout_ns` elapses.
+// Uses futex on Linux so the word may live in memory shared across
+// processes; other platforms fall back to a short sleep.
+void FutexWait(std::atomic<uint32_t>* word, uint32_t expected,
+               int64_t timeout_ns);
+// Wakes every waiter of `word`.
+void FutexWake(std::atomic<uint32_t>* word);
+
+// POSIX shared memory mapped into this process.
+class ShmRegion {
+ public:
+  // Creates a new region and owns its name until Unlink().
+  static absl::StatusOr<std::unique_ptr<ShmRegion>> Create(
+      const std::string& name, size_t size);
+  // Maps an existing region created by another process.
+  static absl::StatusOr<std::unique_ptr<ShmRegion>> Open(
+      const std::string& name);
+
+  ~ShmRegion();
+
+  // Removes the name. The mapping stays valid in every process.
+  void Unlink();
+
+  void* data() const { return data_; }
+  size_t size() const { return size_; }
+  const std::string& name() const { return name_; }
+
+ private:
+  ShmRegion() {}
+
+  std::string name_;
+  void* data_ = nullptr;
+  size_t size_ = 0;
+  bool owner_ = false;
+};
+
+// Layout of the memory shared between AudioEngine and a plugin_host
+// process. Audio blocks travel through a ring of kSlots; the engine
+// publishes sequence numbers in `request` and the host acknowledges them in
+// `response`, both used as futex words.
+struct SandboxShm {
+  static constexpr uint32_t kMagic = 0x6b6f646f;  // "kodo"
+  static constexpr int kSlots = 4;
+  static constexpr int kChannels = 2;
+  static constexpr int kMaxParams = 128;
+  static constexpr int kMaxEvents = 256;
+
+  enum Command : int32_t {
+    kNone = 0,
+    kSetupProcessing,  // arg: max block size. Reads `sample_rate`, `offline`.
+    kSetActive,        // arg: 0 or 1.
+    kEmbedEditor,      // arg: native parent window, 0 to remove.
+    kQuit,
+  };
+  enum State : int32_t { kStarting = 0, kReady, kFailed };
+
+  struct Slot {
+    int32_t num_frames;
+    int32_t num_params;
+    int32_t num_events;
+    int32_t ok;
+    ParamChange params[kMaxParams];
+    MidiEvent events[kMaxEvents];
+  };
+
+  uint32_t magic;
+  int32_t max_block_size;  // Capacity of every slot channel.
+  double sample_rate;
+  int32_t offline;  // ProcessSetup::offline.
+
+  std::atomic<int32_t> state;
+  // Main-bus channel counts reported by the host after setup.
+  int32_t num_inputs;
+  int32_t num_outputs;
+  // Plugin::latency(), kept current by the host.
+  std::atomic<int32_t> latency;
+
+  // Audio blocks: engine -> host and host -> engine.
+  std::atomic<uint32_t> request;
+  std::atomic<uint32_t> response;
+
+  // Control commands, one at a time: engine bumps `command_seq`, the host
+  // copies it to `command_done` when finished.
+  std::atomic<int32_t> command;
+  std::atomic<uint64_t> command_arg;
+  std::atomic<uint32_t> command_seq;
+  std::atomic<uint32_t> command_done;
+  std::atomic<int32_t> command_ok;
+
+  Slot slots[kSlots];
+
+  // Followed by float audio[kSlots][2 * kChannels][max_block_size], inputs
+  // first.
+  static size_t Size(int max_block_size) {
+    return sizeof(SandboxShm) +
+           sizeof(float) * kSlots * 2 * kChannels * max_block_size;
+  }
+  float* channel(int slot, bool output, int c) {
+    float* audio = reinterpret_cast<float*>(this + 1);
+    const int index = (slot * 2 + (output ? 1 : 0)) * kChannels + c;
+    return audio + static_cast<size_t>(index) * max_block_size;
+  }
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "futex words must be plain 32-bit integers.");
+
+}  // namespace kodo
@@ -0,0 +1,162 @@
+#include "spectrum_analyzer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <numbers>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "dsp.h"
+
+namespace kodo {
+
+absl::StatusOr<std::unique_ptr<SpectrumAnalyzer>> SpectrumAnalyzer::Create(
+    const SpectrumOptions& options) {
+  const int n = options.fft_size;
+  if (n < 2 || (n & (n - 1)) != 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("FFT size ", n, " is not a power of two."));
+  }
+  return std::unique_ptr<SpectrumAnalyzer>(new SpectrumAnalyzer(options));
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer(const SpectrumOptions& options)
+    : options_(options),
+      // Frames of several intervals and blocks, so none drop in practice.
+      capacity_(4 * std::max(options.fft_size, 4096)),
+      ring_(capacity_),
+      window_(options.fft_size),
+      hann_(options.fft_size),
+      twiddles_(options.fft_size / 2),
+      bit_reversed_(options.fft_size),
+      bins_(options.fft_size),
+      spectrum_(std::vector<float>(options.fft_size / 2, options.floor_db)) {
+  const int n = options_.fft_size;
+  for (int i = 0; i < n; ++i) {
+    hann_[i] = 0.5 - 0.5 * std::cos(2 * std::numbers::pi * i / n);
+  }
+  for (int k = 0; k < n / 2; ++k) {
+    twiddles_[k] = std::polar(1.0, -2 * std::numbers::pi * k / n);
+  }
+  int bits = 0;
+  while ((1 << bits) < n) ++bits;
+  for (int i = 0; i < n; ++i) {
+    int r = 0;
+    for (int b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+    bit_reversed_[i] = r;
+  }
+  thread_ = std::thread(&SpectrumAnalyzer::Loop, this);
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer() {
+  {
+    absl::MutexLock lock(&mu_);
+    quit_ = true;
+  }
+  thread_.join();
+}
+
+void SpectrumAnalyzer::SetVisible(bool visible) {
+  absl::MutexLock lock(&mu_);
+  if (visible && !visible_) reset_ = true;
+  visible_ = visible;
+  writing_.store(visible, std::memory_order_relaxed);
+}
+
+void SpectrumAnalyzer::Write(const float* const* channels, int num_channels,
+                             int num_frames) {
+  if (!writing_.load(std::memory_order_relaxed) || num_channels <= 0) return;
+  const int64_t write = write_.load(std::memory_order_relaxed);
+  if (write - read_.load(std::memory_order_acquire) + num_frames >
+      capacity_) {
+    return;  // The worker is behind; the display skips these frames.
+  }
+  const float gain = 1.0f / num_channels;
+  const int pos = write % capacity_;
+  const int head = std::min(num_frames, capacity_ - pos);
+  std::fill_n(ring_.data() + pos, head, 0.0f);
+  std::fill_n(ring_.data(), num_frames - head, 0.0f);
+  for (int c = 0; c < num_channels; ++c) {
+    Dsp().add_scaled(channels[c], gain, ring_.data() + pos, head);
+    Dsp().add_scaled(channels[c] + head, gain, ring_.data(),
+                     num_frames - head);
+  }
+  write_.store(write + num_frames, std::memory_order_release);
+}
+
+void SpectrumAnalyzer::Loop() {
+  while (true) {
+    {
+      absl::MutexLock lock(&mu_);
+      // Hidden, nothing is written and nothing needs transforming.
+      mu_.Await(absl::Condition(this, &SpectrumAnalyzer::Running));
+      if (quit_) return;
+      if (std::exchange(reset_, false)) {
+        std::fill(window_.begin(), window_.end(), 0.0f);
+        read_.store(write_.load(std::memory_order_acquire),
+                    std::memory_order_release);
+      }
+    }
+    if (Drain()) Transform();
+    absl::MutexLock lock(&mu_);
+    mu_.AwaitWithTimeout(absl::Condition(&quit_), options_.interval);
+  }
+}
+
+bool SpectrumAnalyzer::Drain() {
+  const int64_t read = read_.load(std::memory_order_relaxed);
+  const int64_t write = write_.load(std::memory_order_acquire);
+  if (write == read) return false;
+  const int n = options_.fft_size;
+  // Only the last n frames matter; older ones are skipped.
+  const int64_t from = std::max(read, write - n);
+  const int count = write - from;
+  std::copy(window_.begin() + count, window_.end(), window_.begin());
+  const int pos = from % capacity_;
+  const int head = std::min(count, capacity_ - pos);
+  float* dst = window_.data() + n - count;
+  std::copy_n(ring_.data() + pos, head, dst);
+  std::copy_n(ring_.data(), count - head, dst + head);
+  read_.store(write, std::memory_order_release);
+  return true;
+}
+
+void SpectrumAnalyzer::Transform() {
+  const int n = options_.fft_size;
+  for (int i = 0; i < n; ++i) {
+    bins_[bit_reversed_[i]] = window_[i] * hann_[i];
+  }
+  // Iterative radix-2 decimation in time.
+  for (int size = 2; size <= n; size *= 2) {
+    const int half = size / 2;
+    const int stride = n / size;
+    for (int start = 0; start < n; start += size) {
+      for (int k = 0; k < half; ++k) {
+        const std::complex<float> t =
+            twiddles_[k * stride] * bins_[start + k + half];
+        bins_[start + k + half] = bins_[start + k] - t;
+        bins_[start + k] += t;
+      }
+    }
+  }
+  // A full-scale sine reads 0 dB: the Hann window sums to n / 2.
+  const float scale = 4.0f / n;
+  std::vector<float>& spectrum = spectrum_.back();
+  for (int k = 0; k < n / 2; ++k) {
+    const float magnitude = std::abs(bins_[k]) * scale;
+    spectrum[k] = magnitude > 0 ? std::max(20 * std::log10(magnitude),
+                                           options_.floor_db)
+                                : options_.floor_db;
+  }
+  spectrum_.Publish();
+}
+
+}  // namespace kodo
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "triple_buffer.h"
+
+namespace kodo {
+
+struct SpectrumOptions {
+  // Frames per transform, a power of two.
+  int fft_size = 2048;
+  // Of the analyzed signal, for bin frequencies only.
+  double sample_rate = 48000;
+  // How often the worker transforms the latest frames while visible.
+  absl::Duration interval = absl::Milliseconds(16);
+  // Quieter bins read as this.
+  float floor_db = -120;
+};
+
+// Magnitude spectrum of a signal written by the audio thread, transformed
+// on a worker thread and handed to the GUI through a TripleBuffer. While
+// hidden, Write() returns at once and the worker sleeps, so an analyzer
+// nobody looks at costs nothing.
+class SpectrumAnalyzer {
+ public:
+  static absl::StatusOr<std::unique_ptr<SpectrumAnalyzer>> Create(
+      const SpectrumOptions& options);
+  ~SpectrumAnalyzer();
+
+  // Any thread. Showing starts over from silence.
+  void SetVisible(bool visible) ABSL_LOCKS_EXCLUDED(mu_);
+  bool visible() const { return writing_.load(std::memory_order_relaxed); }
+
+  // Audio thread. Appends the mean of `channels[num_channels][num_frames]`
+  // while visible. Drops frames if the worker falls behind.
+  void Write(const float* const* channels, int num_channels, int num_frames);
+
+  // GUI thread. Switches spectrum() to the latest transform, if any.
+  bool Update() { return spectrum_.Update(); }
+  // GUI thread. Level in dBFS of fft_size / 2 bins; bin k is centred at
+  // k * bin_hz().
+  const std::vector<float>& spectrum() const { return spectrum_.front(); }
+  double bin_hz() const { return options_.sample_rate / options_.fft_size; }
+  const SpectrumOptions& options() const { return options_; }
+
+ private:
+  explicit SpectrumAnalyzer(const SpectrumOptions& options);
+
+  void Loop() ABSL_LOCKS_EXCLUDED(mu_);
+  bool Running() const ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+    return visible_ || quit_;
+  }
+  // Moves the written frames into window_. Returns whether any were new.
+  bool Drain();
+  // Publishes the spectrum of window_.
+  void Transform();
+
+  const SpectrumOptions options_;
+  const int capacity_;
+
+  // Written by the audio thread, drained by the worker, as AheadBuffer.
+  std::vector<float> ring_;
+  std::atomic<int64_t> write_ = 0;
+  std::atomic<int64_t> read_ = 0;
+  std::atomic<bool> writing_ = false;
+
+  // Worker only. The last fft_size frames, oldest first, and the tables of
+  // the transform.
+  std::vector<float> window_;
+  std::vector<float> hann_;
+  std::vector<std::complex<float>> twiddles_;
+  std::vector<int> bit_reversed_;
+  std::vector<std::complex<float>> bins_;
+
+  TripleBuffer<std::vector<float>> spectrum_;
+
+  absl::Mutex mu_;
+  bool visible_ ABSL_GUARDED_BY(mu_) = false;
+  // Set by showing, so the worker forgets what it drained before.
+  bool reset_ ABSL_GUARDED_BY(mu_) = false;
+  bool quit_ ABSL_GUARDED_BY(mu_) = false;
+  std::thread thread_;
+};
+
+}  // namespace kodo
@@ -0,0 +1,102 @@
+#include "spectrum_analyzer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numbers>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace kodo {
+namespace {
+
+constexpr int kFftSize = 1024;
+
+std::unique_ptr<SpectrumAnalyzer> MakeAnalyzer() {
+  SpectrumOptions options;
+  options.fft_size = kFftSize;
+  options.interval = absl::Milliseconds(1);
+  absl::StatusOr<std::unique_ptr<SpectrumAnalyzer>> analyzer =
+      SpectrumAnalyzer::Create(options);
+  EXPECT_TRUE(analyzer.ok()) << analyzer.status();
+  return *std::move(analyzer);
+}
+
+// Appends a sine centred on `bin` to `x`, continuing its phase.
+void AppendSine(std::vector<float>& x, int num_frames, int bin) {
+  const int start = x.size();
+  for (int i = start; i < start + num_frames; ++i) {
+    x.push_back(std::sin(2 * std::numbers::pi * bin * i / kFftSize));
+  }
+}
+
+// Writes `block` as the audio thread would until the worker publishes a
+// transform, or a second passes.
+bool WriteUntilUpdate(SpectrumAnalyzer& analyzer,
+                      const std::vector<float>& block) {
+  const absl::Time deadline = absl::Now() + absl::Seconds(1);
+  while (absl::Now() < deadline) {
+    const float* channels[] = {block.data()};
+    analyzer.Write(channels, 1, block.size());
+    absl::SleepFor(absl::Milliseconds(2));
+    if (analyzer.Update()) return true;
+  }
+  return false;
+}
+
+int PeakBin(const std::vector<float>& spectrum) {
+  return std::max_element(spectrum.begin(), spectrum.end()) -
+         spectrum.begin();
+}
+
+TEST(SpectrumAnalyzerTest, RejectsSizesOtherThanPowersOfTwo) {
+  SpectrumOptions options;
+  options.fft_size = 1000;
+  EXPECT_FALSE(SpectrumAnalyzer::Create(options).ok());
+}
+
+TEST(SpectrumAnalyzerTest, FullScaleSineReadsZeroDb) {
+  std::unique_ptr<SpectrumAnalyzer> analyzer = MakeAnalyzer();
+  analyzer->SetVisible(true);
+  std::vector<float> block;
+  AppendSine(block, kFftSize, 64);
+  ASSERT_TRUE(WriteUntilUpdate(*analyzer, block));
+  const std::vector<float>& spectrum = analyzer->spectrum();
+  ASSERT_EQ(spectrum.size(), kFftSize / 2);
+  EXPECT_EQ(PeakBin(spectrum), 64);
+  EXPECT_NEAR(spectrum[64], 0.0f, 0.1f);
+  // Far from the sine only the leakage of the window remains.
+  EXPECT_LT(spectrum[300], -60.0f);
+}
+
+// Drain() keeps only the last fft_size frames of each write.
+TEST(SpectrumAnalyzerTest, TransformsOnlyTheLatestFrames) {
+  std::unique_ptr<SpectrumAnalyzer> analyzer = MakeAnalyzer();
+  analyzer->SetVisible(true);
+  std::vector<float> block;
+  AppendSine(block, 3 * kFftSize, 200);
+  AppendSine(block, kFftSize, 32);
+  ASSERT_TRUE(WriteUntilUpdate(*analyzer, block));
+  const std::vector<float>& spectrum = analyzer->spectrum();
+  EXPECT_EQ(PeakBin(spectrum), 32);
+  EXPECT_LT(spectrum[200], -60.0f);
+}
+
+TEST(SpectrumAnalyzerTest, HiddenAnalyzerPublishesNothing) {
+  std::unique_ptr<SpectrumAnalyzer> analyzer = MakeAnalyzer();
+  std::vector<float> block;
+  AppendSine(block, kFftSize, 64);
+  for (int i = 0; i < 10; ++i) {
+    const float* channels[] = {block.data()};
+    analyzer->Write(channels, 1, block.size());
+    absl::SleepFor(absl::Milliseconds(2));
+  }
+  EXPECT_FALSE(analyzer->Update());
+  EXPECT_EQ(analyzer->spectrum()[64], analyzer->options().floor_db);
+}
+
+}  // namespace
+}  // namespace kodo
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace kodo {
+
+// Fixed-capacity wait-free queue for one producer thread and one consumer
+// thread. Neither Push() nor Pop() locks or allocates, so both sides may be
+// the real-time audio thread.
+template <class T, size_t N>
+class SpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two.");
+  static_assert(std::is_trivially_copyable_v<T>,
+                "T is copied on the audio thread.");
+
+ public:
+  // Returns false without blocking when the queue is full.
+  bool Push(const T& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == N) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == N) return false;
+    }
+    buffer_[tail & (N - 1)] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false without blocking when the queue is empty.
+  bool Pop(T* value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) return false;
+    }
+    *value = buffer_[head & (N - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate number of elements. Exact only when both sides are idle.
+  size_t Size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  bool Empty() const { return Size() == 0; }
+
+  static constexpr size_t Capacity() { return N; }
+
+ private:
+  static constexpr size_t kCacheLine = 64;
+
+  // Consumer side.
+  alignas(kCacheLine) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;
+  // Producer side.
+  alignas(kCacheLine) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;
+
+  alignas(kCacheLine) std::array<T, N> buffer_{};
+};
+
+}  // namespace kodo
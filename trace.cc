@@ -0,0 +1,382 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "absl/base/const_init.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "perf_counters.h"
+#include "perfetto_trace.pb.h"
+
+namespace kodo {
+namespace trace_internal {
+
+// Fields are atomics so that WriteTrace() may copy them while the owner
+// overwrites old events; the counters of Buffer tell which copies are
+// intact.
+struct Event {
+  std::atomic<const char*> name = nullptr;
+  std::atomic<uint64_t> begin = 0;
+  std::atomic<uint64_t> end = 0;  // 0 for instants.
+};
+
+struct Buffer {
+  int capacity = 0;
+  std::unique_ptr<Event[]> events;
+  std::atomic<bool> in_use = false;
+  std::atomic<const char*> name = nullptr;
+  // Events whose writing started and completed. Event i lives at
+  // i % capacity, so [started - capacity, committed) are intact.
+  std::atomic<uint64_t> started = 0;
+  std::atomic<uint64_t> committed = 0;
+};
+
+}  // namespace trace_internal
+
+namespace {
+
+using trace_internal::Buffer;
+using trace_internal::Event;
+
+struct Pool {
+  explicit Pool(const TraceOptions& options)
+      : buffers(std::max(options.max_threads, 1)), origin(CycleCount()) {
+    for (Buffer& buffer : buffers) {
+      buffer.capacity = std::max(options.events_per_thread, 1);
+      buffer.events = std::make_unique<Event[]>(buffer.capacity);
+    }
+  }
+
+  std::vector<Buffer> buffers;
+  const uint64_t origin;
+};
+
+ABSL_CONST_INIT absl::Mutex mu(absl::kConstInit);
+// Never freed, as threads may record until the process exits.
+std::atomic<Pool*> pool = nullptr;
+
+thread_local Buffer* thread_buffer = nullptr;
+thread_local const char* thread_name = nullptr;
+// Whether every buffer was taken when this thread looked for one.
+thread_local bool no_buffer = false;
+
+// Claims a free buffer named `name`, or returns nullptr, setting `*full` if
+// every buffer was taken.
+Buffer* TakeBuffer(const char* name, bool* full) {
+  Pool* traced = pool.load(std::memory_order_acquire);
+  if (traced == nullptr) return nullptr;
+  for (Buffer& buffer : traced->buffers) {
+    bool expected = false;
+    if (buffer.in_use.compare_exchange_strong(expected, true,
+                                              std::memory_order_acq_rel)) {
+      buffer.name.store(name, std::memory_order_relaxed);
+      return &buffer;
+    }
+  }
+  *full = true;
+  return nullptr;
+}
+
+Buffer* ThreadBuffer() {
+  if (thread_buffer == nullptr && !no_buffer) {
+    thread_buffer = TakeBuffer(thread_name, &no_buffer);
+  }
+  return thread_buffer;
+}
+
+void Record(const char* name, uint64_t begin, uint64_t end) {
+  if (!TracingEnabled()) return;
+  Buffer* buffer = ThreadBuffer();
+  if (buffer == nullptr) return;
+  const uint64_t index = buffer->committed.load(std::memory_order_relaxed);
+  buffer->started.store(index + 1, std::memory_order_relaxed);
+  // Readers seeing any store below also see `started`.
+  std::atomic_thread_fence(std::memory_order_release);
+  Event& event = buffer->events[index % buffer->capacity];
+  event.name.store(name, std::memory_order_relaxed);
+  event.begin.store(begin, std::memory_order_relaxed);
+  event.end.store(end, std::memory_order_relaxed);
+  buffer->committed.store(index + 1, std::memory_order_release);
+}
+
+struct CopiedEvent {
+  const char* name;
+  uint64_t begin;
+  uint64_t end;
+};
+
+struct ThreadTrace {
+  int tid = 0;
+  std::string name;
+  // By begin, enclosing slices first.
+  std::vector<CopiedEvent> events;
+};
+
+// Copies the intact events of every buffer used so far.
+std::vector<ThreadTrace> Snapshot(const Pool& traced) {
+  std::vector<ThreadTrace> ret;
+  for (int k = 0; k < traced.buffers.size(); ++k) {
+    const Buffer& buffer = traced.buffers[k];
+    const uint64_t committed =
+        buffer.committed.load(std::memory_order_acquire);
+    if (committed == 0) continue;
+    const uint64_t capacity = buffer.capacity;
+    const uint64_t from = committed > capacity ? committed - capacity : 0;
+    std::vector<CopiedEvent> events;
+    events.reserve(committed - from);
+    for (uint64_t i = from; i < committed; ++i) {
+      const Event& event = buffer.events[i % capacity];
+      events.push_back({event.name.load(std::memory_order_relaxed),
+                        event.begin.load(std::memory_order_relaxed),
+                        event.end.load(std::memory_order_relaxed)});
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Drops what the owner overwrote while we copied.
+    const uint64_t started = buffer.started.load(std::memory_order_relaxed);
+    if (started > from + capacity) {
+      events.erase(events.begin(),
+                   events.begin() + std::min<uint64_t>(
+                                        started - capacity - from,
+                                        events.size()));
+    }
+    std::sort(events.begin(), events.end(),
+              [](const CopiedEvent& a, const CopiedEvent& b) {
+                if (a.begin != b.begin) return a.begin < b.begin;
+                return a.end > b.end;
+              });
+    ThreadTrace& thread = ret.emplace_back();
+    thread.tid = k + 1;
+    const char* name = buffer.name.load(std::memory_order_relaxed);
+    thread.name = name ? name : absl::StrCat("Thread ", thread.tid);
+    thread.events = std::move(events);
+  }
+  return ret;
+}
+
+std::string JsonString(std::string_view text) {
+  std::string ret = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      ret.push_back('\\');
+      ret.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      absl::StrAppendFormat(&ret, "\\u%04x", static_cast<int>(c));
+    } else {
+      ret.push_back(c);
+    }
+  }
+  ret.push_back('"');
+  return ret;
+}
+
+void WriteChromeJson(const std::vector<ThreadTrace>& threads,
+                     double ns_per_cycle, uint64_t origin,
+                     std::ostream& output) {
+  auto us = [&](uint64_t cycles) {
+    return (cycles - std::min(cycles, origin)) * ns_per_cycle / 1000;
+  };
+  output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+         << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"args\":{\"name\":\"kodo\"}}";
+  for (const ThreadTrace& thread : threads) {
+    output << absl::StrFormat(
+        ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+        "\"args\":{\"name\":%s}}",
+        thread.tid, JsonString(thread.name));
+    for (const CopiedEvent& event : thread.events) {
+      if (event.end == 0) {
+        output << absl::StrFormat(
+            ",\n{\"name\":%s,\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.3f}",
+            JsonString(event.name), thread.tid, us(event.begin));
+      } else {
+        output << absl::StrFormat(
+            ",\n{\"name\":%s,\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+            "\"dur\":%.3f}",
+            JsonString(event.name), thread.tid, us(event.begin),
+            (event.end - event.begin) * ns_per_cycle / 1000);
+      }
+    }
+  }
+  output << "\n]}\n";
+}
+
+void WritePerfetto(const std::vector<ThreadTrace>& threads,
+                   double ns_per_cycle, uint64_t origin,
+                   std::ostream& output) {
+  google::protobuf::io::OstreamOutputStream raw(&output);
+  google::protobuf::io::CodedOutputStream coded(&raw);
+  // Streams the repeated Trace.packet field, so the trace never has to fit
+  // in one message.
+  auto write = [&](const perfetto::TracePacket& packet) {
+    coded.WriteTag(10);  // Field 1, length-delimited.
+    coded.WriteVarint32(packet.ByteSizeLong());
+    packet.SerializeWithCachedSizes(&coded);
+  };
+  auto ns = [&](uint64_t cycles) -> uint64_t {
+    return (cycles - std::min(cycles, origin)) * ns_per_cycle;
+  };
+  constexpr uint64_t kProcessTrack = 1;
+  perfetto::TracePacket process;
+  perfetto::TrackDescriptor* track = process.mutable_track_descriptor();
+  track->set_uuid(kProcessTrack);
+  track->mutable_process()->set_pid(1);
+  track->mutable_process()->set_process_name("kodo");
+  write(process);
+
+  for (const ThreadTrace& thread : threads) {
+    const uint64_t uuid = kProcessTrack + thread.tid;
+    perfetto::TracePacket descriptor;
+    descriptor.set_trusted_packet_sequence_id(thread.tid);
+    descriptor.set_sequence_flags(1);
+    perfetto::ThreadDescriptor* thread_track =
+        descriptor.mutable_track_descriptor()->mutable_thread();
+    descriptor.mutable_track_descriptor()->set_uuid(uuid);
+    thread_track->set_pid(1);
+    thread_track->set_tid(thread.tid);
+    thread_track->set_thread_name(thread.name);
+    write(descriptor);
+
+    auto write_event = [&](perfetto::TrackEvent::Type type, uint64_t cycles,
+                           const char* name) {
+      perfetto::TracePacket packet;
+      packet.set_trusted_packet_sequence_id(thread.tid);
+      packet.set_timestamp(ns(cycles));
+      perfetto::TrackEvent* event = packet.mutable_track_event();
+      event->set_type(type);
+      event->set_track_uuid(uuid);
+      if (name) event->set_name(name);
+      write(packet);
+    };
+    // Ends of the open slices, innermost last.
+    std::vector<uint64_t> open;
+    auto close_until = [&](uint64_t cycles) {
+      while (!open.empty() && open.back() <= cycles) {
+        write_event(perfetto::TrackEvent::TYPE_SLICE_END, open.back(),
+                    nullptr);
+        open.pop_back();
+      }
+    };
+    for (const CopiedEvent& event : thread.events) {
+      close_until(event.begin);
+      if (event.end == 0) {
+        write_event(perfetto::TrackEvent::TYPE_INSTANT, event.begin,
+                    event.name);
+        continue;
+      }
+      write_event(perfetto::TrackEvent::TYPE_SLICE_BEGIN, event.begin,
+                  event.name);
+      // A slice overlapping its parent's end, e.g. across a lost event,
+      // is cut there to keep the nesting.
+      open.push_back(open.empty() ? event.end
+                                  : std::min(event.end, open.back()));
+    }
+    close_until(UINT64_MAX);
+  }
+}
+
+}  // namespace
+
+void StartTracing(const TraceOptions& options) {
+  absl::MutexLock lock(&mu);
+  if (pool.load(std::memory_order_relaxed) == nullptr) {
+    pool.store(new Pool(options), std::memory_order_release);
+    LOG(INFO) << "Tracing " << options.max_threads << " threads of "
+              << options.events_per_thread << " events";
+  }
+  trace_internal::enabled.store(true, std::memory_order_relaxed);
+}
+
+void StopTracing() {
+  trace_internal::enabled.store(false, std::memory_order_relaxed);
+}
+
+const char* InternTraceName(std::string_view name) {
+  static auto* names = new std::unordered_set<std::string>;
+  absl::MutexLock lock(&mu);
+  return names->emplace(name).first->c_str();
+}
+
+void SetTraceThreadName(const char* name) {
+  thread_name = name;
+  if (thread_buffer) {
+    thread_buffer->name.store(name, std::memory_order_relaxed);
+  }
+}
+
+void AddTraceEvent(const char* name, uint64_t begin, uint64_t end) {
+  // Keeps end == 0 for instants.
+  Record(name, begin, std::max<uint64_t>(end, 1));
+}
+
+void AddTraceInstant(const char* name) {
+  if (TracingEnabled()) Record(name, CycleCount(), 0);
+}
+
+TraceThread::~TraceThread() {
+  thread_name = nullptr;
+  if (thread_buffer) {
+    thread_buffer->in_use.store(false, std::memory_order_release);
+    thread_buffer = nullptr;
+  }
+}
+
+TraceTrack::~TraceTrack() {
+  if (buffer_) buffer_->in_use.store(false, std::memory_order_release);
+}
+
+TraceTrackScope::TraceTrackScope(TraceTrack& track)
+    : previous_buffer_(thread_buffer), previous_no_buffer_(no_buffer) {
+  if (track.buffer_ == nullptr && !track.full_ && TracingEnabled()) {
+    track.buffer_ = TakeBuffer(track.name_, &track.full_);
+  }
+  thread_buffer = track.buffer_;
+  // Without a buffer of the track, records nothing rather than taking one.
+  no_buffer = true;
+}
+
+TraceTrackScope::~TraceTrackScope() {
+  thread_buffer = previous_buffer_;
+  no_buffer = previous_no_buffer_;
+}
+
+absl::Status WriteTrace(const std::string& path) {
+  const Pool* traced = pool.load(std::memory_order_acquire);
+  if (traced == nullptr) {
+    return absl::FailedPreconditionError("Tracing never started.");
+  }
+  const std::vector<ThreadTrace> threads = Snapshot(*traced);
+  const double ns_per_cycle = 1e9 / CyclesPerSecond();
+  {
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (absl::EndsWith(path, ".json")) {
+      WriteChromeJson(threads, ns_per_cycle, traced->origin, output);
+    } else {
+      WritePerfetto(threads, ns_per_cycle, traced->origin, output);
+    }
+    if (!output) {
+      return absl::InternalError(absl::StrCat("Cannot write ", path));
+    }
+  }
+  size_t num_events = 0;
+  for (const ThreadTrace& thread : threads) num_events += thread.events.size();
+  LOG(INFO) << "Wrote " << num_events << " trace events of " << threads.size()
+            << " threads to " << path;
+  return absl::OkStatus();
+}
+
+}  // namespace kodo
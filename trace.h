@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "absl/status/status.h"
+#include "perf_counters.h"
+
+namespace kodo {
+
+struct TraceOptions {
+  // Events kept per thread. Older ones are overwritten.
+  int events_per_thread = 1 << 15;
+  // Threads traced at once. Threads beyond these record nothing.
+  int max_threads = 64;
+};
+
+namespace trace_internal {
+inline std::atomic<bool> enabled = false;
+struct Buffer;
+}  // namespace trace_internal
+
+// Starts recording trace events. The first call allocates the buffers of
+// `options`, which later calls keep. Not real-time safe.
+void StartTracing(const TraceOptions& options = {});
+// Stops recording. The buffers keep their events for WriteTrace().
+void StopTracing();
+inline bool TracingEnabled() {
+  return trace_internal::enabled.load(std::memory_order_relaxed);
+}
+
+// A copy of `name` that lives as long as the process, e.g. of a graph node
+// for events outliving its graph. Not real-time safe.
+const char* InternTraceName(std::string_view name);
+
+// The following record into a buffer of the calling thread, taken on its
+// first event. They never lock or allocate, so the audio thread may call
+// them. Names must live as long as the process, e.g. literals.
+
+// Names the track of the calling thread, e.g. from a callback on a thread
+// the engine does not own.
+void SetTraceThreadName(const char* name);
+// A slice between two CycleCount() readings.
+void AddTraceEvent(const char* name, uint64_t begin, uint64_t end);
+// A point in time, e.g. a work steal.
+void AddTraceInstant(const char* name);
+
+// Records a slice over its lifetime while tracing.
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name)
+      : name_(TracingEnabled() ? name : nullptr),
+        begin_(name_ ? CycleCount() : 0) {}
+  ~TraceScope() {
+    if (name_) AddTraceEvent(name_, begin_, CycleCount());
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* const name_;
+  const uint64_t begin_;
+};
+
+// Names the calling thread for its lifetime, on a thread function's stack.
+// Frees its buffer on exit for the next thread, whose track then continues
+// it, e.g. the workers of a rebuilt scheduler.
+class TraceThread {
+ public:
+  explicit TraceThread(const char* name) { SetTraceThreadName(name); }
+  ~TraceThread();
+
+  TraceThread(const TraceThread&) = delete;
+  TraceThread& operator=(const TraceThread&) = delete;
+};
+
+// A buffer shared by threads recording one at a time, e.g. the callbacks of
+// an audio stream, whose thread changes as the stream reopens. Taken on the
+// first event while tracing, and kept until destroyed, so the track does not
+// cost a buffer per thread.
+class TraceTrack {
+ public:
+  explicit TraceTrack(const char* name) : name_(name) {}
+  // No thread may be recording into it.
+  ~TraceTrack();
+
+  TraceTrack(const TraceTrack&) = delete;
+  TraceTrack& operator=(const TraceTrack&) = delete;
+
+ private:
+  friend class TraceTrackScope;
+
+  const char* const name_;
+  trace_internal::Buffer* buffer_ = nullptr;
+  // Whether every buffer was taken when the track looked for one.
+  bool full_ = false;
+};
+
+// Records the events of the calling thread into `track` over its lifetime,
+// on the stack of a callback. Real-time safe.
+class TraceTrackScope {
+ public:
+  explicit TraceTrackScope(TraceTrack& track);
+  ~TraceTrackScope();
+
+  TraceTrackScope(const TraceTrackScope&) = delete;
+  TraceTrackScope& operator=(const TraceTrackScope&) = delete;
+
+ private:
+  trace_internal::Buffer* const previous_buffer_;
+  const bool previous_no_buffer_;
+};
+
+// Writes the recorded events of every thread as Chrome trace JSON if `path`
+// ends in ".json", or else as a Perfetto protobuf trace. Both open in
+// https://ui.perfetto.dev. Threads may keep recording meanwhile.
+absl::Status WriteTrace(const std::string& path);
+
+}  // namespace kodo
@@ -0,0 +1,230 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+#include "gtest/gtest.h"
+#include "perf_counters.h"
+#include "perfetto_trace.pb.h"
+
+namespace kodo {
+namespace {
+
+// The first StartTracing() of the process sets these for every test.
+constexpr TraceOptions kOptions = {.events_per_thread = 16, .max_threads = 8};
+
+struct Packet {
+  perfetto::TrackEvent::Type type;
+  std::string name;
+  int64_t ns;  // Since the first packet of the track.
+};
+
+// The events on the thread track named `thread_name` of a fresh trace,
+// from the first named `first` on if set. Threads reuse the buffers of
+// earlier tests, so older events may precede those of a test.
+std::vector<Packet> ThreadPackets(const std::string& thread_name,
+                                  const std::string& first = "") {
+  const std::string path = testing::TempDir() + "/trace.pftrace";
+  EXPECT_TRUE(WriteTrace(path).ok());
+  std::ifstream input(path, std::ios::binary);
+  perfetto::Trace trace;
+  EXPECT_TRUE(trace.ParseFromIstream(&input));
+  uint64_t uuid = 0;
+  for (const perfetto::TracePacket& packet : trace.packet()) {
+    if (packet.track_descriptor().thread().thread_name() == thread_name) {
+      uuid = packet.track_descriptor().uuid();
+    }
+  }
+  std::vector<Packet> packets;
+  if (uuid == 0) return packets;
+  for (const perfetto::TracePacket& packet : trace.packet()) {
+    if (!packet.has_track_event() ||
+        packet.track_event().track_uuid() != uuid) {
+      continue;
+    }
+    if (packets.empty() && !first.empty() &&
+        packet.track_event().name() != first) {
+      continue;
+    }
+    packets.push_back({packet.track_event().type(),
+                       packet.track_event().name(),
+                       static_cast<int64_t>(packet.timestamp())});
+  }
+  for (int i = packets.size() - 1; i >= 0; --i) {
+    packets[i].ns -= packets[0].ns;
+  }
+  return packets;
+}
+
+double NsPerCycle() { return 1e9 / CyclesPerSecond(); }
+
+// Names like "prefix 12", which must live as long as the process.
+const char* Name(const std::string& prefix, int index) {
+  return InternTraceName(absl::StrCat(prefix, " ", index));
+}
+
+int NameIndex(const std::string& name, const std::string& prefix) {
+  absl::string_view rest = name;
+  int index = -1;
+  if (!absl::ConsumePrefix(&rest, prefix + " ") ||
+      !absl::SimpleAtoi(rest, &index)) {
+    ADD_FAILURE() << "Unexpected event " << name;
+  }
+  return index;
+}
+
+class TraceTest : public ::testing::Test {
+ protected:
+  void SetUp() override { StartTracing(kOptions); }
+};
+
+TEST_F(TraceTest, WrappedRingKeepsTheLatestEvents) {
+  std::thread([] {
+    TraceThread trace_thread("Wrap");
+    const uint64_t base = CycleCount();
+    for (int i = 0; i < 40; ++i) {
+      AddTraceEvent(Name("wrap", i), base + i * 1000, base + i * 1000 + 500);
+    }
+  }).join();
+  const std::vector<Packet> packets = ThreadPackets("Wrap");
+  ASSERT_EQ(packets.size(), 2 * kOptions.events_per_thread);
+  for (int i = 0; i < kOptions.events_per_thread; ++i) {
+    const Packet& begin = packets[2 * i];
+    const Packet& end = packets[2 * i + 1];
+    EXPECT_EQ(begin.type, perfetto::TrackEvent::TYPE_SLICE_BEGIN);
+    EXPECT_EQ(begin.name, absl::StrCat("wrap ", 40 - 16 + i));
+    EXPECT_EQ(end.type, perfetto::TrackEvent::TYPE_SLICE_END);
+    EXPECT_NEAR(begin.ns, i * 1000 * NsPerCycle(), 1.5);
+    EXPECT_NEAR(end.ns - begin.ns, 500 * NsPerCycle(), 1.5);
+  }
+}
+
+// Slices are recorded as they end, innermost first, as by TraceScope.
+TEST_F(TraceTest, PerfettoSlicesNest) {
+  std::thread([] {
+    TraceThread trace_thread("Nesting");
+    const uint64_t base = CycleCount();
+    auto slice = [base](const char* name, int begin, int end) {
+      AddTraceEvent(name, base + begin * 1000, base + end * 1000);
+    };
+    slice("b", 2, 3);
+    slice("a", 1, 5);
+    slice("d", 8, 12);  // Overlaps the end of its parent c.
+    slice("c", 6, 9);
+    slice("outer", 0, 10);
+    // Instants record the current cycle count, after all of the above.
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    AddTraceInstant("instant");
+  }).join();
+  constexpr auto kBegin = perfetto::TrackEvent::TYPE_SLICE_BEGIN;
+  constexpr auto kEnd = perfetto::TrackEvent::TYPE_SLICE_END;
+  constexpr auto kInstant = perfetto::TrackEvent::TYPE_INSTANT;
+  const struct {
+    perfetto::TrackEvent::Type type;
+    std::string name;
+    int at;  // Thousands of cycles.
+  } kExpected[] = {
+      {kBegin, "outer", 0}, {kBegin, "a", 1}, {kBegin, "b", 2},
+      {kEnd, "", 3},        {kEnd, "", 5},    {kBegin, "c", 6},
+      {kBegin, "d", 8},     {kEnd, "", 9},    {kEnd, "", 9},
+      {kEnd, "", 10},
+  };
+  const std::vector<Packet> packets = ThreadPackets("Nesting", "outer");
+  ASSERT_EQ(packets.size(), std::size(kExpected) + 1);
+  for (int i = 0; i < std::size(kExpected); ++i) {
+    EXPECT_EQ(packets[i].type, kExpected[i].type) << i;
+    EXPECT_EQ(packets[i].name, kExpected[i].name) << i;
+    EXPECT_NEAR(packets[i].ns, kExpected[i].at * 1000 * NsPerCycle(), 1.5)
+        << i;
+  }
+  EXPECT_EQ(packets.back().type, kInstant);
+  EXPECT_EQ(packets.back().name, "instant");
+}
+
+TEST_F(TraceTest, TrackOutlivesTheThreadsRecordingIntoIt) {
+  TraceTrack track("Track");
+  for (int i = 0; i < 3; ++i) {
+    std::thread([&track, i] {
+      TraceThread trace_thread("Track thread");
+      {
+        TraceTrackScope scope(track);
+        AddTraceInstant(Name("track", i));
+      }
+      // The thread records into its own buffer again.
+      AddTraceInstant(Name("thread", i));
+    }).join();
+  }
+  const std::vector<Packet> packets = ThreadPackets("Track", "track 0");
+  ASSERT_EQ(packets.size(), 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(packets[i].name, absl::StrCat("track ", i));
+  }
+  const std::vector<Packet> thread_packets =
+      ThreadPackets("Track thread", "thread 0");
+  ASSERT_EQ(thread_packets.size(), 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(thread_packets[i].name, absl::StrCat("thread ", i));
+  }
+}
+
+// Snapshots taken while the owner overwrites the ring must drop the events
+// it overwrote during the copy: any event that survives is whole. Last, as
+// its events lie far ahead and would follow those of a test reusing its
+// buffer.
+TEST_F(TraceTest, SnapshotDropsEventsOverwrittenWhileCopying) {
+  constexpr int kNames = 64;
+  std::atomic<bool> started = false;
+  std::atomic<bool> done = false;
+  const char* names[kNames];
+  for (int i = 0; i < kNames; ++i) names[i] = Name("overwrite", i);
+  std::thread writer([&names, &started, &done] {
+    TraceThread trace_thread("Overwrite");
+    const uint64_t base = CycleCount();
+    // As fast as it can, to lap the ring while snapshots copy it.
+    for (uint64_t k = 0; !done.load(std::memory_order_relaxed); ++k) {
+      // The name and the duration of event k both tell k % kNames.
+      const uint64_t begin = base + k * 100'000;
+      AddTraceEvent(names[k % kNames], begin,
+                    begin + (k % kNames + 1) * 1000);
+      // Once the ring holds only these events.
+      if (k == kOptions.events_per_thread) started = true;
+    }
+  });
+  while (!started) std::this_thread::yield();
+  const double ns_per_cycle = NsPerCycle();
+  int survivors = 0;
+  for (int round = 0; round < 200; ++round) {
+    const std::vector<Packet> packets = ThreadPackets("Overwrite");
+    ASSERT_EQ(packets.size() % 2, 0);
+    ASSERT_LE(packets.size(), 2 * kOptions.events_per_thread);
+    survivors += packets.size() / 2;
+    for (int i = 0; i < packets.size(); i += 2) {
+      const int index = NameIndex(packets[i].name, "overwrite");
+      ASSERT_NEAR(packets[i + 1].ns - packets[i].ns,
+                  (index + 1) * 1000 * ns_per_cycle, 1.5)
+          << "Torn event " << packets[i].name;
+      if (i == 0) continue;
+      // Consecutive events, without a gap of a dropped one.
+      EXPECT_EQ(index, (NameIndex(packets[i - 2].name, "overwrite") + 1) %
+                           kNames);
+      EXPECT_NEAR(packets[i].ns - packets[i - 2].ns, 100'000 * ns_per_cycle,
+                  1.5);
+    }
+  }
+  done = true;
+  writer.join();
+  EXPECT_GT(survivors, 0);
+}
+
+}  // namespace
+}  // namespace kodo
@@ -0,0 +1,213 @@
+#include "track_freeze.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "audio_file.h"
+#include "automation.h"
+#include "clip_source.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "graph_scheduler.h"
+#include "kodo.pb.h"
+#include "note_store.h"
+#include "offline_render.h"
+#include "plugin_loader.h"
+#include "render_graph.h"
+
+namespace kodo {
+namespace {
+
+namespace fs = std::filesystem;
+
+// FNV-1a, which unlike std::hash is the same in every run and build.
+uint64_t Fnv1a(std::string_view data, uint64_t hash) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211u;
+  }
+  return hash;
+}
+
+// Size and mtime of a file or bundle, as the plugin scanner and peak files
+// tell changed inputs apart.
+void AppendStamp(const std::string& path, std::string* material) {
+  std::error_code ec;
+  const uintmax_t size = fs::file_size(path, ec);
+  const int64_t mtime =
+      fs::last_write_time(path, ec).time_since_epoch().count();
+  absl::StrAppend(material, path, ":", ec ? 0 : size, ":", mtime, ";");
+}
+
+bool HoldsPlugin(const Track& track, int64_t id) {
+  for (const PluginInstance& instance : track.plugins()) {
+    if (instance.id() == id) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+std::string FreezeKey(const Project& project, const Track& track,
+                      const FreezeOptions& options) {
+  Track sound = track;
+  sound.clear_name();
+  sound.clear_output_bus();
+  sound.clear_freeze();
+  std::string material;
+  {
+    google::protobuf::io::StringOutputStream stream(&material);
+    google::protobuf::io::CodedOutputStream coded(&stream);
+    coded.SetSerializationDeterministic(true);
+    sound.SerializeToCodedStream(&coded);
+  }
+  // The tempo, channel count and tail all change the rendered file. %a keeps
+  // every bit of the doubles.
+  absl::StrAppendFormat(&material, "@%a;%a;%d;%a;", project.sample_rate(),
+                        project.tempo(), options.num_channels,
+                        options.tail_seconds);
+  for (const PluginState& state : project.plugin_states()) {
+    if (HoldsPlugin(track, state.plugin_id())) state.AppendToString(&material);
+  }
+  for (const PluginInstance& instance : track.plugins()) {
+    AppendStamp(instance.path(), &material);
+  }
+  for (const AudioClip& clip : track.audio_clips()) {
+    AppendStamp(clip.path(), &material);
+  }
+  // Two bases make 128 bits, beyond accidental collisions of a cache.
+  return absl::StrFormat("%016x%016x",
+                         Fnv1a(material, 14695981039346656037u),
+                         Fnv1a(material, 7809847782465536322u));
+}
+
+absl::StatusOr<Freeze> FreezeTrack(const Project& project, int track_index,
+                                   const FreezeOptions& options) {
+  if (track_index < 0 || track_index >= project.tracks_size()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("No track ", track_index, " to freeze."));
+  }
+  const Track& track = project.tracks(track_index);
+  Freeze freeze;
+  freeze.set_key(FreezeKey(project, track, options));
+  freeze.set_path(
+      (fs::path(options.cache_dir) / (freeze.key() + ".wav")).string());
+  std::error_code ec;
+  if (fs::exists(freeze.path(), ec)) {
+    LOG(INFO) << track.name() << " is unchanged since " << freeze.path();
+    return freeze;
+  }
+  fs::create_directories(options.cache_dir, ec);
+  if (ec) {
+    return absl::InternalError(absl::StrCat(
+        "Cannot create ", options.cache_dir, ": ", ec.message()));
+  }
+
+  // The track alone into an empty master, as RenderOffline() bounces a
+  // project.
+  Project solo;
+  solo.set_sample_rate(project.sample_rate());
+  solo.set_tempo(project.tempo());
+  Track* solo_track = solo.add_tracks();
+  *solo_track = track;
+  solo_track->clear_output_bus();
+  solo_track->clear_freeze();
+  for (const PluginState& state : project.plugin_states()) {
+    if (HoldsPlugin(track, state.plugin_id())) {
+      *solo.add_plugin_states() = state;
+    }
+  }
+
+  PluginLoaderOptions loader_options = options.loader;
+  loader_options.setup.sample_rate = project.sample_rate();
+  loader_options.setup.max_block_size = options.block_size;
+  loader_options.setup.offline = true;
+  std::unique_ptr<PluginLoader> loader =
+      PluginLoader::Create(solo, loader_options);
+  loader->Finish();
+  for (const PluginLoader::Instance& instance : loader->instances()) {
+    if (instance.state == PluginLoader::State::kFailed) {
+      return absl::Status(instance.status.code(),
+                          absl::StrCat("Cannot freeze ", track.name(), ": ",
+                                       instance.status.message()));
+    }
+  }
+
+  ClipPrefetcherOptions prefetch_options;
+  // Clip players decode on the render thread.
+  prefetch_options.background = false;
+  prefetch_options.sample_rate = project.sample_rate();
+  std::unique_ptr<ClipPrefetcher> prefetcher =
+      ClipPrefetcher::Create(prefetch_options);
+  absl::StatusOr<std::unique_ptr<ClipPlayer>> clips =
+      CreateTrackPlayer(*solo_track, *prefetcher, options.block_size);
+  if (!clips.ok()) return clips.status();
+  std::unique_ptr<NotePlayer> notes;
+  if (!solo_track->note_clips().empty()) {
+    absl::StatusOr<std::shared_ptr<const NoteStore>> store =
+        NoteStore::Create(*solo_track);
+    if (!store.ok()) return store.status();
+    notes = std::make_unique<NotePlayer>(*std::move(store));
+  }
+  std::unique_ptr<AutomationPlayer> automation;
+  if (!solo_track->automation().empty()) {
+    absl::StatusOr<std::shared_ptr<const AutomationTable>> table =
+        AutomationTable::Compile(*solo_track);
+    if (!table.ok()) return table.status();
+    automation = std::make_unique<AutomationPlayer>(*std::move(table));
+  }
+
+  RenderGraphOptions graph_options;
+  graph_options.num_channels = options.num_channels;
+  graph_options.max_block_size = options.block_size;
+  absl::StatusOr<std::unique_ptr<RenderGraph>> graph = BuildRenderGraph(
+      solo, graph_options,
+      [&](const PluginInstance& instance) {
+        return loader->Find(instance.id());
+      },
+      [&](const Track& t) -> AudioRenderer* {
+        return &t == solo_track ? clips->get() : nullptr;
+      },
+      [&](const Track& t) { return &t == solo_track ? notes.get() : nullptr; },
+      [&](const Track& t) {
+        return &t == solo_track ? automation.get() : nullptr;
+      });
+  if (!graph.ok()) return graph.status();
+  std::unique_ptr<GraphScheduler> scheduler = GraphScheduler::Create(0);
+  GraphRenderer renderer(*std::move(graph), scheduler.get());
+
+  OfflineRenderOptions render_options;
+  render_options.sample_rate = project.sample_rate();
+  render_options.block_size = options.block_size;
+  render_options.num_channels = options.num_channels;
+  render_options.latency = renderer.latency();
+  render_options.num_frames =
+      ProjectLength(solo) + options.tail_seconds * project.sample_rate();
+  // Only a complete rendering ever gets the name of the key.
+  const std::string tmp = freeze.path() + ".tmp";
+  absl::StatusOr<std::unique_ptr<AudioFileWriter>> writer = CreateWavFile(
+      tmp, project.sample_rate(), options.num_channels);
+  if (!writer.ok()) return writer.status();
+  if (absl::Status status = RenderOffline(renderer, render_options, **writer);
+      !status.ok()) {
+    return status;
+  }
+  fs::rename(tmp, freeze.path(), ec);
+  if (ec) {
+    return absl::InternalError(
+        absl::StrCat("Cannot rename ", tmp, ": ", ec.message()));
+  }
+  LOG(INFO) << "Froze " << track.name() << " into " << freeze.path();
+  return freeze;
+}
+
+}  // namespace kodo
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "kodo.pb.h"
+#include "plugin_loader.h"
+
+namespace kodo {
+
+struct FreezeOptions {
+  // Directory of rendered tracks, created on demand.
+  std::string cache_dir = "freeze_cache";
+  int block_size = 4096;
+  int num_channels = 2;
+  // Rendered past the last clip for release and reverb tails.
+  double tail_seconds = 2;
+  // Opens the plugin modules of the track, as in PluginLoaderOptions.
+  PluginLoaderOptions loader;
+};
+
+// Hex digest of everything a frozen `track` of `project` sounds like: its
+// clips, notes, automation, plugins and their states in Project.plugin_states,
+// the stamps of its audio files and plugin modules, the sample rate and
+// tempo, and the channels and tail of `options`. Not its name, output bus or
+// freeze.
+std::string FreezeKey(const Project& project, const Track& track,
+                      const FreezeOptions& options);
+
+// Bounces the track at `track_index` of `project` with its automation through
+// fresh offline instances of its plugins, restored to their saved states,
+// into a file of options.cache_dir named by FreezeKey(). An unchanged track
+// reuses that file without rendering. Set the result as Track.freeze.
+absl::StatusOr<Freeze> FreezeTrack(const Project& project, int track_index,
+                                   const FreezeOptions& options);
+
+}  // namespace kodo
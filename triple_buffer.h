@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace kodo {
+
+// Hands the latest of a stream of values, e.g. meter readings, from one
+// writer thread to one reader thread. Each side owns a slot and swaps it
+// with the one in the middle, so neither ever waits, locks, allocates or
+// copies: the writer overwrites values the reader skipped, and the reader
+// keeps the last value until a newer one is published.
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() = default;
+  // Starts every slot as `value`, e.g. with preallocated vectors.
+  explicit TripleBuffer(const T& value) : slots_{value, value, value} {}
+
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  // Writer thread. The slot to fill next. It holds an older value.
+  T& back() { return slots_[back_]; }
+  // Writer thread. Makes back() the value the next Update() returns.
+  void Publish() {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) &
+            kIndex;
+  }
+
+  // Reader thread. Switches front() to the latest published value. Returns
+  // false if there is none since the last Update().
+  bool Update() {
+    if (!(middle_.load(std::memory_order_relaxed) & kFresh)) return false;
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+    return true;
+  }
+  // Reader thread. The value of the last Update(), valid until the next.
+  const T& front() const { return slots_[front_]; }
+
+ private:
+  static constexpr uint8_t kIndex = 3;
+  static constexpr uint8_t kFresh = 4;
+
+  std::array<T, 3> slots_;
+  uint8_t back_ = 0;
+  // Index of the spare slot, with kFresh if the writer published it last.
+  std::atomic<uint8_t> middle_ = 1;
+  uint8_t front_ = 2;
+};
+
+}  // namespace kodo
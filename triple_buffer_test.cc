@@ -0,0 +1,77 @@
+#include "triple_buffer.h"
+
+#include <array>
+#include <cstdint>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace kodo {
+namespace {
+
+TEST(TripleBufferTest, StartsWithoutUpdate) {
+  TripleBuffer<int> buffer(7);
+  EXPECT_FALSE(buffer.Update());
+  EXPECT_EQ(buffer.front(), 7);
+}
+
+TEST(TripleBufferTest, UpdateTakesPublishedValueOnce) {
+  TripleBuffer<int> buffer;
+  buffer.back() = 1;
+  buffer.Publish();
+  EXPECT_TRUE(buffer.Update());
+  EXPECT_EQ(buffer.front(), 1);
+  // The reader keeps the value until a newer one.
+  EXPECT_FALSE(buffer.Update());
+  EXPECT_EQ(buffer.front(), 1);
+}
+
+TEST(TripleBufferTest, UpdateSkipsToLatest) {
+  TripleBuffer<int> buffer;
+  for (int i = 1; i <= 5; ++i) {
+    buffer.back() = i;
+    buffer.Publish();
+  }
+  EXPECT_TRUE(buffer.Update());
+  EXPECT_EQ(buffer.front(), 5);
+  EXPECT_FALSE(buffer.Update());
+}
+
+TEST(TripleBufferTest, WriterNeverTouchesFront) {
+  TripleBuffer<int> buffer;
+  buffer.back() = 1;
+  buffer.Publish();
+  ASSERT_TRUE(buffer.Update());
+  // However often the writer publishes, front() stays intact.
+  for (int i = 2; i < 10; ++i) {
+    buffer.back() = i;
+    buffer.Publish();
+    EXPECT_EQ(buffer.front(), 1);
+  }
+}
+
+// Every value is uniform, so a slot the reader shared with the writer would
+// show as a mix of two values.
+TEST(TripleBufferTest, ConcurrentReaderSeesWholeIncreasingValues) {
+  using Value = std::array<int64_t, 16>;
+  TripleBuffer<Value> buffer(Value{});
+  constexpr int64_t kCount = 200000;
+  std::thread writer([&buffer] {
+    for (int64_t i = 1; i <= kCount; ++i) {
+      buffer.back().fill(i);
+      buffer.Publish();
+    }
+  });
+  int64_t last = 0;
+  while (last < kCount) {
+    if (!buffer.Update()) continue;
+    const Value& value = buffer.front();
+    for (int64_t v : value) ASSERT_EQ(v, value[0]);
+    ASSERT_GT(value[0], last);
+    last = value[0];
+  }
+  writer.join();
+}
+
+}  // namespace
+}  // namespace kodo
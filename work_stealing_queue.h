@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace kodo {
+
+// Fixed-capacity Chase-Lev deque of integer task ids. The owner thread calls
+// Push() and Pop() at the bottom; any other thread may Steal() from the top.
+// All operations are lock-free and allocation-free. Based on "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (Le et al., PPoPP 2013).
+class WorkStealingQueue {
+ public:
+  // `capacity` bounds the number of tasks in flight and is rounded up to a
+  // power of two.
+  explicit WorkStealingQueue(size_t capacity) {
+    size_t n = 1;
+    while (n < capacity) n <<= 1;
+    mask_ = n - 1;
+    tasks_ = std::make_unique<std::atomic<int32_t>[]>(n);
+  }
+
+  // Owner only. The caller guarantees at most Capacity() tasks in flight.
+  void Push(int32_t task) {
+    const int64_t b = bottom_.load(std::memory_order_relaxed);
+    tasks_[b & mask_].store(task, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+
+  // Owner only. Takes the most recently pushed task.
+  bool Pop(int32_t* task) {
+    const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    *task = tasks_[b & mask_].load(std::memory_order_relaxed);
+    if (t == b) {
+      // Last task: race against thieves.
+      const bool won = top_.compare_exchange_strong(
+          t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Any thread. Takes the oldest task.
+  bool Steal(int32_t* task) {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return false;
+    *task = tasks_[t & mask_].load(std::memory_order_relaxed);
+    return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed);
+  }
+
+  size_t Capacity() const { return mask_ + 1; }
+
+ private:
+  static constexpr size_t kCacheLine = 64;
+
+  alignas(kCacheLine) std::atomic<int64_t> top_{0};
+  alignas(kCacheLine) std::atomic<int64_t> bottom_{0};
+  alignas(kCacheLine) size_t mask_ = 0;
+  std::unique_ptr<std::atomic<int32_t>[]> tasks_;
+};
+
+}  // namespace kodo